@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "Codec.h"
+
+#define MAX_CODE_LENGTH 11                  // Longest code, sets the decode table size
+#define TABLE_SIZE (1 << MAX_CODE_LENGTH)   // Entries of the decode table
+
+/**
+ * Computes Huffman code lengths for a byte histogram. If the tree is deeper
+ * than MAX_CODE_LENGTH the counts are flattened and the tree rebuilt, which
+ * only costs a little ratio on very skewed inputs.
+ *
+ * @param freq Occurrences of each byte value
+ * @param lengths Code length of each byte value, 0 if unused
+ */
+static void build_lengths(const uint64_t *freq, uint8_t *lengths) {
+    uint64_t weight[512];
+    int symbol[256], parent[512], depth[512];
+    uint64_t scaled[256];
+    int n = 0;
+
+    memset(lengths, 0, 256);
+    for (int s = 0; s < 256; s++) {
+        scaled[s] = freq[s];
+        if (freq[s] > 0) {
+            symbol[n++] = s;
+        }
+    }
+    if (n == 1) {
+        lengths[symbol[0]] = 1;
+        return;
+    }
+
+    while (n > 1) {
+        // Leaves sorted by weight, then the two-queue construction
+        for (int i = 1; i < n; i++) {
+            int s = symbol[i], j = i;
+            while (j > 0 && scaled[symbol[j - 1]] > scaled[s]) {
+                symbol[j] = symbol[j - 1];
+                j--;
+            }
+            symbol[j] = s;
+        }
+        for (int i = 0; i < n; i++) {
+            weight[i] = scaled[symbol[i]];
+        }
+        int leaf = 0, node = n, next = n;
+        for (; next < 2 * n - 1; next++) {
+            int pick[2];
+            for (int k = 0; k < 2; k++) {
+                if (leaf < n && (node >= next || weight[leaf] <= weight[node])) {
+                    pick[k] = leaf++;
+                } else {
+                    pick[k] = node++;
+                }
+            }
+            weight[next] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = parent[pick[1]] = next;
+        }
+
+        // Children always precede their parent, so depths fill in from the root down
+        int max_depth = 0;
+        depth[2 * n - 2] = 0;
+        for (int i = 2 * n - 3; i >= 0; i--) {
+            depth[i] = depth[parent[i]] + 1;
+        }
+        for (int i = 0; i < n; i++) {
+            max_depth = depth[i] > max_depth ? depth[i] : max_depth;
+        }
+        if (max_depth <= MAX_CODE_LENGTH) {
+            for (int i = 0; i < n; i++) {
+                lengths[symbol[i]] = depth[i];
+            }
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            scaled[symbol[i]] = (scaled[symbol[i]] >> 1) | 1;
+        }
+    }
+}
+
+/**
+ * Assigns canonical codes to code lengths, bit-reversed because the bit
+ * stream is written least significant bit first.
+ *
+ * @param lengths Code length of each byte value
+ * @param codes Resulting code of each byte value
+ * @return 0 on success, -1 if the lengths do not form a prefix code
+ */
+static int build_codes(const uint8_t *lengths, uint16_t *codes) {
+    int count[MAX_CODE_LENGTH + 1] = {0};
+    uint32_t kraft = 0;
+    for (int s = 0; s < 256; s++) {
+        if (lengths[s] > 0) {
+            count[lengths[s]]++;
+            kraft += TABLE_SIZE >> lengths[s];
+        }
+    }
+    if (kraft > TABLE_SIZE) {
+        return -1;
+    }
+
+    uint32_t next[MAX_CODE_LENGTH + 2];
+    uint32_t code = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++) {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+    }
+    for (int s = 0; s < 256; s++) {
+        int len = lengths[s];
+        if (len == 0) {
+            continue;
+        }
+        uint32_t value = next[len]++, reversed = 0;
+        for (int b = 0; b < len; b++) {
+            reversed |= ((value >> b) & 1) << (len - 1 - b);
+        }
+        codes[s] = reversed;
+    }
+    return 0;
+}
+
+/**
+ * Compresses a chunk.
+ *
+ * @param in Chunk to compress
+ * @param length Length of the chunk
+ * @param out Buffer for the compressed chunk
+ * @param capacity Size of out
+ * @return Compressed size, 0 if the chunk does not get smaller
+ */
+size_t codec_compress(const char *in, size_t length, char *out, size_t capacity) {
+    if (length < CODEC_MIN_INPUT || length > UINT32_MAX) {
+        return 0;
+    }
+    const unsigned char *src = (const unsigned char *)in;
+
+    // Four interleaved histograms avoid stalls on runs of the same byte
+    uint32_t counts[4][256] = {{0}};
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        counts[0][src[i]]++;
+        counts[1][src[i + 1]]++;
+        counts[2][src[i + 2]]++;
+        counts[3][src[i + 3]]++;
+    }
+    for (; i < length; i++) {
+        counts[0][src[i]]++;
+    }
+    uint64_t freq[256];
+    for (int s = 0; s < 256; s++) {
+        freq[s] = (uint64_t)counts[0][s] + counts[1][s] + counts[2][s] + counts[3][s];
+    }
+
+    uint8_t lengths[256];
+    uint16_t codes[256];
+    build_lengths(freq, lengths);
+    build_codes(lengths, codes);
+
+    uint64_t bits = 0;
+    for (int s = 0; s < 256; s++) {
+        bits += freq[s] * lengths[s];
+    }
+    size_t size = CODEC_HEADER_SIZE + (bits + 7) / 8;
+    if (size >= length || size > capacity) {
+        return 0;
+    }
+
+    unsigned char *dst = (unsigned char *)out;
+    dst[0] = length >> 24;
+    dst[1] = length >> 16;
+    dst[2] = length >> 8;
+    dst[3] = length;
+    for (int s = 0; s < 256; s += 2) {
+        dst[4 + s / 2] = lengths[s] | (lengths[s + 1] << 4);
+    }
+
+    unsigned char *p = dst + CODEC_HEADER_SIZE;
+    uint64_t acc = 0;
+    unsigned count = 0;
+    for (i = 0; i < length; i++) {
+        acc |= (uint64_t)codes[src[i]] << count;
+        count += lengths[src[i]];
+        if (count >= 32) {
+            p[0] = acc;
+            p[1] = acc >> 8;
+            p[2] = acc >> 16;
+            p[3] = acc >> 24;
+            p += 4;
+            acc >>= 32;
+            count -= 32;
+        }
+    }
+    for (; count > 0; count = count > 8 ? count - 8 : 0) {
+        *p++ = acc;
+        acc >>= 8;
+    }
+    return size;
+}
+
+/**
+ * Decompresses a chunk produced by codec_compress().
+ *
+ * @param in Compressed chunk
+ * @param length Length of the compressed chunk
+ * @param out Buffer for the decompressed chunk
+ * @param capacity Size of out
+ * @return Decompressed size, -1 if the input is corrupt or too large for out
+ */
+long codec_decompress(const char *in, size_t length, char *out, size_t capacity) {
+    const unsigned char *src = (const unsigned char *)in;
+    if (length < CODEC_HEADER_SIZE) {
+        return -1;
+    }
+    size_t raw = ((size_t)src[0] << 24) | ((size_t)src[1] << 16) | ((size_t)src[2] << 8) | src[3];
+    if (raw > capacity) {
+        return -1;
+    }
+
+    uint8_t lengths[256];
+    uint16_t codes[256];
+    for (int s = 0; s < 256; s += 2) {
+        lengths[s] = src[4 + s / 2] & 0x0F;
+        lengths[s + 1] = src[4 + s / 2] >> 4;
+        if (lengths[s] > MAX_CODE_LENGTH || lengths[s + 1] > MAX_CODE_LENGTH) {
+            return -1;
+        }
+    }
+    if (build_codes(lengths, codes) < 0) {
+        return -1;
+    }
+    // Each entry holds symbol << 4 | code length; 0 marks a code that is not in use
+    uint16_t table[TABLE_SIZE] = {0};
+    for (int s = 0; s < 256; s++) {
+        if (lengths[s] > 0) {
+            for (uint32_t j = codes[s]; j < TABLE_SIZE; j += 1u << lengths[s]) {
+                table[j] = (uint16_t)(s << 4 | lengths[s]);
+            }
+        }
+    }
+    // Pair table: the symbols of one or two whole codes found in the next
+    // MAX_CODE_LENGTH bits, as first | second << 8 | bits << 16 | symbols << 20
+    uint32_t pairs[TABLE_SIZE];
+    for (uint32_t j = 0; j < TABLE_SIZE; j++) {
+        unsigned len = table[j] & 0x0F;
+        pairs[j] = (table[j] >> 4) | len << 16 | (len > 0) << 20;
+        if (len > 0) {
+            uint16_t second = table[j >> len];
+            unsigned len2 = second & 0x0F;
+            if (len2 > 0 && len + len2 <= MAX_CODE_LENGTH) {
+                pairs[j] = (table[j] >> 4) | (uint32_t)(second >> 4) << 8 | (len + len2) << 16 | 2u << 20;
+            }
+        }
+    }
+
+    const unsigned char *p = src + CODEC_HEADER_SIZE, *end = src + length;
+    unsigned char *dst = (unsigned char *)out;
+    uint64_t bits = 0;
+    unsigned count = 0;
+    size_t padding = 0; // Zero bytes fed in past the end of the input
+    size_t i = 0;
+    while (i < raw) {
+        // Refill to at least 56 bits: five lookups of up to 11 bits
+        if (end - p >= 8) {
+            uint64_t word = 0;
+            for (int b = 7; b >= 0; b--) {
+                word = (word << 8) | p[b];
+            }
+            bits |= word << count;
+            p += (63 - count) >> 3;
+            count |= 56;
+        } else {
+            while (count <= 56) {
+                if (p < end) {
+                    bits |= (uint64_t)*p++ << count;
+                } else {
+                    padding++;
+                }
+                count += 8;
+            }
+        }
+        if (raw - i >= 10) {
+            // Room for five pairs: both bytes are stored, the second one is overwritten if unused
+            for (int k = 0; k < 5; k++) {
+                uint32_t entry = pairs[bits & (TABLE_SIZE - 1)];
+                if (entry == 0) {
+                    return -1;
+                }
+                dst[i] = entry;
+                dst[i + 1] = entry >> 8;
+                i += entry >> 20;
+                bits >>= (entry >> 16) & 0x0F;
+                count -= (entry >> 16) & 0x0F;
+            }
+            continue;
+        }
+        size_t n = raw - i < 5 ? raw - i : 5;
+        for (size_t k = 0; k < n; k++) {
+            uint16_t entry = table[bits & (TABLE_SIZE - 1)];
+            unsigned len = entry & 0x0F;
+            if (len == 0) {
+                return -1;
+            }
+            dst[i++] = entry >> 4;
+            bits >>= len;
+            count -= len;
+        }
+    }
+    if (padding * 8 > count) {
+        return -1; // The codes ran past the end of the input
+    }
+    return (long)raw;
+}
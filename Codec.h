@@ -0,0 +1,24 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CODEC_HEADER_SIZE 132 // raw_length(4) + 256 code lengths packed in nibbles
+#define CODEC_MIN_INPUT 4096  // Smaller chunks are not worth compressing
+
+/*
+ * Chunk codec of the compressed FILE_DATA frames: a static canonical Huffman
+ * code per chunk, i.e. the entropy stage of an LZ codec without the match
+ * finder, which finds nothing in generated text. Uppercase letters take about
+ * 4.7 bits each. Codes are at most 11 bits, so decoding is one table lookup
+ * per byte.
+ *
+ * codec_compress() returns the compressed size, or 0 if the chunk does not
+ * shrink (the caller then sends it raw). codec_decompress() returns the
+ * decompressed size, or -1 if the input is corrupt or does not fit.
+ */
+size_t codec_compress(const char *in, size_t length, char *out, size_t capacity);
+long codec_decompress(const char *in, size_t length, char *out, size_t capacity);
+
+#endif // CODEC_H
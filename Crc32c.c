@@ -0,0 +1,205 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "Crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78u // Reversed Castagnoli polynomial
+#define LANE_SIZE 4096           // Bytes per lane of the interleaved hardware loop
+
+static uint32_t TABLE[8][256];   // Slicing-by-8 tables of the software path
+static uint32_t SHIFT[4][256];   // Appends LANE_SIZE zero bytes to a CRC register, a byte at a time
+static int HARDWARE;             // Set if the crc32 instruction is available
+static pthread_once_t INIT_ONCE = PTHREAD_ONCE_INIT;
+
+/**
+ * Multiplies a GF(2) 32x32 matrix by a vector.
+ */
+static uint32_t gf2_times(const uint32_t *matrix, uint32_t vector) {
+    uint32_t sum = 0;
+    for (int i = 0; vector != 0; i++, vector >>= 1) {
+        if (vector & 1) {
+            sum ^= matrix[i];
+        }
+    }
+    return sum;
+}
+
+/**
+ * Builds the operator that appends a number of zero bytes to a CRC register,
+ * by repeated squaring of the one-zero-byte operator (zlib's method).
+ *
+ * @param op Resulting 32x32 matrix
+ * @param length Number of zero bytes
+ */
+static void zeros_operator(uint32_t *op, uint64_t length) {
+    uint32_t power[32], square[32];
+
+    power[0] = CRC32C_POLY; // One zero bit
+    for (int i = 1; i < 32; i++) {
+        power[i] = 1u << (i - 1);
+    }
+    for (int bits = 1; bits < 8; bits *= 2) { // Two, four, then eight zero bits
+        for (int i = 0; i < 32; i++) {
+            square[i] = gf2_times(power, power[i]);
+        }
+        memcpy(power, square, sizeof(power));
+    }
+
+    for (int i = 0; i < 32; i++) {
+        op[i] = 1u << i; // Identity
+    }
+    while (length != 0) {
+        if (length & 1) {
+            uint32_t product[32];
+            for (int i = 0; i < 32; i++) {
+                product[i] = gf2_times(power, op[i]);
+            }
+            memcpy(op, product, sizeof(product));
+        }
+        length >>= 1;
+        if (length != 0) {
+            for (int i = 0; i < 32; i++) {
+                square[i] = gf2_times(power, power[i]);
+            }
+            memcpy(power, square, sizeof(power));
+        }
+    }
+}
+
+/**
+ * Builds the tables and picks the implementation, once.
+ */
+static void crc32c_init() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        TABLE[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int t = 1; t < 8; t++) {
+            TABLE[t][n] = (TABLE[t - 1][n] >> 8) ^ TABLE[0][TABLE[t - 1][n] & 0xFF];
+        }
+    }
+    uint32_t op[32];
+    zeros_operator(op, LANE_SIZE);
+    for (int k = 0; k < 4; k++) {
+        for (uint32_t n = 0; n < 256; n++) {
+            SHIFT[k][n] = gf2_times(op, n << (8 * k));
+        }
+    }
+#if defined(__x86_64__)
+    HARDWARE = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/**
+ * Appends LANE_SIZE zero bytes to a CRC register.
+ */
+static inline uint32_t shift_lane(uint32_t crc) {
+    return SHIFT[0][crc & 0xFF] ^ SHIFT[1][(crc >> 8) & 0xFF] ^ SHIFT[2][(crc >> 16) & 0xFF] ^ SHIFT[3][crc >> 24];
+}
+
+/**
+ * Software CRC-32C over a buffer, eight bytes per step.
+ */
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *p, size_t length) {
+    while (length > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = (crc >> 8) ^ TABLE[0][(crc ^ *p++) & 0xFF];
+        length--;
+    }
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        word ^= crc;
+        crc = TABLE[7][word & 0xFF] ^ TABLE[6][(word >> 8) & 0xFF] ^ TABLE[5][(word >> 16) & 0xFF] ^
+              TABLE[4][(word >> 24) & 0xFF] ^ TABLE[3][(word >> 32) & 0xFF] ^ TABLE[2][(word >> 40) & 0xFF] ^
+              TABLE[1][(word >> 48) & 0xFF] ^ TABLE[0][word >> 56];
+        p += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ TABLE[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * CRC-32C with the SSE4.2 crc32 instruction. One crc32 takes three cycles but
+ * a new one can start every cycle, so large buffers are cut into three lanes
+ * computed side by side, which are then joined with shift_lane().
+ */
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hardware(uint32_t crc, const unsigned char *p,
+                                                                   size_t length) {
+    uint64_t crc64 = crc;
+    while (length > 0 && ((uintptr_t)p & 7) != 0) {
+        crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *p++);
+        length--;
+    }
+    while (length >= 3 * LANE_SIZE) {
+        uint64_t a = crc64, b = 0, c = 0;
+        for (size_t i = 0; i < LANE_SIZE; i += 8) {
+            uint64_t wa, wb, wc;
+            memcpy(&wa, p + i, 8);
+            memcpy(&wb, p + LANE_SIZE + i, 8);
+            memcpy(&wc, p + 2 * LANE_SIZE + i, 8);
+            a = __builtin_ia32_crc32di(a, wa);
+            b = __builtin_ia32_crc32di(b, wb);
+            c = __builtin_ia32_crc32di(c, wc);
+        }
+        crc64 = shift_lane(shift_lane((uint32_t)a) ^ (uint32_t)b) ^ (uint32_t)c;
+        p += 3 * LANE_SIZE;
+        length -= 3 * LANE_SIZE;
+    }
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        p += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *p++);
+    }
+    return (uint32_t)crc64;
+}
+#endif
+
+/**
+ * Extends a CRC-32C with more data.
+ *
+ * @param crc CRC of the data so far, 0 for none
+ * @param data Next bytes
+ * @param length Number of bytes
+ * @return CRC of the data so far followed by the new bytes
+ */
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t length) {
+    pthread_once(&INIT_ONCE, crc32c_init);
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (HARDWARE) {
+        return ~crc32c_hardware(crc, (const unsigned char *)data, length);
+    }
+#endif
+    return ~crc32c_software(crc, (const unsigned char *)data, length);
+}
+
+/**
+ * Combines the CRCs of two consecutive pieces of data: appends length_b zero
+ * bytes to crc_a, then adds crc_b.
+ *
+ * @param crc_a CRC of the first piece
+ * @param crc_b CRC of the second piece
+ * @param length_b Length of the second piece
+ * @return CRC of the two pieces together
+ */
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b) {
+    if (length_b == 0) {
+        return crc_a;
+    }
+    uint32_t op[32];
+    zeros_operator(op, length_b);
+    return gf2_times(op, crc_a) ^ crc_b;
+}
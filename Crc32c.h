@@ -0,0 +1,17 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC-32C (Castagnoli), as used by iSCSI, ext4 and SCTP. Uses the SSE4.2
+ * crc32 instruction when the CPU has it and a slicing-by-8 table otherwise.
+ * Start with crc = 0 and feed the data in any number of pieces.
+ */
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t length);
+
+// CRC of A followed by B, from crc(A), crc(B) and the length of B
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b);
+
+#endif // CRC32C_H
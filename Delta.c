@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+
+#include "Delta.h"
+#include "Protocol.h"
+
+/**
+ * Chooses the block size for a file: about the square root of its size, so
+ * the signatures and the literal data around a change grow alike, as a power
+ * of two between DELTA_MIN_BLOCK and DELTA_MAX_BLOCK. Large enough that all
+ * signatures fit into one frame.
+ *
+ * @param file_size Size of the signed file
+ * @return Block size in bytes
+ */
+uint32_t delta_block_size(uint64_t file_size) {
+    uint32_t block = DELTA_MIN_BLOCK;
+    while (block < DELTA_MAX_BLOCK &&
+           ((uint64_t)block * block < file_size ||
+            DELTA_HEADER_SIZE + (file_size / block) * DELTA_SIGNATURE_SIZE > FRAME_MAX_PAYLOAD)) {
+        block <<= 1;
+    }
+    return block;
+}
+
+/**
+ * Computes the weak checksum of a block, rsync's pair of 16-bit sums: the
+ * sum of the bytes and the sum of the bytes weighted by their distance from
+ * the end of the block.
+ *
+ * @param data Block
+ * @param length Length of the block
+ * @return Weak checksum
+ */
+uint32_t delta_weak(const unsigned char *data, size_t length) {
+    uint32_t a = 0, b = 0;
+    for (size_t i = 0; i < length; i++) {
+        a += data[i];
+        b += (uint32_t)(length - i) * data[i];
+    }
+    return (a & 0xFFFF) | (b << 16);
+}
+
+/**
+ * Slides the window of a weak checksum one byte forward.
+ *
+ * @param weak Weak checksum of the window
+ * @param out Byte leaving the window at its start
+ * @param in Byte entering the window at its end
+ * @param length Length of the window
+ * @return Weak checksum of the moved window
+ */
+uint32_t delta_roll(uint32_t weak, unsigned char out, unsigned char in, size_t length) {
+    uint32_t a = ((weak & 0xFFFF) - out + in) & 0xFFFF;
+    uint32_t b = ((weak >> 16) - (uint32_t)length * out + a) & 0xFFFF;
+    return a | (b << 16);
+}
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/**
+ * Computes the strong hash of a block: MurmurHash3 x64 128 (seed 0), stored
+ * little endian.
+ *
+ * @param data Block
+ * @param length Length of the block
+ * @param out The 16 byte hash
+ */
+void delta_strong(const unsigned char *data, size_t length, unsigned char out[16]) {
+    const uint64_t c1 = 0x87C37B91114253D5ULL, c2 = 0x4CF5AD432745937FULL;
+    uint64_t h1 = 0, h2 = 0, k1, k2;
+    size_t blocks = length / 16;
+
+    for (size_t i = 0; i < blocks; i++) {
+        memcpy(&k1, data + i * 16, 8);
+        memcpy(&k2, data + i * 16 + 8, 8);
+        k1 = le64toh(k1) * c1;
+        k1 = rotl64(k1, 31) * c2;
+        h1 ^= k1;
+        h1 = (rotl64(h1, 27) + h2) * 5 + 0x52DCE729;
+        k2 = le64toh(k2) * c2;
+        k2 = rotl64(k2, 33) * c1;
+        h2 ^= k2;
+        h2 = (rotl64(h2, 31) + h1) * 5 + 0x38495AB5;
+    }
+
+    const unsigned char *tail = data + blocks * 16;
+    size_t rest = length & 15;
+    k1 = k2 = 0;
+    for (size_t i = rest; i > 8; i--) {
+        k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
+    }
+    if (rest > 8) {
+        k2 = rotl64(k2 * c2, 33) * c1;
+        h2 ^= k2;
+    }
+    for (size_t i = rest < 8 ? rest : 8; i > 0; i--) {
+        k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+    }
+    if (rest > 0) {
+        k1 = rotl64(k1 * c1, 31) * c2;
+        h1 ^= k1;
+    }
+
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    h1 = htole64(h1);
+    h2 = htole64(h2);
+    memcpy(out, &h1, 8);
+    memcpy(out + 8, &h2, 8);
+}
+
+/**
+ * Signs every whole block of a buffer: weak checksum (big endian) followed
+ * by the strong hash, DELTA_SIGNATURE_SIZE bytes per block.
+ *
+ * @param data Buffer to sign
+ * @param length Length of the buffer, the bytes after the last whole block are not signed
+ * @param block_size Block size
+ * @param out Room for length / block_size signatures
+ */
+void delta_sign(const unsigned char *data, size_t length, uint32_t block_size, unsigned char *out) {
+    for (size_t offset = 0; offset + block_size <= length; offset += block_size) {
+        put_u32(out, delta_weak(data + offset, block_size));
+        delta_strong(data + offset, block_size, out + 4);
+        out += DELTA_SIGNATURE_SIZE;
+    }
+}
+
+/**
+ * Returns the hash bucket of a weak checksum.
+ */
+static uint32_t bucket(const DeltaIndex *index, uint32_t weak) {
+    return (weak * 0x9E3779B1u) >> index->shift;
+}
+
+/**
+ * Builds the lookup table over received signatures.
+ *
+ * @param index Index to build
+ * @param blocks Encoded signatures, must stay valid while the index is used
+ * @param count Number of signatures
+ * @param block_size Block size the signatures were made with
+ * @return 0 on success, -1 if out of memory
+ */
+int delta_index_init(DeltaIndex *index, const unsigned char *blocks, uint32_t count, uint32_t block_size) {
+    int bits = 4;
+    while (bits < 30 && (1u << bits) < 2 * count) {
+        bits++;
+    }
+    index->block_size = block_size;
+    index->count = count;
+    index->blocks = blocks;
+    index->shift = 32 - bits;
+    index->heads = malloc(sizeof(int32_t) << bits);
+    index->next = malloc(sizeof(int32_t) * (count > 0 ? count : 1));
+    if (index->heads == NULL || index->next == NULL) {
+        delta_index_free(index);
+        return -1;
+    }
+    memset(index->heads, 0xFF, sizeof(int32_t) << bits);
+    // Inserted backwards so each chain lists the earliest block first
+    for (int32_t k = (int32_t)count - 1; k >= 0; k--) {
+        uint32_t b = bucket(index, get_u32(blocks + (size_t)k * DELTA_SIGNATURE_SIZE));
+        index->next[k] = index->heads[b];
+        index->heads[b] = k;
+    }
+    return 0;
+}
+
+/**
+ * Looks up the block at a position of the new file. The strong hash is only
+ * computed if some signed block has the same weak checksum.
+ *
+ * @param index Lookup table
+ * @param weak Weak checksum of the block_size bytes at data
+ * @param data Block of the new file
+ * @return Index of a signed block with the same content, -1 if none
+ */
+long delta_index_find(const DeltaIndex *index, uint32_t weak, const unsigned char *data) {
+    unsigned char strong[16];
+    int have_strong = 0;
+    for (int32_t k = index->heads[bucket(index, weak)]; k >= 0; k = index->next[k]) {
+        const unsigned char *signature = index->blocks + (size_t)k * DELTA_SIGNATURE_SIZE;
+        if (get_u32(signature) != weak) {
+            continue;
+        }
+        if (!have_strong) {
+            delta_strong(data, index->block_size, strong);
+            have_strong = 1;
+        }
+        if (memcmp(signature + 4, strong, 16) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Releases the lookup table. The signatures are the caller's.
+ *
+ * @param index Index to release
+ */
+void delta_index_free(DeltaIndex *index) {
+    free(index->heads);
+    free(index->next);
+    index->heads = NULL;
+    index->next = NULL;
+}
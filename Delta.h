@@ -0,0 +1,41 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DELTA_SIGNATURE_SIZE 20   // Encoded signature of a block: weak(4) strong(16)
+#define DELTA_HEADER_SIZE 8       // DELTA_SIGNATURES payload header: block_size(4) block_count(4)
+#define DELTA_MIN_BLOCK 4096      // Smallest block size
+#define DELTA_MAX_BLOCK (1 << 20) // Largest block size, one file data chunk
+
+/*
+ * rsync-style delta encoding. The receiver signs every whole block of its
+ * previous copy of the file with a weak rolling checksum and a 128-bit strong
+ * hash. The sender slides a window over the new file, rolling the weak
+ * checksum one byte at a time. A weak hit is confirmed with the strong hash.
+ * A confirmed hit means the receiver already has those bytes. The strong
+ * hash is not cryptographic; the CRC32C of the END frame catches a collision.
+ */
+
+// Lookup table over the signatures received from the receiver
+typedef struct {
+    uint32_t block_size;          // Bytes per signed block
+    uint32_t count;               // Number of signed blocks
+    const unsigned char *blocks;  // count encoded signatures
+    int32_t *heads;               // First block of each weak hash bucket, -1 if empty
+    int32_t *next;                // Next block in the same bucket, -1 at the end
+    int shift;                    // 32 - log2(buckets), buckets are the top bits of a multiplicative hash
+} DeltaIndex;
+
+uint32_t delta_block_size(uint64_t file_size);
+uint32_t delta_weak(const unsigned char *data, size_t length);
+uint32_t delta_roll(uint32_t weak, unsigned char out, unsigned char in, size_t length);
+void delta_strong(const unsigned char *data, size_t length, unsigned char out[16]);
+void delta_sign(const unsigned char *data, size_t length, uint32_t block_size, unsigned char *out);
+
+int delta_index_init(DeltaIndex *index, const unsigned char *blocks, uint32_t count, uint32_t block_size);
+long delta_index_find(const DeltaIndex *index, uint32_t weak, const unsigned char *data);
+void delta_index_free(DeltaIndex *index);
+
+#endif // DELTA_H
@@ -1,65 +1,173 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <time.h>
-
-#define FILE_PATH "random_file.txt"   // Path for the output file
-#define NUM_LINES 2000                // Number of lines to generate
-#define MAX_LINE_LENGTH 3000          // Maximum length of each line
-
-/**
- * Generates a random uppercase alphabet character.
- *
- * @return A random uppercase alphabet character ('A' to 'Z').
- */
-char random_char() {
-    return 'A' + rand() % 26;
-}
-
-/**
- * Generates random text content and writes it to the specified file.
- *
- * @param file Pointer to the file where the text content will be written.
- */
-void generate_txt(FILE *file) {
-    for (int i = 0; i < NUM_LINES; i++) {
-        int line_length = MAX_LINE_LENGTH + 1;
-        for (int j = 0; j < line_length; j++) {
-            fputc(random_char(), file);  // Write random character to file
-        }
-        fputc('\n', file);  // Add newline character at the end of each line
-    }
-}
-
-/**
- * Generates a random text file with specified parameters.
- * Prints the size of the generated file.
- */
-void Generate_File() {
-    srand(time(NULL));  // Initialize random number generator with current time
-
-    FILE *file = fopen(FILE_PATH, "w");  // Open file for writing
-
-    if (file == NULL) {  // Check if file opening is successful
-        perror("Error opening file");
-        exit(EXIT_FAILURE);
-    }
-
-    generate_txt(file);  // Generate text content and write to file
-    fseek(file, 0L, SEEK_END);  // Move file pointer to end to determine file size
-    long size = ftell(file);     // Get current position of file pointer (file size)
-    fclose(file);  // Close the file
-
-    // Print the size of the generated file in megabytes
-    printf("Random text file has been generated (size - %.2f MB)\n", ((double)size / (1024 * 1024)));
-}
-
-/**
- * Main function.
- * Calls the Generate_File() function to generate the random text file.
- *
- * @return 0 indicating successful execution of the program.
- */
-int main() {
-    Generate_File();  // Generate random text file
-    return 0;
-}
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "Generator.h"
+
+#define FILE_PATH "random_file.txt"               // Path for the output file
+#define DEFAULT_SIZE (2000 * (uint64_t)LINE_BYTES) // Default size: 2000 lines, as before
+#define BLOCK_SIZE (8 * 1024 * 1024)              // Bytes generated and written at a time
+
+uint64_t SIZE = DEFAULT_SIZE; // Size of the file to generate
+uint64_t SEED;                // Generator seed
+int THREADS = 0;              // Generator threads, 0 means one per online CPU
+char *OUTPUT = FILE_PATH;     // File to generate
+
+int FD;                       // Output file
+uint64_t BLOCKS;              // Number of BLOCK_SIZE blocks in the file
+atomic_ulong NEXT_BLOCK;      // Next block to be generated
+
+/**
+ * Print the command line usage of the generator.
+ *
+ * @param program Name of the executable.
+ */
+void print_usage(const char *program) {
+    printf("Usage: %s [-size BYTES[K|M|G]] [-seed N] [-threads N] [-o FILE]\n", program);
+}
+
+/**
+ * Extract the generator settings from command line arguments.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 if extraction is successful, 1 otherwise.
+ */
+int extract_Variables(int argc, char *argv[]) {
+    SEED = (uint64_t)time(NULL); // Different content on every run unless a seed is given
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-size") == 0) {
+            if (parse_size(argv[i + 1], &SIZE) < 0) {
+                printf("Invalid size: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-seed") == 0) {
+            SEED = strtoull(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            THREADS = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            OUTPUT = argv[i + 1];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (THREADS < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Generator thread: takes blocks until none are left, fills each one and
+ * writes it at its offset with a single pwrite().
+ *
+ * @param arg Unused.
+ * @return NULL.
+ */
+void *generate_blocks(void *arg) {
+    (void)arg;
+    char *buffer = malloc(BLOCK_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t block;
+    while ((block = atomic_fetch_add(&NEXT_BLOCK, 1)) < BLOCKS) {
+        uint64_t offset = block * BLOCK_SIZE;
+        size_t length = (SIZE - offset < BLOCK_SIZE) ? SIZE - offset : BLOCK_SIZE;
+        generate_text(buffer, length, offset, SEED);
+
+        for (size_t done = 0; done < length;) {
+            ssize_t written = pwrite(FD, buffer + done, length - done, offset + done);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Error writing file");
+                exit(EXIT_FAILURE);
+            }
+            done += written;
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Generates a random text file with specified parameters.
+ * Prints the size of the generated file.
+ */
+void Generate_File() {
+    FD = open(OUTPUT, O_WRONLY | O_CREAT | O_TRUNC, 0644); // Open file for writing
+    if (FD < 0) {
+        perror("Error opening file");
+        exit(EXIT_FAILURE);
+    }
+    // Reserve the blocks up front, so parallel writers do not fragment the file
+    if (SIZE > 0 && fallocate(FD, 0, 0, SIZE) < 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+        perror("fallocate");
+    }
+
+    BLOCKS = (SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (THREADS == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        THREADS = cpus > 0 ? (int)cpus : 1;
+    }
+    if ((uint64_t)THREADS > BLOCKS) {
+        THREADS = BLOCKS > 0 ? (int)BLOCKS : 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        if (pthread_create(&threads[t], NULL, generate_blocks, NULL) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    close(FD);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // Print the size of the generated file in megabytes
+    printf("Random text file has been generated (size - %.2f MB)", ((double)SIZE / (1024 * 1024)));
+    if (SIZE >= BLOCK_SIZE && seconds > 0) {
+        printf(" at %.0f MB/s with %d threads", SIZE / (1024.0 * 1024.0) / seconds, THREADS);
+    }
+    printf("\n");
+}
+
+/**
+ * Main function.
+ * Calls the Generate_File() function to generate the random text file.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 indicating successful execution of the program.
+ */
+int main(int argc, char *argv[]) {
+    if (extract_Variables(argc, argv) == 1) {
+        return 1;
+    }
+    Generate_File();  // Generate random text file
+    return 0;
+}
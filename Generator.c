@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "Generator.h"
+
+/**
+ * Hashes a counter into 64 random bits (splitmix64 finalizer).
+ *
+ * @param seed Generator seed
+ * @param counter Index of the 8-byte word
+ * @return Random bits of the word
+ */
+static inline uint64_t mix(uint64_t seed, uint64_t counter) {
+    uint64_t z = seed + counter * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Maps a random byte to 'A'..'Z' with a multiply-shift instead of a modulo.
+ */
+static inline char letter(uint64_t byte) {
+    return (char)('A' + (((byte & 0xFF) * 26) >> 8));
+}
+
+/**
+ * Fills a buffer with the generated text found at an offset of the stream:
+ * lines of LINE_LENGTH random uppercase letters, each ending in '\n'.
+ *
+ * @param buf Buffer to fill
+ * @param length Number of bytes to generate
+ * @param offset Offset of buf[0] in the stream
+ * @param seed Generator seed
+ */
+void generate_text(char *buf, size_t length, uint64_t offset, uint64_t seed) {
+    size_t i = 0;
+
+    // Bytes before the first 8-byte aligned offset
+    while (i < length && ((offset + i) & 7) != 0) {
+        uint64_t position = offset + i;
+        buf[i++] = letter(mix(seed, position >> 3) >> (8 * (position & 7)));
+    }
+    // Whole words: one hash gives 8 letters, mapped in 16-bit lanes (SWAR)
+    const uint64_t lanes = 0x00FF00FF00FF00FFULL;
+    uint64_t word = (offset + i) >> 3;
+    for (; i + 8 <= length; i += 8, word++) {
+        uint64_t bits = mix(seed, word);
+        uint64_t even = ((bits & lanes) * 26 >> 8) & lanes;      // Bytes 0, 2, 4, 6
+        uint64_t odd = (((bits >> 8) & lanes) * 26) & ~lanes;    // Bytes 1, 3, 5, 7, already in place
+        uint64_t letters = (even | odd) + 0x4141414141414141ULL; // + 'A' in every byte
+        if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {
+            memcpy(buf + i, &letters, 8);
+        } else {
+            for (int b = 0; b < 8; b++) {
+                buf[i + b] = letter(bits >> (8 * b));
+            }
+        }
+    }
+    // Tail
+    for (; i < length; i++) {
+        uint64_t position = offset + i;
+        buf[i] = letter(mix(seed, position >> 3) >> (8 * (position & 7)));
+    }
+
+    // Line ends
+    uint64_t first = LINE_BYTES - 1 - offset % LINE_BYTES;
+    for (uint64_t p = first; p < length; p += LINE_BYTES) {
+        buf[p] = '\n';
+    }
+}
+
+/**
+ * Parses a byte count with an optional K, M or G (binary) suffix.
+ *
+ * @param text Text to parse, e.g. "512M"
+ * @param size Parsed number of bytes
+ * @return 0 on success, -1 if the text is not a size
+ */
+int parse_size(const char *text, uint64_t *size) {
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value < 0) {
+        return -1;
+    }
+    switch (*end) {
+        case 'g': case 'G': value *= 1024.0; // Fall through
+        case 'm': case 'M': value *= 1024.0; // Fall through
+        case 'k': case 'K': value *= 1024.0; end++; break;
+        case '\0': break;
+        default: return -1;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *size = (uint64_t)value;
+    return 0;
+}
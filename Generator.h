@@ -0,0 +1,20 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LINE_LENGTH 3001            // Letters per line of the generated text
+#define LINE_BYTES (LINE_LENGTH + 1) // Letters plus the newline
+
+/*
+ * Counter-based generator of random uppercase text: the byte at any offset
+ * is a pure function of (seed, offset), so blocks can be produced in any
+ * order, by any number of threads, or again later in memory, and always
+ * come out the same. Every 8 bytes come from one splitmix64 hash of their
+ * position, which the compiler vectorizes.
+ */
+void generate_text(char *buf, size_t length, uint64_t offset, uint64_t seed);
+int parse_size(const char *text, uint64_t *size);
+
+#endif // GENERATOR_H
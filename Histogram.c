@@ -0,0 +1,116 @@
+#include <string.h>
+
+#include "Histogram.h"
+
+/**
+ * Returns the bucket a value falls into.
+ *
+ * @param value Value to classify
+ * @return Bucket index
+ */
+static int bucket_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value); // Position of the highest set bit, >= SUB_BITS
+    int sub = (int)(value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/**
+ * Returns the value a bucket stands for: the middle of its range.
+ *
+ * @param index Bucket index
+ * @return Representative value of the bucket
+ */
+static uint64_t bucket_value(int index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+/**
+ * Empties a histogram.
+ *
+ * @param histogram Histogram to reset
+ */
+void histogram_init(Histogram *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->min = UINT64_MAX;
+}
+
+/**
+ * Records one value.
+ *
+ * @param histogram Histogram to record into
+ * @param value Value to record
+ */
+void histogram_record(Histogram *histogram, uint64_t value) {
+    histogram->counts[bucket_index(value)]++;
+    histogram->count++;
+    if (value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+/**
+ * Adds the values of one histogram to another.
+ *
+ * @param into Histogram receiving the values
+ * @param from Histogram whose values are added
+ */
+void histogram_merge(Histogram *into, const Histogram *from) {
+    if (from->count == 0) {
+        return;
+    }
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->count += from->count;
+    if (from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+}
+
+/**
+ * Returns the value below which the given share of the recorded values lie.
+ *
+ * @param histogram Histogram to query
+ * @param percentile Percentile in [0, 100]
+ * @return Approximate value at the percentile, 0 if the histogram is empty
+ */
+uint64_t histogram_percentile(const Histogram *histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank >= histogram->count) {
+        return histogram->max;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_value(i);
+            // The bucket midpoint may lie outside the recorded range
+            if (value < histogram->min) {
+                return histogram->min;
+            }
+            return value > histogram->max ? histogram->max : value;
+        }
+    }
+    return histogram->max;
+}
@@ -0,0 +1,29 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 4                         // Each power of two is split into 2^SUB_BITS buckets
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/*
+ * Log-bucketed histogram of unsigned 64-bit values (nanoseconds here).
+ * Values below 2^SUB_BITS are counted exactly; above that every power of two
+ * is split into 2^SUB_BITS linear buckets, so any percentile is reported
+ * within 1/2^(SUB_BITS+1) (about 3%) of the true value. Recording is O(1)
+ * and needs no allocation.
+ */
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;  // Number of recorded values
+    uint64_t min;    // Smallest recorded value, UINT64_MAX if empty
+    uint64_t max;    // Largest recorded value
+} Histogram;
+
+void histogram_init(Histogram *histogram);
+void histogram_record(Histogram *histogram, uint64_t value);
+void histogram_merge(Histogram *into, const Histogram *from);
+uint64_t histogram_percentile(const Histogram *histogram, double percentile);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,519 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "Protocol.h"
+#include "Generator.h"
+#include "Stats.h"
+#include "Histogram.h"
+
+#define DEFAULT_REPS 11                  // Timed repetitions of every benchmark
+#define WORK_BYTES (64 * 1024 * 1024)    // Bytes one repetition of a data benchmark processes
+#define LOOP_BYTES (256 * 1024 * 1024)   // Bytes one repetition of the frame loop sends
+#define MIN_CHUNK 4096                   // Smallest chunk size benchmarked
+#define RECV_SIZE (256 * 1024)           // Receive buffer of the frame loop, like a worker's read
+#define MAX_RESULTS 64                   // Most results one run produces
+#define MIN_REP_NS 20000000ULL           // Shortest repetition; quicker benchmarks are called several times per repetition
+
+/*
+ * Microbenchmarks of the hot code paths, without the network: text
+ * generation, frame encoding and parsing, frames sent and parsed over a
+ * socketpair and the statistics code, each at several sizes. Every
+ * benchmark runs once as a warmup and then -reps times, each repetition at
+ * least MIN_REP_NS long so timer and scheduler noise stay small. The
+ * repetitions are interleaved, one of every benchmark per round, so a
+ * machine that slows down during the run widens the spread of every
+ * benchmark instead of shifting the medians of the last ones. The result
+ * is the median throughput of the repetitions and its median absolute
+ * deviation, written as JSON with one result per line and a fixed key
+ * order, so runs can be diffed and compared by bench_compare.sh.
+ */
+
+// One benchmark: runs the work once for a size and returns the amount done, in unit per second
+typedef double (*Benchmark)(size_t size);
+
+// Summary of one benchmark at one size
+typedef struct {
+    const char *name;
+    size_t size;       // Chunk size, or number of samples for the statistics benchmarks
+    const char *unit;
+    double median;
+    double mad;        // Median absolute deviation of the repetitions
+    Benchmark benchmark;
+    int calls;         // Calls of the benchmark per repetition
+    double *values;    // Throughput of every repetition
+} Result;
+
+int REPS = DEFAULT_REPS;       // Timed repetitions
+char *OUTPUT = NULL;           // JSON output file, stdout if NULL
+char *VARIANT = "default";     // Build variant written into the JSON
+char *FILTER = NULL;           // Only run benchmarks whose name contains this
+Result RESULTS[MAX_RESULTS];
+int RESULT_COUNT = 0;
+volatile uint64_t SINK;        // Keeps the compiler from dropping the measured work
+unsigned char *FRAMES = NULL;  // Room for WORK_BYTES of MIN_CHUNK frames, shared by the framing benchmarks
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ */
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Allocates memory or exits.
+ *
+ * @param size Bytes to allocate.
+ * @return The memory.
+ */
+void *checked_malloc(size_t size) {
+    void *memory = malloc(size);
+    if (memory == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+/**
+ * Generates WORK_BYTES of text, size bytes at a time.
+ *
+ * @param size Bytes per generate_text() call.
+ * @return MB/s.
+ */
+double bench_generate(size_t size) {
+    char *buffer = checked_malloc(size);
+    uint64_t start = now_ns();
+    for (uint64_t offset = 0; offset < WORK_BYTES; offset += size) {
+        generate_text(buffer, size, offset, 42);
+        SINK += buffer[size - 1];
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    free(buffer);
+    return WORK_BYTES / (1024.0 * 1024.0) / seconds;
+}
+
+/**
+ * Returns the buffer of the framing benchmarks, allocated and faulted in on
+ * first use so page faults are not part of the measurements.
+ *
+ * @return WORK_BYTES plus room for the headers of MIN_CHUNK byte frames.
+ */
+unsigned char *frame_buffer() {
+    if (FRAMES == NULL) {
+        size_t room = WORK_BYTES + (WORK_BYTES / MIN_CHUNK + 1) * FRAME_HEADER_SIZE;
+        FRAMES = checked_malloc(room);
+        memset(FRAMES, 0, room);
+    }
+    return FRAMES;
+}
+
+/**
+ * Fills a buffer with back to back FILE_DATA frames of size byte payloads,
+ * as they would arrive on a connection.
+ *
+ * @param size Payload bytes per frame.
+ * @param payload Payload of every frame, size bytes.
+ * @param out WORK_BYTES plus room for the frame headers.
+ * @return Bytes written to out.
+ */
+size_t encode_frames(size_t size, const char *payload, unsigned char *out) {
+    size_t length = 0;
+    uint32_t seq = 0;
+    for (uint64_t done = 0; done < WORK_BYTES; done += size) {
+        FrameHeader header = {PROTOCOL_VERSION, FILE_DATA, 0, size, seq++};
+        encode_frame_header(&header, out + length);
+        memcpy(out + length + FRAME_HEADER_SIZE, payload, size);
+        length += FRAME_HEADER_SIZE + size;
+    }
+    return length;
+}
+
+/**
+ * Frames WORK_BYTES of data: a header encoded in front of every chunk,
+ * copied into one stream buffer.
+ *
+ * @param size Payload bytes per frame.
+ * @return MB/s of payload.
+ */
+double bench_encode(size_t size) {
+    char *payload = checked_malloc(size);
+    unsigned char *out = frame_buffer();
+    generate_text(payload, size, 0, 42);
+    uint64_t start = now_ns();
+    SINK += encode_frames(size, payload, out);
+    double seconds = (now_ns() - start) / 1e9;
+    SINK += out[size];
+    free(payload);
+    return WORK_BYTES / (1024.0 * 1024.0) / seconds;
+}
+
+/**
+ * Parses WORK_BYTES of framed data, fed to the parser RECV_SIZE bytes at a
+ * time like the receiver's event loop does.
+ *
+ * @param size Payload bytes per frame.
+ * @return MB/s of payload.
+ */
+double bench_parse(size_t size) {
+    char *payload = checked_malloc(size);
+    unsigned char *frames = frame_buffer();
+    generate_text(payload, size, 0, 42);
+    size_t length = encode_frames(size, payload, frames);
+
+    FrameParser *parser = checked_malloc(sizeof(FrameParser));
+    frame_parser_init(parser);
+    uint64_t data = 0;
+    uint64_t start = now_ns();
+    for (size_t position = 0; position < length; position += RECV_SIZE) {
+        size_t slice = length - position < RECV_SIZE ? length - position : RECV_SIZE;
+        size_t offset = 0;
+        while (offset < slice) {
+            FrameEvent event;
+            offset += frame_parser_feed(parser, (const char *)frames + position + offset, slice - offset, &event);
+            if (event.kind == FRAME_EVENT_ERROR) {
+                fprintf(stderr, "Parse error: %s\n", frame_error_string(event.error));
+                exit(EXIT_FAILURE);
+            }
+            if (event.kind == FRAME_EVENT_DATA) {
+                data += event.length;
+            }
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    SINK += data;
+    free(parser);
+    free(payload);
+    return WORK_BYTES / (1024.0 * 1024.0) / seconds;
+}
+
+// Sending side of the frame loop
+typedef struct {
+    int socket;
+    size_t size;
+} LoopSender;
+
+/**
+ * Sender thread of the frame loop: LOOP_BYTES as FILE_DATA frames with
+ * send_frame(). This is the framing of the sender's copy path only:
+ * send_range() and send_packed() live in TCP_Sender.c, with the file reads,
+ * checksums and compression, and are measured end to end by bench.sh.
+ *
+ * @param arg Pointer to the LoopSender.
+ * @return NULL.
+ */
+void *loop_sender(void *arg) {
+    LoopSender *sender = (LoopSender *)arg;
+    char *payload = checked_malloc(sender->size);
+    generate_text(payload, sender->size, 0, 42);
+    uint32_t seq = 0;
+    for (uint64_t done = 0; done < LOOP_BYTES; done += sender->size) {
+        send_frame(sender->socket, &seq, FILE_DATA, 0, payload, sender->size);
+    }
+    shutdown(sender->socket, SHUT_WR);
+    free(payload);
+    return NULL;
+}
+
+/**
+ * Frame loop: sends LOOP_BYTES through a socketpair, one thread sends
+ * frames and this one receives and parses them the way the receiver's event
+ * loop does. A framing benchmark, not one of the transfer loops: it does
+ * not run send_range() or connection_receive(), so the file reads and
+ * writes, the sinks and the checksums are left out; bench.sh measures
+ * those end to end.
+ *
+ * @param size Payload bytes per frame.
+ * @return MB/s of payload.
+ */
+double bench_frame_loop(size_t size) {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+        perror("socketpair");
+        exit(EXIT_FAILURE);
+    }
+    char *buffer = checked_malloc(RECV_SIZE);
+    FrameParser *parser = checked_malloc(sizeof(FrameParser));
+    frame_parser_init(parser);
+    LoopSender sender = {sockets[0], size};
+    pthread_t thread;
+
+    uint64_t start = now_ns();
+    if (pthread_create(&thread, NULL, loop_sender, &sender) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t data = 0;
+    for (;;) {
+        ssize_t received = recv(sockets[1], buffer, RECV_SIZE, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0) {
+            perror("recv");
+            exit(EXIT_FAILURE);
+        }
+        if (received == 0) {
+            break;
+        }
+        size_t offset = 0;
+        while (offset < (size_t)received) {
+            FrameEvent event;
+            offset += frame_parser_feed(parser, buffer + offset, received - offset, &event);
+            if (event.kind == FRAME_EVENT_DATA) {
+                data += event.length;
+            }
+        }
+    }
+    pthread_join(thread, NULL);
+    double seconds = (now_ns() - start) / 1e9;
+
+    if (data < LOOP_BYTES) {
+        fprintf(stderr, "Frame loop lost data: %llu of %d bytes\n", (unsigned long long)data, LOOP_BYTES);
+        exit(EXIT_FAILURE);
+    }
+    close(sockets[0]);
+    close(sockets[1]);
+    free(parser);
+    free(buffer);
+    return data / (1024.0 * 1024.0) / seconds;
+}
+
+/**
+ * Records size run results into a StatsStore and summarizes them the way
+ * the receiver does at the end of a session: percentiles of both fields and
+ * the per-algorithm groups.
+ *
+ * @param size Number of runs.
+ * @return Thousands of runs per second.
+ */
+double bench_stats(size_t size) {
+    static const char *algos[] = {"reno", "cubic", "bbr"};
+    AlgoStats groups[STATS_MAX_ALGOS];
+    StatsStore store;
+    uint64_t start = now_ns();
+    stats_init(&store);
+    for (size_t k = 0; k < size; k++) {
+        // Deterministic spread of times around 1 s
+        double time_ms = 900.0 + (double)((k * 2654435761u) % 200);
+        stats_add(&store, (int)k + 1, algos[k % 3], time_ms, 1 << 30, 1 << 30);
+    }
+    SINK += (uint64_t)stats_percentile(&store, STATS_TIME, 50);
+    SINK += (uint64_t)stats_percentile(&store, STATS_BANDWIDTH, 99);
+    SINK += stats_group_by_algo(&store, groups, STATS_MAX_ALGOS);
+    stats_free(&store);
+    double seconds = (now_ns() - start) / 1e9;
+    return size / 1e3 / seconds;
+}
+
+/**
+ * Records size latencies into a histogram and reads its percentiles, as the
+ * receiver does for every data frame.
+ *
+ * @param size Number of values.
+ * @return Millions of values per second.
+ */
+double bench_histogram(size_t size) {
+    Histogram *histogram = checked_malloc(sizeof(Histogram));
+    uint64_t start = now_ns();
+    histogram_init(histogram);
+    uint64_t value = 88172645463325252ULL;
+    for (size_t k = 0; k < size; k++) {
+        value ^= value << 13; // xorshift64, spread over many buckets
+        value ^= value >> 7;
+        value ^= value << 17;
+        histogram_record(histogram, value >> 40);
+    }
+    SINK += histogram_percentile(histogram, 50) + histogram_percentile(histogram, 99.9);
+    double seconds = (now_ns() - start) / 1e9;
+    free(histogram);
+    return size / 1e6 / seconds;
+}
+
+/**
+ * Compares two doubles for qsort().
+ */
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Returns the median of values, sorting them.
+ *
+ * @param values Values.
+ * @param count Number of values.
+ * @return Median.
+ */
+double median(double *values, int count) {
+    qsort(values, count, sizeof(double), compare_doubles);
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/**
+ * Adds a benchmark at a size to the run and warms it up. The warmup also
+ * decides how many calls make up a repetition.
+ *
+ * @param name Name of the benchmark in the results.
+ * @param benchmark Benchmark to run.
+ * @param size Size to run it at.
+ * @param unit Unit of its results.
+ */
+void run(const char *name, Benchmark benchmark, size_t size, const char *unit) {
+    if ((FILTER != NULL && strstr(name, FILTER) == NULL) || RESULT_COUNT == MAX_RESULTS) {
+        return;
+    }
+    uint64_t start = now_ns();
+    benchmark(size);
+    uint64_t elapsed = now_ns() - start;
+    Result *result = &RESULTS[RESULT_COUNT++];
+    result->name = name;
+    result->size = size;
+    result->unit = unit;
+    result->benchmark = benchmark;
+    result->calls = elapsed < MIN_REP_NS ? (int)(MIN_REP_NS / (elapsed + 1)) + 1 : 1;
+    result->values = checked_malloc(REPS * sizeof(double));
+}
+
+/**
+ * Runs REPS rounds of timed repetitions, one repetition of every added
+ * benchmark per round, and summarizes each benchmark by the median and the
+ * median absolute deviation of its repetitions. A repetition's throughput
+ * is its total work over its total time.
+ */
+void measure() {
+    for (int r = 0; r < REPS; r++) {
+        for (int k = 0; k < RESULT_COUNT; k++) {
+            Result *result = &RESULTS[k];
+            double inverse = 0;
+            for (int c = 0; c < result->calls; c++) {
+                inverse += 1 / result->benchmark(result->size);
+            }
+            result->values[r] = result->calls / inverse;
+        }
+    }
+    for (int k = 0; k < RESULT_COUNT; k++) {
+        Result *result = &RESULTS[k];
+        result->median = median(result->values, REPS);
+        for (int r = 0; r < REPS; r++) {
+            double deviation = result->values[r] - result->median;
+            result->values[r] = deviation > 0 ? deviation : -deviation;
+        }
+        result->mad = median(result->values, REPS);
+        free(result->values);
+        fprintf(stderr, "%-16s %9zu %12.3f %-8s +- %.3f\n", result->name, result->size, result->median, result->unit,
+                result->mad);
+    }
+}
+
+/**
+ * Writes the results as JSON, one result per line.
+ *
+ * @param file Output.
+ */
+void write_json(FILE *file) {
+    fprintf(file, "{\"variant\":\"%s\",\"reps\":%d,\"results\":[\n", VARIANT, REPS);
+    for (int k = 0; k < RESULT_COUNT; k++) {
+        Result *result = &RESULTS[k];
+        fprintf(file, "{\"name\":\"%s\",\"size\":%zu,\"unit\":\"%s\",\"median\":%.3f,\"mad\":%.3f}%s\n", result->name,
+                result->size, result->unit, result->median, result->mad, k + 1 < RESULT_COUNT ? "," : "");
+    }
+    fprintf(file, "]}\n");
+}
+
+/**
+ * Print the command line usage of the microbenchmarks.
+ *
+ * @param program Name of the executable.
+ */
+void print_usage(const char *program) {
+    printf("Usage: %s [-reps N] [-o FILE] [-variant NAME] [-only NAME]\n", program);
+}
+
+/**
+ * Extract the benchmark settings from command line arguments.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 if extraction is successful, 1 otherwise.
+ */
+int extract_Variables(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-reps") == 0) {
+            REPS = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            OUTPUT = argv[i + 1];
+        } else if (strcmp(argv[i], "-variant") == 0) {
+            VARIANT = argv[i + 1];
+        } else if (strcmp(argv[i], "-only") == 0) {
+            FILTER = argv[i + 1];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (REPS < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Run the microbenchmarks selected on the command line and write their
+ * results as JSON.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 on success, 1 on invalid arguments or if the output cannot be written.
+ */
+int main(int argc, char *argv[]) {
+    if (extract_Variables(argc, argv) != 0) {
+        return 1;
+    }
+
+    static const size_t chunks[] = {MIN_CHUNK, 65536, BUFFER_SIZE};
+    for (int k = 0; k < 3; k++) {
+        run("generate_text", bench_generate, chunks[k], "MB/s");
+    }
+    for (int k = 0; k < 3; k++) {
+        run("frame_encode", bench_encode, chunks[k], "MB/s");
+    }
+    for (int k = 0; k < 3; k++) {
+        run("frame_parse", bench_parse, chunks[k], "MB/s");
+    }
+    for (int k = 0; k < 3; k++) {
+        run("frame_loop", bench_frame_loop, chunks[k], "MB/s");
+    }
+    static const size_t samples[] = {1000, 10000, 100000};
+    for (int k = 0; k < 3; k++) {
+        run("stats", bench_stats, samples[k], "Kruns/s");
+    }
+    for (int k = 0; k < 3; k++) {
+        run("histogram", bench_histogram, samples[k] * 10, "Mvalues/s");
+    }
+    measure();
+
+    FILE *file = stdout;
+    if (OUTPUT != NULL && (file = fopen(OUTPUT, "w")) == NULL) {
+        perror("Error opening output file");
+        return 1;
+    }
+    write_json(file);
+    if (file != stdout) {
+        fclose(file);
+    }
+    return 0;
+}
@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "Protocol.h"
+
+/**
+ * Encodes a frame header into its wire representation.
+ *
+ * @param header Header to encode
+ * @param out Buffer of at least FRAME_HEADER_SIZE bytes
+ */
+void encode_frame_header(const FrameHeader *header, unsigned char *out) {
+    uint32_t magic = htonl(PROTOCOL_MAGIC);
+    uint16_t flags = htons(header->flags);
+    uint32_t length = htonl(header->length);
+    uint32_t seq = htonl(header->seq);
+
+    memcpy(out, &magic, 4);
+    out[4] = header->version;
+    out[5] = header->type;
+    memcpy(out + 6, &flags, 2);
+    memcpy(out + 8, &length, 4);
+    memcpy(out + 12, &seq, 4);
+}
+
+/**
+ * Decodes and validates a frame header.
+ *
+ * @param in Buffer holding FRAME_HEADER_SIZE bytes received from the peer
+ * @param header Pointer to store the decoded header
+ * @return FRAME_OK on success, a negative enum FrameError otherwise
+ */
+int decode_frame_header(const unsigned char *in, FrameHeader *header) {
+    uint32_t magic, length, seq;
+    uint16_t flags;
+
+    memcpy(&magic, in, 4);
+    if (ntohl(magic) != PROTOCOL_MAGIC) {
+        return FRAME_BAD_MAGIC;
+    }
+    header->version = in[4];
+    header->type = in[5];
+    memcpy(&flags, in + 6, 2);
+    memcpy(&length, in + 8, 4);
+    memcpy(&seq, in + 12, 4);
+    header->flags = ntohs(flags);
+    header->length = ntohl(length);
+    header->seq = ntohl(seq);
+
+    if (header->version != PROTOCOL_VERSION) {
+        return FRAME_BAD_VERSION;
+    }
+    if (header->type < FILE_DATA || header->type >= MESSAGE_TYPE_COUNT) {
+        return FRAME_BAD_TYPE;
+    }
+    if (header->length > FRAME_MAX_PAYLOAD ||
+        (header->type != FILE_DATA && header->type != DELTA_SIGNATURES && header->length > FRAME_MAX_CONTROL)) {
+        return FRAME_BAD_LENGTH;
+    }
+    return FRAME_OK;
+}
+
+/**
+ * Describes a frame decoding error.
+ *
+ * @param error enum FrameError value
+ * @return Human readable description
+ */
+const char *frame_error_string(int error) {
+    switch (error) {
+        case FRAME_OK:
+            return "no error";
+        case FRAME_BAD_MAGIC:
+            return "peer does not speak the framed protocol (legacy sender?)";
+        case FRAME_BAD_VERSION:
+            return "peer speaks an unsupported protocol version";
+        case FRAME_BAD_TYPE:
+            return "unknown message type";
+        case FRAME_BAD_LENGTH:
+            return "payload length exceeds the allowed maximum";
+        case FRAME_BAD_SEQUENCE:
+            return "frame received out of sequence";
+        case FRAME_CLOSED:
+            return "connection closed in the middle of a frame";
+        default:
+            return "unknown frame error";
+    }
+}
+
+/**
+ * Stores a 32-bit value in big endian order.
+ *
+ * @param out Buffer of at least 4 bytes
+ * @param value Value to store
+ */
+void put_u32(unsigned char *out, uint32_t value) {
+    value = htonl(value);
+    memcpy(out, &value, 4);
+}
+
+/**
+ * Loads a 32-bit value stored in big endian order.
+ *
+ * @param in Buffer of at least 4 bytes
+ * @return The stored value
+ */
+uint32_t get_u32(const unsigned char *in) {
+    uint32_t value;
+    memcpy(&value, in, 4);
+    return ntohl(value);
+}
+
+/**
+ * Stores a 64-bit value in big endian order.
+ *
+ * @param out Buffer of at least 8 bytes
+ * @param value Value to store
+ */
+void put_u64(unsigned char *out, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        out[i] = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+/**
+ * Loads a 64-bit value stored in big endian order.
+ *
+ * @param in Buffer of at least 8 bytes
+ * @return The stored value
+ */
+uint64_t get_u64(const unsigned char *in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+/**
+ * Sends a whole buffer through the socket, retrying on short writes.
+ *
+ * @param socket File descriptor of the socket
+ * @param buf Data to send
+ * @param length Number of bytes to send
+ */
+void send_all(int socket, const void *buf, size_t length) {
+    const char *p = buf;
+    while (length > 0) {
+        ssize_t bytes_sent = send(socket, p, length, MSG_NOSIGNAL);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error sending message");
+            exit(EXIT_FAILURE);
+        }
+        p += bytes_sent;
+        length -= bytes_sent;
+    }
+}
+
+/**
+ * Receives exactly length bytes from the socket.
+ *
+ * @param socket File descriptor of the socket
+ * @param buf Buffer to store the received data
+ * @param length Number of bytes to receive
+ * @return 0 on success, -1 if the connection was closed or failed
+ */
+int recv_all(int socket, void *buf, size_t length) {
+    char *p = buf;
+    while (length > 0) {
+        ssize_t bytes_received = recv(socket, p, length, 0);
+        if (bytes_received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_received <= 0) {
+            return -1;
+        }
+        p += bytes_received;
+        length -= bytes_received;
+    }
+    return 0;
+}
+
+/**
+ * Sends only the header of a frame. The caller must follow it with exactly
+ * length payload bytes, e.g. moved by sendfile() or splice().
+ *
+ * @param socket File descriptor of the socket
+ * @param seq Per-connection sequence counter, incremented for each frame
+ * @param type Type of the message
+ * @param flags Per-frame option bits
+ * @param length Number of payload bytes that will follow
+ */
+void send_frame_header(int socket, uint32_t *seq, enum MessageType type, uint16_t flags,
+                       uint32_t length) {
+    unsigned char header_buf[FRAME_HEADER_SIZE];
+    FrameHeader header = {PROTOCOL_VERSION, type, flags, length, (*seq)++};
+    encode_frame_header(&header, header_buf);
+
+    const unsigned char *p = header_buf;
+    size_t left = FRAME_HEADER_SIZE;
+    while (left > 0) {
+        // MSG_MORE lets the kernel coalesce the header with the payload that follows
+        ssize_t bytes_sent = send(socket, p, left, MSG_NOSIGNAL | (length > 0 ? MSG_MORE : 0));
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error sending message");
+            exit(EXIT_FAILURE);
+        }
+        p += bytes_sent;
+        left -= bytes_sent;
+    }
+}
+
+/**
+ * Sends one frame (header followed by payload) through the socket.
+ * Header and payload leave in a single sendmsg() when possible.
+ *
+ * @param socket File descriptor of the socket
+ * @param seq Per-connection sequence counter, incremented for each frame
+ * @param type Type of the message
+ * @param flags Per-frame option bits
+ * @param payload Payload bytes, may be NULL if length is 0
+ * @param length Number of payload bytes
+ */
+void send_frame(int socket, uint32_t *seq, enum MessageType type, uint16_t flags,
+                const void *payload, uint32_t length) {
+    unsigned char header_buf[FRAME_HEADER_SIZE];
+    FrameHeader header = {PROTOCOL_VERSION, type, flags, length, (*seq)++};
+    encode_frame_header(&header, header_buf);
+
+    struct iovec iov[2] = {
+        {header_buf, FRAME_HEADER_SIZE},
+        {(void *)payload, length}
+    };
+    size_t total = FRAME_HEADER_SIZE + (size_t)length;
+    struct msghdr message = {.msg_iov = iov, .msg_iovlen = length > 0 ? 2 : 1};
+    ssize_t bytes_sent;
+    do {
+        bytes_sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (bytes_sent < 0 && errno == EINTR);
+
+    if (bytes_sent < 0) {
+        perror("Error sending message");
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t)bytes_sent == total) {
+        return;
+    }
+    // Short write: finish whatever is left of the header, then the payload
+    if ((size_t)bytes_sent < FRAME_HEADER_SIZE) {
+        send_all(socket, header_buf + bytes_sent, FRAME_HEADER_SIZE - bytes_sent);
+        bytes_sent = FRAME_HEADER_SIZE;
+    }
+    send_all(socket, (const char *)payload + (bytes_sent - FRAME_HEADER_SIZE),
+             total - bytes_sent);
+}
+
+/**
+ * Receives and validates the header of the next frame on a blocking socket.
+ * The caller then receives exactly header->length payload bytes, e.g. with
+ * recv_all().
+ *
+ * @param socket File descriptor of the socket
+ * @param seq Sequence number the frame must carry, incremented on success
+ * @param header Pointer to store the decoded header
+ * @return FRAME_OK on success, a negative enum FrameError otherwise
+ */
+int recv_frame_header(int socket, uint32_t *seq, FrameHeader *header) {
+    unsigned char header_buf[FRAME_HEADER_SIZE];
+    if (recv_all(socket, header_buf, FRAME_HEADER_SIZE) < 0) {
+        return FRAME_CLOSED;
+    }
+    int error = decode_frame_header(header_buf, header);
+    if (error != FRAME_OK) {
+        return error;
+    }
+    if (header->seq != *seq) {
+        return FRAME_BAD_SEQUENCE;
+    }
+    (*seq)++;
+    return FRAME_OK;
+}
+
+/**
+ * Initializes an incremental frame parser.
+ *
+ * @param parser Parser to initialize
+ */
+void frame_parser_init(FrameParser *parser) {
+    parser->header_have = 0;
+    parser->remaining = 0;
+    parser->next_seq = 0;
+    parser->in_payload = 0;
+    parser->control_have = 0;
+}
+
+/**
+ * Fills a control event from the staged control payload and resets the staging area.
+ */
+static void emit_control(FrameParser *parser, FrameEvent *event) {
+    event->kind = FRAME_EVENT_CONTROL;
+    event->header = parser->header;
+    event->data = parser->control;
+    event->length = parser->control_have;
+    event->end_of_frame = 1;
+    parser->in_payload = 0;
+    parser->control_have = 0;
+}
+
+/**
+ * Feeds received bytes to the parser and stops at the first event.
+ * FILE_DATA payloads are returned as slices of the input buffer without copying;
+ * control payloads are small and are staged until complete.
+ *
+ * @param parser Parser state of the connection
+ * @param buf Received bytes
+ * @param length Number of bytes in buf
+ * @param event Pointer to store the produced event
+ * @return Number of bytes of buf consumed
+ */
+size_t frame_parser_feed(FrameParser *parser, const char *buf, size_t length, FrameEvent *event) {
+    size_t consumed = 0;
+    event->kind = FRAME_EVENT_NONE;
+    event->data = NULL;
+    event->length = 0;
+    event->end_of_frame = 0;
+    event->error = FRAME_OK;
+
+    while (consumed < length) {
+        if (!parser->in_payload) {
+            // Collect the fixed-size header
+            size_t need = FRAME_HEADER_SIZE - parser->header_have;
+            size_t take = (length - consumed < need) ? length - consumed : need;
+            memcpy(parser->header_buf + parser->header_have, buf + consumed, take);
+            parser->header_have += take;
+            consumed += take;
+            if (parser->header_have < FRAME_HEADER_SIZE) {
+                break;
+            }
+
+            parser->header_have = 0;
+            int error = decode_frame_header(parser->header_buf, &parser->header);
+            if (error == FRAME_OK && parser->header.seq != parser->next_seq) {
+                error = FRAME_BAD_SEQUENCE;
+            }
+            if (error == FRAME_OK && parser->header.type != FILE_DATA && parser->header.length > FRAME_MAX_CONTROL) {
+                error = FRAME_BAD_LENGTH; // Only file data is passed through, the rest must fit the staging area
+            }
+            if (error != FRAME_OK) {
+                event->kind = FRAME_EVENT_ERROR;
+                event->header = parser->header;
+                event->error = error;
+                return consumed;
+            }
+            parser->next_seq++;
+            parser->in_payload = 1;
+            parser->remaining = parser->header.length;
+            parser->control_have = 0;
+
+            if (parser->remaining == 0) {
+                if (parser->header.type == FILE_DATA) {
+                    parser->in_payload = 0; // Empty data frame carries nothing
+                    continue;
+                }
+                emit_control(parser, event);
+                return consumed;
+            }
+            continue;
+        }
+
+        size_t take = (length - consumed < parser->remaining) ? length - consumed : parser->remaining;
+        parser->remaining -= take;
+
+        if (parser->header.type == FILE_DATA) {
+            event->kind = FRAME_EVENT_DATA;
+            event->header = parser->header;
+            event->data = buf + consumed;
+            event->length = take;
+            event->end_of_frame = (parser->remaining == 0);
+            if (parser->remaining == 0) {
+                parser->in_payload = 0;
+            }
+            return consumed + take;
+        }
+
+        memcpy(parser->control + parser->control_have, buf + consumed, take);
+        parser->control_have += take;
+        consumed += take;
+        if (parser->remaining == 0) {
+            emit_control(parser, event);
+            return consumed;
+        }
+    }
+    return consumed;
+}
+
+/**
+ * Returns how many bytes complete the current header or payload.
+ * Reading no more than this never crosses a frame boundary.
+ *
+ * @param parser Parser state of the connection
+ * @return Number of bytes still missing from the current header or payload
+ */
+size_t frame_parser_want(const FrameParser *parser) {
+    if (!parser->in_payload) {
+        return FRAME_HEADER_SIZE - parser->header_have;
+    }
+    return parser->remaining;
+}
+
+/**
+ * Tells whether the parser is inside a FILE_DATA payload.
+ *
+ * @param parser Parser state of the connection
+ * @return Non-zero if the next bytes on the stream are file data
+ */
+int frame_parser_in_data(const FrameParser *parser) {
+    return parser->in_payload && parser->header.type == FILE_DATA && parser->remaining > 0;
+}
+
+/**
+ * Accounts for FILE_DATA payload bytes the caller consumed directly from the
+ * socket (e.g. with splice()) instead of feeding them to the parser.
+ *
+ * @param parser Parser state of the connection
+ * @param length Number of payload bytes consumed, at most frame_parser_want()
+ */
+void frame_parser_skip(FrameParser *parser, size_t length) {
+    parser->remaining -= length;
+    if (parser->remaining == 0) {
+        parser->in_payload = 0;
+    }
+}
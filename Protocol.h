@@ -0,0 +1,124 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUFFER_SIZE (1024 * 1024)             // Size of a file data chunk
+#define PROTOCOL_MAGIC 0x544E4333u            // "TNC3", first bytes of every frame
+#define PROTOCOL_VERSION 2                    // Bumped on any incompatible wire change
+#define FRAME_HEADER_SIZE 16                  // Size of an encoded frame header
+#define FRAME_MAX_PAYLOAD (16 * 1024 * 1024)  // Largest payload a single frame may carry
+#define FRAME_MAX_CONTROL 4096                // Largest payload of a control frame
+#define MAX_STREAMS 64                        // Most connections one transfer session may use
+
+// Frame flags
+#define FRAME_FLAG_COMPRESSED 0x0001          // FILE_DATA payload is a chunk compressed by Codec.c
+#define FRAME_FLAG_DELTA 0x0002               // CONTROL_START: the run is sent as a delta, answer with DELTA_SIGNATURES
+#define FRAME_FLAG_WARMUP 0x0004              // CONTROL_START: warmup run, not counted in the statistics
+#define FRAME_FLAG_TREE 0x0008                // CONTROL_START and CONTROL_RANGE: the run carries a directory tree, see CONTROL_MANIFEST
+
+// Control payload sizes (all fields big endian)
+#define START_PAYLOAD_SIZE 16  // CONTROL_START: run(4) file_size(8) warmup_runs(4), then optionally the congestion control algorithm
+#define START_ALGO_MAX 16      // Longest algorithm name in CONTROL_START, sent without terminator
+#define JOIN_PAYLOAD_SIZE 16   // CONTROL_JOIN: session_id(8) stream_index(4) stream_count(4)
+#define RANGE_PAYLOAD_SIZE 28  // CONTROL_RANGE: run(4) file_size(8) offset(8) length(8)
+#define END_PAYLOAD_SIZE 12    // CONTROL_END: bytes(8) crc32c(4) of the stream's range, empty if not checksummed
+#define DELTA_COPY_PAYLOAD_SIZE 16 // DELTA_COPY: base_offset(8) length(8)
+#define MANIFEST_PAYLOAD_SIZE 4    // CONTROL_MANIFEST: run(4), then entries up to FRAME_MAX_CONTROL
+#define MANIFEST_ENTRY_SIZE 16     // Manifest entry: size(8) mode(4) path_length(4), then the relative path
+#define MANIFEST_PATH_MAX 1024     // Longest relative path of a manifest entry, sent without terminator
+
+// Message types
+enum MessageType {
+    FILE_DATA = 1,      // Chunk of file data
+    CONTROL_START,      // Sender is about to transmit a file
+    CONTROL_END,        // Sender finished transmitting the file
+    CONTROL_SEND_AGAIN, // Sender will transmit the file again
+    CONTROL_EXIT,       // Sender is closing the session
+    CONTROL_JOIN,       // Connection belongs to a multi-stream session
+    CONTROL_RANGE,      // Following file data belongs at a byte range of the file
+    DELTA_SIGNATURES,   // Receiver -> sender: block signatures of the previous file, see Delta.h
+    DELTA_COPY,         // Next bytes of the file are a byte range of the receiver's previous file
+    CONTROL_MANIFEST,   // Entries of a directory tree run; the run's data is its files' contents in this order
+    MESSAGE_TYPE_COUNT  // Number of message types, keep last
+};
+
+// Errors reported while decoding frames
+enum FrameError {
+    FRAME_OK = 0,
+    FRAME_BAD_MAGIC = -1,    // Peer does not speak the framed protocol
+    FRAME_BAD_VERSION = -2,  // Peer speaks another protocol version
+    FRAME_BAD_TYPE = -3,     // Unknown message type
+    FRAME_BAD_LENGTH = -4,   // Payload length exceeds the allowed maximum
+    FRAME_BAD_SEQUENCE = -5, // Frame arrived out of sequence
+    FRAME_CLOSED = -6        // Connection closed in the middle of a frame
+};
+
+/*
+ * Decoded frame header.
+ * On the wire (big endian): magic(4) version(1) type(1) flags(2) length(4) seq(4),
+ * followed by exactly `length` payload bytes.
+ */
+typedef struct {
+    uint8_t version;   // Protocol version of the sender
+    uint8_t type;      // enum MessageType
+    uint16_t flags;    // Per-frame option bits
+    uint32_t length;   // Number of payload bytes following the header
+    uint32_t seq;      // Per-connection frame counter, starting at 0
+} FrameHeader;
+
+// Events produced by the incremental frame parser
+enum FrameEventKind {
+    FRAME_EVENT_NONE,    // All input consumed, more bytes are needed
+    FRAME_EVENT_CONTROL, // A complete control frame is available
+    FRAME_EVENT_DATA,    // A slice of a FILE_DATA payload is available
+    FRAME_EVENT_ERROR    // The stream is malformed, see error
+};
+
+// A single parser event
+typedef struct {
+    enum FrameEventKind kind;
+    FrameHeader header;   // Header of the frame the event belongs to
+    const char *data;     // Control payload or data slice (valid until the next feed)
+    size_t length;        // Number of bytes at data
+    int end_of_frame;     // Non-zero if this event completes the frame
+    int error;            // enum FrameError when kind is FRAME_EVENT_ERROR
+} FrameEvent;
+
+// Incremental parser state, one per connection
+typedef struct {
+    unsigned char header_buf[FRAME_HEADER_SIZE]; // Partially received header
+    size_t header_have;                          // Header bytes collected so far
+    FrameHeader header;                          // Header of the frame being parsed
+    uint32_t remaining;                          // Payload bytes still expected
+    uint32_t next_seq;                           // Sequence number of the next frame
+    int in_payload;                              // Non-zero while inside a payload
+    char control[FRAME_MAX_CONTROL];             // Staging area for control payloads
+    size_t control_have;                         // Control payload bytes collected so far
+} FrameParser;
+
+void encode_frame_header(const FrameHeader *header, unsigned char *out);
+int decode_frame_header(const unsigned char *in, FrameHeader *header);
+const char *frame_error_string(int error);
+
+void put_u32(unsigned char *out, uint32_t value);
+uint32_t get_u32(const unsigned char *in);
+void put_u64(unsigned char *out, uint64_t value);
+uint64_t get_u64(const unsigned char *in);
+
+void send_all(int socket, const void *buf, size_t length);
+int recv_all(int socket, void *buf, size_t length);
+void send_frame_header(int socket, uint32_t *seq, enum MessageType type, uint16_t flags,
+                       uint32_t length);
+void send_frame(int socket, uint32_t *seq, enum MessageType type, uint16_t flags,
+                const void *payload, uint32_t length);
+int recv_frame_header(int socket, uint32_t *seq, FrameHeader *header);
+
+void frame_parser_init(FrameParser *parser);
+size_t frame_parser_feed(FrameParser *parser, const char *buf, size_t length, FrameEvent *event);
+size_t frame_parser_want(const FrameParser *parser);
+int frame_parser_in_data(const FrameParser *parser);
+void frame_parser_skip(FrameParser *parser, size_t length);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "Reporter.h"
+
+/**
+ * Prints one interval report, and writes it to the JSON file if there is one.
+ *
+ * @param reporter Reporter
+ * @param start_s Start of the interval, in seconds since the reporter started
+ * @param end_s End of the interval
+ * @param bytes Bytes moved during the interval
+ * @param losses Retransmitted or out-of-order segments during the interval
+ */
+static void print_interval(Reporter *reporter, double start_s, double end_s, uint64_t bytes, unsigned long losses) {
+    double rate = end_s > start_s ? bytes / (1024.0 * 1024.0) / (end_s - start_s) : 0.0;
+    int sender = strcmp(reporter->role, "sender") == 0;
+    printf("[%7.2f-%7.2f s] %10.2f MB %10.2f MB/s %8lu %s\n", start_s, end_s, bytes / (1024.0 * 1024.0), rate,
+           losses, sender ? "retransmits" : "out-of-order");
+    fflush(stdout);
+    if (reporter->json != NULL) {
+        fprintf(reporter->json,
+                "{\"role\":\"%s\",\"start_s\":%.3f,\"end_s\":%.3f,\"bytes\":%llu,\"mb_per_s\":%.3f,\"%s\":%lu}\n",
+                reporter->role, start_s, end_s, (unsigned long long)bytes, rate,
+                sender ? "retransmits" : "out_of_order", losses);
+        fflush(reporter->json);
+    }
+}
+
+/**
+ * Listener of the sampler: reports the interval that just ended if a
+ * transfer was in progress during it or bytes moved. The final call only
+ * reports the bytes moved since the last report, if any.
+ *
+ * @param arg Pointer to the Reporter
+ * @param elapsed_s Seconds since the reporter started
+ * @param retransmits Segments the connections retransmitted during the interval
+ * @param out_of_order Segments the connections received out of order during the interval
+ * @param last Whether the reporter is stopping
+ */
+static void report_interval(void *arg, double elapsed_s, unsigned long retransmits, unsigned long out_of_order,
+                            int last) {
+    Reporter *reporter = (Reporter *)arg;
+    unsigned long bytes = atomic_load_explicit(&reporter->bytes, memory_order_relaxed);
+    int active = atomic_load_explicit(&reporter->active, memory_order_relaxed) > 0;
+    unsigned long losses;
+    if (reporter->losses != NULL) {
+        unsigned long total = reporter->losses();
+        losses = total - reporter->last_losses;
+        reporter->last_losses = total;
+    } else {
+        losses = strcmp(reporter->role, "sender") == 0 ? retransmits : out_of_order;
+    }
+    // An idle interval only shows up if a transfer ended during it
+    if (bytes != reporter->last_bytes || (!last && (active || reporter->was_active))) {
+        print_interval(reporter, reporter->last_s, elapsed_s, bytes - reporter->last_bytes, losses);
+    }
+    reporter->last_s = elapsed_s;
+    reporter->last_bytes = bytes;
+    reporter->was_active = active;
+}
+
+/**
+ * Opens the JSON file, if any, and starts listening on the sampler, which
+ * is started without a CSV file if it is not running yet.
+ *
+ * @param reporter Reporter to start
+ * @param sampler Sampler of the data connections
+ * @param role "sender" or "receiver", picks the loss counter and labels the JSON
+ * @param interval_ms Period of the reports in milliseconds
+ * @param json_path File the reports are also written to as JSON lines, NULL for none
+ * @param losses Returns the retransmissions so far when TCP_INFO does not see them, NULL to use TCP_INFO
+ */
+void reporter_start(Reporter *reporter, TcpSampler *sampler, const char *role, int interval_ms,
+                    const char *json_path, unsigned long (*losses)(void)) {
+    memset(reporter, 0, sizeof(*reporter));
+    reporter->losses = losses;
+    if (json_path != NULL) {
+        reporter->json = fopen(json_path, "w");
+        if (reporter->json == NULL) {
+            perror("Error opening interval JSON file");
+            exit(EXIT_FAILURE);
+        }
+    }
+    reporter->sampler = sampler;
+    reporter->role = role;
+    reporter->last_losses = losses != NULL ? losses() : 0;
+    reporter->running = 1;
+    tcp_sampler_listen(sampler, interval_ms, report_interval, reporter);
+}
+
+/**
+ * Reports the bytes moved since the last report, stops listening on the
+ * sampler and closes the JSON file. The sampler keeps running until it is
+ * stopped itself.
+ *
+ * @param reporter Reporter to stop, ignored if it was never started
+ */
+void reporter_stop(Reporter *reporter) {
+    if (!reporter->running) {
+        return;
+    }
+    tcp_sampler_unlisten(reporter->sampler);
+    reporter->running = 0;
+    if (reporter->json != NULL) {
+        fclose(reporter->json);
+    }
+}
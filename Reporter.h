@@ -0,0 +1,76 @@
+#ifndef REPORTER_H
+#define REPORTER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "TcpInfo.h"
+
+#define REPORTER_DEFAULT_INTERVAL_MS 1000  // Default period of the interval reports
+
+/*
+ * iperf-style interval reports. The data path adds the bytes it moves to a
+ * counter with a relaxed atomic add and marks transfers as they begin and
+ * end; it makes no syscalls and prints nothing for the reports. The
+ * reporter listens on the TcpSampler, whose thread calls it every interval:
+ * it takes the difference of the counter and prints the bytes and goodput
+ * of the interval, with the retransmissions (sender) or out-of-order
+ * segments (receiver) the sampler counted on the connections meanwhile.
+ * Intervals are reported while a transfer is in progress, so a stall shows
+ * up as a row of zeros. With a JSON file every report is also written to it
+ * as one line of JSON.
+ */
+typedef struct {
+    TcpSampler *sampler;      // Sampler whose thread drives the reports
+    FILE *json;               // Newline-delimited JSON output, NULL for none
+    const char *role;         // "sender" or "receiver"
+    int running;
+    atomic_ulong bytes;       // Bytes moved so far, added to by the data path
+    atomic_int active;        // Transfers in progress
+    unsigned long (*losses)(void); // Source of the retransmissions instead of TCP_INFO, NULL for TCP_INFO
+    double last_s;            // End of the previous interval
+    unsigned long last_bytes; // Counter at the end of the previous interval
+    unsigned long last_losses; // losses() at the end of the previous interval
+    int was_active;           // Whether a transfer was in progress at the end of the previous interval
+} Reporter;
+
+void reporter_start(Reporter *reporter, TcpSampler *sampler, const char *role, int interval_ms,
+                    const char *json_path, unsigned long (*losses)(void));
+void reporter_stop(Reporter *reporter);
+
+/**
+ * Counts bytes moved by the data path: one relaxed atomic add.
+ *
+ * @param reporter Reporter, ignored if it was never started
+ * @param bytes Number of bytes
+ */
+static inline void reporter_count(Reporter *reporter, uint64_t bytes) {
+    if (reporter->running) {
+        atomic_fetch_add_explicit(&reporter->bytes, bytes, memory_order_relaxed);
+    }
+}
+
+/**
+ * Marks the start of a transfer; intervals are reported until it ends.
+ *
+ * @param reporter Reporter, ignored if it was never started
+ */
+static inline void reporter_begin(Reporter *reporter) {
+    if (reporter->running) {
+        atomic_fetch_add_explicit(&reporter->active, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * Marks the end of a transfer.
+ *
+ * @param reporter Reporter, ignored if it was never started
+ */
+static inline void reporter_end(Reporter *reporter) {
+    if (reporter->running) {
+        atomic_fetch_sub_explicit(&reporter->active, 1, memory_order_relaxed);
+    }
+}
+
+#endif // REPORTER_H
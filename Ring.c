@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "Ring.h"
+
+/**
+ * Sleeps until *word is no longer expected (or a spurious wakeup).
+ */
+static void futex_wait(atomic_uint *word, unsigned expected) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+/**
+ * Wakes the thread sleeping on word, if any.
+ */
+static void futex_wake(atomic_uint *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * Initializes an empty ring.
+ *
+ * @param ring Ring to initialize
+ * @param capacity Number of slots, rounded up to a power of two
+ * @return 0 on success, -1 if out of memory
+ */
+int ring_init(Ring *ring, unsigned capacity) {
+    unsigned size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    ring->slots = calloc(size, sizeof(void *));
+    if (ring->slots == NULL) {
+        return -1;
+    }
+    ring->capacity = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->producer_waiting, 0);
+    atomic_init(&ring->consumer_waiting, 0);
+    atomic_init(&ring->push_waits, 0);
+    atomic_init(&ring->pop_waits, 0);
+    return 0;
+}
+
+/**
+ * Releases the slots of a ring. The items are the caller's.
+ *
+ * @param ring Ring to release
+ */
+void ring_free(Ring *ring) {
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/**
+ * Appends an item, sleeping while the ring is full. Producer side only.
+ *
+ * @param ring Ring to push to
+ * @param item Item to append, may be NULL (e.g. as an end marker)
+ */
+void ring_push(Ring *ring, void *item) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head == ring->capacity) {
+        atomic_fetch_add_explicit(&ring->push_waits, 1, memory_order_relaxed);
+        while (tail - head == ring->capacity) {
+            // Announce the wait, then check again: the consumer either sees the flag or we see its pop
+            atomic_store(&ring->producer_waiting, 1);
+            head = atomic_load(&ring->head);
+            if (tail - head == ring->capacity) {
+                futex_wait(&ring->head, head);
+                head = atomic_load(&ring->head);
+            }
+            atomic_store(&ring->producer_waiting, 0);
+        }
+    }
+
+    ring->slots[tail & (ring->capacity - 1)] = item;
+    atomic_store(&ring->tail, tail + 1);
+    if (atomic_load(&ring->consumer_waiting)) {
+        futex_wake(&ring->tail);
+    }
+}
+
+/**
+ * Takes the oldest item if there is one, without sleeping. Consumer side only.
+ *
+ * @param ring Ring to pop from
+ * @param item Set to the item taken
+ * @return 1 if an item was taken, 0 if the ring is empty
+ */
+int ring_try_pop(Ring *ring, void **item) {
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == tail) {
+        return 0;
+    }
+    *item = ring->slots[head & (ring->capacity - 1)];
+    atomic_store(&ring->head, head + 1);
+    if (atomic_load(&ring->producer_waiting)) {
+        futex_wake(&ring->head);
+    }
+    return 1;
+}
+
+/**
+ * Takes the oldest item, sleeping while the ring is empty. Consumer side only.
+ *
+ * @param ring Ring to pop from
+ * @return The item
+ */
+void *ring_pop(Ring *ring) {
+    void *item;
+    if (ring_try_pop(ring, &item)) {
+        return item;
+    }
+    atomic_fetch_add_explicit(&ring->pop_waits, 1, memory_order_relaxed);
+    while (!ring_try_pop(ring, &item)) {
+        atomic_store(&ring->consumer_waiting, 1);
+        unsigned tail = atomic_load(&ring->tail);
+        if (tail == atomic_load_explicit(&ring->head, memory_order_relaxed)) {
+            futex_wait(&ring->tail, tail);
+        }
+        atomic_store(&ring->consumer_waiting, 0);
+    }
+    return item;
+}
+
+/**
+ * Returns the number of items in the ring; exact only for the producer or
+ * the consumer, a snapshot for anyone else.
+ *
+ * @param ring Ring to inspect
+ * @return Items in the ring
+ */
+unsigned ring_size(Ring *ring) {
+    return atomic_load(&ring->tail) - atomic_load(&ring->head);
+}
@@ -0,0 +1,32 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Lock-free single-producer/single-consumer ring of pointers. One thread
+ * pushes, one thread pops; neither takes a lock. A side that finds the ring
+ * full (or empty) sleeps on a futex until the other side moves, so a
+ * pipeline stage that is waiting costs no CPU. The wait counters tell which
+ * side of a pipeline is the bottleneck.
+ */
+typedef struct {
+    void **slots;
+    unsigned capacity;                  // Power of two
+    _Alignas(64) atomic_uint head;      // Slots popped so far, written by the consumer
+    atomic_int producer_waiting;        // Set while the producer sleeps on head
+    _Alignas(64) atomic_uint tail;      // Slots pushed so far, written by the producer
+    atomic_int consumer_waiting;        // Set while the consumer sleeps on tail
+    atomic_ulong push_waits;            // Times the producer found the ring full
+    atomic_ulong pop_waits;             // Times the consumer found the ring empty
+} Ring;
+
+int ring_init(Ring *ring, unsigned capacity);
+void ring_free(Ring *ring);
+void ring_push(Ring *ring, void *item);
+void *ring_pop(Ring *ring);
+int ring_try_pop(Ring *ring, void **item);
+unsigned ring_size(Ring *ring);
+
+#endif // RING_H
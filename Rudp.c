@@ -0,0 +1,1181 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include "Rudp.h"
+#include "Protocol.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 // Linux 4.18
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104     // Linux 5.0
+#endif
+
+#define RUDP_MASK (RUDP_WINDOW - 1)
+#define RUDP_TX_SLOTS (2 * RUDP_WINDOW)       // Transmissions remembered for loss detection, power of two
+#define RUDP_BATCH 32                         // Messages per sendmmsg() and recvmmsg()
+#define RUDP_GSO_SEGMENTS 32                  // Most datagrams one GSO send carries
+#define RUDP_GRO_BUFFER 65536                 // Receive buffer of a GRO batch entry
+#define RUDP_READ_SLOTS 64                    // Most datagrams filled by one readv() from the application
+#define RUDP_ACK_SIZE (RUDP_HEADER_SIZE + 4 + RUDP_WINDOW / 8) // ACK: header, window limit(4), SACK bitmap
+#define RUDP_MIN_CWND 16                      // Smallest congestion window, datagrams
+#define RUDP_REORDER 3                        // Later sends acknowledged before a datagram counts as lost
+#define RUDP_LOSS_LIMIT 0.2                   // Share of a round's datagrams lost that signals congestion
+#define RUDP_BW_ROUNDS 10                     // Rounds the delivery rate maximum is taken over
+#define RUDP_STARTUP_GAIN 2.89                // Pacing gain while the rate is still being found
+#define RUDP_MIN_RTT_WINDOW_NS 10000000000ULL // Lowest round trip time is taken over 10 s
+#define RUDP_INITIAL_RTO_NS 200000000ULL      // Retransmission timeout before the first round trip sample
+#define RUDP_MIN_RTO_NS 20000000ULL
+#define RUDP_MAX_RTO_NS 2000000000ULL
+#define RUDP_PACING_SLACK_NS 100000           // Sends may run this far ahead of the pacing schedule
+#define RUDP_ACK_INTERVAL_NS 100000000ULL     // ACK at least this often, carries lost window updates
+#define RUDP_LINGER_NS 200000000ULL           // Time a finished flow keeps acknowledging the peer's retransmissions
+#define RUDP_IDLE_NS 10000000000ULL           // A flow that hears nothing from its peer for this long is dropped
+#define RUDP_SYN_TRIES 10                     // Handshake attempts before giving up
+#define RUDP_RECENT_FLOWS 64                  // Handshakes the server remembers to answer repeated SYNs
+
+// Datagram types
+enum {
+    RUDP_SYN = 1, // Client -> server listener: open a flow, conn is the client's flow id
+    RUDP_SYNACK,  // Server listener -> client: payload port(2) of the flow's UDP socket
+    RUDP_DATA,    // seq, payload of the byte stream; time is the sender's clock in microseconds
+    RUDP_ACK      // seq is the next expected datagram, time echoes the newest DATA; payload limit(4) bitmap
+};
+#define RUDP_FLAG_FIN 0x1 // DATA: end of the byte stream, no payload
+
+// State of a datagram of the send window
+enum {
+    SLOT_FREE,     // Outside the window
+    SLOT_QUEUED,   // Filled, never sent
+    SLOT_INFLIGHT, // Sent, not acknowledged
+    SLOT_LOST,     // Sent, deemed lost, waiting for its retransmission
+    SLOT_SACKED    // Acknowledged by a SACK bit, not yet by the cumulative sequence number
+};
+
+// A datagram of the send window
+typedef struct {
+    uint64_t tx;      // Transmission number of its last send
+    uint16_t length;  // Payload length
+    uint8_t state;
+    uint8_t fin;
+} SendSlot;
+
+// One connection carried over UDP, both directions
+typedef struct {
+    int udp;                 // Connected UDP socket of the flow
+    int tcp;                 // Loopback TCP connection to the application
+    uint32_t conn;           // Flow id, chosen by the client
+    double loss;             // Share of DATA datagrams dropped on purpose to emulate a lossy path
+    unsigned seed;           // State of the loss generator
+    int gso, gro;            // UDP GSO and GRO in use
+    int failed;              // Peer unreachable, give up
+
+    // Send direction: seq snd_una <= snd_new <= snd_nxt
+    unsigned char *send_data; // RUDP_WINDOW datagrams of RUDP_DATAGRAM bytes, header first
+    SendSlot *send;
+    uint32_t snd_una;        // Oldest datagram not cumulatively acknowledged
+    uint32_t snd_new;        // Next datagram never sent
+    uint32_t snd_nxt;        // Next datagram to fill from the application
+    uint32_t peer_limit;     // First datagram the peer has no room for
+    uint32_t lost_scan;      // No lost datagram before this one
+    int inflight, lost;      // Datagrams in flight, datagrams waiting for a retransmission
+    uint64_t tx_next;        // Number of the next transmission, from 1
+    uint64_t tx_acked;       // Highest transmission acknowledged
+    uint64_t tx_checked;     // Transmissions up to here have been checked for loss
+    uint32_t *tx_seq;        // Datagram of each recent transmission, RUDP_TX_SLOTS entries
+    int app_eof;             // Application closed its side, FIN queued
+
+    // Congestion control
+    double cwnd;             // Congestion window, datagrams
+    double bw;               // Highest delivery rate of the last rounds, bytes per nanosecond
+    double bw_samples[RUDP_BW_ROUNDS];
+    int bw_index;
+    int startup;             // Still doubling to find the rate
+    double full_bw;          // Rate startup last grew to
+    int full_bw_rounds;      // Rounds startup has not grown the rate by 25%
+    int cycle;               // Phase of the pacing gain cycle
+    uint64_t min_rtt_ns, min_rtt_stamp_ns;
+    uint64_t srtt_ns, rttvar_ns, rto_ns;
+    uint64_t progress_ns;    // Last time the send window moved, or the first send into an empty one
+    uint64_t pace_ns;        // Time the pacing schedule allows the next send
+    uint64_t round_tx;       // A round ends when this transmission is acknowledged
+    uint64_t round_ns, round_bytes;
+    uint32_t round_packets, round_lost;
+    int app_limited;         // The round ran out of data to send, its rate says nothing about the path
+
+    // Receive direction: seq deliver <= rcv_nxt <= rcv_high
+    unsigned char *recv_data; // RUDP_WINDOW payloads of RUDP_MSS bytes
+    uint16_t *recv_length;
+    uint8_t *recv_state;     // 0 empty, 1 data, 2 FIN
+    uint32_t deliver;        // Next datagram to write to the application
+    size_t deliver_offset;   // Bytes of it already written
+    uint32_t rcv_nxt;        // Next datagram missing
+    uint32_t rcv_high;       // One past the highest datagram received
+    uint32_t limit_sent;     // Window limit of the last ACK
+    int peer_eof;            // Peer's FIN delivered to the application
+    int app_gone;            // Application closed, received data is dropped
+    int ack_pending;
+    uint32_t echo;           // Time of the newest DATA, echoed for round trip samples
+    uint64_t ack_ns;         // Time of the last ACK
+    uint64_t heard_ns;       // Time the peer was last heard from
+    unsigned char *batch;    // RUDP_BATCH receive buffers
+    size_t batch_size;       // Size of one receive buffer
+} Flow;
+
+// A handshake answered by the server listener
+typedef struct {
+    struct sockaddr_in peer;
+    uint32_t conn;
+    uint16_t port;           // Port of the flow's socket, 0 if the entry is unused
+} RecentFlow;
+
+static char *SERVER_IP;               // Client bridge: address of the server
+static int SERVER_PORT;               // Client bridge: port of the server, server bridge: port of the receiver
+static double LOSS = 0;               // Loss emulation of the flows of this process
+static int CLIENT_LISTENER = -1;      // Client bridge: loopback TCP listener the sender connects to
+static pthread_mutex_t FLOWS_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t FLOWS_DONE = PTHREAD_COND_INITIALIZER;
+static int ACTIVE_FLOWS = 0;          // Flows whose threads are running
+static atomic_ulong DATAGRAMS;        // DATA datagrams sent, retransmissions included
+static atomic_ulong RETRANSMITS;      // Of which retransmissions
+static atomic_ulong DROPPED;          // Of which dropped by the loss emulation
+static atomic_ulong ACKS;             // ACKs sent
+static atomic_ulong SEND_CALLS;       // sendmmsg() and send() calls
+static atomic_ulong RECEIVE_CALLS;    // recvmmsg() calls that returned datagrams
+static atomic_ulong TIMEOUTS;         // Retransmission timeouts
+static atomic_ulong FLOW_COUNT;       // Flows opened
+static _Atomic double SRTT_SUM_MS;    // Smoothed round trip time of the finished flows, summed
+static _Atomic double BW_SUM;         // Last delivery rate of the finished flows in bytes per second, summed
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ */
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Returns whether sequence number a comes before b, across the wrap.
+ */
+static int before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+/**
+ * Encodes a datagram header.
+ */
+static void put_header(unsigned char *out, int type, int flags, size_t length, uint32_t conn, uint32_t seq,
+                       uint32_t time) {
+    out[0] = type;
+    out[1] = flags;
+    out[2] = length >> 8;
+    out[3] = length & 0xFF;
+    put_u32(out + 4, conn);
+    put_u32(out + 8, seq);
+    put_u32(out + 12, time);
+}
+
+/**
+ * Returns a datagram of the send window.
+ */
+static unsigned char *send_datagram(Flow *flow, uint32_t seq) {
+    return flow->send_data + (size_t)(seq & RUDP_MASK) * RUDP_DATAGRAM;
+}
+
+/**
+ * Adds a double to an atomic accumulator.
+ */
+static void atomic_add_double(_Atomic double *sum, double value) {
+    double old = atomic_load(sum);
+    while (!atomic_compare_exchange_weak(sum, &old, old + value)) {
+    }
+}
+
+/**
+ * Allocates the state of a flow.
+ *
+ * @param udp Connected UDP socket
+ * @param tcp Loopback TCP connection to the application
+ * @param conn Flow id
+ * @return The flow
+ */
+static Flow *flow_create(int udp, int tcp, uint32_t conn) {
+    Flow *flow = calloc(1, sizeof(Flow));
+    if (flow == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    flow->udp = udp;
+    flow->tcp = tcp;
+    flow->conn = conn;
+    flow->loss = LOSS / 100;
+    flow->seed = conn;
+
+    // GSO cuts a batch of equal datagrams in the kernel, the loss emulation needs to see every datagram
+    int segment = 0;
+    socklen_t length = sizeof(segment);
+    flow->gso = flow->loss == 0 && getsockopt(udp, SOL_UDP, UDP_SEGMENT, &segment, &length) == 0;
+    int on = 1;
+    flow->gro = setsockopt(udp, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+    flow->batch_size = flow->gro ? RUDP_GRO_BUFFER : RUDP_DATAGRAM;
+    int buffer = 4 * 1024 * 1024; // Room for a window burst, best effort
+    setsockopt(udp, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+    setsockopt(udp, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    setsockopt(tcp, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    fcntl(tcp, F_SETFL, fcntl(tcp, F_GETFL) | O_NONBLOCK);
+
+    flow->send_data = malloc((size_t)RUDP_WINDOW * RUDP_DATAGRAM);
+    flow->send = calloc(RUDP_WINDOW, sizeof(SendSlot));
+    flow->tx_seq = calloc(RUDP_TX_SLOTS, sizeof(uint32_t));
+    flow->recv_data = malloc((size_t)RUDP_WINDOW * RUDP_MSS);
+    flow->recv_length = calloc(RUDP_WINDOW, sizeof(uint16_t));
+    flow->recv_state = calloc(RUDP_WINDOW, 1);
+    flow->batch = malloc(RUDP_BATCH * flow->batch_size);
+    if (flow->send_data == NULL || flow->send == NULL || flow->tx_seq == NULL || flow->recv_data == NULL ||
+        flow->recv_length == NULL || flow->recv_state == NULL || flow->batch == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t now = monotonic_ns();
+    flow->peer_limit = RUDP_WINDOW;
+    flow->limit_sent = RUDP_WINDOW;
+    flow->tx_next = 1;
+    flow->tx_checked = 1;
+    flow->cwnd = RUDP_MIN_CWND;
+    flow->startup = 1;
+    flow->rto_ns = RUDP_INITIAL_RTO_NS;
+    flow->min_rtt_ns = UINT64_MAX;
+    flow->round_tx = 1;
+    flow->round_ns = now;
+    flow->heard_ns = now;
+    flow->ack_ns = now;
+    return flow;
+}
+
+/**
+ * Releases a flow and closes its sockets.
+ */
+static void flow_free(Flow *flow) {
+    close(flow->udp);
+    close(flow->tcp);
+    free(flow->send_data);
+    free(flow->send);
+    free(flow->tx_seq);
+    free(flow->recv_data);
+    free(flow->recv_length);
+    free(flow->recv_state);
+    free(flow->batch);
+    free(flow);
+}
+
+/**
+ * Marks a datagram in flight as lost, to be retransmitted.
+ */
+static void mark_lost(Flow *flow, uint32_t seq) {
+    SendSlot *slot = &flow->send[seq & RUDP_MASK];
+    slot->state = SLOT_LOST;
+    flow->inflight--;
+    flow->lost++;
+    flow->round_lost++;
+    if (before(seq, flow->lost_scan)) {
+        flow->lost_scan = seq;
+    }
+}
+
+/**
+ * Fills the send window from the application, as far as the window and the
+ * peer's receive window allow. The end of the application's stream is
+ * queued as a FIN datagram.
+ */
+static void fill(Flow *flow) {
+    while (!flow->app_eof) {
+        uint32_t room = RUDP_WINDOW - (flow->snd_nxt - flow->snd_una);
+        uint32_t peer_room = before(flow->snd_nxt, flow->peer_limit) ? flow->peer_limit - flow->snd_nxt : 0;
+        room = room < peer_room ? room : peer_room;
+        if (room == 0) {
+            return;
+        }
+        int count = room < RUDP_READ_SLOTS ? room : RUDP_READ_SLOTS;
+        struct iovec iov[RUDP_READ_SLOTS];
+        for (int k = 0; k < count; k++) {
+            iov[k].iov_base = send_datagram(flow, flow->snd_nxt + k) + RUDP_HEADER_SIZE;
+            iov[k].iov_len = RUDP_MSS;
+        }
+        ssize_t bytes = readv(flow->tcp, iov, count);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (bytes <= 0) {
+            // End of the stream, or the application reset the connection
+            SendSlot *slot = &flow->send[flow->snd_nxt & RUDP_MASK];
+            *slot = (SendSlot){0, 0, SLOT_QUEUED, 1};
+            flow->snd_nxt++;
+            flow->app_eof = 1;
+            return;
+        }
+        while (bytes > 0) {
+            SendSlot *slot = &flow->send[flow->snd_nxt & RUDP_MASK];
+            *slot = (SendSlot){0, bytes < RUDP_MSS ? bytes : RUDP_MSS, SLOT_QUEUED, 0};
+            bytes -= slot->length;
+            flow->snd_nxt++;
+        }
+        if (flow->send[(flow->snd_nxt - 1) & RUDP_MASK].length < RUDP_MSS) {
+            return; // Drained what the application had written
+        }
+    }
+}
+
+/**
+ * Stamps a datagram for its next transmission: header, transmission
+ * number, flight accounting and the pacing schedule.
+ */
+static void stamp(Flow *flow, uint32_t seq, uint64_t now) {
+    SendSlot *slot = &flow->send[seq & RUDP_MASK];
+    if (slot->state == SLOT_LOST) {
+        flow->lost--;
+        atomic_fetch_add(&RETRANSMITS, 1);
+    }
+    if (flow->inflight == 0) {
+        // Sending again after an idle spell: the idle time belongs to no round
+        flow->progress_ns = now;
+        flow->pace_ns = now;
+        flow->round_tx = flow->tx_next;
+        flow->round_ns = now;
+        flow->round_bytes = 0;
+        flow->round_packets = 0;
+        flow->round_lost = 0;
+        flow->app_limited = 0;
+    }
+    slot->state = SLOT_INFLIGHT;
+    slot->tx = flow->tx_next++;
+    flow->tx_seq[slot->tx & (RUDP_TX_SLOTS - 1)] = seq;
+    flow->inflight++;
+    put_header(send_datagram(flow, seq), RUDP_DATA, slot->fin ? RUDP_FLAG_FIN : 0, slot->length, flow->conn, seq,
+               (uint32_t)(now / 1000));
+
+    if (flow->bw > 0) {
+        static const double gains[8] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+        double rate = flow->bw * (flow->startup ? RUDP_STARTUP_GAIN : gains[flow->cycle]);
+        if (flow->pace_ns + RUDP_PACING_SLACK_NS < now) {
+            flow->pace_ns = now - RUDP_PACING_SLACK_NS; // An idle flow does not bank a burst
+        }
+        flow->pace_ns += (RUDP_HEADER_SIZE + slot->length) / rate;
+    }
+}
+
+/**
+ * Sends what the congestion window and the pacing schedule allow:
+ * retransmissions first, then new datagrams. Runs of full new datagrams go
+ * out as one GSO message; all messages of a round go in one sendmmsg().
+ * Messages the kernel refuses are marked lost and retransmitted.
+ *
+ * @param flow Flow to send on
+ * @param now Current time
+ */
+static void transmit(Flow *flow, uint64_t now) {
+    struct mmsghdr messages[RUDP_BATCH];
+    struct iovec iov[RUDP_BATCH];
+    char controls[RUDP_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+    uint32_t first[RUDP_BATCH];
+    int runs[RUDP_BATCH];
+
+    while (!flow->failed) {
+        int count = 0;
+        while (count < RUDP_BATCH && flow->inflight < (int)flow->cwnd && flow->pace_ns <= now + RUDP_PACING_SLACK_NS) {
+            uint32_t seq;
+            int run = 1;
+            if (flow->lost > 0) {
+                if (before(flow->lost_scan, flow->snd_una)) {
+                    flow->lost_scan = flow->snd_una;
+                }
+                while (before(flow->lost_scan, flow->snd_new) && flow->send[flow->lost_scan & RUDP_MASK].state != SLOT_LOST) {
+                    flow->lost_scan++;
+                }
+                if (!before(flow->lost_scan, flow->snd_new)) {
+                    flow->lost = 0; // Every datagram marked lost has been acknowledged since
+                    continue;
+                }
+                seq = flow->lost_scan;
+            } else if (flow->snd_new != flow->snd_nxt) {
+                seq = flow->snd_new;
+                // A GSO run: consecutive full datagrams, contiguous in the window, the last one may be short
+                while (flow->gso && run < RUDP_GSO_SEGMENTS && flow->snd_new + run != flow->snd_nxt &&
+                       ((seq + run) & RUDP_MASK) != 0 && flow->send[(seq + run - 1) & RUDP_MASK].length == RUDP_MSS &&
+                       !flow->send[(seq + run - 1) & RUDP_MASK].fin && flow->inflight + run < (int)flow->cwnd) {
+                    run++;
+                }
+                flow->snd_new += run;
+            } else {
+                flow->app_limited = 1;
+                break;
+            }
+
+            size_t bytes = 0;
+            for (int k = 0; k < run; k++) {
+                stamp(flow, seq + k, now);
+                bytes += RUDP_HEADER_SIZE + flow->send[(seq + k) & RUDP_MASK].length;
+            }
+            atomic_fetch_add(&DATAGRAMS, run);
+            if (flow->loss > 0 && rand_r(&flow->seed) < flow->loss * ((double)RAND_MAX + 1)) {
+                atomic_fetch_add(&DROPPED, 1); // Run is 1 with the loss emulation
+                continue;
+            }
+
+            struct msghdr *msg = &messages[count].msg_hdr;
+            memset(msg, 0, sizeof(*msg));
+            iov[count].iov_base = send_datagram(flow, seq);
+            iov[count].iov_len = bytes;
+            msg->msg_iov = &iov[count];
+            msg->msg_iovlen = 1;
+            if (run > 1) {
+                msg->msg_control = controls[count];
+                msg->msg_controllen = sizeof(controls[count]);
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                *(uint16_t *)CMSG_DATA(cmsg) = RUDP_DATAGRAM;
+            }
+            first[count] = seq;
+            runs[count] = run;
+            count++;
+        }
+        if (count == 0) {
+            return;
+        }
+
+        int done = 0;
+        while (done < count) {
+            int sent = sendmmsg(flow->udp, messages + done, count - done, 0);
+            atomic_fetch_add(&SEND_CALLS, 1);
+            if (sent > 0) {
+                done += sent;
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ECONNREFUSED) {
+                flow->failed = 1; // Nobody listens on the peer's port anymore
+            } else if (runs[done] > 1 && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP)) {
+                flow->gso = 0; // No GSO on this path after all, the run is retransmitted datagram by datagram
+            } else if (errno != ENOBUFS && errno != EAGAIN && errno != EPERM) {
+                perror("sendmmsg");
+                exit(EXIT_FAILURE);
+            }
+            // Whatever was refused is lost like on the wire
+            for (int k = 0; k < runs[done]; k++) {
+                if (flow->send[(first[done] + k) & RUDP_MASK].state == SLOT_INFLIGHT) {
+                    mark_lost(flow, first[done] + k);
+                }
+            }
+            done++;
+        }
+    }
+}
+
+/**
+ * Acknowledges the receive direction: the next datagram missing, the
+ * receive window and a SACK bitmap of the datagrams received beyond it.
+ */
+static void send_ack(Flow *flow, uint64_t now) {
+    unsigned char ack[RUDP_ACK_SIZE];
+    uint32_t bits = before(flow->rcv_nxt + 1, flow->rcv_high) ? flow->rcv_high - flow->rcv_nxt - 1 : 0;
+    size_t bytes = (bits + 7) / 8;
+    memset(ack + RUDP_HEADER_SIZE + 4, 0, bytes);
+    for (uint32_t i = 0; i < bits; i++) {
+        if (flow->recv_state[(flow->rcv_nxt + 1 + i) & RUDP_MASK]) {
+            ack[RUDP_HEADER_SIZE + 4 + i / 8] |= 1 << (i % 8);
+        }
+    }
+    flow->limit_sent = flow->deliver + RUDP_WINDOW;
+    put_header(ack, RUDP_ACK, 0, 4 + bytes, flow->conn, flow->rcv_nxt, flow->echo);
+    put_u32(ack + RUDP_HEADER_SIZE, flow->limit_sent);
+    if (send(flow->udp, ack, RUDP_HEADER_SIZE + 4 + bytes, 0) < 0 && errno == ECONNREFUSED) {
+        flow->failed = 1;
+    }
+    atomic_fetch_add(&ACKS, 1);
+    atomic_fetch_add(&SEND_CALLS, 1);
+    flow->ack_pending = 0;
+    flow->ack_ns = now;
+}
+
+/**
+ * Takes a datagram of the send window as acknowledged.
+ *
+ * @return Its payload bytes if it was not acknowledged before, -1 otherwise
+ */
+static long acknowledge(Flow *flow, uint32_t seq, int state) {
+    SendSlot *slot = &flow->send[seq & RUDP_MASK];
+    int old = slot->state;
+    slot->state = state;
+    if (old != SLOT_INFLIGHT && old != SLOT_LOST) {
+        return -1;
+    }
+    if (old == SLOT_INFLIGHT) {
+        flow->inflight--;
+    } else {
+        flow->lost--;
+    }
+    if (slot->tx > flow->tx_acked) {
+        flow->tx_acked = slot->tx;
+    }
+    return slot->length;
+}
+
+/**
+ * Updates the rate model with the datagrams an ACK newly acknowledged and
+ * sets the congestion window from it.
+ */
+static void update_model(Flow *flow, uint64_t bytes, uint32_t packets, uint64_t now) {
+    flow->round_bytes += bytes;
+    flow->round_packets += packets;
+    if (flow->tx_acked >= flow->round_tx) {
+        // A round trip has passed: take its delivery rate
+        uint64_t elapsed = now - flow->round_ns;
+        double sample = elapsed > 0 ? (double)flow->round_bytes / elapsed : 0;
+        if (!flow->app_limited || sample > flow->bw) {
+            flow->bw_samples[flow->bw_index++ % RUDP_BW_ROUNDS] = sample;
+        }
+        flow->bw = 0;
+        for (int k = 0; k < RUDP_BW_ROUNDS; k++) {
+            flow->bw = flow->bw_samples[k] > flow->bw ? flow->bw_samples[k] : flow->bw;
+        }
+        if (flow->round_lost >= 4 && flow->round_lost > RUDP_LOSS_LIMIT * (flow->round_packets + flow->round_lost)) {
+            // Congestion rather than random loss: back off
+            for (int k = 0; k < RUDP_BW_ROUNDS; k++) {
+                flow->bw_samples[k] *= 0.7;
+            }
+            flow->bw *= 0.7;
+            flow->cwnd *= 0.7;
+            flow->startup = 0;
+        } else if (flow->startup) {
+            if (flow->bw >= flow->full_bw * 1.25) {
+                flow->full_bw = flow->bw;
+                flow->full_bw_rounds = 0;
+            } else if (++flow->full_bw_rounds >= 3) {
+                flow->startup = 0;
+            }
+        } else {
+            flow->cycle = (flow->cycle + 1) % 8;
+        }
+        flow->round_tx = flow->tx_next;
+        flow->round_ns = now;
+        flow->round_bytes = 0;
+        flow->round_packets = 0;
+        flow->round_lost = 0;
+        flow->app_limited = 0;
+    }
+
+    double target = flow->min_rtt_ns != UINT64_MAX ? 2 * flow->bw * flow->min_rtt_ns / RUDP_MSS + 4 : 0;
+    if (flow->startup) {
+        flow->cwnd += packets;
+    } else if (flow->cwnd < target) {
+        flow->cwnd = flow->cwnd + packets < target ? flow->cwnd + packets : target;
+    } else {
+        flow->cwnd = target;
+    }
+    flow->cwnd = flow->cwnd < RUDP_MIN_CWND ? RUDP_MIN_CWND : flow->cwnd;
+    flow->cwnd = flow->cwnd > RUDP_WINDOW ? RUDP_WINDOW : flow->cwnd;
+}
+
+/**
+ * Handles an ACK: round trip sample, cumulative and selective
+ * acknowledgements, the peer's window and loss detection.
+ */
+static void on_ack(Flow *flow, const unsigned char *packet, size_t length, uint64_t now) {
+    if (length < RUDP_HEADER_SIZE + 4) {
+        return;
+    }
+    uint32_t cum = get_u32(packet + 8);
+    if (before(cum, flow->snd_una) || before(flow->snd_new, cum)) {
+        return; // Older than what is known, or acknowledges what was never sent
+    }
+    uint32_t limit = get_u32(packet + RUDP_HEADER_SIZE);
+    if (before(flow->peer_limit, limit)) {
+        flow->peer_limit = limit;
+    }
+
+    uint64_t bytes = 0;
+    uint32_t packets = 0;
+    for (; flow->snd_una != cum; flow->snd_una++) {
+        long acked = acknowledge(flow, flow->snd_una, SLOT_FREE);
+        if (acked >= 0) {
+            bytes += acked;
+            packets++;
+        }
+    }
+    const unsigned char *bitmap = packet + RUDP_HEADER_SIZE + 4;
+    size_t bits = (length - RUDP_HEADER_SIZE - 4) * 8;
+    for (size_t i = 0; i < bits && before(cum + 1 + i, flow->snd_new); i++) {
+        if (bitmap[i / 8] & (1 << (i % 8))) {
+            long acked = acknowledge(flow, cum + 1 + i, SLOT_SACKED);
+            if (acked >= 0) {
+                bytes += acked;
+                packets++;
+            }
+        }
+    }
+    // Round trip sample from the echoed time, if the ACK answers new data rather than a timer
+    uint64_t rtt = ((uint32_t)(now / 1000) - get_u32(packet + 12)) * 1000ULL;
+    if (packets > 0 && rtt < RUDP_MAX_RTO_NS) {
+        if (flow->srtt_ns == 0) {
+            flow->srtt_ns = rtt;
+            flow->rttvar_ns = rtt / 2;
+        } else {
+            uint64_t delta = rtt > flow->srtt_ns ? rtt - flow->srtt_ns : flow->srtt_ns - rtt;
+            flow->rttvar_ns = (3 * flow->rttvar_ns + delta) / 4;
+            flow->srtt_ns = (7 * flow->srtt_ns + rtt) / 8;
+        }
+        if (rtt < flow->min_rtt_ns || now - flow->min_rtt_stamp_ns > RUDP_MIN_RTT_WINDOW_NS) {
+            flow->min_rtt_ns = rtt > 0 ? rtt : 1000;
+            flow->min_rtt_stamp_ns = now;
+        }
+    }
+    if (packets > 0) {
+        flow->progress_ns = now;
+        uint64_t rto = flow->srtt_ns + 4 * flow->rttvar_ns;
+        flow->rto_ns = rto < RUDP_MIN_RTO_NS ? RUDP_MIN_RTO_NS : rto > RUDP_MAX_RTO_NS ? RUDP_MAX_RTO_NS : rto;
+    }
+
+    // Lost: still in flight although RUDP_REORDER later transmissions made it
+    for (; flow->tx_checked + RUDP_REORDER <= flow->tx_acked; flow->tx_checked++) {
+        uint32_t seq = flow->tx_seq[flow->tx_checked & (RUDP_TX_SLOTS - 1)];
+        SendSlot *slot = &flow->send[seq & RUDP_MASK];
+        if (!before(seq, flow->snd_una) && before(seq, flow->snd_new) && slot->tx == flow->tx_checked &&
+            slot->state == SLOT_INFLIGHT) {
+            mark_lost(flow, seq);
+        }
+    }
+    update_model(flow, bytes, packets, now);
+}
+
+/**
+ * Handles a DATA datagram: stores it in the receive window if it is new and
+ * fits, and moves the next missing sequence number past it.
+ */
+static void on_data(Flow *flow, const unsigned char *packet, size_t length) {
+    size_t payload = ((size_t)packet[2] << 8) | packet[3];
+    if (length != RUDP_HEADER_SIZE + payload || payload > RUDP_MSS) {
+        return;
+    }
+    uint32_t seq = get_u32(packet + 8);
+    flow->echo = get_u32(packet + 12);
+    flow->ack_pending = 1;
+    if (before(seq, flow->rcv_nxt) || seq - flow->deliver >= RUDP_WINDOW || flow->recv_state[seq & RUDP_MASK]) {
+        return; // Duplicate, or beyond the window
+    }
+    memcpy(flow->recv_data + (size_t)(seq & RUDP_MASK) * RUDP_MSS, packet + RUDP_HEADER_SIZE, payload);
+    flow->recv_length[seq & RUDP_MASK] = payload;
+    flow->recv_state[seq & RUDP_MASK] = (packet[1] & RUDP_FLAG_FIN) ? 2 : 1;
+    if (!before(seq, flow->rcv_high)) {
+        flow->rcv_high = seq + 1;
+    }
+    while (flow->rcv_nxt - flow->deliver < RUDP_WINDOW && flow->recv_state[flow->rcv_nxt & RUDP_MASK]) {
+        flow->rcv_nxt++;
+    }
+}
+
+/**
+ * Receives every datagram waiting on the flow's socket, in batches of
+ * RUDP_BATCH with recvmmsg(). A GRO batch entry holds several datagrams of
+ * the size in its UDP_GRO control message.
+ */
+static void receive(Flow *flow, uint64_t now) {
+    struct mmsghdr messages[RUDP_BATCH];
+    struct iovec iov[RUDP_BATCH];
+    char controls[RUDP_BATCH][CMSG_SPACE(sizeof(int))];
+
+    while (1) {
+        memset(messages, 0, sizeof(messages));
+        for (int k = 0; k < RUDP_BATCH; k++) {
+            iov[k].iov_base = flow->batch + k * flow->batch_size;
+            iov[k].iov_len = flow->batch_size;
+            messages[k].msg_hdr.msg_iov = &iov[k];
+            messages[k].msg_hdr.msg_iovlen = 1;
+            messages[k].msg_hdr.msg_control = controls[k];
+            messages[k].msg_hdr.msg_controllen = sizeof(controls[k]);
+        }
+        int count = recvmmsg(flow->udp, messages, RUDP_BATCH, MSG_DONTWAIT, NULL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ECONNREFUSED) {
+                flow->failed = 1;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("recvmmsg");
+                exit(EXIT_FAILURE);
+            }
+            return;
+        }
+        atomic_fetch_add(&RECEIVE_CALLS, 1);
+        flow->heard_ns = now;
+
+        for (int k = 0; k < count; k++) {
+            size_t total = messages[k].msg_len;
+            size_t segment = total;
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&messages[k].msg_hdr); cmsg != NULL;
+                 cmsg = CMSG_NXTHDR(&messages[k].msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    segment = *(int *)CMSG_DATA(cmsg);
+                }
+            }
+            const unsigned char *data = iov[k].iov_base;
+            for (size_t offset = 0; offset < total; offset += segment) {
+                size_t length = total - offset < segment ? total - offset : segment;
+                const unsigned char *packet = data + offset;
+                if (length < RUDP_HEADER_SIZE || get_u32(packet + 4) != flow->conn) {
+                    continue;
+                }
+                if (packet[0] == RUDP_DATA) {
+                    on_data(flow, packet, length);
+                } else if (packet[0] == RUDP_ACK) {
+                    on_ack(flow, packet, length, now);
+                }
+            }
+        }
+        if (count < RUDP_BATCH) {
+            return;
+        }
+    }
+}
+
+/**
+ * Writes the received datagrams that are in order to the application. The
+ * peer's FIN shuts down the application's receive side.
+ */
+static void deliver(Flow *flow) {
+    while (flow->deliver != flow->rcv_nxt) {
+        uint32_t index = flow->deliver & RUDP_MASK;
+        if (flow->recv_state[index] == 2 || flow->app_gone) {
+            if (flow->recv_state[index] == 2) {
+                shutdown(flow->tcp, SHUT_WR);
+                flow->peer_eof = 1;
+            }
+            flow->recv_state[index] = 0;
+            flow->deliver++;
+            flow->deliver_offset = 0;
+            continue;
+        }
+
+        struct iovec iov[RUDP_READ_SLOTS];
+        int count = 0;
+        for (uint32_t seq = flow->deliver; seq != flow->rcv_nxt && count < RUDP_READ_SLOTS; seq++) {
+            uint32_t slot = seq & RUDP_MASK;
+            if (flow->recv_state[slot] != 1) {
+                break;
+            }
+            size_t skip = count == 0 ? flow->deliver_offset : 0;
+            iov[count].iov_base = flow->recv_data + (size_t)slot * RUDP_MSS + skip;
+            iov[count].iov_len = flow->recv_length[slot] - skip;
+            count++;
+        }
+        struct msghdr msg = {0};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t written = sendmsg(flow->tcp, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            flow->app_gone = 1; // The application closed, drop what is left
+            continue;
+        }
+        for (int k = 0; k < count && written > 0; k++) {
+            if ((size_t)written < iov[k].iov_len) {
+                flow->deliver_offset += written;
+                break;
+            }
+            written -= iov[k].iov_len;
+            flow->recv_state[flow->deliver & RUDP_MASK] = 0;
+            flow->deliver++;
+            flow->deliver_offset = 0;
+        }
+    }
+}
+
+/**
+ * Retransmission timeout: nothing was acknowledged for rto_ns with
+ * datagrams in flight. All of them are taken as lost and the window starts
+ * over from the minimum.
+ */
+static void check_timeout(Flow *flow, uint64_t now) {
+    if (flow->inflight == 0 || now - flow->progress_ns < flow->rto_ns) {
+        return;
+    }
+    for (uint32_t seq = flow->snd_una; seq != flow->snd_new; seq++) {
+        if (flow->send[seq & RUDP_MASK].state == SLOT_INFLIGHT) {
+            mark_lost(flow, seq);
+        }
+    }
+    atomic_fetch_add(&TIMEOUTS, 1);
+    flow->rto_ns = flow->rto_ns * 2 < RUDP_MAX_RTO_NS ? flow->rto_ns * 2 : RUDP_MAX_RTO_NS;
+    flow->cwnd = RUDP_MIN_CWND;
+    flow->startup = 1;
+    flow->full_bw = 0;
+    flow->full_bw_rounds = 0;
+    flow->tx_checked = flow->tx_next;
+    flow->progress_ns = now;
+}
+
+/**
+ * Event loop of a flow: moves data between the application's TCP
+ * connection and the peer until both directions have ended and the peer
+ * has acknowledged everything, then lingers to acknowledge retransmissions
+ * of the peer's last datagrams.
+ *
+ * @param arg The flow
+ */
+static void *flow_run(void *arg) {
+    Flow *flow = arg;
+    uint64_t finished_ns = 0;
+    while (!flow->failed) {
+        uint64_t now = monotonic_ns();
+        if (now - flow->heard_ns > RUDP_IDLE_NS) {
+            fprintf(stderr, "RUDP flow %08x: peer silent for %llu s, dropped\n", flow->conn,
+                    RUDP_IDLE_NS / 1000000000ULL);
+            break;
+        }
+        int done = flow->app_eof && flow->snd_una == flow->snd_nxt && (flow->peer_eof || flow->app_gone);
+        if (done && finished_ns == 0) {
+            finished_ns = now;
+        }
+        if (done && now - finished_ns > RUDP_LINGER_NS) {
+            break;
+        }
+
+        fill(flow);
+        transmit(flow, now);
+
+        struct pollfd fds[2] = {{flow->udp, POLLIN, 0}, {flow->tcp, 0, 0}};
+        if (!flow->app_eof && flow->snd_nxt - flow->snd_una < RUDP_WINDOW && before(flow->snd_nxt, flow->peer_limit)) {
+            fds[1].events |= POLLIN;
+        }
+        if (flow->deliver != flow->rcv_nxt && !flow->app_gone) {
+            fds[1].events |= POLLOUT;
+        }
+        // Sleep until the next event: a datagram, the application, the pacing schedule or a timer
+        uint64_t wait = RUDP_ACK_INTERVAL_NS - (now - flow->ack_ns < RUDP_ACK_INTERVAL_NS ? now - flow->ack_ns : RUDP_ACK_INTERVAL_NS);
+        if (flow->inflight > 0) {
+            uint64_t timeout = flow->progress_ns + flow->rto_ns > now ? flow->progress_ns + flow->rto_ns - now : 0;
+            wait = timeout < wait ? timeout : wait;
+        }
+        if ((flow->lost > 0 || flow->snd_new != flow->snd_nxt) && flow->inflight < (int)flow->cwnd) {
+            uint64_t pace = flow->pace_ns > now + RUDP_PACING_SLACK_NS ? flow->pace_ns - now - RUDP_PACING_SLACK_NS : 0;
+            wait = pace < wait ? pace : wait;
+        }
+        struct timespec timeout = {wait / 1000000000, wait % 1000000000};
+        if (ppoll(fds, fds[1].events ? 2 : 1, &timeout, NULL) < 0 && errno != EINTR) {
+            perror("ppoll");
+            exit(EXIT_FAILURE);
+        }
+
+        now = monotonic_ns();
+        receive(flow, now);
+        deliver(flow);
+        if (flow->ack_pending || now - flow->ack_ns >= RUDP_ACK_INTERVAL_NS ||
+            flow->deliver + RUDP_WINDOW - flow->limit_sent >= RUDP_WINDOW / 4) {
+            send_ack(flow, now);
+        }
+        check_timeout(flow, now);
+    }
+
+    atomic_add_double(&SRTT_SUM_MS, flow->srtt_ns / 1e6);
+    atomic_add_double(&BW_SUM, flow->bw * 1e9);
+    flow_free(flow);
+    pthread_mutex_lock(&FLOWS_LOCK);
+    ACTIVE_FLOWS--;
+    pthread_cond_broadcast(&FLOWS_DONE);
+    pthread_mutex_unlock(&FLOWS_LOCK);
+    return NULL;
+}
+
+/**
+ * Starts the thread of a flow.
+ */
+static void flow_start(int udp, int tcp, uint32_t conn) {
+    Flow *flow = flow_create(udp, tcp, conn);
+    pthread_t thread;
+    pthread_mutex_lock(&FLOWS_LOCK);
+    ACTIVE_FLOWS++;
+    pthread_mutex_unlock(&FLOWS_LOCK);
+    atomic_fetch_add(&FLOW_COUNT, 1);
+    if (pthread_create(&thread, NULL, flow_run, flow) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+}
+
+/**
+ * Opens a flow to the server for a connection of the application: sends
+ * SYNs to the server's listener until it answers with the port of the
+ * flow's socket.
+ *
+ * @param tcp Connection accepted from the application
+ */
+static void client_handshake(int tcp) {
+    struct sockaddr_in server = {0};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(SERVER_PORT);
+    inet_pton(AF_INET, SERVER_IP, &server.sin_addr);
+    int udp = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp < 0 || connect(udp, (struct sockaddr *)&server, sizeof(server)) < 0) {
+        perror("RUDP socket");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t conn = (uint32_t)(monotonic_ns() ^ ((uint64_t)getpid() << 16)) ^ (uint32_t)atomic_load(&FLOW_COUNT);
+
+    unsigned char packet[RUDP_HEADER_SIZE + 2];
+    for (int attempt = 0; attempt < RUDP_SYN_TRIES; attempt++) {
+        put_header(packet, RUDP_SYN, 0, 0, conn, 0, 0);
+        send(udp, packet, RUDP_HEADER_SIZE, 0);
+        struct pollfd pfd = {udp, POLLIN, 0};
+        if (poll(&pfd, 1, 200 * (attempt + 1)) <= 0) {
+            continue;
+        }
+        ssize_t length = recv(udp, packet, sizeof(packet), 0);
+        if (length == RUDP_HEADER_SIZE + 2 && packet[0] == RUDP_SYNACK && get_u32(packet + 4) == conn) {
+            server.sin_port = htons(((uint16_t)packet[RUDP_HEADER_SIZE] << 8) | packet[RUDP_HEADER_SIZE + 1]);
+            if (connect(udp, (struct sockaddr *)&server, sizeof(server)) < 0) {
+                perror("RUDP connect");
+                exit(EXIT_FAILURE);
+            }
+            fcntl(udp, F_SETFL, fcntl(udp, F_GETFL) | O_NONBLOCK);
+            flow_start(udp, tcp, conn);
+            return;
+        }
+    }
+    fprintf(stderr, "RUDP handshake with %s:%d failed\n", SERVER_IP, SERVER_PORT);
+    close(udp);
+    close(tcp); // The application sees the connection end
+}
+
+/**
+ * Client bridge thread: accepts the application's connections on the
+ * loopback listener and opens a flow for each.
+ */
+static void *client_accept(void *arg) {
+    (void)arg;
+    while (1) {
+        int tcp = accept(CLIENT_LISTENER, NULL, NULL);
+        if (tcp < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("RUDP accept");
+            exit(EXIT_FAILURE);
+        }
+        client_handshake(tcp);
+    }
+    return NULL;
+}
+
+/**
+ * Starts the client bridge: a loopback TCP listener whose connections are
+ * carried to the server over UDP.
+ *
+ * @param ip Address of the server
+ * @param port UDP port of the server's listener
+ * @param loss_percent Share of DATA datagrams to drop, to emulate a lossy path
+ * @return Loopback TCP port for the application to connect to
+ */
+int rudp_client_start(const char *ip, int port, double loss_percent) {
+    SERVER_IP = strdup(ip);
+    SERVER_PORT = port;
+    LOSS = loss_percent;
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    CLIENT_LISTENER = socket(AF_INET, SOCK_STREAM, 0);
+    if (CLIENT_LISTENER < 0 || bind(CLIENT_LISTENER, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(CLIENT_LISTENER, MAX_STREAMS) < 0 ||
+        getsockname(CLIENT_LISTENER, (struct sockaddr *)&address, &length) < 0) {
+        perror("RUDP listener");
+        exit(EXIT_FAILURE);
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, client_accept, NULL) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+    return ntohs(address.sin_port);
+}
+
+/**
+ * Server bridge thread: answers SYNs on the listener. A new flow gets its
+ * own UDP socket connected to the client and a loopback TCP connection to
+ * the application; a repeated SYN, whose SYNACK was lost, gets the same
+ * answer again.
+ *
+ * @param arg Listener socket
+ */
+static void *server_accept(void *arg) {
+    int listener = (int)(intptr_t)arg;
+    RecentFlow recent[RUDP_RECENT_FLOWS] = {0};
+    int next = 0;
+    while (1) {
+        unsigned char packet[RUDP_DATAGRAM];
+        struct sockaddr_in peer;
+        socklen_t peer_length = sizeof(peer);
+        ssize_t length = recvfrom(listener, packet, sizeof(packet), 0, (struct sockaddr *)&peer, &peer_length);
+        if (length < RUDP_HEADER_SIZE || packet[0] != RUDP_SYN) {
+            continue; // Errors from old peers and strays
+        }
+        uint32_t conn = get_u32(packet + 4);
+
+        RecentFlow *flow = NULL;
+        for (int k = 0; k < RUDP_RECENT_FLOWS; k++) {
+            if (recent[k].port != 0 && recent[k].conn == conn && recent[k].peer.sin_port == peer.sin_port &&
+                recent[k].peer.sin_addr.s_addr == peer.sin_addr.s_addr) {
+                flow = &recent[k];
+            }
+        }
+        if (flow == NULL) {
+            struct sockaddr_in address = {0};
+            address.sin_family = AF_INET;
+            socklen_t address_length = sizeof(address);
+            int udp = socket(AF_INET, SOCK_DGRAM, 0);
+            if (udp < 0 || bind(udp, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+                connect(udp, (struct sockaddr *)&peer, sizeof(peer)) < 0 ||
+                getsockname(udp, (struct sockaddr *)&address, &address_length) < 0) {
+                perror("RUDP flow socket");
+                exit(EXIT_FAILURE);
+            }
+            fcntl(udp, F_SETFL, fcntl(udp, F_GETFL) | O_NONBLOCK);
+
+            struct sockaddr_in local = {0};
+            local.sin_family = AF_INET;
+            local.sin_port = htons(SERVER_PORT);
+            local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int tcp = socket(AF_INET, SOCK_STREAM, 0);
+            if (tcp < 0 || connect(tcp, (struct sockaddr *)&local, sizeof(local)) < 0) {
+                perror("RUDP connect to the receiver");
+                close(udp);
+                if (tcp >= 0) {
+                    close(tcp);
+                }
+                continue;
+            }
+            flow_start(udp, tcp, conn);
+            flow = &recent[next];
+            next = (next + 1) % RUDP_RECENT_FLOWS;
+            *flow = (RecentFlow){peer, conn, ntohs(address.sin_port)};
+        }
+
+        put_header(packet, RUDP_SYNACK, 0, 2, conn, 0, 0);
+        packet[RUDP_HEADER_SIZE] = flow->port >> 8;
+        packet[RUDP_HEADER_SIZE + 1] = flow->port & 0xFF;
+        sendto(listener, packet, RUDP_HEADER_SIZE + 2, 0, (struct sockaddr *)&peer, sizeof(peer));
+    }
+    return NULL;
+}
+
+/**
+ * Starts the server bridge: a UDP listener whose flows are carried to the
+ * application's TCP listener on the same port number of the loopback
+ * interface.
+ *
+ * @param port UDP port to listen on, and the application's TCP port
+ * @param loss_percent Share of DATA datagrams to drop, to emulate a lossy path
+ */
+void rudp_server_start(int port, double loss_percent) {
+    SERVER_PORT = port;
+    LOSS = loss_percent;
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    int listener = socket(AF_INET, SOCK_DGRAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("RUDP listener");
+        exit(EXIT_FAILURE);
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, server_accept, (void *)(intptr_t)listener) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+}
+
+/**
+ * Waits for the flows of this process to deliver their last datagrams,
+ * which the kernel would do for a closed TCP socket.
+ *
+ * @param timeout_ms Longest wait
+ * @return 0 if all flows finished, -1 on timeout
+ */
+int rudp_wait(int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    int result = 0;
+    pthread_mutex_lock(&FLOWS_LOCK);
+    while (ACTIVE_FLOWS > 0 && result == 0) {
+        result = pthread_cond_timedwait(&FLOWS_DONE, &FLOWS_LOCK, &deadline);
+    }
+    int left = ACTIVE_FLOWS;
+    pthread_mutex_unlock(&FLOWS_LOCK);
+    return left > 0 ? -1 : 0;
+}
+
+/**
+ * Returns the datagrams retransmitted so far by all flows.
+ */
+unsigned long rudp_retransmits() {
+    return atomic_load_explicit(&RETRANSMITS, memory_order_relaxed);
+}
+
+/**
+ * Prints the transport's counters over all flows of this process.
+ */
+void rudp_report() {
+    unsigned long datagrams = atomic_load(&DATAGRAMS), retransmits = atomic_load(&RETRANSMITS);
+    unsigned long flows = atomic_load(&FLOW_COUNT);
+    int active;
+    pthread_mutex_lock(&FLOWS_LOCK);
+    active = ACTIVE_FLOWS;
+    pthread_mutex_unlock(&FLOWS_LOCK);
+    unsigned long finished = flows - active;
+    printf("RUDP: %lu flows, %lu datagrams, %lu retransmitted (%.1f%%), %lu dropped by -loss, %lu timeouts\n", flows,
+           datagrams, retransmits, datagrams > 0 ? 100.0 * retransmits / datagrams : 0.0, atomic_load(&DROPPED),
+           atomic_load(&TIMEOUTS));
+    printf("- %lu ACKs, %.1f datagrams per send call, srtt %.3f ms, delivery rate %.2f MB/s per flow\n",
+           atomic_load(&ACKS),
+           atomic_load(&SEND_CALLS) > 0 ? (double)(datagrams + atomic_load(&ACKS)) / atomic_load(&SEND_CALLS) : 0.0,
+           finished > 0 ? atomic_load(&SRTT_SUM_MS) / finished : 0.0,
+           finished > 0 ? atomic_load(&BW_SUM) / finished / (1024 * 1024) : 0.0);
+}
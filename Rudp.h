@@ -0,0 +1,41 @@
+#ifndef RUDP_H
+#define RUDP_H
+
+#include <stdint.h>
+
+#define RUDP_MSS 1448                                // Payload bytes per datagram, a typical Ethernet TCP MSS
+#define RUDP_HEADER_SIZE 16                          // type(1) flags(1) length(2) conn(4) seq(4) time(4)
+#define RUDP_DATAGRAM (RUDP_HEADER_SIZE + RUDP_MSS)  // Largest datagram
+#define RUDP_WINDOW 4096                             // Datagrams in flight or buffered per direction, power of two
+
+/*
+ * Reliable transport over UDP, for comparing a userspace transport against
+ * kernel TCP under loss. Each side runs it as a bridge to a loopback TCP
+ * connection, so TCP_Sender and TCP_Receiver speak their usual frame
+ * protocol and keep all of their statistics:
+ *
+ *   TCP_Sender --tcp--> bridge ==udp==> bridge --tcp--> TCP_Receiver
+ *
+ * Every connection becomes a flow with its own UDP socket and thread. The
+ * flow cuts the byte stream into sequence-numbered datagrams, sends them in
+ * batches with sendmmsg() (with UDP GSO where available) and receives with
+ * recvmmsg() (with UDP GRO). Every receive batch is answered by an ACK
+ * carrying the cumulative sequence number, a SACK bitmap of everything
+ * received beyond it and the receive window. A datagram counts as lost
+ * once RUDP_REORDER datagrams sent after it are acknowledged, or after a
+ * retransmission timeout.
+ *
+ * Congestion control is model based, like BBR: the window is twice the
+ * product of the highest delivery rate of the last rounds and the lowest
+ * round trip time, and sends are paced at that rate. Random loss only costs
+ * retransmissions; the rate is cut only when a round loses more than
+ * RUDP_LOSS_LIMIT of its datagrams, a sign of congestion.
+ */
+
+int rudp_client_start(const char *ip, int port, double loss_percent);
+void rudp_server_start(int port, double loss_percent);
+int rudp_wait(int timeout_ms);
+void rudp_report();
+unsigned long rudp_retransmits();
+
+#endif // RUDP_H
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Stats.h"
+
+/**
+ * Adds a value to running statistics.
+ *
+ * @param stats Statistics to update
+ * @param value New value
+ */
+void running_stats_add(RunningStats *stats, double value) {
+    stats->count++;
+    double delta = value - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (value - stats->mean);
+    if (stats->count == 1 || value < stats->min) {
+        stats->min = value;
+    }
+    if (stats->count == 1 || value > stats->max) {
+        stats->max = value;
+    }
+}
+
+/**
+ * Returns the sample standard deviation.
+ *
+ * @param stats Statistics to read
+ * @return Standard deviation, 0 with fewer than two values
+ */
+double running_stats_stddev(const RunningStats *stats) {
+    return stats->count > 1 ? sqrt(stats->m2 / (stats->count - 1)) : 0.0;
+}
+
+/**
+ * Empties a store.
+ *
+ * @param store Store to initialize
+ */
+void stats_init(StatsStore *store) {
+    memset(store, 0, sizeof(*store));
+}
+
+/**
+ * Releases the samples of a store.
+ *
+ * @param store Store to release
+ */
+void stats_free(StatsStore *store) {
+    free(store->samples);
+    stats_init(store);
+}
+
+/**
+ * Records the result of a run. Throughput is derived from the bytes
+ * actually received.
+ *
+ * @param store Store to add to
+ * @param run Run number from 1, warmup runs are not counted
+ * @param algo Congestion control algorithm of the run
+ * @param time_ms Wall-clock duration of the run
+ * @param bytes File bytes received
+ * @param wire_bytes Payload bytes the file data took on the wire
+ */
+void stats_add(StatsStore *store, int run, const char *algo, double time_ms, uint64_t bytes, uint64_t wire_bytes) {
+    if (store->count == store->capacity) {
+        size_t capacity = store->capacity ? store->capacity * 2 : 16;
+        RunSample *samples = (RunSample *)realloc(store->samples, capacity * sizeof(RunSample));
+        if (samples == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        store->samples = samples;
+        store->capacity = capacity;
+    }
+
+    RunSample *sample = &store->samples[store->count++];
+    sample->run = run;
+    snprintf(sample->algo, sizeof(sample->algo), "%s", algo);
+    sample->time_ms = time_ms;
+    sample->bytes = bytes;
+    sample->wire_bytes = wire_bytes;
+    sample->mbps = time_ms > 0 ? (bytes / (1024.0 * 1024.0)) / (time_ms / 1000.0) : 0.0;
+    running_stats_add(&store->time_ms, sample->time_ms);
+    running_stats_add(&store->mbps, sample->mbps);
+}
+
+/**
+ * Adds every sample of another store, e.g. to summarize several sessions.
+ *
+ * @param store Store to add to
+ * @param other Store whose samples are added
+ */
+void stats_merge(StatsStore *store, const StatsStore *other) {
+    for (size_t i = 0; i < other->count; i++) {
+        const RunSample *sample = &other->samples[i];
+        stats_add(store, sample->run, sample->algo, sample->time_ms, sample->bytes, sample->wire_bytes);
+    }
+}
+
+/**
+ * Summarizes the samples per congestion control algorithm, in the order the
+ * algorithms first appear. Samples of algorithms beyond max_groups are left
+ * out.
+ *
+ * @param store Store to read
+ * @param groups Room for max_groups summaries
+ * @param max_groups Most summaries to fill
+ * @return Number of summaries filled
+ */
+size_t stats_group_by_algo(const StatsStore *store, AlgoStats *groups, size_t max_groups) {
+    size_t count = 0;
+    for (size_t i = 0; i < store->count; i++) {
+        const RunSample *sample = &store->samples[i];
+        size_t g = 0;
+        while (g < count && strcmp(groups[g].algo, sample->algo) != 0) {
+            g++;
+        }
+        if (g == count) {
+            if (count == max_groups) {
+                continue;
+            }
+            memset(&groups[g], 0, sizeof(groups[g]));
+            memcpy(groups[g].algo, sample->algo, sizeof(groups[g].algo));
+            count++;
+        }
+        running_stats_add(&groups[g].time_ms, sample->time_ms);
+        running_stats_add(&groups[g].mbps, sample->mbps);
+    }
+    return count;
+}
+
+/**
+ * qsort() comparator for doubles.
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Returns a percentile of one field over all samples, interpolating
+ * linearly between the closest ranks.
+ *
+ * @param store Store to read
+ * @param field Field to take the percentile of
+ * @param percentile Percentile in [0, 100]
+ * @return Value at the percentile, 0 if the store is empty
+ */
+double stats_percentile(const StatsStore *store, enum StatsField field, double percentile) {
+    if (store->count == 0) {
+        return 0.0;
+    }
+    double *values = (double *)malloc(store->count * sizeof(double));
+    if (values == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < store->count; i++) {
+        values[i] = field == STATS_TIME ? store->samples[i].time_ms : store->samples[i].mbps;
+    }
+    qsort(values, store->count, sizeof(double), compare_doubles);
+
+    double position = percentile / 100.0 * (store->count - 1);
+    size_t low = (size_t)position;
+    size_t high = low + 1 < store->count ? low + 1 : low;
+    double value = values[low] + (values[high] - values[low]) * (position - low);
+    free(values);
+    return value;
+}
+
+/**
+ * Writes the column names of stats_write_csv().
+ *
+ * @param file Output file
+ */
+void stats_write_csv_header(FILE *file) {
+    fprintf(file, "session,run,time_ms,bytes,mb_per_s,wire_bytes,algo\n");
+}
+
+/**
+ * Writes one CSV row per run.
+ *
+ * @param file Output file
+ * @param session Session number
+ * @param store Runs of the session
+ */
+void stats_write_csv(FILE *file, int session, const StatsStore *store) {
+    for (size_t i = 0; i < store->count; i++) {
+        const RunSample *sample = &store->samples[i];
+        fprintf(file, "%d,%d,%.6f,%llu,%.6f,%llu,%s\n", session, sample->run, sample->time_ms,
+                (unsigned long long)sample->bytes, sample->mbps, (unsigned long long)sample->wire_bytes, sample->algo);
+    }
+}
+
+/**
+ * Writes one field's summary as a JSON object.
+ */
+static void write_json_summary(FILE *file, const char *name, const StatsStore *store, const RunningStats *stats,
+                               enum StatsField field) {
+    fprintf(file, "\"%s\":{\"mean\":%.6f,\"stddev\":%.6f,\"min\":%.6f,\"max\":%.6f,"
+                  "\"p50\":%.6f,\"p90\":%.6f,\"p99\":%.6f}",
+            name, stats->mean, running_stats_stddev(stats), stats->min, stats->max,
+            stats_percentile(store, field, 50), stats_percentile(store, field, 90),
+            stats_percentile(store, field, 99));
+}
+
+/**
+ * Writes a session as one JSON object: its summary and every run.
+ *
+ * @param file Output file
+ * @param session Session number
+ * @param streams Number of streams of the session
+ * @param store Runs of the session
+ */
+void stats_write_json(FILE *file, int session, int streams, const StatsStore *store) {
+    fprintf(file, "{\"session\":%d,\"streams\":%d,\"runs\":%zu,", session, streams, store->count);
+    write_json_summary(file, "time_ms", store, &store->time_ms, STATS_TIME);
+    fprintf(file, ",");
+    write_json_summary(file, "mb_per_s", store, &store->mbps, STATS_BANDWIDTH);
+    fprintf(file, ",\"samples\":[");
+    for (size_t i = 0; i < store->count; i++) {
+        const RunSample *sample = &store->samples[i];
+        fprintf(file, "%s{\"run\":%d,\"algo\":\"%s\",\"time_ms\":%.6f,\"bytes\":%llu,\"mb_per_s\":%.6f,"
+                      "\"wire_bytes\":%llu}",
+                i ? "," : "", sample->run, sample->algo, sample->time_ms, (unsigned long long)sample->bytes,
+                sample->mbps, (unsigned long long)sample->wire_bytes);
+    }
+    fprintf(file, "]}");
+}
@@ -0,0 +1,70 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATS_ALGO_SIZE 17 // Congestion control algorithm name with its terminator
+#define STATS_MAX_ALGOS 8  // Most algorithms stats_group_by_algo() tells apart
+
+// Online mean and variance (Welford), with the extremes
+typedef struct {
+    uint64_t count;
+    double mean;
+    double m2;   // Sum of squared differences from the mean
+    double min;
+    double max;
+} RunningStats;
+
+// Result of one run
+typedef struct {
+    int run;          // Run number from 1, warmup runs are not counted
+    char algo[STATS_ALGO_SIZE]; // Congestion control algorithm the run was sent with
+    double time_ms;   // Wall-clock duration of the run
+    uint64_t bytes;   // File bytes received
+    uint64_t wire_bytes; // Payload bytes the file data took on the wire, fewer if compressed
+    double mbps;      // Throughput in MB/s, from bytes and time
+} RunSample;
+
+// Summary of the runs sent with one congestion control algorithm
+typedef struct {
+    char algo[STATS_ALGO_SIZE];
+    RunningStats time_ms;
+    RunningStats mbps;
+} AlgoStats;
+
+// Sample fields percentiles can be taken over
+enum StatsField {
+    STATS_TIME,
+    STATS_BANDWIDTH
+};
+
+/*
+ * Results of the runs of a session: the samples in one growable array,
+ * with running statistics updated as they are added, so neither adding a
+ * sample nor reading the summary walks the samples.
+ */
+typedef struct {
+    RunSample *samples;
+    size_t count;
+    size_t capacity;
+    RunningStats time_ms;
+    RunningStats mbps;
+} StatsStore;
+
+void running_stats_add(RunningStats *stats, double value);
+double running_stats_stddev(const RunningStats *stats);
+
+void stats_init(StatsStore *store);
+void stats_free(StatsStore *store);
+void stats_add(StatsStore *store, int run, const char *algo, double time_ms, uint64_t bytes, uint64_t wire_bytes);
+void stats_merge(StatsStore *store, const StatsStore *other);
+size_t stats_group_by_algo(const StatsStore *store, AlgoStats *groups, size_t max_groups);
+double stats_percentile(const StatsStore *store, enum StatsField field, double percentile);
+
+void stats_write_csv_header(FILE *file);
+void stats_write_csv(FILE *file, int session, const StatsStore *store);
+void stats_write_json(FILE *file, int session, int streams, const StatsStore *store);
+
+#endif // STATS_H
@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+
+#define SEGMENT_SIZE 1448               // Default "packet" size, a typical Ethernet MSS
+#define QUEUE_SEGMENTS 1024             // Segments held per connection before the sender is back-pressured
+#define REVERSE_BUFFER_SIZE (64 * 1024) // Buffer for the unimpaired receiver -> sender direction
+
+/*
+ * Userspace impairment relay: accepts connections from TCP_Sender, connects
+ * each one to TCP_Receiver and forwards the sender's bytes cut into
+ * segments. Every segment is serialized on an emulated link at the
+ * configured rate and held back for the one-way delay plus jitter. A "lost"
+ * segment stalls the link for the retransmission time, delaying it and
+ * everything behind it the way a lost packet blocks a TCP receiver; once
+ * the queue is full the sender is back-pressured. No root, tc or netem is
+ * needed; the receiver -> sender direction is relayed unimpaired.
+ */
+
+char *TARGET_IP = "127.0.0.1"; // Address of the receiver
+int TARGET_PORT = 0;           // Port of the receiver
+int LISTEN_PORT = 0;           // Port the proxy accepts senders on
+double DELAY_MS = 0;           // One-way delay added to every segment
+double JITTER_MS = 0;          // Each segment's delay varies uniformly by +- this much
+double LOSS_PERCENT = 0;       // Share of segments that are "lost"
+double STALL_MS = -1;          // Time a lost segment stalls the link, -1 means one round trip (2 * delay)
+double RATE_MBIT = 0;          // Bandwidth cap in Mbit/s, 0 for none
+int MSS = SEGMENT_SIZE;        // Segment size
+unsigned SEED = 1;             // Base seed of the loss and jitter generators
+
+// One segment waiting in the forward queue
+typedef struct {
+    uint64_t release_ns; // Time the segment may be forwarded
+    int length;
+    int sent;            // Bytes of the segment already forwarded
+    char *data;
+} Segment;
+
+// A relayed connection: sender <-> proxy <-> receiver
+typedef struct {
+    pthread_t thread;
+    int client;          // Socket of the sender
+    int server;          // Socket of the receiver
+    unsigned seed;       // State of the connection's random generator
+    Segment *queue;      // Circular queue of QUEUE_SEGMENTS segments
+    char *storage;       // Data of the queued segments
+    int head, count;     // Oldest queued segment, number of queued segments
+    uint64_t link_free_ns;    // Time the emulated link finishes serializing the last segment
+    uint64_t last_release_ns; // Release time of the newest segment, to keep delivery in order
+    uint64_t segments, lost;  // Counters for the summary line
+} Relay;
+
+/**
+ * Return the current monotonic time in nanoseconds.
+ */
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Return a uniformly distributed number in [0, 1).
+ *
+ * @param seed State of the generator.
+ */
+double uniform(unsigned *seed) {
+    return rand_r(seed) / ((double)RAND_MAX + 1.0);
+}
+
+/**
+ * Print the command line usage of the proxy.
+ *
+ * @param program Name of the executable.
+ */
+void print_usage(const char *program) {
+    printf("Usage: %s -p PORT -to-port PORT [-to-ip IP] [-delay MS] [-jitter MS] [-loss PERCENT]\n"
+           "       [-stall MS] [-rate MBIT] [-mss BYTES] [-seed N]\n", program);
+}
+
+/**
+ * Extract the proxy settings from command line arguments.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 if extraction is successful, 1 otherwise.
+ */
+int extract_Variables(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        const char *option = argv[i];
+        char *value = argv[i + 1];
+        if (strcmp(option, "-p") == 0) {
+            LISTEN_PORT = atoi(value);
+        } else if (strcmp(option, "-to-port") == 0) {
+            TARGET_PORT = atoi(value);
+        } else if (strcmp(option, "-to-ip") == 0) {
+            TARGET_IP = value;
+        } else if (strcmp(option, "-delay") == 0) {
+            DELAY_MS = atof(value);
+        } else if (strcmp(option, "-jitter") == 0) {
+            JITTER_MS = atof(value);
+        } else if (strcmp(option, "-loss") == 0) {
+            LOSS_PERCENT = atof(value);
+        } else if (strcmp(option, "-stall") == 0) {
+            STALL_MS = atof(value);
+        } else if (strcmp(option, "-rate") == 0) {
+            RATE_MBIT = atof(value);
+        } else if (strcmp(option, "-mss") == 0) {
+            MSS = atoi(value);
+        } else if (strcmp(option, "-seed") == 0) {
+            SEED = (unsigned)strtoul(value, NULL, 10);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (LISTEN_PORT == 0 || TARGET_PORT == 0 || MSS < 1 || MSS > 65536 || DELAY_MS < 0 || JITTER_MS < 0 ||
+        LOSS_PERCENT < 0 || LOSS_PERCENT >= 100 || RATE_MBIT < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (STALL_MS < 0) {
+        // A lost segment costs about one round trip to repair (fast retransmit), at least 1 ms
+        STALL_MS = 2 * DELAY_MS > 1 ? 2 * DELAY_MS : 1;
+    }
+    return 0;
+}
+
+/**
+ * Queue the bytes read from the sender as segments with their release times.
+ *
+ * @param relay Connection the bytes belong to.
+ * @param buf Bytes read from the sender.
+ * @param length Number of bytes, at most the free queue space.
+ */
+void enqueue(Relay *relay, const char *buf, size_t length) {
+    uint64_t now = now_ns();
+    while (length > 0) {
+        int index = (relay->head + relay->count) % QUEUE_SEGMENTS;
+        Segment *segment = &relay->queue[index];
+        segment->data = relay->storage + (size_t)index * MSS;
+        segment->length = length < (size_t)MSS ? (int)length : MSS;
+        segment->sent = 0;
+        memcpy(segment->data, buf, segment->length);
+
+        // Serialization on the emulated link, which a loss keeps busy until the retransmission
+        uint64_t departure = relay->link_free_ns > now ? relay->link_free_ns : now;
+        if (LOSS_PERCENT > 0 && uniform(&relay->seed) * 100 < LOSS_PERCENT) {
+            departure += (uint64_t)(STALL_MS * 1e6);
+            relay->lost++;
+        }
+        if (RATE_MBIT > 0) {
+            departure += (uint64_t)(segment->length * 8 * 1000.0 / RATE_MBIT);
+        }
+        relay->link_free_ns = departure;
+
+        // Propagation delay with jitter
+        double delay_ms = DELAY_MS + (JITTER_MS > 0 ? (2 * uniform(&relay->seed) - 1) * JITTER_MS : 0);
+        if (delay_ms < 0) {
+            delay_ms = 0;
+        }
+        uint64_t release = departure + (uint64_t)(delay_ms * 1e6);
+        if (release < relay->last_release_ns) {
+            release = relay->last_release_ns; // In-order delivery: nothing overtakes a stalled segment
+        }
+        segment->release_ns = release;
+        relay->last_release_ns = release;
+
+        relay->count++;
+        relay->segments++;
+        buf += segment->length;
+        length -= segment->length;
+    }
+}
+
+/**
+ * Forward every queued segment whose release time has come.
+ *
+ * @param relay Connection to forward on.
+ * @return 0 on success, -1 if the receiver connection failed.
+ */
+int forward_released(Relay *relay) {
+    uint64_t now = now_ns();
+    while (relay->count > 0) {
+        Segment *segment = &relay->queue[relay->head];
+        if (segment->release_ns > now) {
+            return 0;
+        }
+        ssize_t sent = send(relay->server, segment->data + segment->sent, segment->length - segment->sent,
+                            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return 0;
+            }
+            perror("send to receiver");
+            return -1;
+        }
+        segment->sent += sent;
+        if (segment->sent < segment->length) {
+            return 0;
+        }
+        relay->head = (relay->head + 1) % QUEUE_SEGMENTS;
+        relay->count--;
+    }
+    return 0;
+}
+
+/**
+ * Relay thread of one connection.
+ *
+ * @param arg Pointer to the Relay.
+ * @return NULL.
+ */
+void *relay_loop(void *arg) {
+    Relay *relay = (Relay *)arg;
+    char *buffer = malloc(QUEUE_SEGMENTS * (size_t)MSS);
+    char *reverse = malloc(REVERSE_BUFFER_SIZE);
+    if (buffer == NULL || reverse == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    int client_open = 1, server_open = 1;
+
+    while (server_open && (client_open || relay->count > 0)) {
+        if (forward_released(relay) < 0) {
+            break;
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = relay->client;
+        fds[0].events = (client_open && relay->count < QUEUE_SEGMENTS) ? POLLIN : 0;
+        fds[1].fd = relay->server;
+        fds[1].events = POLLIN;
+        int timeout = -1;
+        if (relay->count > 0) {
+            Segment *segment = &relay->queue[relay->head];
+            uint64_t now = now_ns();
+            if (segment->release_ns <= now) {
+                fds[1].events |= POLLOUT; // Released but the socket was full
+            } else {
+                timeout = (int)((segment->release_ns - now + 999999) / 1000000);
+            }
+        }
+        if (poll(fds, 2, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            size_t room = (size_t)(QUEUE_SEGMENTS - relay->count) * MSS;
+            ssize_t n = recv(relay->client, buffer, room, MSG_DONTWAIT);
+            if (n > 0) {
+                enqueue(relay, buffer, n);
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                client_open = 0;
+            }
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            // Receiver -> sender direction, relayed as is
+            ssize_t n = recv(relay->server, reverse, REVERSE_BUFFER_SIZE, MSG_DONTWAIT);
+            if (n > 0) {
+                for (ssize_t done = 0; done < n;) {
+                    ssize_t sent = send(relay->client, reverse + done, n - done, MSG_NOSIGNAL);
+                    if (sent <= 0) {
+                        break;
+                    }
+                    done += sent;
+                }
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                server_open = 0;
+            }
+        }
+    }
+
+    printf("Connection closed: %llu segments, %llu lost\n", (unsigned long long)relay->segments,
+           (unsigned long long)relay->lost);
+    shutdown(relay->server, SHUT_WR);
+    close(relay->client);
+    close(relay->server);
+    free(buffer);
+    free(reverse);
+    free(relay->queue);
+    free(relay->storage);
+    free(relay);
+    return NULL;
+}
+
+/**
+ * Connect to the receiver.
+ *
+ * @return File descriptor of the connected socket, -1 on error.
+ */
+int connect_to_receiver() {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(TARGET_PORT);
+    if (inet_pton(AF_INET, TARGET_IP, &address.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid receiver address: %s\n", TARGET_IP);
+        exit(EXIT_FAILURE);
+    }
+
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("connect to receiver");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * Main function. Accepts senders forever, one relay thread per connection.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 on success.
+ */
+int main(int argc, char *argv[]) {
+    if (extract_Variables(argc, argv) == 1) {
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    int opt = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(LISTEN_PORT);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listen_fd, 64) < 0) {
+        perror("bind/listen");
+        exit(EXIT_FAILURE);
+    }
+    printf("Proxy :%d -> %s:%d  delay %.2f ms, jitter %.2f ms, loss %.2f%% (stall %.2f ms), rate %s, mss %d\n",
+           LISTEN_PORT, TARGET_IP, TARGET_PORT, DELAY_MS, JITTER_MS, LOSS_PERCENT, STALL_MS,
+           RATE_MBIT > 0 ? "capped" : "unlimited", MSS);
+    fflush(stdout);
+
+    for (unsigned connection = 0;; connection++) {
+        int client = accept(listen_fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        int server = connect_to_receiver();
+        if (server < 0) {
+            close(client);
+            continue;
+        }
+        int nodelay = 1; // Segments are already paced, do not let Nagle regroup them
+        setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        Relay *relay = (Relay *)calloc(1, sizeof(Relay));
+        if (relay == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        relay->client = client;
+        relay->server = server;
+        relay->seed = SEED + connection;
+        relay->queue = (Segment *)calloc(QUEUE_SEGMENTS, sizeof(Segment));
+        relay->storage = malloc(QUEUE_SEGMENTS * (size_t)MSS);
+        if (relay->queue == NULL || relay->storage == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_create(&relay->thread, NULL, relay_loop, relay) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(relay->thread);
+    }
+    close(listen_fd);
+    return 0;
+}
@@ -1,428 +1,3650 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <netinet/tcp.h>
-#include <errno.h>
-#include <time.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-
-#define BUFFER_SIZE 1024 * 1024
-#define MKDIR(directory) mkdir(directory, 0700)
-#define DIR "assets"
-
-int PORT; // Port number of the server
-char *ALGO; // Congestion control algorithm to be used
-
-// Message types
-enum MessageType {
-    FILE_DATA,
-    CONTROL_MESSAGE
-};
-
-// Struct to represent messages
-typedef struct {
-    enum MessageType type;
-    char data[BUFFER_SIZE];
-    size_t length;
-} Message;
-
-// Define the node structure
-typedef struct Node {
-    double data;
-    struct Node *next;
-} Node;
-
-// Define the list structure
-typedef struct {
-    Node *head;
-} List;
-
-/**
- * Create a directory if it doesn't exist.
- */
-void creating_path() {
-    // Use MKDIR macro for directory creation
-    if (MKDIR(DIR) != 0) {
-        fprintf(stderr, "Error creating directory.\n");
-        exit(EXIT_FAILURE);
-    }
-    printf("Directory created successfully.\n");
-}
-
-/**
- * Create an empty list.
- *
- * @return Pointer to the newly created list.
- */
-List *createList() {
-    List *list = (List *)malloc(sizeof(List));
-    if (list == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
-    }
-    list->head = NULL;
-    return list;
-}
-
-/**
- * Get the size of the list.
- *
- * @param list Pointer to the list.
- * @return Size of the list.
- */
-int size(List *list) {
-    if (list == NULL) {
-        return 0;
-    }
-    Node *current = list->head;
-    int i = 0; // Start count from 0
-    while (current != NULL) {
-        current = current->next;
-        i++;
-    }
-    return i;
-}
-
-/**
- * Insert an element at the end of the list.
- *
- * @param list Pointer to the list.
- * @param value Value to be inserted.
- */
-void insert(List *list, double value) {
-    Node *newNode = (Node *)malloc(sizeof(Node));
-    if (newNode == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
-    }
-    newNode->data = value;
-    newNode->next = NULL;
-
-    if (list->head == NULL) {
-        list->head = newNode;
-    } else {
-        Node *current = list->head;
-        while (current->next != NULL) {
-            current = current->next;
-        }
-        current->next = newNode;
-    }
-}
-
-/**
- * Delete an element from the list by value.
- *
- * @param list Pointer to the list.
- * @param value Value to be deleted.
- */
-void deleteValue(List *list, double value) {
-    Node *current = list->head;
-    Node *prev = NULL;
-
-    while (current != NULL) {
-        if (current->data == value) {
-            if (prev == NULL) {
-                list->head = current->next;
-            } else {
-                prev->next = current->next;
-            }
-            free(current);
-            return;
-        }
-        prev = current;
-        current = current->next;
-    }
-}
-
-/**
- * Delete the entire list and free memory.
- *
- * @param list Pointer to the list.
- */
-void deleteList(List *list) {
-    Node *current = list->head;
-    while (current != NULL) {
-        Node *next = current->next;
-        free(current);
-        current = next;
-    }
-    free(list);
-}
-
-/**
- * Print the elements of the list.
- *
- * @param list Pointer to the list.
- */
-void printList(List *list) {
-    Node *current = list->head;
-    while (current != NULL) {
-        printf("%.2f ", current->data);
-        current = current->next;
-    }
-    printf("\n");
-}
-
-/**
- * Print times and average time from a dynamic array.
- *
- * @param iteration Number of iterations.
- * @param times Pointer to the list containing times.
- */
-void print_times(int iteration, List *times) {
-    printf("____________________________________________________________\n");
-    printf("-                     *  statistics  *                     -\n");
-    printf("-\n");
-    double avg = 0;
-    double total_bandwidth = 0;
-    Node *current = times->head; // Start from the head of the list
-    int i = 1; // Variable to keep track of the run number
-    while (current != NULL) {
-        printf("- Run   #%d  Data: Time = %.2f ms;    speed = %.2f MB/s\n", i, current->data, 1024.00 / current->data);
-        avg += current->data;
-        total_bandwidth += 1024.00 / current->data;
-        current = current->next; // Move to the next node
-        i++; // Increment the run number
-    }
-    printf("-\n");
-    printf("- Average time:   %.2f ms\n", avg / iteration);
-    printf("- Average bandwidth:  %.2f MB/s\n", total_bandwidth / iteration);
-    printf("____________________________________________________________\n");
-}
-
-/**
- * Extract port number and congestion control algorithm from command line arguments.
- *
- * @param argc Number of command line arguments.
- * @param argv Array of command line arguments.
- * @return 0 if extraction is successful, 1 otherwise.
- */
-int extract_Variables(int argc, char *argv[]) {
-    // Check if the number of arguments is correct
-    if (argc != 5 || strcmp(argv[1], "-p") != 0 || strcmp(argv[3], "-algo") != 0) {
-        printf("Usage: %s -p PORT -algo ALGO\n", argv[0]);
-        return 1; // Exit with error
-    }
-
-    // Extract PORT and ALGO from command-line arguments
-    PORT = atoi(argv[2]);
-    ALGO = argv[4];
-    return 0;
-}
-
-/**
- * Set the congestion control algorithm for the socket.
- *
- * @param sock File descriptor of the socket.
- */
-void set_congestion_control(int sock) {
-    const char *congestion_algo = (strcmp(ALGO, "cubic") == 0) ? "cubic" : "reno";
-    if (setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, congestion_algo, strlen(congestion_algo)) < 0) {
-        perror("setsockopt TCP_CONGESTION failed");
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * Open a file for writing.
- *
- * @param file_name Name of the file.
- * @return File pointer.
- */
-FILE *open_file_to_write(char *file_name) {
-    FILE *file = fopen(file_name, "wb");
-    if (file == NULL) {
-        perror("Error opening file");
-        exit(EXIT_FAILURE);
-    }
-    return file;
-}
-
-/**
- * Create a server socket.
- *
- * @param server_fd Pointer to store the server socket file descriptor.
- */
-void create_server_socket(int *server_fd) {
-    if ((*server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("socket failed");
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * Bind the server socket to an address.
- *
- * @param server_fd File descriptor of the server socket.
- * @param address Pointer to the address structure.
- */
-void bind_socket(int server_fd, struct sockaddr_in *address) {
-    int opt = 1;
-    address->sin_family = AF_INET;
-    address->sin_addr.s_addr = INADDR_ANY;
-    address->sin_port = htons(PORT);
-
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-        perror("setsockopt");
-        exit(EXIT_FAILURE);
-    }
-
-    if (bind(server_fd, (struct sockaddr *)address, sizeof(*address)) < 0) {
-        perror("bind failed");
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * Start listening for incoming connections on the server socket.
- *
- * @param server_fd File descriptor of the server socket.
- */
-void start_listening(int server_fd) {
-    if (listen(server_fd, 3) < 0) {
-        perror("listen");
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * Accept a connection on the server socket.
- *
- * @param server_fd File descriptor of the server socket.
- * @param address Pointer to the client address structure.
- * @return File descriptor of the accepted connection.
- */
-int accept_connection(int server_fd, struct sockaddr_in *address) {
-    int new_socket;
-    int addrlen = sizeof(*address);
-
-    if ((new_socket = accept(server_fd, (struct sockaddr *)address, (socklen_t *)&addrlen)) < 0) {
-        perror("accept");
-        exit(EXIT_FAILURE);
-    }
-    return new_socket;
-}
-
-/**
- * Close the client and server sockets.
- *
- * @param new_socket File descriptor of the client socket.
- * @param server_fd File descriptor of the server socket.
- */
-void close_sockets(int new_socket, int server_fd) {
-    close(new_socket);
-    close(server_fd);
-    system("make clean_files");
-}
-
-/**
- * Receive a message from the socket.
- *
- * @param socket File descriptor of the socket.
- * @param msg Pointer to the message structure to store the received message.
- */
-void receive_message(int socket, Message *msg) {
-    // Initialize variables for tracking received bytes and total message length
-    ssize_t total_bytes_received = 0;
-    ssize_t bytes_received;
-
-    // Loop until the entire message is received
-    while (total_bytes_received < sizeof(Message)) {
-        // Receive data into the message buffer starting from the last received position
-        bytes_received = recv(socket, ((char *)msg) + total_bytes_received, sizeof(Message) - total_bytes_received, 0);
-
-        if (bytes_received <= 0) {
-            // Handle receive errors or connection closed
-            perror("Error receiving message");
-            exit(EXIT_FAILURE);
-        }
-
-        // Update the total received bytes
-        total_bytes_received += bytes_received;
-    }
-}
-
-/**
- * Handle the sender communication.
- *
- * @param client_socket File descriptor of the client socket.
- * @param file File pointer to write the received data.
- * @param times Pointer to the list to store transfer times.
- */
-void sender_handler(int client_socket, FILE *file, List *times) {
-    // Function implementation remains the same, just use the updated receive_message() function
-    clock_t start, end;
-    int i = 0;
-    while (1) {
-        Message msg;
-        receive_message(client_socket, &msg);
-        if (msg.type == FILE_DATA) {
-            fwrite(msg.data, 1, msg.length, file);
-
-        } else if (msg.type == CONTROL_MESSAGE) {
-            if (strcmp(msg.data, "START") == 0) {
-                start = clock();
-            } else if (strcmp(msg.data, "END") == 0) {
-                end = clock();
-                insert(times, (((double)(end - start)) * 1000.0 / CLOCKS_PER_SEC));
-                fclose(file);
-                printf("File %d transfer completed\n", i + 1);
-            } else if (strcmp(msg.data, "EXIT") == 0) {
-                break;
-            } else if (strcmp(msg.data, "SEND_AGAIN") == 0) {
-                i++;
-                char filename[50];
-                snprintf(filename, 50, "assets/receive_file%d.txt", i);
-                file = open_file_to_write(filename);
-            }
-        } else {
-            perror("Error processing new data: ");
-            fprintf(stdout, "Data failed processing - %ld bytes | DATA = %s\n", msg.length, msg.data);
-            exit(EXIT_FAILURE);
-        }
-    }
-}
-
-/**
- * Main function.
- *
- * @param argc Number of command line arguments.
- * @param argv Array of command line arguments.
- * @return 0 indicating successful execution of the program.
- */
-int main(int argc, char *argv[]) {
-
-    int server_fd, client_socket;
-    struct sockaddr_in address;
-
-    List *times = createList();
-
-    printf("Starting Receiver...\n");
-
-    if (extract_Variables(argc, argv) == 1) {
-        return 1;
-    }
-    create_server_socket(&server_fd);
-    set_congestion_control(server_fd);
-
-    bind_socket(server_fd, &address);
-    creating_path();
-    start_listening(server_fd);
-    client_socket = accept_connection(server_fd, &address);
-
-    printf("Sender connected, beginning to receive file...\n");
-    FILE *file = open_file_to_write("assets/receive_file.txt");
-
-    sender_handler(client_socket, file, times);
-
-    print_times(size(times), times);
-    printf("Receiver end..\n");
-    deleteList(times);
-    close_sockets(client_socket, server_fd);
-
-    return 0;
-}
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <math.h>
+#include <ftw.h>
+
+#include "Protocol.h"
+#include "Uring.h"
+#include "Histogram.h"
+#include "Stats.h"
+#include "TcpInfo.h"
+#include "Crc32c.h"
+#include "Codec.h"
+#include "Ring.h"
+#include "Delta.h"
+#include "Rudp.h"
+#include "Reporter.h"
+
+#define MKDIR(directory) mkdir(directory, 0700)
+#define DIR "assets"
+#define LATENCY_UNIT (1024 * 1024)     // Bytes per sample of the per-MB latency histogram
+#define URING_SLOTS 16                 // Registered receive buffers per worker with the io_uring sink
+#define URING_SLOT_SIZE BUFFER_SIZE    // Size of one registered receive buffer
+#define RUDP_DRAIN_MS 2000             // Longest wait at exit for the RUDP flows to finish
+#define PIPE_BUFFERS 16                // Receive buffers in each worker's pool with the pipeline sink
+#define PIPE_REQUESTS 8                // File writes one pool buffer can have in flight
+#define PIPE_BATCH 64                  // Most write requests the writer thread takes per round
+#define MANIFEST_MAX (64 * 1024 * 1024) // Largest manifest of a directory tree run
+#define TREE_OPEN_MAX 64               // Files of a tree run left open when the manifest creates them
+
+// Where received file data is written
+enum SinkMode {
+    SINK_FILE,  // write() from the receive buffer
+    SINK_SPLICE, // splice() socket -> pipe -> file, payload never enters user space
+    SINK_URING,  // io_uring receives into registered buffers, file writes batched with them
+    SINK_PIPELINE, // Receives into a buffer pool, a writer thread per worker does the file writes
+    SINK_NULL    // Payload is discarded (optionally checksummed), for network-only benchmarks
+};
+
+int PORT; // Port number of the server
+char *ALGO; // Congestion control algorithm to be used
+enum SinkMode SINK = SINK_FILE; // Receive path for file data
+int SERVE = 0; // Keep serving sessions instead of exiting after the first one
+int CHECKSUM = 1; // Verify ranges against the CRC32C carried by END frames, cleared by -no-checksum
+int KEEP_FILES = 0; // Leave the received files in place on exit, set by -keep-files
+int WORKERS = 0; // Event loop threads, 0 means one per online CPU
+int MAX_CONNECTIONS = 256; // Most connections served at the same time
+int RCVBUF = 0; // SO_RCVBUF of the accepted sockets, 0 leaves it to the kernel's autotuning
+int RUDP = 0; // Also take sessions over the RUDP transport on the UDP port of the same number, set by -transport rudp
+char *CSV_PATH = NULL; // File the per-run results are exported to as CSV, if any
+char *JSON_PATH = NULL; // File the per-session results are exported to as JSON, if any
+FILE *CSV_FILE = NULL;
+FILE *JSON_FILE = NULL;
+StatsStore ALL_STATS; // Results of every session, under EXPORT_LOCK
+int ALL_SESSIONS = 0; // Sessions that contributed to ALL_STATS
+int JSON_SESSIONS = 0; // Sessions written to JSON_FILE so far
+pthread_mutex_t EXPORT_LOCK = PTHREAD_MUTEX_INITIALIZER;
+char *TCPINFO_PATH = NULL; // CSV file of TCP_INFO samples, no sampling if NULL
+int TCPINFO_INTERVAL_MS = TCP_SAMPLER_DEFAULT_INTERVAL_MS; // TCP_INFO sampling period
+TcpSampler SAMPLER; // Samples the connections when TCPINFO_PATH is set, drives the interval reports
+int INTERVAL_MS = 0; // Period of the interval reports, 0 for none
+char *INTERVAL_JSON = NULL; // File the interval reports are also written to as JSON lines
+Reporter REPORTER; // Prints the interval reports when INTERVAL_MS is set
+
+atomic_int ACTIVE_CONNECTIONS; // Connections currently open
+atomic_int SESSIONS_STARTED; // Sessions created so far, used to number them
+atomic_int CONNECTIONS_ACCEPTED; // Connections accepted so far, used to label TCP_INFO samples
+atomic_int FAILED; // Set if any session ended with an error
+volatile sig_atomic_t STOP = 0; // Set when the event loops must exit
+
+// Per-stream results of one run
+typedef struct {
+    uint64_t bytes;   // Bytes of the stream's range
+    uint32_t crc;     // CRC32C of the received range
+    int checked;      // 1 if the range matched its END frame, -1 if not, 0 if not checked
+    double start_ms;  // Monotonic time the range was announced
+    double end_ms;    // Monotonic time the last byte of the range was written
+} StreamStats;
+
+// A regular file of a tree run, written in place as its bytes arrive
+typedef struct {
+    char *path;       // Path of the file, under the run's directory
+    uint64_t offset;  // Offset of its contents in the run
+    uint64_t size;    // Size of the file
+    uint64_t written; // Bytes of it written so far
+    uint32_t mode;    // Permissions, applied once the file is complete
+    int fd;           // The open file, -1 while closed
+    int writers;      // Writes into the file in progress
+} TreeFile;
+
+// A directory of a tree run, which gets its permissions once the run is complete
+typedef struct {
+    char *path;
+    uint32_t mode;
+} TreeDir;
+
+// Bytes of a tree run that arrived before the manifest placed them
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} TreeSpan;
+
+// Files of a tree run laid out from its manifest, shared by the threads writing the run
+typedef struct {
+    pthread_mutex_t lock;
+    atomic_int refs;          // Runs and sessions holding the layout
+    char root[128];           // Directory the tree is written into
+    TreeFile *files;          // Non-empty files in manifest order, which is also offset order
+    size_t file_count, file_capacity;
+    TreeDir *dirs;            // Directories in manifest order, parents first
+    size_t dir_count, dir_capacity;
+    int created;              // Regular files created, empty ones included, counted by the manifest's stream
+    int open_count;           // Files currently open for writing
+    uint64_t covered;         // Bytes of the run placed by the manifest so far, grown by the manifest's stream
+    char spill_path[128];     // File holding the bytes that arrived ahead of their manifest entry
+    int spill_fd;             // That file, -1 until needed
+    TreeSpan *spans;          // Ranges of the run written to it
+    size_t span_count, span_capacity;
+    uint64_t spilled;         // Bytes written to it
+    int read_file;            // File open for reading as the base of a delta run, -1 if none
+    int read_fd;              // That file
+} TreeLayout;
+
+struct Connection;
+
+// State of one run (one transmission of the file), shared by all streams of the session
+typedef struct RunState {
+    int run;                          // Run index announced by the sender
+    int fd;                           // Output file of the run, -1 for tree runs and with the null sink
+    int ends_pending;                 // END frames still expected, one per stream
+    uint64_t file_size;               // Size announced by the sender
+    uint64_t bytes_written;           // Highest end offset written by any stream
+    uint64_t bytes_received;          // File bytes written by all streams
+    uint64_t wire_bytes;              // Payload bytes the file data took on the wire
+    uint64_t compressed_bytes;        // File bytes that arrived in compressed frames
+    uint64_t start_ns;                // Monotonic time when the run was first seen
+    int warmup;                       // Set for the sender's warmup runs, which are left out of the statistics
+    int number;                       // Run number in the statistics, from 1 after the warmup runs
+    char algo[STATS_ALGO_SIZE];       // Congestion control algorithm the sender announced for the run
+    int delta;                        // Set if the run is sent as a delta against the previous run's file
+    int base_run;                     // Run whose file delta copies come from, -1 if none
+    int base_fd;                      // That file, -1 if none
+    TreeLayout *base_tree;            // Or the files of that run if it was a tree run, NULL if not
+    uint64_t base_size;               // Size of that file
+    uint64_t copied_bytes;            // File bytes copied from the base file
+    uint64_t copy_ns;                 // Time spent copying them
+    double signature_ms;              // Time spent signing the base file and sending the signatures
+    struct Connection *signer;        // Connection whose delta START waits for the previous run, NULL if none
+    int tree;                         // Set if the run carries a directory tree, written straight into its files
+    TreeLayout *layout;               // Files of a tree run, NULL otherwise and with the null sink
+    size_t manifest_length;           // Bytes of manifest received
+    StreamStats streams[MAX_STREAMS]; // Per-stream results
+    Histogram gaps;                   // Time between consecutive data frames, merged from the streams
+    Histogram mb_latency;             // Time to receive each MB, merged from the streams
+    struct RunState *next;
+} RunState;
+
+// Shared state of one transfer session, possibly spread over several connections
+typedef struct Transfer {
+    pthread_mutex_t lock;
+    int id;                // Session number, names the output directory in serve mode
+    uint64_t session_id;   // Identifier announced in CONTROL_JOIN, 0 for single-stream sessions
+    int stream_count;      // Connections carrying the session
+    int connections;       // Connections currently attached to the session
+    int failed;            // Set if a connection of the session hit an error
+    char dir[64];          // Directory the session's files are written to
+    RunState *runs;        // Runs that have started but not yet completed
+    int finishing;         // Runs no longer in runs whose files are still being completed
+    int last_run;          // Last run that completed, the base of a delta run, -1 if none
+    TreeLayout *base_tree; // Files of last_run if it was a tree run, NULL if not
+    StatsStore stats;      // Results of completed runs
+    Histogram gaps;        // Data frame inter-arrival times over all runs
+    Histogram mb_latency;  // Per-MB latencies over all runs
+    struct Transfer *next; // Next entry of the session table
+} Transfer;
+
+struct PoolBuffer;
+
+// A file write handed from an event loop to its writer thread
+typedef struct {
+    struct Connection *conn;   // Connection the data arrived on
+    struct PoolBuffer *buffer; // Pool buffer holding the data
+    int fd;                    // Output file
+    TreeLayout *tree;          // Or the files of the tree run the data belongs to, NULL if not a tree run
+    uint64_t offset;           // Offset of the data in the file, or in the run for a tree run
+    const char *data;          // Data to write, inside buffer
+    size_t length;             // Length of the data
+    int error;                 // errno of a failed write, set by the writer
+} WriteRequest;
+
+// A receive buffer of the pipeline sink's pool
+typedef struct PoolBuffer {
+    char *data;              // BUFFER_SIZE bytes, page-aligned
+    size_t length;           // Bytes received into the buffer
+    size_t parsed;           // Bytes of the buffer handed to the parser so far
+    int held;                // Set while the receiving connection has not parsed it all
+    int writes;              // Requests out of the buffer not completed yet
+    int request_count;       // Entries of requests in use
+    WriteRequest requests[PIPE_REQUESTS];
+    struct PoolBuffer *next_free;
+} PoolBuffer;
+
+// Receive state of one connection
+typedef struct Connection {
+    int socket;
+    int stream_index;      // Index of the stream within its session
+    int running;           // Cleared once the sender sent CONTROL_EXIT
+    int failed;            // Set when the connection is dropped because of an error
+    Transfer *transfer;    // Session of the connection, NULL until its first control frame
+    RunState *run;         // Run the current range belongs to
+    uint64_t range_offset; // Offset of the current range in the file
+    uint64_t range_length; // Length of the current range
+    uint64_t range_done;   // Bytes of the current range written so far
+    uint64_t range_queued; // Bytes of the current range handed to asynchronous writes so far
+    uint32_t range_crc;    // CRC32C of the bytes of the current range so far
+    char *packed;          // Payload of the compressed frame being received
+    size_t packed_have;    // Bytes of it received so far
+    char *unpacked;        // Decompressed chunk
+    uint64_t last_frame_ns;  // Arrival time of the previous data frame of the range, 0 if none
+    uint64_t unit_start_ns;  // Time the current LATENCY_UNIT of the range started arriving
+    uint64_t unit_bytes;     // Bytes of the current LATENCY_UNIT received so far
+    Histogram gaps;          // Data frame inter-arrival times of the current range
+    Histogram mb_latency;    // Per-MB latencies of the current range
+    FrameParser parser;
+    uint32_t send_seq;       // Sequence number of the next frame sent back to the sender
+    // io_uring and pipeline sinks
+    int writes_pending;    // File writes in flight
+    int closing;           // Set once the connection must be closed when idle
+    int has_deferred;      // Set if deferred holds a control frame waiting for the writes to finish
+    FrameEvent deferred;   // Control frame that must not overtake the pending writes
+    int waiting;           // Set while queued for a free receive buffer
+    struct Connection *wait_next;
+    // io_uring sink only
+    int file_index;        // Slot of the socket in the ring's fixed file table
+    int slot;              // Registered buffer being parsed, -1 if none
+    int reading;           // Set while a receive is in flight
+    int inflight;          // Operations in flight (receive and writes)
+    // pipeline sink only
+    PoolBuffer *buffer;    // Pool buffer being parsed, NULL if none
+    int paused;            // Set while the socket is out of the epoll set
+    struct Connection *prev, *next; // Links in the owning worker's connection list
+} Connection;
+
+// A registered receive buffer of the io_uring sink
+typedef struct {
+    Connection *owner; // Connection using the buffer, NULL if free
+    size_t length;     // Bytes received into the buffer
+    size_t parsed;     // Bytes of the buffer handed to the parser so far
+    int writes;        // File writes still reading from the buffer
+} UringSlot;
+
+// io_uring state of a worker running the io_uring sink
+typedef struct {
+    Uring ring;
+    char *buffers;                     // URING_SLOTS registered buffers of URING_SLOT_SIZE bytes
+    UringSlot slots[URING_SLOTS];
+    int *free_files;                   // Free slots of the fixed file table
+    int free_file_count;
+    Connection *wait_head, *wait_tail; // Connections waiting for a free buffer
+    struct sockaddr_in accept_address; // Peer address of the pending accept
+    socklen_t accept_length;
+    struct __kernel_timespec timeout;  // Wakeup period to check STOP
+} UringLoop;
+
+// Counters of the pipeline sink
+typedef struct {
+    unsigned long requests;      // Write requests completed
+    unsigned long writes;        // pwritev() calls they took
+    unsigned long pool_waits;    // Receives put off because every pool buffer was in use
+    unsigned long control_waits; // Control frames held back until the writes before them finished
+    unsigned long writer_idle;   // Times the writer found the queue empty
+    unsigned long depth_sum;     // Write queue depth summed over every request queued
+    unsigned max_depth;          // Deepest the write queue got
+} PipeStats;
+
+// Disk writer of a worker running the pipeline sink
+typedef struct {
+    pthread_t thread;
+    Ring submit;                 // Write requests, event loop -> writer
+    Ring complete;               // Completed requests, writer -> event loop
+    int event_fd;                // Signalled by the writer when requests complete
+    PoolBuffer *buffers;         // PIPE_BUFFERS pool buffers
+    PoolBuffer *free_buffers;    // Free pool buffers, used by the event loop only
+    struct Connection *wait_head, *wait_tail; // Connections waiting for a free buffer
+    unsigned long syscalls;      // System calls of the writer thread
+    PipeStats stats;
+} PipeWriter;
+
+// One event loop thread, with its own SO_REUSEPORT listener and epoll instance
+typedef struct {
+    pthread_t thread;
+    int listen_fd;           // Listening socket of this worker
+    int epoll_fd;            // epoll instance watching the listener and the connections
+    char *buffer;            // Receive buffer shared by the worker's connections
+    int pipe_fds[2];         // Pipe used by the splice sink
+    Connection *connections; // Connections served by this worker
+    UringLoop *uring;        // io_uring state, NULL when the worker runs on epoll
+    PipeWriter *writer;      // Disk writer of the pipeline sink, NULL with the other sinks
+    PipeStats pipe_stats;    // Counters of the pipeline sink, filled in when the worker stops
+    unsigned long syscalls;  // System calls made on the data path
+    uint64_t bytes;          // File bytes received
+} Worker;
+
+pthread_mutex_t SESSIONS_LOCK = PTHREAD_MUTEX_INITIALIZER;
+Transfer *SESSIONS = NULL; // Multi-stream sessions, looked up by session id
+
+/**
+ * Create a directory if it doesn't exist.
+ */
+void creating_path() {
+    // Use MKDIR macro for directory creation; it is left over from a run with -keep-files
+    if (MKDIR(DIR) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error creating directory.\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("Directory created successfully.\n");
+}
+
+/**
+ * Print the results of a session's runs: time and throughput of every run,
+ * computed from the bytes actually received, then their summary.
+ *
+ * @param stats Results of the session's runs.
+ */
+void print_times(const StatsStore *stats) {
+    printf("____________________________________________________________\n");
+    printf("-                     *  statistics  *                     -\n");
+    printf("-\n");
+    for (size_t i = 0; i < stats->count; i++) {
+        const RunSample *sample = &stats->samples[i];
+        printf("- Run   #%d  Data: Time = %.2f ms;    speed = %.2f MB/s\n", sample->run, sample->time_ms,
+               sample->mbps);
+    }
+    printf("-\n");
+    printf("- Average time:   %.2f ms\n", stats->time_ms.mean);
+    printf("- Average bandwidth:  %.2f MB/s\n", stats->mbps.mean);
+    printf("- Time (ms):  stddev = %.2f  min = %.2f  max = %.2f  p50 = %.2f  p90 = %.2f  p99 = %.2f\n",
+           running_stats_stddev(&stats->time_ms), stats->time_ms.min, stats->time_ms.max,
+           stats_percentile(stats, STATS_TIME, 50), stats_percentile(stats, STATS_TIME, 90),
+           stats_percentile(stats, STATS_TIME, 99));
+    printf("- Bandwidth (MB/s):  stddev = %.2f  min = %.2f  max = %.2f  p50 = %.2f\n",
+           running_stats_stddev(&stats->mbps), stats->mbps.min, stats->mbps.max,
+           stats_percentile(stats, STATS_BANDWIDTH, 50));
+
+    AlgoStats groups[STATS_MAX_ALGOS];
+    size_t group_count = stats_group_by_algo(stats, groups, STATS_MAX_ALGOS);
+    if (group_count > 1) {
+        for (size_t g = 0; g < group_count; g++) {
+            printf("- %-6s %llu runs:  time = %.2f +- %.2f ms  bandwidth = %.2f +- %.2f MB/s\n", groups[g].algo,
+                   (unsigned long long)groups[g].mbps.count, groups[g].time_ms.mean,
+                   running_stats_stddev(&groups[g].time_ms), groups[g].mbps.mean, running_stats_stddev(&groups[g].mbps));
+        }
+    }
+    if (group_count == 2 && groups[0].mbps.count > 1 && groups[1].mbps.count > 1) {
+        // Welch's standard error, the 95% interval assumes enough runs for the normal approximation
+        double a = running_stats_stddev(&groups[0].mbps), b = running_stats_stddev(&groups[1].mbps);
+        double error = sqrt(a * a / groups[0].mbps.count + b * b / groups[1].mbps.count);
+        double difference = groups[1].mbps.mean - groups[0].mbps.mean;
+        printf("- %s - %s bandwidth: %.2f MB/s, 95%% interval [%.2f, %.2f]%s\n", groups[1].algo, groups[0].algo,
+               difference, difference - 1.96 * error, difference + 1.96 * error,
+               fabs(difference) > 1.96 * error ? ", significant" : "");
+    }
+
+    uint64_t bytes = 0, wire_bytes = 0;
+    for (size_t i = 0; i < stats->count; i++) {
+        bytes += stats->samples[i].bytes;
+        wire_bytes += stats->samples[i].wire_bytes;
+    }
+    if (wire_bytes != bytes) {
+        printf("- Wire:  %.2f MB carried %.2f MB of file data (%.1f%%)\n", wire_bytes / (1024.0 * 1024.0),
+               bytes / (1024.0 * 1024.0), bytes > 0 ? 100.0 * wire_bytes / bytes : 100.0);
+    }
+}
+
+/**
+ * Print the percentiles of a latency histogram on one line.
+ *
+ * @param label Name of the measurement.
+ * @param histogram Histogram of nanosecond values.
+ * @param scale Nanoseconds per printed unit.
+ * @param unit Name of the printed unit.
+ */
+void print_latency(const char *label, const Histogram *histogram, double scale, const char *unit) {
+    if (histogram->count == 0) {
+        return;
+    }
+    printf("- %s (%s): p50 = %.2f  p90 = %.2f  p99 = %.2f  p99.9 = %.2f  max = %.2f  (%llu samples)\n", label, unit,
+           histogram_percentile(histogram, 50) / scale, histogram_percentile(histogram, 90) / scale,
+           histogram_percentile(histogram, 99) / scale, histogram_percentile(histogram, 99.9) / scale,
+           histogram->max / scale, (unsigned long long)histogram->count);
+}
+
+/**
+ * Print the command line usage of the receiver.
+ *
+ * @param program Name of the executable.
+ */
+void print_usage(const char *program) {
+    printf("Usage: %s -p PORT -algo ALGO [-sink file|splice|uring|pipeline|null] [-no-checksum] [-serve] [-keep-files]\n"
+           "       [-workers N] [-max-conns N] [-rcvbuf BYTES] [-csv FILE] [-json FILE] [-tcpinfo FILE] [-tcpinfo-interval MS]\n"
+           "       [-transport tcp|rudp] [-interval MS] [-interval-json FILE]\n", program);
+}
+
+/**
+ * Extract port number and congestion control algorithm from command line arguments.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 if extraction is successful, 1 otherwise.
+ */
+int extract_Variables(int argc, char *argv[]) {
+    PORT = 0;
+    ALGO = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-serve") == 0) {
+            SERVE = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "-no-checksum") == 0) {
+            CHECKSUM = 0;
+            continue;
+        }
+        if (strcmp(argv[i], "-keep-files") == 0) {
+            KEEP_FILES = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        const char *option = argv[i];
+        char *value = argv[++i];
+        if (strcmp(option, "-p") == 0) {
+            PORT = atoi(value);
+        } else if (strcmp(option, "-algo") == 0) {
+            ALGO = value;
+        } else if (strcmp(option, "-sink") == 0) {
+            if (strcmp(value, "file") == 0) {
+                SINK = SINK_FILE;
+            } else if (strcmp(value, "splice") == 0) {
+                SINK = SINK_SPLICE;
+            } else if (strcmp(value, "uring") == 0) {
+                SINK = SINK_URING;
+            } else if (strcmp(value, "pipeline") == 0) {
+                SINK = SINK_PIPELINE;
+            } else if (strcmp(value, "null") == 0) {
+                SINK = SINK_NULL;
+            } else {
+                printf("Invalid sink: %s\n", value);
+                return 1;
+            }
+        } else if (strcmp(option, "-workers") == 0) {
+            WORKERS = atoi(value);
+        } else if (strcmp(option, "-max-conns") == 0) {
+            MAX_CONNECTIONS = atoi(value);
+        } else if (strcmp(option, "-rcvbuf") == 0) {
+            RCVBUF = atoi(value);
+        } else if (strcmp(option, "-tcpinfo") == 0) {
+            TCPINFO_PATH = value;
+        } else if (strcmp(option, "-tcpinfo-interval") == 0) {
+            TCPINFO_INTERVAL_MS = atoi(value);
+        } else if (strcmp(option, "-interval") == 0) {
+            INTERVAL_MS = atoi(value);
+            if (INTERVAL_MS < 1) {
+                printf("Report interval must be at least 1 ms\n");
+                return 1;
+            }
+        } else if (strcmp(option, "-interval-json") == 0) {
+            INTERVAL_JSON = value;
+        } else if (strcmp(option, "-transport") == 0) {
+            if (strcmp(value, "tcp") == 0) {
+                RUDP = 0;
+            } else if (strcmp(value, "rudp") == 0) {
+                RUDP = 1;
+            } else {
+                printf("Invalid transport: %s\n", value);
+                return 1;
+            }
+        } else if (strcmp(option, "-csv") == 0) {
+            CSV_PATH = value;
+        } else if (strcmp(option, "-json") == 0) {
+            JSON_PATH = value;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // PORT and ALGO are mandatory
+    if (PORT == 0 || ALGO == NULL || WORKERS < 0 || MAX_CONNECTIONS < 1 || TCPINFO_INTERVAL_MS < 1 || RCVBUF < 0) {
+        print_usage(argv[0]);
+        return 1; // Exit with error
+    }
+    if (INTERVAL_JSON != NULL && INTERVAL_MS == 0) {
+        INTERVAL_MS = REPORTER_DEFAULT_INTERVAL_MS;
+    }
+    char available[TCP_CONGESTION_LIST_SIZE];
+    if (tcp_congestion_available(ALGO, available, sizeof(available)) == 0) {
+        printf("Congestion control algorithm %s is not loaded (modprobe tcp_%s), available: %s\n", ALGO, ALGO,
+               available);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Set the congestion control algorithm for the socket.
+ *
+ * @param sock File descriptor of the socket.
+ */
+void set_congestion_control(int sock) {
+    if (setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, ALGO, strlen(ALGO)) < 0) {
+        fprintf(stderr, "setsockopt TCP_CONGESTION %s failed: %s\n", ALGO, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Open a file for writing.
+ *
+ * @param file_name Name of the file.
+ * @return File descriptor, -1 on error.
+ */
+int open_file_to_write(char *file_name) {
+    int fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC, 0644); // Readable for the splice sink's checksum
+    if (fd < 0) {
+        perror("Error opening file");
+    }
+    return fd;
+}
+
+/**
+ * Write a whole buffer to a file at the given offset.
+ *
+ * @param fd File descriptor of the file.
+ * @param buf Data to write.
+ * @param length Number of bytes to write.
+ * @param offset File offset to write at.
+ * @return 0 on success, -1 on error.
+ */
+int pwrite_all(int fd, const char *buf, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, buf, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error writing file");
+            return -1;
+        }
+        buf += written;
+        length -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+/**
+ * Reserve disk space for a file of the announced size, so the transfer
+ * does not pay for block allocation as it goes.
+ *
+ * @param fd File descriptor of the file.
+ * @param file_size Size announced in the START frame.
+ */
+void preallocate_file(int fd, uint64_t file_size) {
+    if (file_size == 0) {
+        return;
+    }
+    if (fallocate(fd, 0, 0, file_size) < 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+        perror("fallocate");
+    }
+}
+
+/**
+ * Move up to length payload bytes from the socket to the file with splice(),
+ * going through a pipe so the data never enters user space.
+ *
+ * @param socket File descriptor of the socket (non-blocking).
+ * @param pipe_fds Pipe used as the in-kernel buffer, empty on entry and exit.
+ * @param fd File descriptor of the output file.
+ * @param offset File offset to write at, advanced by the bytes moved.
+ * @param length Maximum number of bytes to move.
+ * @return Number of bytes moved, 0 if the peer closed the connection,
+ *         -1 on error (errno is EAGAIN if no data was available).
+ */
+ssize_t splice_to_file(int socket, int pipe_fds[2], int fd, loff_t *offset, size_t length) {
+    ssize_t moved;
+    do {
+        moved = splice(socket, NULL, pipe_fds[1], NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+    } while (moved < 0 && errno == EINTR);
+
+    if (moved <= 0) {
+        if (moved < 0 && errno != EAGAIN) {
+            perror("splice from socket");
+        }
+        return moved;
+    }
+
+    for (ssize_t drained = 0; drained < moved;) {
+        ssize_t n = splice(pipe_fds[0], NULL, fd, offset, moved - drained, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("splice to file");
+            errno = EIO;
+            return -1;
+        }
+        drained += n;
+    }
+    return moved;
+}
+
+/**
+ * Create a server socket.
+ *
+ * @param server_fd Pointer to store the server socket file descriptor.
+ */
+void create_server_socket(int *server_fd) {
+    if ((*server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Bind the server socket to an address.
+ * SO_REUSEPORT lets every worker bind its own listener to the same port,
+ * and the kernel spreads incoming connections across them.
+ *
+ * @param server_fd File descriptor of the server socket.
+ * @param address Pointer to the address structure.
+ */
+void bind_socket(int server_fd, struct sockaddr_in *address) {
+    int opt = 1;
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = INADDR_ANY;
+    address->sin_port = htons(PORT);
+
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("setsockopt");
+        exit(EXIT_FAILURE);
+    }
+
+    if (bind(server_fd, (struct sockaddr *)address, sizeof(*address)) < 0) {
+        perror("bind failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Start listening for incoming connections on the server socket. Accepted
+ * sockets inherit its SO_RCVBUF, which has to be set before the handshake
+ * since the window scale is fixed by it.
+ *
+ * @param server_fd File descriptor of the server socket.
+ */
+void start_listening(int server_fd) {
+    if (RCVBUF > 0 && setsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &RCVBUF, sizeof(RCVBUF)) < 0) {
+        perror("setsockopt SO_RCVBUF");
+        exit(EXIT_FAILURE);
+    }
+    if (listen(server_fd, MAX_CONNECTIONS) < 0) {
+        perror("listen");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * nftw() callback removing one entry of the received files' tree.
+ */
+int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    if (remove(path) != 0) {
+        perror(path);
+    }
+    return 0;
+}
+
+/**
+ * Close the server socket and remove the received files, unless they are
+ * kept with -keep-files.
+ *
+ * @param server_fd File descriptor of the server socket.
+ */
+void close_sockets(int server_fd) {
+    close(server_fd);
+    if (!KEEP_FILES) {
+        nftw(DIR, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+}
+
+/**
+ * Return the current monotonic (wall-clock) time in nanoseconds.
+ *
+ * @return Nanoseconds since an arbitrary fixed point.
+ */
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Return the current monotonic time in milliseconds.
+ *
+ * @return Milliseconds since an arbitrary fixed point.
+ */
+double now_ms() {
+    return now_ns() / 1e6;
+}
+
+/**
+ * Receive the next chunk of bytes from the socket.
+ *
+ * @param socket File descriptor of the socket (non-blocking).
+ * @param buffer Buffer to store the received bytes.
+ * @param length Capacity of the buffer.
+ * @return Number of bytes received, 0 if the sender closed the connection,
+ *         -1 on error (errno is EAGAIN if no data was available).
+ */
+ssize_t receive_message(int socket, char *buffer, size_t length) {
+    ssize_t bytes_received;
+    do {
+        bytes_received = recv(socket, buffer, length, 0);
+    } while (bytes_received < 0 && errno == EINTR);
+
+    if (bytes_received < 0 && errno != EAGAIN) {
+        perror("Error receiving message");
+    }
+    return bytes_received;
+}
+
+/**
+ * Create the shared state of a transfer session. In serve mode every
+ * session writes into its own directory, assets/sessionN.
+ *
+ * @param session_id Identifier announced in CONTROL_JOIN, 0 if none.
+ * @param stream_count Connections carrying the session.
+ * @return Pointer to the new transfer.
+ */
+Transfer *create_transfer(uint64_t session_id, int stream_count) {
+    Transfer *transfer = (Transfer *)calloc(1, sizeof(Transfer));
+    if (transfer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&transfer->lock, NULL);
+    transfer->id = atomic_fetch_add(&SESSIONS_STARTED, 1) + 1;
+    transfer->session_id = session_id;
+    transfer->stream_count = stream_count;
+    transfer->last_run = -1;
+    stats_init(&transfer->stats);
+    histogram_init(&transfer->gaps);
+    histogram_init(&transfer->mb_latency);
+
+    if (SERVE) {
+        snprintf(transfer->dir, sizeof(transfer->dir), "%s/session%d", DIR, transfer->id);
+        if (MKDIR(transfer->dir) != 0 && errno != EEXIST) {
+            perror("Error creating session directory");
+        }
+    } else {
+        snprintf(transfer->dir, sizeof(transfer->dir), "%s", DIR);
+    }
+    return transfer;
+}
+
+/**
+ * Attach a connection to the session it announced in CONTROL_JOIN,
+ * creating the session on its first connection.
+ *
+ * @param conn Connection that sent CONTROL_JOIN.
+ * @param session_id Announced session identifier.
+ * @param index Announced stream index.
+ * @param count Announced number of streams.
+ * @return 0 on success, -1 if the announcement is inconsistent.
+ */
+int join_transfer(Connection *conn, uint64_t session_id, uint32_t index, uint32_t count) {
+    if (conn->transfer != NULL || count == 0 || count > MAX_STREAMS || index >= count) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&SESSIONS_LOCK);
+    Transfer *transfer = SESSIONS;
+    while (transfer != NULL && transfer->session_id != session_id) {
+        transfer = transfer->next;
+    }
+    if (transfer == NULL) {
+        transfer = create_transfer(session_id, count);
+        transfer->next = SESSIONS;
+        SESSIONS = transfer;
+    }
+    pthread_mutex_lock(&transfer->lock);
+    int valid = (uint32_t)transfer->stream_count == count;
+    if (valid) {
+        transfer->connections++;
+    }
+    pthread_mutex_unlock(&transfer->lock);
+    pthread_mutex_unlock(&SESSIONS_LOCK);
+
+    if (!valid) {
+        return -1;
+    }
+    conn->transfer = transfer;
+    conn->stream_index = index;
+    return 0;
+}
+
+/**
+ * Append the results of a finished session to the export files.
+ *
+ * @param transfer Finished session.
+ */
+void export_results(Transfer *transfer) {
+    if (transfer->stats.count == 0) {
+        return;
+    }
+    pthread_mutex_lock(&EXPORT_LOCK);
+    stats_merge(&ALL_STATS, &transfer->stats);
+    ALL_SESSIONS++;
+    if (CSV_FILE != NULL) {
+        stats_write_csv(CSV_FILE, transfer->id, &transfer->stats);
+        fflush(CSV_FILE);
+    }
+    if (JSON_FILE != NULL) {
+        fprintf(JSON_FILE, "%s\n", JSON_SESSIONS++ ? "," : "");
+        stats_write_json(JSON_FILE, transfer->id, transfer->stream_count, &transfer->stats);
+        fflush(JSON_FILE);
+    }
+    pthread_mutex_unlock(&EXPORT_LOCK);
+}
+
+/**
+ * Open the export files given on the command line.
+ */
+void open_exports() {
+    if (CSV_PATH != NULL) {
+        CSV_FILE = fopen(CSV_PATH, "w");
+        if (CSV_FILE == NULL) {
+            perror("Error opening CSV file");
+            exit(EXIT_FAILURE);
+        }
+        stats_write_csv_header(CSV_FILE);
+    }
+    if (JSON_PATH != NULL) {
+        JSON_FILE = fopen(JSON_PATH, "w");
+        if (JSON_FILE == NULL) {
+            perror("Error opening JSON file");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(JSON_FILE, "[");
+    }
+}
+
+/**
+ * Complete and close the export files. The JSON file holds an array with
+ * one object per session.
+ */
+void close_exports() {
+    if (CSV_FILE != NULL) {
+        fclose(CSV_FILE);
+    }
+    if (JSON_FILE != NULL) {
+        fprintf(JSON_FILE, "\n]\n");
+        fclose(JSON_FILE);
+    }
+}
+
+void release_tree(TreeLayout *tree);
+
+/**
+ * Print the results of a finished session and release it. Outside of serve
+ * mode the first finished session also ends the receiver.
+ *
+ * @param transfer Session whose last connection has closed.
+ */
+void finish_transfer(Transfer *transfer) {
+    // Runs the sender never completed still hold an open file
+    while (transfer->runs != NULL) {
+        RunState *state = transfer->runs;
+        transfer->runs = state->next;
+        if (state->ends_pending > 0) {
+            reporter_end(&REPORTER);
+        }
+        if (state->fd >= 0) {
+            close(state->fd);
+        }
+        if (state->base_fd >= 0) {
+            close(state->base_fd);
+        }
+        release_tree(state->layout);
+        release_tree(state->base_tree);
+        free(state);
+    }
+    release_tree(transfer->base_tree);
+
+    flockfile(stdout);
+    if (SERVE) {
+        printf("Session %d finished (%d stream%s%s)\n", transfer->id, transfer->stream_count,
+               transfer->stream_count > 1 ? "s" : "", transfer->failed ? ", failed" : "");
+    }
+    if (transfer->stats.count > 0) {
+        print_times(&transfer->stats);
+        print_latency("Frame inter-arrival", &transfer->gaps, 1e3, "us");
+        print_latency("Per-MB latency", &transfer->mb_latency, 1e6, "ms");
+        printf("____________________________________________________________\n");
+    }
+    funlockfile(stdout);
+
+    if (transfer->failed) {
+        atomic_store(&FAILED, 1);
+    }
+    if (!SERVE) {
+        STOP = 1;
+    }
+    export_results(transfer);
+    stats_free(&transfer->stats);
+    pthread_mutex_destroy(&transfer->lock);
+    free(transfer);
+}
+
+/**
+ * Detach a closing connection from its session; the last connection to
+ * leave finishes the session.
+ *
+ * @param conn Connection being closed.
+ */
+void leave_transfer(Connection *conn) {
+    Transfer *transfer = conn->transfer;
+    if (transfer == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&SESSIONS_LOCK);
+    pthread_mutex_lock(&transfer->lock);
+    int last = (--transfer->connections == 0);
+    if (conn->failed) {
+        transfer->failed = 1;
+    }
+    if (last && transfer->session_id != 0) {
+        Transfer **link = &SESSIONS;
+        while (*link != NULL && *link != transfer) {
+            link = &(*link)->next;
+        }
+        if (*link != NULL) {
+            *link = transfer->next;
+        }
+    }
+    pthread_mutex_unlock(&transfer->lock);
+    pthread_mutex_unlock(&SESSIONS_LOCK);
+
+    conn->transfer = NULL;
+    if (last) {
+        finish_transfer(transfer);
+    }
+}
+
+/**
+ * Build the name of a run's output file: run 0 is written to
+ * receive_file.txt, run N to receive_fileN.txt.
+ *
+ * @param transfer Transfer the run belongs to.
+ * @param run Run index.
+ * @param filename Buffer for the name.
+ * @param size Size of the buffer.
+ */
+void run_filename(Transfer *transfer, int run, char *filename, size_t size) {
+    if (run == 0) {
+        snprintf(filename, size, "%s/receive_file.txt", transfer->dir);
+    } else {
+        snprintf(filename, size, "%s/receive_file%d.txt", transfer->dir, run);
+    }
+}
+
+/**
+ * Build the name of the directory a tree run is written into: receive_tree
+ * for run 0, receive_treeN for run N.
+ *
+ * @param transfer Transfer the run belongs to.
+ * @param run Run index.
+ * @param dirname Buffer for the name.
+ * @param size Size of the buffer.
+ */
+void run_treename(Transfer *transfer, int run, char *dirname, size_t size) {
+    if (run == 0) {
+        snprintf(dirname, size, "%s/receive_tree", transfer->dir);
+    } else {
+        snprintf(dirname, size, "%s/receive_tree%d", transfer->dir, run);
+    }
+}
+
+/**
+ * Create the layout of a tree run and the directory it is written into.
+ * The manifest fills the layout in as its frames arrive.
+ *
+ * @param transfer Transfer the run belongs to.
+ * @param run Run index.
+ * @return Pointer to the layout, NULL if the directory cannot be created.
+ */
+TreeLayout *create_tree(Transfer *transfer, int run) {
+    TreeLayout *tree = (TreeLayout *)calloc(1, sizeof(TreeLayout));
+    if (tree == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    run_treename(transfer, run, tree->root, sizeof(tree->root));
+    run_filename(transfer, run, tree->spill_path, sizeof(tree->spill_path));
+    if (mkdir(tree->root, 0755) < 0 && errno != EEXIST) {
+        perror(tree->root);
+        free(tree);
+        return NULL;
+    }
+    pthread_mutex_init(&tree->lock, NULL);
+    atomic_init(&tree->refs, 1);
+    tree->spill_fd = -1;
+    tree->read_file = -1;
+    tree->read_fd = -1;
+    return tree;
+}
+
+/**
+ * Drop a reference to the layout of a tree run, freeing it with the last
+ * one. Files still open are closed and a spill file left over by a run
+ * that did not complete is removed.
+ *
+ * @param tree Layout to release, may be NULL.
+ */
+void release_tree(TreeLayout *tree) {
+    if (tree == NULL || atomic_fetch_sub(&tree->refs, 1) > 1) {
+        return;
+    }
+    for (size_t k = 0; k < tree->file_count; k++) {
+        if (tree->files[k].fd >= 0) {
+            close(tree->files[k].fd);
+        }
+        free(tree->files[k].path);
+    }
+    for (size_t k = 0; k < tree->dir_count; k++) {
+        free(tree->dirs[k].path);
+    }
+    if (tree->spill_fd >= 0) {
+        close(tree->spill_fd);
+        unlink(tree->spill_path);
+    }
+    if (tree->read_fd >= 0) {
+        close(tree->read_fd);
+    }
+    pthread_mutex_destroy(&tree->lock);
+    free(tree->files);
+    free(tree->dirs);
+    free(tree->spans);
+    free(tree);
+}
+
+/**
+ * Find the file of a tree run holding a byte of the run, which the manifest
+ * must already have placed.
+ *
+ * @param tree Layout of the run.
+ * @param offset Offset of the byte in the run, below tree->covered.
+ * @return Index of the file in tree->files.
+ */
+size_t tree_find(TreeLayout *tree, uint64_t offset) {
+    size_t low = 0, high = tree->file_count;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (tree->files[middle].offset <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Find where a byte of a tree run is written: into its file, opened if it
+ * is not open yet, or into the spill file if the manifest has not placed it
+ * yet. Every successful call is paired with tree_target_done().
+ *
+ * @param tree Layout of the run.
+ * @param offset Offset of the byte in the run.
+ * @param fd Set to the file to write to.
+ * @param position Set to the offset to write at in that file.
+ * @param room Set to the bytes that can be written there in one go.
+ * @return Index of the file in tree->files, -1 for the spill file, -2 if the file cannot be opened.
+ */
+int tree_target(TreeLayout *tree, uint64_t offset, int *fd, uint64_t *position, uint64_t *room) {
+    pthread_mutex_lock(&tree->lock);
+    if (offset >= tree->covered) {
+        if (tree->spill_fd < 0) {
+            tree->spill_fd = open_file_to_write(tree->spill_path);
+        }
+        *fd = tree->spill_fd;
+        *position = offset;
+        *room = UINT64_MAX;
+        pthread_mutex_unlock(&tree->lock);
+        return *fd >= 0 ? -1 : -2;
+    }
+    size_t index = tree_find(tree, offset);
+    TreeFile *file = &tree->files[index];
+    if (file->fd < 0) {
+        file->fd = open(file->path, O_WRONLY | O_NOFOLLOW);
+        if (file->fd < 0) {
+            perror(file->path);
+            pthread_mutex_unlock(&tree->lock);
+            return -2;
+        }
+        tree->open_count++;
+    }
+    file->writers++;
+    *fd = file->fd;
+    *position = offset - file->offset;
+    *room = file->offset + file->size - offset;
+    pthread_mutex_unlock(&tree->lock);
+    return (int)index;
+}
+
+/**
+ * Account for a write tree_target() directed. A file whose bytes have all
+ * been written gets its permissions and is closed; bytes written to the
+ * spill file are recorded so they can be moved into place later.
+ *
+ * @param tree Layout of the run.
+ * @param index Value returned by tree_target().
+ * @param offset Offset of the written bytes in the run.
+ * @param length Number of bytes written, 0 if the write failed.
+ */
+void tree_target_done(TreeLayout *tree, int index, uint64_t offset, uint64_t length) {
+    int fd = -1;
+    uint32_t mode = 0;
+    pthread_mutex_lock(&tree->lock);
+    if (index < 0 && length > 0) {
+        // Each stream spills contiguous bytes, so most writes extend a span
+        size_t k = 0;
+        while (k < tree->span_count && tree->spans[k].offset + tree->spans[k].length != offset) {
+            k++;
+        }
+        if (k == tree->span_count) {
+            if (tree->span_count == tree->span_capacity) {
+                tree->span_capacity = tree->span_capacity ? tree->span_capacity * 2 : 16;
+                tree->spans = realloc(tree->spans, tree->span_capacity * sizeof(TreeSpan));
+                if (tree->spans == NULL) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            tree->spans[tree->span_count++] = (TreeSpan){.offset = offset, .length = 0};
+        }
+        tree->spans[k].length += length;
+        tree->spilled += length;
+    } else if (index >= 0) {
+        TreeFile *file = &tree->files[index];
+        file->written += length;
+        if (--file->writers == 0 && file->written >= file->size) {
+            fd = file->fd;
+            mode = file->mode;
+            file->fd = -1;
+            tree->open_count--;
+        }
+    }
+    pthread_mutex_unlock(&tree->lock);
+    if (fd >= 0) {
+        if (fchmod(fd, mode & 07777) < 0) {
+            perror("fchmod");
+        }
+        close(fd);
+    }
+}
+
+/**
+ * Write data of a tree run at its offset in the run, into the files it
+ * spans.
+ *
+ * @param tree Layout of the run.
+ * @param data Data to write.
+ * @param length Number of bytes to write.
+ * @param offset Offset of the data in the run.
+ * @return 0 on success, -1 on error.
+ */
+int tree_write(TreeLayout *tree, const char *data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        int fd;
+        uint64_t position, room;
+        int index = tree_target(tree, offset, &fd, &position, &room);
+        if (index < -1) {
+            return -1;
+        }
+        size_t chunk = length < room ? length : room;
+        int result = pwrite_all(fd, data, chunk, position);
+        tree_target_done(tree, index, offset, result < 0 ? 0 : chunk);
+        if (result < 0) {
+            return -1;
+        }
+        data += chunk;
+        length -= chunk;
+        offset += chunk;
+    }
+    return 0;
+}
+
+/**
+ * Write file data of a run at its offset: into the run's file, or into the
+ * files of a tree run.
+ *
+ * @param state Run the data belongs to.
+ * @param data Data to write.
+ * @param length Number of bytes to write.
+ * @param offset Offset of the data in the run.
+ * @return 0 on success, -1 on error.
+ */
+int run_write(RunState *state, const char *data, size_t length, uint64_t offset) {
+    if (state->layout != NULL) {
+        return tree_write(state->layout, data, length, offset);
+    }
+    return pwrite_all(state->fd, data, length, offset);
+}
+
+/**
+ * Read bytes of a completed tree run back from its files, for a delta run
+ * based on it. Reads stop at the end of a file.
+ *
+ * @param tree Layout of the completed run.
+ * @param buffer Buffer to read into.
+ * @param length Most bytes to read.
+ * @param offset Offset of the bytes in the run.
+ * @return Number of bytes read, 0 past the end of the run, -1 on error.
+ */
+ssize_t tree_read(TreeLayout *tree, char *buffer, size_t length, uint64_t offset) {
+    if (offset >= tree->covered) {
+        return 0;
+    }
+    int index = (int)tree_find(tree, offset);
+    TreeFile *file = &tree->files[index];
+    if (tree->read_file != index) {
+        if (tree->read_fd >= 0) {
+            close(tree->read_fd);
+        }
+        tree->read_file = index;
+        tree->read_fd = open(file->path, O_RDONLY | O_NOFOLLOW);
+        if (tree->read_fd < 0) {
+            tree->read_file = -1;
+            return -1;
+        }
+    }
+    uint64_t left = file->offset + file->size - offset;
+    return pread(tree->read_fd, buffer, length < left ? length : left, offset - file->offset);
+}
+
+/**
+ * Find the state of a run, creating it and its output file on first sight.
+ * A tree run gets the layout its files are written through instead, and
+ * the null sink creates neither.
+ *
+ * @param transfer Transfer the run belongs to.
+ * @param run Run index announced by the sender.
+ * @param file_size File size announced by the sender.
+ * @param tree Non-zero if the run carries a directory tree.
+ * @return Pointer to the run state, NULL if the output file cannot be created.
+ */
+RunState *get_run(Transfer *transfer, int run, uint64_t file_size, int tree) {
+    pthread_mutex_lock(&transfer->lock);
+    RunState *state = transfer->runs;
+    while (state != NULL && state->run != run) {
+        state = state->next;
+    }
+    if (state == NULL) {
+        int fd = -1;
+        TreeLayout *layout = NULL;
+        if (SINK != SINK_NULL && tree) {
+            layout = create_tree(transfer, run);
+            if (layout == NULL) {
+                pthread_mutex_unlock(&transfer->lock);
+                return NULL;
+            }
+        } else if (SINK != SINK_NULL) {
+            char filename[128];
+            run_filename(transfer, run, filename, sizeof(filename));
+            fd = open_file_to_write(filename);
+            if (fd < 0) {
+                pthread_mutex_unlock(&transfer->lock);
+                return NULL;
+            }
+        }
+
+        state = (RunState *)calloc(1, sizeof(RunState));
+        if (state == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        state->run = run;
+        state->fd = fd;
+        state->tree = tree;
+        state->layout = layout;
+        state->file_size = file_size;
+        state->ends_pending = transfer->stream_count;
+        state->start_ns = now_ns();
+        state->base_run = -1;
+        state->base_fd = -1;
+        snprintf(state->algo, sizeof(state->algo), "%s", ALGO);
+        histogram_init(&state->gaps);
+        histogram_init(&state->mb_latency);
+        if (state->fd >= 0) {
+            preallocate_file(state->fd, file_size);
+        }
+        state->next = transfer->runs;
+        transfer->runs = state;
+        reporter_begin(&REPORTER);
+    }
+    pthread_mutex_unlock(&transfer->lock);
+    return state;
+}
+
+/**
+ * Print per-stream and aggregate throughput of a multi-stream run, with
+ * Jain's fairness index over the per-stream throughputs.
+ *
+ * @param state Completed run.
+ * @param stream_count Number of streams of the session.
+ * @param elapsed_ms Wall-clock duration of the run.
+ */
+void print_stream_stats(RunState *state, int stream_count, double elapsed_ms) {
+    double sum = 0, sum_squares = 0;
+    for (int k = 0; k < stream_count; k++) {
+        StreamStats *stream = &state->streams[k];
+        double ms = stream->end_ms - stream->start_ms;
+        double mbps = ms > 0 ? (stream->bytes / (1024.0 * 1024.0)) / (ms / 1000.0) : 0;
+        printf("    Stream #%d: %.2f MB in %.2f ms = %.2f MB/s\n", k, stream->bytes / (1024.0 * 1024.0), ms, mbps);
+        sum += mbps;
+        sum_squares += mbps * mbps;
+    }
+    double aggregate = elapsed_ms > 0 ? (state->bytes_written / (1024.0 * 1024.0)) / (elapsed_ms / 1000.0) : 0;
+    printf("    Aggregate: %.2f MB/s over %d streams, fairness (Jain) = %.3f\n", aggregate, stream_count,
+           sum_squares > 0 ? (sum * sum) / (stream_count * sum_squares) : 1.0);
+}
+
+/**
+ * Check a path of a manifest entry: relative, without empty, "." or ".."
+ * components, so the tree cannot reach outside of its directory.
+ *
+ * @param path Path as sent, not terminated.
+ * @param length Length of the path.
+ * @return 1 if the path is safe, 0 if not.
+ */
+int manifest_path_ok(const char *path, size_t length) {
+    if (length == 0 || length > MANIFEST_PATH_MAX || memchr(path, '\0', length) != NULL) {
+        return 0;
+    }
+    size_t start = 0;
+    while (start <= length) {
+        const char *slash = memchr(path + start, '/', length - start);
+        size_t end = slash != NULL ? (size_t)(slash - path) : length;
+        size_t component = end - start;
+        if (component == 0 || (component == 1 && path[start] == '.') ||
+            (component == 2 && path[start] == '.' && path[start + 1] == '.')) {
+            return 0;
+        }
+        start = end + 1;
+    }
+    return 1;
+}
+
+/**
+ * Lay out the entries of a CONTROL_MANIFEST frame: directories are created
+ * writable, files are created and preallocated, and the first TREE_OPEN_MAX
+ * stay open for the data that follows. Files are published in the layout
+ * once they exist, so data never reaches a file before it is truncated.
+ *
+ * @param tree Layout of the run.
+ * @param entries Manifest entries of the frame, which carries whole entries.
+ * @param length Length of the entries.
+ * @param file_size Size of the run, which the files cannot exceed.
+ * @return 0 on success, -1 if an entry is invalid or cannot be created.
+ */
+int tree_add_entries(TreeLayout *tree, const unsigned char *entries, size_t length, uint64_t file_size) {
+    char path[sizeof(tree->root) + MANIFEST_PATH_MAX + 2];
+    size_t position = 0;
+    while (position < length) {
+        const unsigned char *entry = entries + position;
+        size_t left = length - position;
+        uint64_t size = left >= MANIFEST_ENTRY_SIZE ? get_u64(entry) : 0;
+        uint32_t mode = left >= MANIFEST_ENTRY_SIZE ? get_u32(entry + 8) : 0;
+        uint32_t path_length = left >= MANIFEST_ENTRY_SIZE ? get_u32(entry + 12) : 0;
+        const char *name = (const char *)entry + MANIFEST_ENTRY_SIZE;
+        if (left < MANIFEST_ENTRY_SIZE || path_length > left - MANIFEST_ENTRY_SIZE ||
+            !manifest_path_ok(name, path_length) || (!S_ISDIR(mode) && !S_ISREG(mode)) ||
+            size > file_size - tree->covered) {
+            fprintf(stderr, "Invalid manifest entry at byte %zu of a frame\n", position);
+            return -1;
+        }
+        snprintf(path, sizeof(path), "%s/%.*s", tree->root, (int)path_length, name);
+        position += MANIFEST_ENTRY_SIZE + path_length;
+
+        char *copy = strdup(path);
+        if (copy == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (S_ISDIR(mode)) {
+            if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+                perror(path);
+                free(copy);
+                return -1;
+            }
+            pthread_mutex_lock(&tree->lock);
+            if (tree->dir_count == tree->dir_capacity) {
+                tree->dir_capacity = tree->dir_capacity ? tree->dir_capacity * 2 : 16;
+                tree->dirs = realloc(tree->dirs, tree->dir_capacity * sizeof(TreeDir));
+                if (tree->dirs == NULL) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            tree->dirs[tree->dir_count++] = (TreeDir){.path = copy, .mode = mode};
+            pthread_mutex_unlock(&tree->lock);
+            continue;
+        }
+
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
+        if (fd < 0) {
+            perror(path);
+            free(copy);
+            return -1;
+        }
+        preallocate_file(fd, size);
+        tree->created++;
+        if (size == 0) {
+            // Nothing follows for an empty file, it is complete already
+            if (fchmod(fd, mode & 07777) < 0) {
+                perror("fchmod");
+            }
+            close(fd);
+            free(copy);
+            continue;
+        }
+        pthread_mutex_lock(&tree->lock);
+        int keep = tree->open_count < TREE_OPEN_MAX;
+        tree->open_count += keep;
+        if (tree->file_count == tree->file_capacity) {
+            tree->file_capacity = tree->file_capacity ? tree->file_capacity * 2 : 64;
+            tree->files = realloc(tree->files, tree->file_capacity * sizeof(TreeFile));
+            if (tree->files == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        tree->files[tree->file_count++] =
+            (TreeFile){.path = copy, .offset = tree->covered, .size = size, .mode = mode, .fd = keep ? fd : -1};
+        tree->covered += size;
+        pthread_mutex_unlock(&tree->lock);
+        if (!keep) {
+            close(fd);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Handle a CONTROL_MANIFEST frame of a tree run: its files and directories
+ * are created right away, outside of the session lock, so the data can be
+ * written straight into them.
+ *
+ * @param transfer Transfer the run belongs to.
+ * @param run Run index announced in the frame.
+ * @param entries Manifest entries of the frame.
+ * @param length Length of the entries.
+ * @return 0 on success, -1 if the run is not a tree run, the manifest is too large or invalid.
+ */
+int append_manifest(Transfer *transfer, int run, const unsigned char *entries, size_t length) {
+    pthread_mutex_lock(&transfer->lock);
+    RunState *state = transfer->runs;
+    while (state != NULL && state->run != run) {
+        state = state->next;
+    }
+    if (state == NULL || !state->tree || length > MANIFEST_MAX - state->manifest_length) {
+        pthread_mutex_unlock(&transfer->lock);
+        fprintf(stderr, "CONTROL_MANIFEST outside of a directory tree run or over %d bytes\n", MANIFEST_MAX);
+        return -1;
+    }
+    state->manifest_length += length;
+    TreeLayout *tree = state->layout;
+    uint64_t file_size = state->file_size;
+    pthread_mutex_unlock(&transfer->lock);
+    // The manifest comes before END on the same stream, so the run outlives this call
+    return tree != NULL ? tree_add_entries(tree, entries, length, file_size) : 0;
+}
+
+/**
+ * Complete a tree run once all its data is written: the bytes that arrived
+ * ahead of their manifest entry move from the spill file into place, then
+ * the directories get their permissions, deepest first, so a read-only
+ * directory still received its contents. No stream writes to the run
+ * anymore.
+ *
+ * @param state Completed tree run.
+ * @param files Set to the number of files created.
+ * @param dirs Set to the number of directories created.
+ * @return 0 on success, -1 if the tree is incomplete or cannot be written.
+ */
+int finish_tree(RunState *state, int *files, int *dirs) {
+    TreeLayout *tree = state->layout;
+    int result = 0;
+    if (tree->covered != state->bytes_written) {
+        fprintf(stderr, "The manifest covers %llu of the %llu bytes of the tree\n",
+                (unsigned long long)tree->covered, (unsigned long long)state->bytes_written);
+        result = -1;
+    }
+    if (tree->spill_fd >= 0) {
+        char *buffer = malloc(BUFFER_SIZE);
+        if (buffer == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t k = 0; result == 0 && k < tree->span_count; k++) {
+            uint64_t offset = tree->spans[k].offset, end = offset + tree->spans[k].length;
+            while (offset < end) {
+                ssize_t n = pread(tree->spill_fd, buffer, end - offset < BUFFER_SIZE ? end - offset : BUFFER_SIZE,
+                                  offset);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0 || tree_write(tree, buffer, n, offset) < 0) {
+                    perror("Error moving spilled data into the tree");
+                    result = -1;
+                    break;
+                }
+                offset += n;
+            }
+        }
+        free(buffer);
+        close(tree->spill_fd);
+        tree->spill_fd = -1;
+        unlink(tree->spill_path);
+    }
+
+    int incomplete = 0;
+    for (size_t k = 0; k < tree->file_count; k++) {
+        incomplete += tree->files[k].written < tree->files[k].size;
+        if (tree->files[k].fd >= 0) {
+            close(tree->files[k].fd);
+            tree->files[k].fd = -1;
+        }
+    }
+    tree->open_count = 0;
+    if (incomplete > 0 && result == 0) {
+        fprintf(stderr, "%d files of the tree were not written completely\n", incomplete);
+        result = -1;
+    }
+    for (size_t k = tree->dir_count; k-- > 0;) {
+        if (chmod(tree->dirs[k].path, tree->dirs[k].mode & 07777) < 0) {
+            perror(tree->dirs[k].path);
+        }
+    }
+    *files = tree->created;
+    *dirs = (int)tree->dir_count;
+    return result;
+}
+
+/**
+ * Check whether a run before the given one has not completed yet, or is
+ * still being completed on disk. Called with the session lock held.
+ *
+ * @param transfer Transfer the run belongs to.
+ * @param state Run to check.
+ * @return 1 if an earlier run is still in progress, 0 if not.
+ */
+int earlier_run_pending(Transfer *transfer, RunState *state) {
+    if (transfer->finishing > 0) {
+        return 1;
+    }
+    for (RunState *other = transfer->runs; other != NULL; other = other->next) {
+        if (other->run < state->run) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int sign_base(Connection *conn, RunState *state);
+
+/**
+ * Account for a stream's END frame: its latency samples join the run's. The
+ * stream that delivers the last END of a run records its wall-clock time and
+ * closes the output file, or completes the tree, outside of the session lock.
+ *
+ * @param conn Connection that received the END frame.
+ */
+void finish_stream(Connection *conn) {
+    Transfer *transfer = conn->transfer;
+    RunState *state = conn->run;
+
+    pthread_mutex_lock(&transfer->lock);
+    histogram_merge(&state->gaps, &conn->gaps);
+    histogram_merge(&state->mb_latency, &conn->mb_latency);
+    if (--state->ends_pending > 0) {
+        pthread_mutex_unlock(&transfer->lock);
+        return;
+    }
+
+    reporter_end(&REPORTER);
+    uint64_t elapsed_ns = now_ns() - state->start_ns;
+    int streams = state->delta ? 1 : transfer->stream_count; // Delta runs use stream 0 alone
+    if (!state->warmup) {
+        stats_add(&transfer->stats, state->number, state->algo, elapsed_ns / 1e6, state->bytes_received,
+                  state->wire_bytes);
+        histogram_merge(&transfer->gaps, &state->gaps);
+        histogram_merge(&transfer->mb_latency, &state->mb_latency);
+    }
+    RunState **link = &transfer->runs;
+    while (*link != state) {
+        link = &(*link)->next;
+    }
+    *link = state->next;
+    transfer->finishing++;
+    pthread_mutex_unlock(&transfer->lock);
+
+    int tree_result = 0, tree_files = 0, tree_dirs = 0;
+    double tree_ms = 0, tree_spilled = 0;
+    if (state->fd >= 0) {
+        if (ftruncate(state->fd, state->bytes_written) < 0) { // Drop any preallocated space that was not used
+            perror("ftruncate");
+        }
+        close(state->fd);
+    }
+    if (state->layout != NULL) {
+        uint64_t tree_start = now_ns();
+        tree_result = finish_tree(state, &tree_files, &tree_dirs);
+        tree_ms = (now_ns() - tree_start) / 1e6;
+        tree_spilled = state->layout->spilled / (1024.0 * 1024.0);
+    }
+
+    // The run is complete on disk before a delta run can take it as its base
+    pthread_mutex_lock(&transfer->lock);
+    if (tree_result < 0) {
+        transfer->failed = 1;
+    }
+    transfer->finishing--;
+    transfer->last_run = state->run;
+    TreeLayout *previous = transfer->base_tree;
+    transfer->base_tree = state->layout;
+    state->layout = NULL;
+    // A delta run whose START arrived before this run completed is answered now
+    RunState *waiting = transfer->runs;
+    while (waiting != NULL && (waiting->signer == NULL || earlier_run_pending(transfer, waiting))) {
+        waiting = waiting->next;
+    }
+    Connection *signer = waiting != NULL ? waiting->signer : NULL;
+    if (waiting != NULL) {
+        waiting->signer = NULL;
+    }
+    pthread_mutex_unlock(&transfer->lock);
+    release_tree(previous);
+    if (signer != NULL && sign_base(signer, waiting) < 0) {
+        pthread_mutex_lock(&transfer->lock);
+        transfer->failed = 1;
+        pthread_mutex_unlock(&transfer->lock);
+    }
+
+    flockfile(stdout);
+    if (SERVE) {
+        printf("Session %d: ", transfer->id);
+    }
+    printf("File %d transfer completed%s\n", state->run + 1, state->warmup ? " (warmup, not counted)" : "");
+    if (streams > 1) {
+        print_stream_stats(state, streams, elapsed_ns / 1e6);
+    }
+    if (state->gaps.count > 0) {
+        printf("    Frame inter-arrival: p50 = %.1f us, p99 = %.1f us, p99.9 = %.1f us\n",
+               histogram_percentile(&state->gaps, 50) / 1e3, histogram_percentile(&state->gaps, 99) / 1e3,
+               histogram_percentile(&state->gaps, 99.9) / 1e3);
+    }
+    if (state->compressed_bytes > 0) {
+        printf("    Compression: %.2f MB of %.2f MB arrived compressed, %.2f MB on the wire (%.1f%%)\n",
+               state->compressed_bytes / (1024.0 * 1024.0), state->bytes_received / (1024.0 * 1024.0),
+               state->wire_bytes / (1024.0 * 1024.0),
+               state->bytes_received > 0 ? 100.0 * state->wire_bytes / state->bytes_received : 100.0);
+    }
+    if (state->delta) {
+        uint64_t literal_bytes = state->bytes_received - state->copied_bytes;
+        char base[128] = "no previous file";
+        if (state->base_tree != NULL) {
+            run_treename(transfer, state->base_run, base, sizeof(base));
+        } else if (state->base_fd >= 0) {
+            run_filename(transfer, state->base_run, base, sizeof(base));
+        }
+        printf("    Delta: %.2f MB rebuilt from %.2f MB of literals and %.2f MB copied from %s (%.1f%% saved)\n",
+               state->bytes_received / (1024.0 * 1024.0), literal_bytes / (1024.0 * 1024.0),
+               state->copied_bytes / (1024.0 * 1024.0), base,
+               state->bytes_received > 0 ? 100.0 * state->copied_bytes / state->bytes_received : 0.0);
+        printf("    Delta timing: signatures %.2f ms, copies %.2f ms, reconstruction %.2f ms\n", state->signature_ms,
+               state->copy_ns / 1e6, elapsed_ns / 1e6 - state->signature_ms);
+        if (state->base_fd >= 0) {
+            close(state->base_fd);
+        }
+        release_tree(state->base_tree);
+    }
+    int checked = 0, mismatches = 0;
+    for (int k = 0; k < streams; k++) {
+        checked += state->streams[k].checked != 0;
+        mismatches += state->streams[k].checked < 0;
+    }
+    if (checked > 0) {
+        // Stream k carries the k-th contiguous range, so the run's CRC chains them in stream order
+        uint32_t crc = state->streams[0].crc;
+        for (int k = 1; k < streams; k++) {
+            crc = crc32c_combine(crc, state->streams[k].crc, state->streams[k].bytes);
+        }
+        printf("    Checksum (CRC32C): %08x over %llu bytes, %s\n", crc, (unsigned long long)state->bytes_received,
+               mismatches > 0 ? "MISMATCH" : (checked < streams ? "partly verified" : "verified"));
+    }
+    if (state->tree) {
+        char tree[128];
+        run_treename(transfer, state->run, tree, sizeof(tree));
+        if (SINK == SINK_NULL) {
+            printf("    Tree: %zu manifest bytes, not written by the null sink\n", state->manifest_length);
+        } else if (tree_result < 0) {
+            printf("    Tree: writing %s FAILED, %d files and %d directories created\n", tree, tree_files, tree_dirs);
+        } else {
+            printf("    Tree: %d files and %d directories written in place into %s, completed in %.2f ms", tree_files,
+                   tree_dirs, tree, tree_ms);
+            if (tree_spilled > 0) {
+                printf(" (%.2f MB arrived ahead of the manifest and were moved into place)", tree_spilled);
+            }
+            printf("\n");
+        }
+    }
+    funlockfile(stdout);
+    free(state);
+}
+
+/**
+ * Start receiving a byte range of a run on a connection.
+ *
+ * @param conn Connection the range arrives on.
+ * @param state Run the range belongs to.
+ * @param offset Offset of the range in the file.
+ * @param length Length of the range.
+ */
+void begin_range(Connection *conn, RunState *state, uint64_t offset, uint64_t length) {
+    conn->run = state;
+    conn->range_offset = offset;
+    conn->range_length = length;
+    conn->range_done = 0;
+    conn->range_queued = 0;
+    conn->range_crc = 0;
+    conn->last_frame_ns = 0;
+    conn->unit_start_ns = now_ns();
+    conn->unit_bytes = 0;
+    histogram_init(&conn->gaps);
+    histogram_init(&conn->mb_latency);
+
+    StreamStats *stream = &state->streams[conn->stream_index];
+    stream->bytes = length;
+    stream->start_ms = conn->unit_start_ns / 1e6;
+    stream->end_ms = stream->start_ms;
+    stream->crc = 0;
+    stream->checked = 0;
+}
+
+/**
+ * Record the arrival of file data for the latency histograms: the gap since
+ * the previous data frame once a frame is complete, and the time each
+ * LATENCY_UNIT of the range took to arrive.
+ *
+ * @param conn Connection the data arrived on.
+ * @param length Number of payload bytes that arrived.
+ * @param end_of_frame Non-zero if the bytes complete a FILE_DATA frame.
+ */
+void data_arrived(Connection *conn, size_t length, int end_of_frame) {
+    uint64_t now = now_ns();
+    if (end_of_frame) {
+        if (conn->last_frame_ns != 0) {
+            histogram_record(&conn->gaps, now - conn->last_frame_ns);
+        }
+        conn->last_frame_ns = now;
+    }
+
+    conn->unit_bytes += length;
+    if (conn->unit_bytes >= LATENCY_UNIT) {
+        uint64_t units = conn->unit_bytes / LATENCY_UNIT;
+        uint64_t per_unit = (now - conn->unit_start_ns) / units;
+        for (uint64_t u = 0; u < units; u++) {
+            histogram_record(&conn->mb_latency, per_unit);
+        }
+        conn->unit_bytes %= LATENCY_UNIT;
+        conn->unit_start_ns = now;
+    }
+}
+
+/**
+ * Account for file data written for the current range.
+ *
+ * @param conn Connection the data arrived on.
+ * @param length Number of bytes written.
+ * @param wire_length Payload bytes the data took on the wire, fewer than
+ *                    length if it arrived compressed.
+ */
+void range_written(Connection *conn, size_t length, size_t wire_length) {
+    conn->range_done += length;
+    uint64_t end = conn->range_offset + conn->range_done;
+
+    reporter_count(&REPORTER, length);
+    pthread_mutex_lock(&conn->transfer->lock);
+    conn->run->bytes_received += length;
+    conn->run->wire_bytes += wire_length;
+    if (wire_length < length) {
+        conn->run->compressed_bytes += length;
+    }
+    if (end > conn->run->bytes_written) {
+        conn->run->bytes_written = end;
+    }
+    pthread_mutex_unlock(&conn->transfer->lock);
+    if (conn->range_done >= conn->range_length) {
+        conn->run->streams[conn->stream_index].end_ms = now_ms();
+    }
+}
+
+/**
+ * Collect a slice of a compressed FILE_DATA frame and decompress the chunk
+ * once the frame is complete.
+ *
+ * @param conn Connection the slice arrived on.
+ * @param event Data event carrying the slice.
+ * @param data Set to the decompressed chunk when one is ready.
+ * @param length Set to the length of the decompressed chunk.
+ * @return 1 if a chunk is ready, 0 if the frame is incomplete, -1 if it is invalid.
+ */
+int unpack_chunk(Connection *conn, FrameEvent *event, const char **data, size_t *length) {
+    if (conn->packed == NULL) {
+        conn->packed = malloc(BUFFER_SIZE);
+        conn->unpacked = malloc(BUFFER_SIZE);
+        if (conn->packed == NULL || conn->unpacked == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (conn->packed_have + event->length > BUFFER_SIZE) {
+        fprintf(stderr, "Compressed chunk larger than %d bytes\n", BUFFER_SIZE);
+        return -1;
+    }
+    memcpy(conn->packed + conn->packed_have, event->data, event->length);
+    conn->packed_have += event->length;
+    if (!event->end_of_frame) {
+        return 0;
+    }
+
+    long unpacked = codec_decompress(conn->packed, conn->packed_have, conn->unpacked, BUFFER_SIZE);
+    if (unpacked < 0) {
+        fprintf(stderr, "Corrupt compressed chunk\n");
+        return -1;
+    }
+    *data = conn->unpacked;
+    *length = unpacked;
+    return 1;
+}
+
+/**
+ * Write file data of the current range synchronously and account for it.
+ * The sinks that write asynchronously out of their receive buffers use this
+ * for the data they cannot hand off as one write.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection the data arrived on.
+ * @param data Data to write.
+ * @param length Number of bytes of data.
+ * @param wire_length Payload bytes the data took on the wire.
+ * @param end_of_frame Non-zero if the data completes a FILE_DATA frame.
+ * @return 0 on success, -1 if the data is outside of the range or cannot be written.
+ */
+int write_now(Worker *worker, Connection *conn, const char *data, size_t length, size_t wire_length,
+              int end_of_frame) {
+    if (conn->run == NULL || conn->range_queued + length > conn->range_length ||
+        run_write(conn->run, data, length, conn->range_offset + conn->range_queued) < 0) {
+        fprintf(stderr, "File data received outside of its range or not written\n");
+        return -1;
+    }
+    worker->syscalls++;
+    worker->bytes += length;
+    if (CHECKSUM) {
+        conn->range_crc = crc32c_update(conn->range_crc, data, length);
+    }
+    data_arrived(conn, length, end_of_frame);
+    conn->range_queued += length;
+    range_written(conn, length, wire_length);
+    return 0;
+}
+
+/**
+ * Collect a slice of a compressed FILE_DATA frame and write the chunk
+ * synchronously once it is decompressed, since a decompressed chunk lives in
+ * the connection's own buffer instead of a receive buffer.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection the slice arrived on.
+ * @param event Data event carrying the slice.
+ * @return 0 on success, -1 if the frame is invalid or the chunk cannot be written.
+ */
+int write_compressed(Worker *worker, Connection *conn, FrameEvent *event) {
+    const char *data;
+    size_t length;
+    int ready = unpack_chunk(conn, event, &data, &length);
+    if (ready <= 0) {
+        return ready;
+    }
+    size_t wire_length = conn->packed_have;
+    conn->packed_have = 0;
+    return write_now(worker, conn, data, length, wire_length, 1);
+}
+
+/**
+ * Compute the CRC32C of a byte range of an output file, reading it back from
+ * the page cache. Used by the splice sink, whose payload never reaches user
+ * space.
+ *
+ * @param fd Output file.
+ * @param offset Offset of the range.
+ * @param length Length of the range.
+ * @return CRC32C of the range, as far as it could be read.
+ */
+uint32_t crc_file_range(int fd, uint64_t offset, uint64_t length) {
+    char *buffer = malloc(BUFFER_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t crc = 0;
+    while (length > 0) {
+        ssize_t n = pread(fd, buffer, length < BUFFER_SIZE ? length : BUFFER_SIZE, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                perror("Error reading back file");
+            }
+            break;
+        }
+        crc = crc32c_update(crc, buffer, n);
+        offset += n;
+        length -= n;
+    }
+    free(buffer);
+    return crc;
+}
+
+/**
+ * Check the range a stream just finished against the byte count and CRC32C
+ * its END frame carries. A mismatch is reported and fails the session, but
+ * the connection stays up so later runs are still received. Senders that do
+ * not checksum send an empty END, which is not checked.
+ *
+ * @param conn Connection that received the END frame.
+ * @param payload Payload of the END frame.
+ * @param length Length of the payload.
+ */
+void verify_range(Connection *conn, const unsigned char *payload, size_t length) {
+    if (!CHECKSUM || length < END_PAYLOAD_SIZE) {
+        return;
+    }
+    StreamStats *stream = &conn->run->streams[conn->stream_index];
+    if (SINK == SINK_SPLICE && !conn->run->tree) {
+        conn->range_crc = crc_file_range(conn->run->fd, conn->range_offset, conn->range_done);
+    }
+    uint64_t bytes = get_u64(payload);
+    uint32_t crc = get_u32(payload + 8);
+    stream->crc = conn->range_crc;
+    stream->checked = (bytes == conn->range_done && crc == conn->range_crc) ? 1 : -1;
+    if (stream->checked < 0) {
+        fprintf(stderr, "Checksum mismatch on stream %d of run %d: sent %llu bytes with CRC32C %08x, "
+                "received %llu bytes with CRC32C %08x\n", conn->stream_index, conn->run->run + 1,
+                (unsigned long long)bytes, crc, (unsigned long long)conn->range_done, conn->range_crc);
+        conn->failed = 1;
+    }
+}
+
+/**
+ * Read bytes of the base of a delta run: the previous run's file, or the
+ * files of the previous tree run.
+ *
+ * @param state Delta run.
+ * @param buffer Buffer to read into.
+ * @param length Most bytes to read.
+ * @param offset Offset of the bytes in the previous run.
+ * @return Number of bytes read, 0 at the end, -1 on error.
+ */
+ssize_t base_read(RunState *state, char *buffer, size_t length, uint64_t offset) {
+    if (state->base_tree != NULL) {
+        return tree_read(state->base_tree, buffer, length, offset);
+    }
+    return pread(state->base_fd, buffer, length, offset);
+}
+
+/**
+ * Answer the START of a delta run with the block signatures of the previous
+ * run's file. The run then arrives on this connection alone, as literal file
+ * data and DELTA_COPY frames. Without a previous file (or with the null sink)
+ * no block is signed and the sender sends everything literally.
+ *
+ * @param conn Connection that received the START frame.
+ * @param state Run being started, whose previous run has completed.
+ * @return 0 on success, -1 if the signatures cannot be sent.
+ */
+int sign_base(Connection *conn, RunState *state) {
+    uint64_t start = now_ns();
+    Transfer *transfer = conn->transfer;
+    pthread_mutex_lock(&transfer->lock);
+    state->base_run = transfer->last_run;
+    state->base_tree = transfer->base_tree;
+    if (state->base_tree != NULL) {
+        atomic_fetch_add(&state->base_tree->refs, 1);
+    }
+    pthread_mutex_unlock(&transfer->lock);
+
+    struct stat st;
+    if (state->base_tree != NULL) {
+        state->base_size = state->base_tree->covered;
+    } else if (state->base_run >= 0 && SINK != SINK_NULL) {
+        char filename[128];
+        run_filename(transfer, state->base_run, filename, sizeof(filename));
+        state->base_fd = open(filename, O_RDONLY);
+        if (state->base_fd >= 0 && fstat(state->base_fd, &st) == 0) {
+            state->base_size = st.st_size;
+        }
+    }
+
+    uint32_t block = delta_block_size(state->base_size);
+    uint64_t count = state->base_size / block;
+    if (DELTA_HEADER_SIZE + count * DELTA_SIGNATURE_SIZE > FRAME_MAX_PAYLOAD) {
+        count = (FRAME_MAX_PAYLOAD - DELTA_HEADER_SIZE) / DELTA_SIGNATURE_SIZE; // The rest of the file is not reused
+    }
+    size_t length = DELTA_HEADER_SIZE + count * DELTA_SIGNATURE_SIZE;
+    size_t span = (BUFFER_SIZE / block > 0 ? BUFFER_SIZE / block : 1) * (size_t)block;
+    unsigned char *signatures = malloc(length);
+    unsigned char *buffer = malloc(span);
+    if (signatures == NULL || buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Sign the file a few blocks at a time, the signatures of a short read cover what was read
+    uint64_t signed_blocks = 0;
+    while (signed_blocks < count) {
+        size_t want = (count - signed_blocks) * block < span ? (count - signed_blocks) * block : span;
+        size_t have = 0;
+        while (have < want) {
+            ssize_t n = base_read(state, (char *)buffer + have, want - have, signed_blocks * block + have);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                if (n < 0) {
+                    perror("Error reading previous file");
+                }
+                break;
+            }
+            have += n;
+        }
+        delta_sign(buffer, have, block, signatures + DELTA_HEADER_SIZE + signed_blocks * DELTA_SIGNATURE_SIZE);
+        signed_blocks += have / block;
+        if (have < want) {
+            break;
+        }
+    }
+    put_u32(signatures, block);
+    put_u32(signatures + 4, signed_blocks);
+    length = DELTA_HEADER_SIZE + signed_blocks * DELTA_SIGNATURE_SIZE;
+
+    // The event loops keep their sockets non-blocking, the signatures are sent in one go
+    int flags = fcntl(conn->socket, F_GETFL);
+    fcntl(conn->socket, F_SETFL, flags & ~O_NONBLOCK);
+    send_frame(conn->socket, &conn->send_seq, DELTA_SIGNATURES, 0, signatures, length);
+    fcntl(conn->socket, F_SETFL, flags);
+
+    free(buffer);
+    free(signatures);
+    state->signature_ms = (now_ns() - start) / 1e6;
+    return 0;
+}
+
+/**
+ * Take the START of a delta run. The previous run's last END may still be
+ * on its way over another stream, and until it is processed the previous
+ * file is incomplete. The answer then waits, without blocking the event
+ * loop, and the stream that completes the previous run sends it. The
+ * sender sends nothing on this connection before it has the signatures.
+ *
+ * @param conn Connection that received the START frame.
+ * @param state Run being started.
+ * @return 0 on success, -1 if the signatures cannot be sent.
+ */
+int send_signatures(Connection *conn, RunState *state) {
+    Transfer *transfer = conn->transfer;
+    pthread_mutex_lock(&transfer->lock);
+    state->delta = 1;
+    state->ends_pending = 1;
+    int wait = earlier_run_pending(transfer, state);
+    if (wait) {
+        state->signer = conn;
+    }
+    pthread_mutex_unlock(&transfer->lock);
+    return wait ? 0 : sign_base(conn, state);
+}
+
+/**
+ * Rebuild a byte range of a delta run from the previous run's file. The
+ * copied bytes continue the current range like literal file data would, and
+ * are checksummed alike. Control frames only reach this point once the
+ * file data before them is written, so nothing is in flight.
+ *
+ * @param conn Connection that received the DELTA_COPY frame.
+ * @param base_offset Offset of the bytes in the previous file.
+ * @param length Number of bytes to copy.
+ * @return 0 on success, -1 if the copy is invalid or fails.
+ */
+int apply_copy(Connection *conn, uint64_t base_offset, uint64_t length) {
+    RunState *state = conn->run;
+    if (state == NULL || !state->delta || (state->base_fd < 0 && state->base_tree == NULL) ||
+        base_offset > state->base_size ||
+        length > state->base_size - base_offset || length > conn->range_length - conn->range_done) {
+        fprintf(stderr, "DELTA_COPY outside of the previous file or of the range\n");
+        return -1;
+    }
+    uint64_t start = now_ns();
+    char *buffer = malloc(BUFFER_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t done = 0;
+    while (done < length) {
+        size_t chunk = length - done < BUFFER_SIZE ? length - done : BUFFER_SIZE;
+        ssize_t n = base_read(state, buffer, chunk, base_offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || run_write(state, buffer, n, conn->range_offset + conn->range_done + done) < 0) {
+            perror("Error copying from previous file");
+            free(buffer);
+            return -1;
+        }
+        if (CHECKSUM) {
+            conn->range_crc = crc32c_update(conn->range_crc, buffer, n);
+        }
+        done += n;
+    }
+    free(buffer);
+
+    conn->range_done += length;
+    conn->range_queued = conn->range_done;
+    uint64_t end = conn->range_offset + conn->range_done;
+    reporter_count(&REPORTER, length);
+    pthread_mutex_lock(&conn->transfer->lock);
+    state->bytes_received += length;
+    state->copied_bytes += length;
+    state->copy_ns += now_ns() - start;
+    if (end > state->bytes_written) {
+        state->bytes_written = end;
+    }
+    pthread_mutex_unlock(&conn->transfer->lock);
+    if (conn->range_done >= conn->range_length) {
+        state->streams[conn->stream_index].end_ms = now_ms();
+    }
+    return 0;
+}
+
+/**
+ * Handle a complete control frame received on a connection.
+ *
+ * @param conn Connection the frame arrived on.
+ * @param event Control event produced by the parser.
+ * @return 0 on success, -1 if the frame is invalid for the connection.
+ */
+int handle_control(Connection *conn, FrameEvent *event) {
+    const unsigned char *payload = (const unsigned char *)event->data;
+
+    if (event->header.type == CONTROL_JOIN) {
+        if (event->length < JOIN_PAYLOAD_SIZE ||
+            join_transfer(conn, get_u64(payload), get_u32(payload + 8), get_u32(payload + 12)) < 0) {
+            fprintf(stderr, "Rejected stream: invalid CONTROL_JOIN\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // A connection that does not announce a session is a single-stream session of its own
+    if (conn->transfer == NULL) {
+        conn->transfer = create_transfer(0, 1);
+        conn->transfer->connections = 1;
+    }
+    Transfer *transfer = conn->transfer;
+
+    if (event->header.type == CONTROL_START && event->length >= START_PAYLOAD_SIZE) {
+        // Single-stream runs carry no RANGE: the whole file follows START
+        uint64_t file_size = get_u64(payload + 4);
+        RunState *state = get_run(transfer, get_u32(payload), file_size, (event->header.flags & FRAME_FLAG_TREE) != 0);
+        if (state == NULL) {
+            return -1;
+        }
+        state->warmup = (event->header.flags & FRAME_FLAG_WARMUP) != 0;
+        state->number = (int)(get_u32(payload) - get_u32(payload + 12)) + 1;
+        if (event->length > START_PAYLOAD_SIZE) {
+            // The name ends up in the CSV and JSON exports, anything but a plain identifier is replaced
+            size_t length = event->length - START_PAYLOAD_SIZE < START_ALGO_MAX ? event->length - START_PAYLOAD_SIZE
+                                                                              : START_ALGO_MAX;
+            for (size_t k = 0; k < length; k++) {
+                char c = payload[START_PAYLOAD_SIZE + k];
+                state->algo[k] = ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_') ? c : '_';
+            }
+            state->algo[length] = '\0';
+        }
+        if (event->header.flags & FRAME_FLAG_DELTA) {
+            begin_range(conn, state, 0, file_size);
+            return send_signatures(conn, state);
+        }
+        if (transfer->stream_count == 1) {
+            begin_range(conn, state, 0, file_size);
+        }
+    } else if (event->header.type == CONTROL_RANGE && event->length >= RANGE_PAYLOAD_SIZE) {
+        RunState *state = get_run(transfer, get_u32(payload), get_u64(payload + 4),
+                                  (event->header.flags & FRAME_FLAG_TREE) != 0);
+        if (state == NULL) {
+            return -1;
+        }
+        begin_range(conn, state, get_u64(payload + 12), get_u64(payload + 20));
+    } else if (event->header.type == CONTROL_END) {
+        if (conn->run == NULL) {
+            fprintf(stderr, "END received outside of a transfer\n");
+            return -1;
+        }
+        verify_range(conn, payload, event->length);
+        finish_stream(conn);
+        conn->run = NULL;
+    } else if (event->header.type == CONTROL_MANIFEST && event->length >= MANIFEST_PAYLOAD_SIZE) {
+        return append_manifest(transfer, get_u32(payload), payload + MANIFEST_PAYLOAD_SIZE,
+                               event->length - MANIFEST_PAYLOAD_SIZE);
+    } else if (event->header.type == DELTA_COPY && event->length >= DELTA_COPY_PAYLOAD_SIZE) {
+        return apply_copy(conn, get_u64(payload), get_u64(payload + 8));
+    } else if (event->header.type == CONTROL_EXIT) {
+        conn->running = 0;
+    }
+    // CONTROL_SEND_AGAIN needs no action, the next run opens its own file
+    return 0;
+}
+
+/**
+ * Print why a sender's stream was rejected.
+ *
+ * @param conn Connection the malformed frame arrived on.
+ * @param event Error event produced by the parser.
+ */
+void report_frame_error(Connection *conn, FrameEvent *event) {
+    fprintf(stderr, "Rejected sender: %s", frame_error_string(event->error));
+    if (event->error == FRAME_BAD_VERSION) {
+        fprintf(stderr, " (peer v%u, receiver v%d)", event->header.version, PROTOCOL_VERSION);
+    } else if (event->error == FRAME_BAD_SEQUENCE) {
+        fprintf(stderr, " (got %u, expected %u)", event->header.seq, conn->parser.next_seq);
+    }
+    fprintf(stderr, "\n");
+}
+
+/**
+ * Receive from a connection once and process everything that arrived.
+ * File data is written with pwrite() at its offset in the current range, or
+ * moved socket -> pipe -> file by splice() with the splice sink, in which case
+ * only headers and control payloads are read into memory. The null sink only
+ * accounts for the data. Unless -no-checksum is given, the data is
+ * checksummed as it passes through the receive buffer.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection to receive from.
+ * @return 1 while the connection stays open, 0 once it must be closed.
+ */
+int connection_receive(Worker *worker, Connection *conn) {
+    if (SINK == SINK_SPLICE && frame_parser_in_data(&conn->parser) && conn->run != NULL && !conn->run->tree &&
+        !(conn->parser.header.flags & FRAME_FLAG_COMPRESSED)) {
+        loff_t offset = conn->range_offset + conn->range_done;
+        ssize_t moved = splice_to_file(conn->socket, worker->pipe_fds, conn->run->fd, &offset,
+                                       frame_parser_want(&conn->parser));
+        worker->syscalls += 2;
+        if (moved < 0 && errno == EAGAIN) {
+            return 1;
+        }
+        if (moved <= 0) {
+            if (moved == 0) {
+                fprintf(stderr, "Sender closed the connection in the middle of a frame\n");
+            }
+            conn->failed = 1;
+            return 0;
+        }
+        frame_parser_skip(&conn->parser, moved);
+        data_arrived(conn, moved, !frame_parser_in_data(&conn->parser));
+        range_written(conn, moved, moved);
+        worker->bytes += moved;
+        return 1;
+    }
+
+    // The splice sink never reads past the current header or control payload, except in a tree run, whose
+    // data spreads over several files and goes through the buffer
+    size_t want = (SINK == SINK_SPLICE && (conn->run == NULL || !conn->run->tree)) ? frame_parser_want(&conn->parser)
+                                                                                   : BUFFER_SIZE;
+    ssize_t bytes_received = receive_message(conn->socket, worker->buffer, want);
+    worker->syscalls++;
+    if (bytes_received < 0 && errno == EAGAIN) {
+        return 1;
+    }
+    if (bytes_received <= 0) {
+        // Only the control stream may go away without EXIT, and only between runs
+        if (bytes_received < 0 || conn->stream_index == 0 || conn->run != NULL) {
+            fprintf(stderr, "Sender closed the connection unexpectedly\n");
+            conn->failed = 1;
+        }
+        return 0;
+    }
+
+    size_t offset = 0;
+    while (conn->running && offset < (size_t)bytes_received) {
+        FrameEvent event;
+        offset += frame_parser_feed(&conn->parser, worker->buffer + offset, bytes_received - offset, &event);
+
+        if (event.kind == FRAME_EVENT_DATA) {
+            const char *data = event.data;
+            size_t length = event.length, wire_length = event.length;
+            if (event.header.flags & FRAME_FLAG_COMPRESSED) {
+                int ready = unpack_chunk(conn, &event, &data, &length);
+                if (ready < 0) {
+                    conn->failed = 1;
+                    return 0;
+                }
+                if (ready == 0) {
+                    continue;
+                }
+                wire_length = conn->packed_have;
+                conn->packed_have = 0;
+            }
+            if (conn->run == NULL || conn->range_done + length > conn->range_length) {
+                fprintf(stderr, "File data received outside of its range\n");
+                conn->failed = 1;
+                return 0;
+            }
+            if (SINK != SINK_NULL) {
+                if (run_write(conn->run, data, length, conn->range_offset + conn->range_done) < 0) {
+                    conn->failed = 1;
+                    return 0;
+                }
+                worker->syscalls++;
+            }
+            if (CHECKSUM) {
+                conn->range_crc = crc32c_update(conn->range_crc, data, length);
+            }
+            worker->bytes += length;
+            data_arrived(conn, length, event.end_of_frame);
+            range_written(conn, length, wire_length);
+        } else if (event.kind == FRAME_EVENT_CONTROL) {
+            if (handle_control(conn, &event) < 0) {
+                conn->failed = 1;
+                return 0;
+            }
+        } else if (event.kind == FRAME_EVENT_ERROR) {
+            report_frame_error(conn, &event);
+            conn->failed = 1;
+            return 0;
+        }
+    }
+    return conn->running;
+}
+
+/**
+ * Close a connection, detach it from its session and forget it.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection to close.
+ */
+void close_connection(Worker *worker, Connection *conn) {
+    if (worker->uring == NULL) {
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->socket, NULL);
+    }
+    tcp_sampler_remove(&SAMPLER, conn->socket);
+    close(conn->socket);
+    leave_transfer(conn);
+
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        worker->connections = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    free(conn->packed);
+    free(conn->unpacked);
+    free(conn);
+    atomic_fetch_sub(&ACTIVE_CONNECTIONS, 1);
+}
+
+/**
+ * Register an accepted socket with a worker. Connections over the
+ * MAX_CONNECTIONS limit are closed right away.
+ *
+ * @param worker Worker that accepted the socket.
+ * @param socket File descriptor of the accepted socket.
+ * @param address Address of the sender.
+ * @return The new connection, NULL if it was rejected.
+ */
+Connection *new_connection(Worker *worker, int socket, struct sockaddr_in *address) {
+    if (atomic_fetch_add(&ACTIVE_CONNECTIONS, 1) >= MAX_CONNECTIONS) {
+        atomic_fetch_sub(&ACTIVE_CONNECTIONS, 1);
+        fprintf(stderr, "Connection limit (%d) reached, rejecting %s\n", MAX_CONNECTIONS, inet_ntoa(address->sin_addr));
+        close(socket);
+        return NULL;
+    }
+
+    Connection *conn = (Connection *)calloc(1, sizeof(Connection));
+    if (conn == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    conn->socket = socket;
+    conn->running = 1;
+    conn->slot = -1;
+    conn->file_index = -1;
+    frame_parser_init(&conn->parser);
+    conn->next = worker->connections;
+    if (worker->connections != NULL) {
+        worker->connections->prev = conn;
+    }
+    worker->connections = conn;
+
+    tcp_sampler_add(&SAMPLER, socket, atomic_fetch_add(&CONNECTIONS_ACCEPTED, 1) + 1);
+
+    if (SERVE) {
+        printf("Connection from %s:%d (%d active)\n", inet_ntoa(address->sin_addr), ntohs(address->sin_port),
+               atomic_load(&ACTIVE_CONNECTIONS));
+    } else if (atomic_load(&ACTIVE_CONNECTIONS) == 1 && atomic_load(&SESSIONS_STARTED) == 0) {
+        printf("Sender connected, beginning to receive file...\n");
+    }
+    return conn;
+}
+
+/**
+ * Accept every pending connection on the worker's listener.
+ *
+ * @param worker Worker owning the listener.
+ */
+void accept_connections(Worker *worker) {
+    while (1) {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int socket = accept4(worker->listen_fd, (struct sockaddr *)&address, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0) {
+            if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+                perror("accept");
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+
+        Connection *conn = new_connection(worker, socket, &address);
+        if (conn == NULL) {
+            continue;
+        }
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = conn};
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, socket, &ev) < 0) {
+            perror("epoll_ctl");
+            close_connection(worker, conn);
+        }
+    }
+}
+
+/**
+ * Event loop of a worker thread. Every ready connection gets one receive per
+ * wakeup, so a busy sender cannot starve the others on the same worker.
+ *
+ * @param arg Pointer to the Worker.
+ * @return NULL.
+ */
+void *worker_loop(void *arg) {
+    Worker *worker = (Worker *)arg;
+    struct epoll_event events[64];
+
+    while (!STOP) {
+        int n = epoll_wait(worker->epoll_fd, events, 64, 200);
+        worker->syscalls++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        for (int e = 0; e < n; e++) {
+            if (events[e].data.ptr == NULL) {
+                accept_connections(worker);
+                continue;
+            }
+            Connection *conn = (Connection *)events[e].data.ptr;
+            if (!connection_receive(worker, conn)) {
+                close_connection(worker, conn);
+            }
+        }
+    }
+
+    while (worker->connections != NULL) {
+        close_connection(worker, worker->connections);
+    }
+    return NULL;
+}
+
+// Operations of the io_uring sink, kept in the top byte of a completion's user_data
+enum UringOp {
+    URING_ACCEPT = 1,
+    URING_TIMEOUT,
+    URING_RECV,
+    URING_WRITE
+};
+
+/**
+ * Pack the operation, the buffer and the length of a request into user_data.
+ *
+ * @param op enum UringOp of the request.
+ * @param slot Registered buffer the request uses, 0 if none.
+ * @param length Bytes requested.
+ * @return Value for the request's user_data.
+ */
+uint64_t uring_tag(enum UringOp op, int slot, uint32_t length) {
+    return ((uint64_t)op << 56) | ((uint64_t)slot << 32) | length;
+}
+
+/**
+ * Return a free submission queue entry, flushing the queue to the kernel
+ * first if it is full.
+ *
+ * @param worker Worker owning the ring.
+ * @return Zeroed submission queue entry.
+ */
+struct io_uring_sqe *uring_next_sqe(Worker *worker) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&worker->uring->ring);
+    while (sqe == NULL) {
+        if (uring_submit_and_wait(&worker->uring->ring, 0) < 0) {
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+        sqe = uring_get_sqe(&worker->uring->ring);
+    }
+    return sqe;
+}
+
+/**
+ * Queue an accept on the worker's listener.
+ *
+ * @param worker Worker owning the listener.
+ */
+void uring_post_accept(Worker *worker) {
+    UringLoop *loop = worker->uring;
+    loop->accept_length = sizeof(loop->accept_address);
+    struct io_uring_sqe *sqe = uring_next_sqe(worker);
+    uring_prep_rw(sqe, IORING_OP_ACCEPT, worker->listen_fd, &loop->accept_address, 0,
+                  (uint64_t)(uintptr_t)&loop->accept_length, uring_tag(URING_ACCEPT, 0, 0));
+    sqe->accept_flags = SOCK_CLOEXEC;
+}
+
+/**
+ * Queue the timeout that wakes the loop up to check STOP.
+ *
+ * @param worker Worker owning the ring.
+ */
+void uring_post_timeout(Worker *worker) {
+    struct io_uring_sqe *sqe = uring_next_sqe(worker);
+    uring_prep_rw(sqe, IORING_OP_TIMEOUT, -1, &worker->uring->timeout, 1, 0, uring_tag(URING_TIMEOUT, 0, 0));
+}
+
+/**
+ * Queue a receive into a free registered buffer, or put the connection on
+ * the wait queue if every buffer is in use.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection to receive from.
+ */
+void uring_post_recv(Worker *worker, Connection *conn) {
+    UringLoop *loop = worker->uring;
+    int slot = 0;
+    while (slot < URING_SLOTS && loop->slots[slot].owner != NULL) {
+        slot++;
+    }
+    if (slot == URING_SLOTS) {
+        conn->waiting = 1;
+        conn->wait_next = NULL;
+        if (loop->wait_tail != NULL) {
+            loop->wait_tail->wait_next = conn;
+        } else {
+            loop->wait_head = conn;
+        }
+        loop->wait_tail = conn;
+        return;
+    }
+
+    loop->slots[slot].owner = conn;
+    loop->slots[slot].length = 0;
+    loop->slots[slot].parsed = 0;
+    loop->slots[slot].writes = 0;
+    struct io_uring_sqe *sqe = uring_next_sqe(worker);
+    uring_prep_rw(sqe, IORING_OP_READ_FIXED, conn->file_index, loop->buffers + (size_t)slot * URING_SLOT_SIZE,
+                  URING_SLOT_SIZE, 0, uring_tag(URING_RECV, slot, URING_SLOT_SIZE));
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->buf_index = slot;
+    conn->reading = 1;
+    conn->inflight++;
+}
+
+void uring_advance(Worker *worker, Connection *conn);
+
+/**
+ * Give a registered buffer back and hand it to the first waiting connection.
+ *
+ * @param worker Worker owning the buffer.
+ * @param slot Buffer to release.
+ */
+void uring_release_slot(Worker *worker, int slot) {
+    UringLoop *loop = worker->uring;
+    loop->slots[slot].owner = NULL;
+
+    Connection *conn = loop->wait_head;
+    if (conn != NULL) {
+        loop->wait_head = conn->wait_next;
+        if (loop->wait_head == NULL) {
+            loop->wait_tail = NULL;
+        }
+        conn->waiting = 0;
+        uring_advance(worker, conn);
+    }
+}
+
+/**
+ * Parse the connection's current buffer. File data becomes WRITE_FIXED
+ * requests straight out of the registered buffer; a control frame that
+ * arrives while writes are in flight is held back until they finish, so END
+ * never overtakes the data it closes.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection whose buffer is parsed.
+ * @return 0 on success, -1 if the connection must be dropped.
+ */
+int uring_parse_slot(Worker *worker, Connection *conn) {
+    UringLoop *loop = worker->uring;
+    int slot_index = conn->slot;
+    UringSlot *slot = &loop->slots[slot_index];
+    char *base = loop->buffers + (size_t)slot_index * URING_SLOT_SIZE;
+
+    if (conn->has_deferred) {
+        if (conn->writes_pending > 0) {
+            return 0;
+        }
+        conn->has_deferred = 0;
+        if (handle_control(conn, &conn->deferred) < 0) {
+            return -1;
+        }
+    }
+
+    while (conn->running && slot->parsed < slot->length) {
+        FrameEvent event;
+        slot->parsed += frame_parser_feed(&conn->parser, base + slot->parsed, slot->length - slot->parsed, &event);
+
+        if (event.kind == FRAME_EVENT_DATA && (event.header.flags & FRAME_FLAG_COMPRESSED)) {
+            if (write_compressed(worker, conn, &event) < 0) {
+                return -1;
+            }
+        } else if (event.kind == FRAME_EVENT_DATA && conn->run != NULL && conn->run->tree) {
+            // A tree run's data may span files, opened and closed as it is written
+            if (write_now(worker, conn, event.data, event.length, event.length, event.end_of_frame) < 0) {
+                return -1;
+            }
+        } else if (event.kind == FRAME_EVENT_DATA) {
+            if (conn->run == NULL || conn->range_queued + event.length > conn->range_length) {
+                fprintf(stderr, "File data received outside of its range\n");
+                return -1;
+            }
+            struct io_uring_sqe *sqe = uring_next_sqe(worker);
+            uring_prep_rw(sqe, IORING_OP_WRITE_FIXED, conn->run->fd, event.data, event.length,
+                          conn->range_offset + conn->range_queued, uring_tag(URING_WRITE, slot_index, event.length));
+            sqe->buf_index = slot_index;
+            if (CHECKSUM) {
+                conn->range_crc = crc32c_update(conn->range_crc, event.data, event.length);
+            }
+            data_arrived(conn, event.length, event.end_of_frame);
+            conn->range_queued += event.length;
+            conn->writes_pending++;
+            conn->inflight++;
+            slot->writes++;
+        } else if (event.kind == FRAME_EVENT_CONTROL) {
+            if (conn->writes_pending > 0) {
+                // The payload stays in the parser's staging area until the next feed
+                conn->deferred = event;
+                conn->has_deferred = 1;
+                return 0;
+            }
+            if (handle_control(conn, &event) < 0) {
+                return -1;
+            }
+        } else if (event.kind == FRAME_EVENT_ERROR) {
+            report_frame_error(conn, &event);
+            return -1;
+        }
+    }
+
+    // Buffer consumed: it is released once its writes are done
+    conn->slot = -1;
+    if (slot->writes == 0) {
+        uring_release_slot(worker, slot_index);
+    }
+    return 0;
+}
+
+/**
+ * Forget a connection of the io_uring sink once nothing is in flight for it.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection to close.
+ */
+void uring_close_connection(Worker *worker, Connection *conn) {
+    UringLoop *loop = worker->uring;
+    uring_update_file(&loop->ring, conn->file_index, -1);
+    worker->syscalls++;
+    loop->free_files[loop->free_file_count++] = conn->file_index;
+    close_connection(worker, conn);
+}
+
+/**
+ * Move a connection of the io_uring sink forward: parse what it received,
+ * post its next receive, or close it once it is idle.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection to advance.
+ */
+void uring_advance(Worker *worker, Connection *conn) {
+    if (!conn->closing && conn->slot >= 0 && uring_parse_slot(worker, conn) < 0) {
+        conn->failed = 1;
+        conn->closing = 1;
+    }
+    if (!conn->closing && conn->slot < 0 && !conn->reading && !conn->waiting) {
+        if (conn->running) {
+            uring_post_recv(worker, conn);
+        } else {
+            conn->closing = 1;
+        }
+    }
+    if (!conn->closing) {
+        return;
+    }
+    if (conn->reading) {
+        shutdown(conn->socket, SHUT_RDWR); // Completes the pending receive
+        return;
+    }
+    if (conn->inflight == 0) {
+        if (conn->slot >= 0) {
+            uring_release_slot(worker, conn->slot);
+            conn->slot = -1;
+        }
+        uring_close_connection(worker, conn);
+    }
+}
+
+/**
+ * Handle one completion of the io_uring sink.
+ *
+ * @param worker Worker owning the ring.
+ * @param user_data Tag of the completed request.
+ * @param res Result of the request.
+ */
+void uring_complete(Worker *worker, uint64_t user_data, int res) {
+    UringLoop *loop = worker->uring;
+    enum UringOp op = user_data >> 56;
+    int slot_index = (user_data >> 32) & 0xFFFFFF;
+    uint32_t length = user_data & 0xFFFFFFFF;
+
+    if (op == URING_TIMEOUT) {
+        uring_post_timeout(worker);
+        return;
+    }
+    if (op == URING_ACCEPT) {
+        if (res < 0) {
+            if (res != -EINTR && res != -ECONNABORTED && res != -EAGAIN) {
+                errno = -res;
+                perror("accept");
+            }
+        } else {
+            Connection *conn = new_connection(worker, res, &loop->accept_address);
+            if (conn != NULL) {
+                conn->file_index = loop->free_files[--loop->free_file_count];
+                if (uring_update_file(&loop->ring, conn->file_index, conn->socket) < 0) {
+                    perror("io_uring register socket");
+                    loop->free_files[loop->free_file_count++] = conn->file_index;
+                    close_connection(worker, conn);
+                } else {
+                    worker->syscalls++;
+                    uring_advance(worker, conn);
+                }
+            }
+        }
+        uring_post_accept(worker);
+        return;
+    }
+
+    UringSlot *slot = &loop->slots[slot_index];
+    Connection *conn = slot->owner;
+    conn->inflight--;
+
+    if (op == URING_RECV) {
+        conn->reading = 0;
+        if (res <= 0 || conn->closing) {
+            // Only the control stream may go away without EXIT, and only between runs
+            if (!conn->closing && (res < 0 || conn->stream_index == 0 || conn->run != NULL)) {
+                if (res < 0) {
+                    errno = -res;
+                    perror("Error receiving message");
+                }
+                fprintf(stderr, "Sender closed the connection unexpectedly\n");
+                conn->failed = 1;
+            }
+            conn->closing = 1;
+            uring_release_slot(worker, slot_index);
+        } else {
+            slot->length = res;
+            conn->slot = slot_index;
+        }
+        uring_advance(worker, conn);
+        return;
+    }
+
+    // URING_WRITE
+    conn->writes_pending--;
+    slot->writes--;
+    if (res != (int)length) {
+        if (res < 0) {
+            errno = -res;
+            perror("Error writing file");
+        } else {
+            fprintf(stderr, "Error writing file: short write\n");
+        }
+        conn->failed = 1;
+        conn->closing = 1;
+    } else {
+        worker->bytes += length;
+        range_written(conn, length, length);
+    }
+    if (slot->writes == 0 && conn->slot != slot_index) {
+        uring_release_slot(worker, slot_index);
+    }
+    uring_advance(worker, conn);
+}
+
+/**
+ * Set up the io_uring state of a worker: the ring, the registered receive
+ * buffers and a sparse fixed file table for the connections' sockets.
+ *
+ * @param worker Worker to set up.
+ * @return 0 on success, -1 if io_uring is unavailable.
+ */
+int uring_setup(Worker *worker) {
+    UringLoop *loop = (UringLoop *)calloc(1, sizeof(UringLoop));
+    if (loop == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (uring_init(&loop->ring, 2 * URING_SLOTS) < 0) {
+        free(loop);
+        return -1;
+    }
+
+    if (posix_memalign((void **)&loop->buffers, 4096, (size_t)URING_SLOTS * URING_SLOT_SIZE) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    struct iovec iov[URING_SLOTS];
+    for (int slot = 0; slot < URING_SLOTS; slot++) {
+        iov[slot].iov_base = loop->buffers + (size_t)slot * URING_SLOT_SIZE;
+        iov[slot].iov_len = URING_SLOT_SIZE;
+    }
+
+    loop->free_files = (int *)malloc(MAX_CONNECTIONS * sizeof(int));
+    int *files = (int *)malloc(MAX_CONNECTIONS * sizeof(int));
+    if (loop->free_files == NULL || files == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        files[i] = -1;
+        loop->free_files[i] = MAX_CONNECTIONS - 1 - i;
+    }
+    loop->free_file_count = MAX_CONNECTIONS;
+
+    int failed = uring_register_buffers(&loop->ring, iov, URING_SLOTS) < 0 ||
+                 uring_register_files(&loop->ring, files, MAX_CONNECTIONS) < 0;
+    free(files);
+    if (failed) {
+        uring_exit(&loop->ring);
+        free(loop->buffers);
+        free(loop->free_files);
+        free(loop);
+        return -1;
+    }
+
+    loop->timeout.tv_nsec = 200 * 1000000L;
+    worker->uring = loop;
+    return 0;
+}
+
+/**
+ * Event loop of a worker running the io_uring sink. Accepts, receives into
+ * registered buffers and file writes are all requests on one ring; every
+ * io_uring_enter() submits the requests prepared since the last one and reaps
+ * their completions in a batch. Falls back to the epoll loop if the kernel
+ * has no io_uring.
+ *
+ * @param arg Pointer to the Worker.
+ * @return NULL.
+ */
+void *worker_loop_uring(void *arg) {
+    Worker *worker = (Worker *)arg;
+    if (uring_setup(worker) < 0) {
+        fprintf(stderr, "io_uring unavailable (%s), falling back to epoll\n", strerror(errno));
+        return worker_loop(arg);
+    }
+    UringLoop *loop = worker->uring;
+
+    uring_post_accept(worker);
+    uring_post_timeout(worker);
+    while (!STOP) {
+        if (uring_submit_and_wait(&loop->ring, 1) < 0) {
+            perror("io_uring_enter");
+            break;
+        }
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&loop->ring)) != NULL) {
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            uring_cqe_seen(&loop->ring);
+            uring_complete(worker, user_data, res);
+        }
+    }
+
+    // Tearing the ring down cancels the outstanding requests
+    worker->syscalls += loop->ring.enters;
+    uring_exit(&loop->ring);
+    while (worker->connections != NULL) {
+        close_connection(worker, worker->connections);
+    }
+    free(loop->buffers);
+    free(loop->free_files);
+    free(loop);
+    return NULL;
+}
+
+/**
+ * Write a run of iovecs at an offset, resuming after short writes.
+ *
+ * @param fd File to write to.
+ * @param iov Buffers to write, modified as they are consumed.
+ * @param count Number of buffers.
+ * @param offset Offset in the file.
+ * @param syscalls Incremented for every pwritev() call.
+ * @return 0 on success, -1 on error with errno set.
+ */
+int pwritev_all(int fd, struct iovec *iov, int count, off_t offset, unsigned long *syscalls) {
+    while (count > 0) {
+        ssize_t written = pwritev(fd, iov, count, offset);
+        (*syscalls)++;
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (written == 0) {
+            errno = EIO;
+            return -1;
+        }
+        offset += written;
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Body of a worker's disk writer thread with the pipeline sink. Takes every
+ * request queued since its last round, up to PIPE_BATCH, writes the ones
+ * that continue each other in the same file with one pwritev(), then hands
+ * them back and wakes the event loop once per round. Requests of tree runs
+ * are written one by one into the files they span. A NULL request stops
+ * the thread.
+ *
+ * @param arg Pointer to the PipeWriter.
+ * @return NULL.
+ */
+void *pipe_writer_loop(void *arg) {
+    PipeWriter *writer = (PipeWriter *)arg;
+    WriteRequest *batch[PIPE_BATCH];
+    struct iovec iov[PIPE_BATCH];
+    int stop = 0;
+
+    while (!stop) {
+        WriteRequest *request = ring_pop(&writer->submit);
+        if (request == NULL) {
+            break;
+        }
+        int count = 0;
+        batch[count++] = request;
+        void *item;
+        while (count < PIPE_BATCH && ring_try_pop(&writer->submit, &item)) {
+            if (item == NULL) {
+                stop = 1;
+                break;
+            }
+            batch[count++] = item;
+        }
+
+        for (int first = 0; first < count;) {
+            if (batch[first]->tree != NULL) {
+                // A tree run's data goes to the files it spans, one request at a time
+                WriteRequest *single = batch[first++];
+                single->error = 0;
+                if (tree_write(single->tree, single->data, single->length, single->offset) < 0) {
+                    single->error = errno != 0 ? errno : EIO;
+                }
+                writer->syscalls++;
+                writer->stats.writes++;
+                continue;
+            }
+            int last = first + 1;
+            while (last < count && batch[last]->tree == NULL && batch[last]->fd == batch[first]->fd &&
+                   batch[last]->offset == batch[last - 1]->offset + batch[last - 1]->length) {
+                last++;
+            }
+            for (int k = first; k < last; k++) {
+                iov[k - first].iov_base = (void *)batch[k]->data;
+                iov[k - first].iov_len = batch[k]->length;
+            }
+            int error = 0;
+            if (pwritev_all(batch[first]->fd, iov, last - first, batch[first]->offset, &writer->syscalls) < 0) {
+                error = errno;
+            }
+            writer->stats.writes++;
+            for (int k = first; k < last; k++) {
+                batch[k]->error = error;
+            }
+            first = last;
+        }
+
+        for (int k = 0; k < count; k++) {
+            ring_push(&writer->complete, batch[k]);
+        }
+        writer->stats.requests += count;
+        uint64_t one = 1;
+        if (write(writer->event_fd, &one, sizeof(one)) < 0) {
+            perror("eventfd write");
+        }
+        writer->syscalls++;
+    }
+    return NULL;
+}
+
+/**
+ * Take a connection's socket out of the epoll set, so a connection that
+ * cannot take more data does not keep the loop spinning. Its unread data
+ * stays in the socket buffer and throttles the sender through the window.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection to pause.
+ */
+void pipe_pause(Worker *worker, Connection *conn) {
+    if (!conn->paused) {
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->socket, NULL);
+        worker->syscalls++;
+        conn->paused = 1;
+    }
+}
+
+/**
+ * Put a paused connection's socket back into the epoll set.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection to resume.
+ */
+void pipe_resume(Worker *worker, Connection *conn) {
+    if (conn->paused) {
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = conn};
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, conn->socket, &ev) < 0) {
+            perror("epoll_ctl");
+        }
+        worker->syscalls++;
+        conn->paused = 0;
+    }
+}
+
+/**
+ * Give a pool buffer back and let the first connection waiting for one
+ * receive again.
+ *
+ * @param worker Worker owning the pool.
+ * @param buffer Buffer to release.
+ */
+void pipe_release_buffer(Worker *worker, PoolBuffer *buffer) {
+    PipeWriter *writer = worker->writer;
+    buffer->next_free = writer->free_buffers;
+    writer->free_buffers = buffer;
+
+    Connection *conn = writer->wait_head;
+    if (conn != NULL) {
+        writer->wait_head = conn->wait_next;
+        if (writer->wait_head == NULL) {
+            writer->wait_tail = NULL;
+        }
+        conn->waiting = 0;
+        pipe_resume(worker, conn);
+    }
+}
+
+/**
+ * Parse the connection's current pool buffer. File data becomes write
+ * requests for the writer thread, straight out of the buffer; a control
+ * frame that arrives while writes are queued is held back until they
+ * finish, so END never overtakes the data it closes.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection whose buffer is parsed.
+ * @return 0 on success, -1 if the connection must be dropped.
+ */
+int pipe_parse(Worker *worker, Connection *conn) {
+    PipeWriter *writer = worker->writer;
+    PoolBuffer *buffer = conn->buffer;
+
+    if (conn->has_deferred) {
+        if (conn->writes_pending > 0) {
+            return 0;
+        }
+        conn->has_deferred = 0;
+        if (handle_control(conn, &conn->deferred) < 0) {
+            return -1;
+        }
+    }
+
+    while (conn->running && buffer->parsed < buffer->length) {
+        if (buffer->request_count == PIPE_REQUESTS) {
+            if (buffer->writes > 0) {
+                return 0; // Every request of the buffer is in flight, continue once they are done
+            }
+            buffer->request_count = 0;
+        }
+        FrameEvent event;
+        buffer->parsed += frame_parser_feed(&conn->parser, buffer->data + buffer->parsed,
+                                            buffer->length - buffer->parsed, &event);
+
+        if (event.kind == FRAME_EVENT_DATA && (event.header.flags & FRAME_FLAG_COMPRESSED)) {
+            if (write_compressed(worker, conn, &event) < 0) {
+                return -1;
+            }
+        } else if (event.kind == FRAME_EVENT_DATA) {
+            if (conn->run == NULL || conn->range_queued + event.length > conn->range_length) {
+                fprintf(stderr, "File data received outside of its range\n");
+                return -1;
+            }
+            WriteRequest *request = &buffer->requests[buffer->request_count++];
+            request->conn = conn;
+            request->buffer = buffer;
+            request->fd = conn->run->fd;
+            request->tree = conn->run->layout;
+            request->offset = conn->range_offset + conn->range_queued;
+            request->data = event.data;
+            request->length = event.length;
+            conn->writes_pending++;
+            buffer->writes++;
+            ring_push(&writer->submit, request);
+
+            unsigned depth = ring_size(&writer->submit);
+            writer->stats.depth_sum += depth;
+            if (depth > writer->stats.max_depth) {
+                writer->stats.max_depth = depth;
+            }
+            if (CHECKSUM) {
+                conn->range_crc = crc32c_update(conn->range_crc, event.data, event.length);
+            }
+            data_arrived(conn, event.length, event.end_of_frame);
+            conn->range_queued += event.length;
+        } else if (event.kind == FRAME_EVENT_CONTROL) {
+            if (conn->writes_pending > 0) {
+                // The payload stays in the parser's staging area until the next feed
+                conn->deferred = event;
+                conn->has_deferred = 1;
+                writer->stats.control_waits++;
+                return 0;
+            }
+            if (handle_control(conn, &event) < 0) {
+                return -1;
+            }
+        } else if (event.kind == FRAME_EVENT_ERROR) {
+            report_frame_error(conn, &event);
+            return -1;
+        }
+    }
+
+    // Buffer consumed: it is released once its writes are done
+    conn->buffer = NULL;
+    buffer->held = 0;
+    if (buffer->writes == 0) {
+        pipe_release_buffer(worker, buffer);
+    }
+    return 0;
+}
+
+/**
+ * Move a connection of the pipeline sink forward: parse the rest of its
+ * buffer, receive again once the buffer is parsed, or close it once its
+ * writes are done.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Connection to advance.
+ */
+void pipe_advance(Worker *worker, Connection *conn) {
+    if (!conn->closing && conn->buffer != NULL && pipe_parse(worker, conn) < 0) {
+        conn->failed = 1;
+        conn->closing = 1;
+    }
+    if (!conn->closing && conn->buffer == NULL && !conn->running) {
+        conn->closing = 1;
+    }
+
+    if (conn->closing) {
+        pipe_pause(worker, conn);
+        if (conn->writes_pending > 0) {
+            return;
+        }
+        if (conn->buffer != NULL) {
+            conn->buffer->held = 0;
+            pipe_release_buffer(worker, conn->buffer);
+            conn->buffer = NULL;
+        }
+        if (conn->waiting) {
+            PipeWriter *writer = worker->writer;
+            Connection **link = &writer->wait_head;
+            while (*link != conn) {
+                link = &(*link)->wait_next;
+            }
+            *link = conn->wait_next;
+            if (writer->wait_tail == conn) {
+                writer->wait_tail = NULL;
+                for (Connection *c = writer->wait_head; c != NULL; c = c->wait_next) {
+                    writer->wait_tail = c;
+                }
+            }
+        }
+        close_connection(worker, conn);
+        return;
+    }
+    if (conn->buffer != NULL) {
+        pipe_pause(worker, conn); // Parsing waits for writes, so must receiving
+    } else if (!conn->waiting) {
+        pipe_resume(worker, conn);
+    }
+}
+
+/**
+ * Receive from a connection of the pipeline sink into a free pool buffer
+ * and parse it. If the pool is exhausted the connection waits, out of the
+ * epoll set, until a buffer is released.
+ *
+ * @param worker Worker serving the connection.
+ * @param conn Readable connection.
+ */
+void pipe_receive(Worker *worker, Connection *conn) {
+    PipeWriter *writer = worker->writer;
+    PoolBuffer *buffer = writer->free_buffers;
+    if (buffer == NULL) {
+        writer->stats.pool_waits++;
+        conn->waiting = 1;
+        conn->wait_next = NULL;
+        if (writer->wait_tail != NULL) {
+            writer->wait_tail->wait_next = conn;
+        } else {
+            writer->wait_head = conn;
+        }
+        writer->wait_tail = conn;
+        pipe_pause(worker, conn);
+        return;
+    }
+
+    ssize_t bytes_received = receive_message(conn->socket, buffer->data, BUFFER_SIZE);
+    worker->syscalls++;
+    if (bytes_received < 0 && errno == EAGAIN) {
+        return;
+    }
+    if (bytes_received <= 0) {
+        // Only the control stream may go away without EXIT, and only between runs
+        if (bytes_received < 0 || conn->stream_index == 0 || conn->run != NULL) {
+            fprintf(stderr, "Sender closed the connection unexpectedly\n");
+            conn->failed = 1;
+        }
+        conn->closing = 1;
+        pipe_advance(worker, conn);
+        return;
+    }
+
+    writer->free_buffers = buffer->next_free;
+    buffer->length = bytes_received;
+    buffer->parsed = 0;
+    buffer->held = 1;
+    buffer->writes = 0;
+    buffer->request_count = 0;
+    conn->buffer = buffer;
+    pipe_advance(worker, conn);
+}
+
+/**
+ * Account for the writes the writer thread completed and move their
+ * connections forward.
+ *
+ * @param worker Worker owning the writer.
+ */
+void pipe_complete(Worker *worker) {
+    PipeWriter *writer = worker->writer;
+    uint64_t count;
+    if (read(writer->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("eventfd read");
+    }
+    worker->syscalls++;
+
+    void *item;
+    while (ring_try_pop(&writer->complete, &item)) {
+        WriteRequest *request = (WriteRequest *)item;
+        Connection *conn = request->conn;
+        conn->writes_pending--;
+        if (request->error != 0) {
+            errno = request->error;
+            perror("Error writing file");
+            conn->failed = 1;
+            conn->closing = 1;
+        } else {
+            worker->bytes += request->length;
+            range_written(conn, request->length, request->length);
+        }
+        if (--request->buffer->writes == 0 && !request->buffer->held) {
+            pipe_release_buffer(worker, request->buffer);
+        }
+        pipe_advance(worker, conn);
+    }
+}
+
+/**
+ * Set up the pipeline sink of a worker: the buffer pool, the two request
+ * rings, the eventfd the writer wakes the loop with, and the writer thread.
+ *
+ * @param worker Worker to set up.
+ */
+void pipe_setup(Worker *worker) {
+    PipeWriter *writer = (PipeWriter *)calloc(1, sizeof(PipeWriter));
+    if (writer == NULL || (writer->buffers = calloc(PIPE_BUFFERS, sizeof(PoolBuffer))) == NULL ||
+        ring_init(&writer->submit, PIPE_BUFFERS * PIPE_REQUESTS + 1) < 0 ||
+        ring_init(&writer->complete, PIPE_BUFFERS * PIPE_REQUESTS) < 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int k = 0; k < PIPE_BUFFERS; k++) {
+        if (posix_memalign((void **)&writer->buffers[k].data, 4096, BUFFER_SIZE) != 0) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        writer->buffers[k].next_free = writer->free_buffers;
+        writer->free_buffers = &writer->buffers[k];
+    }
+
+    writer->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (writer->event_fd < 0) {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = writer};
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, writer->event_fd, &ev) < 0) {
+        perror("epoll_ctl");
+        exit(EXIT_FAILURE);
+    }
+    if (pthread_create(&writer->thread, NULL, pipe_writer_loop, writer) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    worker->writer = writer;
+}
+
+/**
+ * Event loop of a worker running the pipeline sink. The loop only receives
+ * and parses; file writes go to the worker's writer thread through a
+ * lock-free queue, so a slow disk does not stop the receives. Only a
+ * connection that finds the whole buffer pool waiting to be written waits
+ * for the disk.
+ *
+ * @param arg Pointer to the Worker.
+ * @return NULL.
+ */
+void *worker_loop_pipeline(void *arg) {
+    Worker *worker = (Worker *)arg;
+    pipe_setup(worker);
+    PipeWriter *writer = worker->writer;
+    struct epoll_event events[64];
+
+    while (!STOP) {
+        int n = epoll_wait(worker->epoll_fd, events, 64, 200);
+        worker->syscalls++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        int completed = 0;
+        for (int e = 0; e < n; e++) {
+            if (events[e].data.ptr == NULL) {
+                accept_connections(worker);
+            } else if (events[e].data.ptr == writer) {
+                completed = 1;
+            } else {
+                pipe_receive(worker, (Connection *)events[e].data.ptr);
+            }
+        }
+        // Completions may close connections, so they wait until the events that point to them are handled
+        if (completed) {
+            pipe_complete(worker);
+        }
+    }
+
+    // The writer finishes what is queued before it stops
+    ring_push(&writer->submit, NULL);
+    pthread_join(writer->thread, NULL);
+    while (worker->connections != NULL) {
+        close_connection(worker, worker->connections);
+    }
+    writer->stats.writer_idle = atomic_load(&writer->submit.pop_waits);
+    worker->pipe_stats = writer->stats;
+    worker->syscalls += writer->syscalls;
+    close(writer->event_fd);
+    for (int k = 0; k < PIPE_BUFFERS; k++) {
+        free(writer->buffers[k].data);
+    }
+    free(writer->buffers);
+    ring_free(&writer->submit);
+    ring_free(&writer->complete);
+    free(writer);
+    worker->writer = NULL;
+    return NULL;
+}
+
+/**
+ * Create a worker: its own listener on PORT, epoll instance, receive buffer
+ * and splice pipe, then start its event loop thread.
+ *
+ * @param worker Worker to start.
+ */
+void start_worker(Worker *worker) {
+    struct sockaddr_in address;
+    memset(worker, 0, sizeof(*worker));
+    worker->pipe_fds[0] = worker->pipe_fds[1] = -1;
+
+    create_server_socket(&worker->listen_fd);
+    set_congestion_control(worker->listen_fd);
+    bind_socket(worker->listen_fd, &address);
+    start_listening(worker->listen_fd);
+
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epoll_fd < 0) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->listen_fd, &ev) < 0) {
+        perror("epoll_ctl");
+        exit(EXIT_FAILURE);
+    }
+
+    worker->buffer = malloc(BUFFER_SIZE);
+    if (worker->buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (SINK == SINK_SPLICE) {
+        if (pipe(worker->pipe_fds) < 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        fcntl(worker->pipe_fds[1], F_SETPIPE_SZ, BUFFER_SIZE); // Best effort, bigger pipe means fewer splices
+    }
+
+    void *(*loop)(void *) = worker_loop;
+    if (SINK == SINK_URING) {
+        loop = worker_loop_uring;
+    } else if (SINK == SINK_PIPELINE) {
+        loop = worker_loop_pipeline;
+    }
+    if (pthread_create(&worker->thread, NULL, loop, worker) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Release the resources of a stopped worker.
+ *
+ * @param worker Worker whose thread has exited.
+ */
+void stop_worker(Worker *worker) {
+    pthread_join(worker->thread, NULL);
+    if (worker->pipe_fds[0] >= 0) {
+        close(worker->pipe_fds[0]);
+        close(worker->pipe_fds[1]);
+    }
+    free(worker->buffer);
+    close(worker->epoll_fd);
+}
+
+/**
+ * Signal handler asking the event loops to stop.
+ *
+ * @param signum Received signal.
+ */
+void handle_stop_signal(int signum) {
+    (void)signum;
+    STOP = 1;
+}
+
+/**
+ * Main function.
+ * Starts one event loop per worker. Without -serve the receiver ends after
+ * its first session; with -serve it keeps accepting sessions until SIGINT
+ * or SIGTERM.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 indicating successful execution of the program.
+ */
+int main(int argc, char *argv[]) {
+    printf("Starting Receiver...\n");
+
+    if (extract_Variables(argc, argv) == 1) {
+        return 1;
+    }
+    if (WORKERS == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        WORKERS = cpus > 0 ? (int)cpus : 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (SERVE) {
+        signal(SIGINT, handle_stop_signal);
+        signal(SIGTERM, handle_stop_signal);
+    }
+
+    creating_path();
+    open_exports();
+    if (TCPINFO_PATH != NULL) {
+        tcp_sampler_start(&SAMPLER, TCPINFO_PATH, TCPINFO_INTERVAL_MS);
+    }
+    if (INTERVAL_MS > 0) {
+        reporter_start(&REPORTER, &SAMPLER, "receiver", INTERVAL_MS, INTERVAL_JSON, NULL);
+    }
+    Worker *workers = (Worker *)calloc(WORKERS, sizeof(Worker));
+    if (workers == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int w = 0; w < WORKERS; w++) {
+        start_worker(&workers[w]);
+    }
+    if (RUDP) {
+        rudp_server_start(PORT, 0);
+    }
+    if (SERVE) {
+        printf("Serving on port %d with %d workers, up to %d connections\n", PORT, WORKERS, MAX_CONNECTIONS);
+    }
+
+    unsigned long syscalls = 0;
+    uint64_t bytes = 0;
+    for (int w = 0; w < WORKERS; w++) {
+        stop_worker(&workers[w]);
+        syscalls += workers[w].syscalls;
+        bytes += workers[w].bytes;
+    }
+    reporter_stop(&REPORTER);
+    printf("Data path syscalls: %lu for %.2f MB = %.0f per GB\n", syscalls, bytes / (1024.0 * 1024.0),
+           bytes > 0 ? (double)syscalls * (1 << 30) / bytes : 0.0);
+    if (SINK == SINK_PIPELINE) {
+        PipeStats pipe = {0};
+        for (int w = 0; w < WORKERS; w++) {
+            PipeStats *stats = &workers[w].pipe_stats;
+            pipe.requests += stats->requests;
+            pipe.writes += stats->writes;
+            pipe.pool_waits += stats->pool_waits;
+            pipe.control_waits += stats->control_waits;
+            pipe.writer_idle += stats->writer_idle;
+            pipe.depth_sum += stats->depth_sum;
+            pipe.max_depth = stats->max_depth > pipe.max_depth ? stats->max_depth : pipe.max_depth;
+        }
+        printf("Write pipeline: %lu writes in %lu pwritev calls, queue depth avg %.1f max %u\n", pipe.requests,
+               pipe.writes, pipe.requests > 0 ? (double)pipe.depth_sum / pipe.requests : 0.0, pipe.max_depth);
+        printf("- Stalls: %lu receives waited for a free buffer, %lu control frames for the disk, writer idle %lu times\n",
+               pipe.pool_waits, pipe.control_waits, pipe.writer_idle);
+    }
+    if (SERVE && ALL_SESSIONS > 1) {
+        printf("All %d sessions:\n", ALL_SESSIONS);
+        print_times(&ALL_STATS);
+        printf("____________________________________________________________\n");
+    }
+    if (RUDP) {
+        rudp_wait(RUDP_DRAIN_MS); // The sender's bridge waits for the acknowledgement of the last bytes
+    }
+    stats_free(&ALL_STATS);
+    close_exports();
+    tcp_sampler_stop(&SAMPLER);
+    printf("Receiver end..\n");
+    for (int w = 0; w < WORKERS - 1; w++) {
+        close(workers[w].listen_fd);
+    }
+    close_sockets(workers[WORKERS - 1].listen_fd);
+    free(workers);
+
+    return atomic_load(&FAILED) ? EXIT_FAILURE : 0;
+}
@@ -1,225 +1,2554 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <netinet/tcp.h>
-#include <errno.h>
-
-#define BUFFER_SIZE 1024 * 1024
-#define FILE_PATH "random_file.txt"
-
-char *IP;   // IP address of the server
-int PORT;   // Port number of the server
-char *ALGO; // Congestion control algorithm to be used
-
-// Message types
-enum MessageType {
-    FILE_DATA,       // Represents file data
-    CONTROL_MESSAGE  // Represents control messages
-};
-
-// Struct to represent messages
-typedef struct {
-    enum MessageType type;  // Type of message
-    char data[BUFFER_SIZE]; // Data of the message
-    size_t length;          // Length of the message data
-} Message;
-
-/**
- * Extracts IP address, port number, and congestion control algorithm from command line arguments.
- *
- * @param argc Number of command line arguments
- * @param argv Array of command line arguments
- * @return 0 if extraction is successful, 1 otherwise
- */
-int extract_Variables(int argc, char *argv[]) {
-    if (argc != 7 || strcmp(argv[1], "-ip") != 0 || strcmp(argv[3], "-p") != 0 || strcmp(argv[5], "-algo") != 0) {
-        printf("Usage: %s -ip IP -p Port -algo Algo\n", argv[0]);
-        return 1; // Exit with error
-    }
-
-    IP = argv[2];
-    PORT = atoi(argv[4]);
-    ALGO = argv[6];
-
-    return 0;
-}
-
-/**
- * Sets the congestion control algorithm for the socket.
- *
- * @param server_fd File descriptor of the socket
- */
-void set_congestion_control(int server_fd) {
-    int result;
-    if (strcmp(ALGO, "reno") == 0) {
-        const char *congestion_algo = "reno";
-        result = setsockopt(server_fd, IPPROTO_TCP, TCP_CONGESTION, congestion_algo, strlen(congestion_algo));
-    } else if (strcmp(ALGO, "cubic") == 0) {
-        const char *congestion_algo = "cubic";
-        result = setsockopt(server_fd, IPPROTO_TCP, TCP_CONGESTION, congestion_algo, strlen(congestion_algo));
-    } else {
-        printf("Invalid congestion control algorithm.\n");
-        exit(EXIT_FAILURE);
-    }
-
-    if (result < 0) {
-        perror("setsockopt TCP_CONGESTION failed");
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * Sends a message through the socket.
- *
- * @param socket File descriptor of the socket
- * @param msg Pointer to the Message structure to be sent
- */
-void send_message(int socket, const Message *msg) {
-    ssize_t bytes_sent = send(socket, msg, sizeof(Message), 0);
-    if (bytes_sent != sizeof(Message)) {
-        perror("Error sending message");
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * Sends a control message through the socket.
- *
- * @param socket File descriptor of the socket
- * @param msg The control message to be sent
- */
-void send_control_message(int socket, const char *msg) {
-    Message control_msg;
-    control_msg.type = CONTROL_MESSAGE;
-    strncpy(control_msg.data, msg, BUFFER_SIZE);
-    control_msg.length = strlen(msg) + 1; // +1 to include the null terminator
-
-    send_message(socket, &control_msg);
-}
-
-/**
- * Sends the content of a file through the socket.
- *
- * @param socket File descriptor of the socket
- */
-void send_file(int socket) {
-    FILE *file = fopen(FILE_PATH, "rb");
-    if (file == NULL) {
-        perror("Error opening file");
-        return;
-    }
-    char buffer[BUFFER_SIZE];
-    size_t bytes_read;
-    // Send "START" message before sending the file
-    Message start_msg;
-    start_msg.type = CONTROL_MESSAGE;
-    strcpy(start_msg.data, "START");
-    start_msg.length = strlen(start_msg.data);
-    send_message(socket, &start_msg);
-
-    while ((bytes_read = fread(buffer, 1, BUFFER_SIZE, file)) > 0) {
-        Message file_msg;
-        file_msg.type = FILE_DATA;
-        memcpy(file_msg.data, buffer, bytes_read);
-        file_msg.length = bytes_read;
-        send_message(socket, &file_msg);
-    }
-
-    // Send "END" message after finishing sending the file
-    Message end_msg;
-    end_msg.type = CONTROL_MESSAGE;
-    strcpy(end_msg.data, "END");
-    end_msg.length = strlen(end_msg.data);
-    send_message(socket, &end_msg);
-
-    fclose(file);
-}
-
-/**
- * Creates a socket.
- *
- * @return File descriptor of the created socket
- */
-int create_socket() {
-    int sock;
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        printf("\n Socket creation error \n");
-        exit(EXIT_FAILURE);
-    }
-    return sock;
-}
-
-/**
- * Connects to the server.
- *
- * @param sock File descriptor of the socket
- */
-void connect_to_server(int sock) {
-    struct sockaddr_in serv_addr;
-    serv_addr.sin_family = AF_INET; // set the address family to AF_INET (IPv4)
-    serv_addr.sin_port = htons(PORT); // set the port number
-    if (inet_pton(AF_INET, IP, &serv_addr.sin_addr) <= 0) {
-        printf("\nInvalid address/ Address not supported \n");
-        exit(EXIT_FAILURE);
-    }
-
-    printf("Waiting for TCP connection...\n");
-
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        printf("\nConnection Failed \n");
-        exit(EXIT_FAILURE);
-    }
-}
-
-/**
- * Closes the socket.
- *
- * @param sock File descriptor of the socket
- */
-void close_socket(int sock) {
-    close(sock);
-}
-
-/**
- * Main function.
- *
- * @param argc Number of command line arguments
- * @param argv Array of command line arguments
- * @return 0 indicating successful execution of the program
- */
-int main(int argc, char *argv[]) {
-    if (extract_Variables(argc, argv) == 1) {
-        return 1;
-    }
-    printf("Starting Sender...\n");
-
-    int sock = create_socket();
-    set_congestion_control(sock);
-
-    system("./File_Generator"); // Assuming File_Generator is a separate program to generate random_file.txt
-    connect_to_server(sock);
-
-    printf("Connection established. Sending file...\n");
-
-    while (1) {
-        send_file(sock);
-        printf("File sent successfully.\n");
-        // Prompt user to send the file again
-        char response[10];
-        printf("Do you want to send the file again? (yes/no): ");
-        scanf("%s", response);
-
-        if (strcmp(response, "no") == 0 || strcmp(response, "n") == 0) {
-            send_control_message(sock, "EXIT");
-            break;
-        }
-
-        // Send "SEND_AGAIN" message
-        send_control_message(sock, "SEND_AGAIN");
-    }
-    close_socket(sock);
-    return 0;
-}
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <signal.h>
+#include <ftw.h>
+
+#include "Protocol.h"
+#include "Uring.h"
+#include "TcpInfo.h"
+#include "Generator.h"
+#include "Crc32c.h"
+#include "Codec.h"
+#include "Ring.h"
+#include "Delta.h"
+#include "Rudp.h"
+#include "Reporter.h"
+
+#define FILE_PATH "random_file.txt"
+#define URING_DEPTH 4                                 // Chunks in flight per stream with the io_uring backend
+#define URING_SLOT_SIZE (FRAME_HEADER_SIZE + BUFFER_SIZE) // Registered buffer: frame header + chunk
+#define DEFAULT_SIZE (2000 * (uint64_t)LINE_BYTES)      // File_Generator's default size
+#define SOURCE_BUFFER_SIZE ((64 * 1024 * 1024 / LINE_BYTES) * LINE_BYTES) // Largest in-memory source, whole lines
+#define SOURCE_SEED 1                                  // Generator seed of the in-memory source
+#define COMPRESS_PROBE_INTERVAL 8                      // Chunks between compression probes while it is off
+#define PIPELINE_DEPTH 4                               // Chunk buffers per stream in pipeline mode
+#define DIRECT_ALIGN 4096                              // Offset and length alignment of O_DIRECT reads
+#define PIPELINE_BUFFER_SIZE (BUFFER_SIZE + 2 * DIRECT_ALIGN) // A chunk plus the block-aligned slack of O_DIRECT
+#define ZEROCOPY_BUFFERS 8                             // Frame buffers per stream in zerocopy mode
+#define ZEROCOPY_MAX_SENDS 256                         // Zerocopy sends in flight per stream, before waiting for completions
+#define MAX_ALGOS 8                                    // Most entries of the -algos list
+#define TUNE_PROBE_SIZE (32 * 1024 * 1024)             // Bytes of the file every tuning probe sends
+#define TUNE_REPEATS 2                                 // Probes per candidate setting, averaged
+#define TUNE_MIN_MS 1000                               // Shortest measurement of a candidate, more probes if needed
+#define RUDP_DRAIN_MS 5000                             // Longest wait at exit for the RUDP flows to deliver their last bytes
+#define TUNE_MARGIN 0.05                               // Goodput difference tuning treats as noise
+
+// How file data is moved from disk to the socket
+enum SendMode {
+    SEND_COPY,     // fread() into a user buffer, then send()
+    SEND_SENDFILE, // sendfile() straight from the page cache
+    SEND_SPLICE,   // splice() file -> pipe -> socket
+    SEND_URING,    // io_uring with registered buffers and fixed files, reads overlapped with sends
+    SEND_PIPELINE, // A reader thread per stream fills buffers that the stream's thread sends
+    SEND_ZEROCOPY  // send() with MSG_ZEROCOPY from locked buffers, recycled as the kernel completes them
+};
+
+// Where the transferred data comes from
+enum SourceMode {
+    SOURCE_FILE, // random_file.txt, written by File_Generator
+    SOURCE_MEM,  // Generated once into memory and sent over and over, no disk involved
+    SOURCE_DIR   // The files of a directory tree, back to back, read from the files as each range is sent
+};
+
+// Whether chunks of the copy path are compressed
+enum CompressMode {
+    COMPRESS_OFF,
+    COMPRESS_ON,  // Every chunk that gets smaller
+    COMPRESS_AUTO // Per chunk, when the link time saved outweighs the time spent compressing
+};
+
+// What carries the connections to the receiver
+enum TransportMode {
+    TRANSPORT_TCP, // Kernel TCP with the -algo congestion control
+    TRANSPORT_RUDP // Reliable UDP of Rudp.c, through a loopback bridge
+};
+
+// How -pace holds the data path to its rate
+enum PaceMode {
+    PACE_KERNEL, // SO_MAX_PACING_RATE, the kernel spaces out the packets
+    PACE_USER    // A token bucket per stream in front of every send
+};
+
+// Chunk buffer of the pipeline mode, passed from the reader thread to the stream's thread and back
+typedef struct {
+    char *base;           // Page-aligned allocation of PIPELINE_BUFFER_SIZE bytes
+    const char *data;     // The chunk: in base, or in SOURCE_MAP for the in-memory source
+    size_t length;        // Length of the chunk, 0 marks the end of the range
+    char *packed;         // Compressed chunk, allocated when compression is on
+    size_t packed_length; // Length of the compressed chunk, 0 to send the chunk raw
+} PipeBuffer;
+
+// One connection of the transfer session; stream 0 also carries the control messages
+typedef struct {
+    pthread_t thread;  // Pool thread sending this stream's ranges (streams 1..N-1)
+    int socket;        // File descriptor of the connection
+    uint32_t seq;      // Sequence number of the next frame on the connection
+    uint32_t peer_seq; // Sequence number of the next frame from the receiver
+    char *buffer;      // Chunk buffer of the copy path
+    int pipe_fds[2];   // Pipe of the splice path
+    Uring ring;        // Ring of the io_uring path
+    char *ring_buffers; // URING_DEPTH registered buffers of URING_SLOT_SIZE bytes
+    int fd;            // File of the current range
+    off_t offset;      // Offset of the current range
+    size_t length;     // Length of the current range
+    uint32_t crc;      // CRC32C of the data of the current range sent so far
+    char *packed;      // Compressed chunk of the copy path
+    _Atomic double link_ns; // Average time the socket takes per wire byte, read by the pipeline reader
+    double codec_ns;   // Average time compression takes per input byte, 0 until measured
+    double ratio;      // Average compressed size over input size
+    int since_probe;   // Chunks sent raw since compression was last tried
+    pthread_t reader;  // Reader thread of the current range in pipeline mode
+    int read_fd;       // File the pipeline reader reads from
+    PipeBuffer *pipe;  // PIPELINE_DEPTH buffers of the pipeline mode
+    Ring empty;        // Buffers sent and free for the reader
+    Ring filled;       // Buffers read and waiting to be sent
+    char *zc_pool;     // ZEROCOPY_BUFFERS frame buffers of URING_SLOT_SIZE bytes of the zerocopy path
+    int zc_pending[ZEROCOPY_BUFFERS]; // Sends from each buffer the kernel has not completed yet
+    unsigned char zc_owner[ZEROCOPY_MAX_SENDS]; // Buffer of each send in flight, by id modulo ZEROCOPY_MAX_SENDS
+    uint32_t zc_next_id; // Id the kernel gives the next zerocopy send on the socket
+    int zc_inflight;   // Zerocopy sends not completed yet
+    int zc_next;       // Buffer the next chunk goes into
+    double pace_tokens; // Bytes the token bucket lets through without waiting, negative while in debt
+    uint64_t pace_ns;  // Time the token bucket was last refilled
+    int tree_file;     // Entry of TREE whose file tree_fd has open, -1 for none
+    int tree_fd;       // Open file of the -dir tree the stream reads from
+} Stream;
+
+// A file or directory of the tree sent with -dir
+typedef struct {
+    char *path;     // Path relative to the root of the tree
+    uint64_t size;  // Bytes of data, 0 for a directory
+    uint32_t mode;  // st_mode: file type and permissions
+    uint64_t offset; // Offset of the file's data in the transferred data
+} TreeEntry;
+
+char *IP;                       // IP address of the server
+int PORT;                       // Port number of the server
+char *ALGO;                     // Congestion control algorithm to be used
+enum SendMode MODE = SEND_COPY; // File send path
+int STREAM_COUNT = 1;           // Number of parallel connections
+uint64_t FILE_SIZE = 0;         // Size of the file to generate, 0 for File_Generator's default
+enum SourceMode SOURCE = SOURCE_FILE; // Data source
+int SOURCE_FD = -1;             // memfd holding the in-memory source
+char *SOURCE_MAP = NULL;        // Mapping of SOURCE_FD, sent from directly by the copy path
+uint64_t SOURCE_LENGTH = 0;     // Length of the in-memory source; longer transfers wrap around it
+char *DIR_PATH = NULL;          // Root of the tree sent with -dir
+TreeEntry *TREE = NULL;         // Entries of the tree, every directory before its contents
+int TREE_COUNT = 0;             // Entries of TREE
+int TREE_CAPACITY = 0;          // Room in TREE
+int TREE_SKIPPED = 0;           // Symbolic links, devices and the like left out of the tree
+off_t TRANSFER_SIZE = 0;        // Size of the data of the current run
+char *RUN_MAP = NULL;           // Mapping of the current run's data, checksummed by the zero-copy paths
+int CHECKSUM = 1;               // Carry the CRC32C of every range in its END frame
+enum CompressMode COMPRESS = COMPRESS_OFF; // Compression of the copy and pipeline paths' chunks
+int DIRECT = 0;                 // Pipeline reads bypass the page cache with O_DIRECT
+int READAHEAD = 0;              // Chunks the pipeline reader asks the kernel to prefetch, 0 to leave it to the kernel
+int DELTA = 0;                  // Send runs after the first as a delta against the receiver's previous file
+char *TCPINFO_PATH = NULL;      // CSV file of TCP_INFO samples, no sampling if NULL
+int TCPINFO_INTERVAL_MS = TCP_SAMPLER_DEFAULT_INTERVAL_MS; // TCP_INFO sampling period
+TcpSampler SAMPLER;             // Samples the data sockets when TCPINFO_PATH is set, drives the interval reports
+int INTERVAL_MS = 0;            // Period of the interval reports, 0 for none
+char *INTERVAL_JSON = NULL;     // File the interval reports are also written to as JSON lines
+Reporter REPORTER;              // Prints the interval reports when INTERVAL_MS is set
+Stream STREAMS[MAX_STREAMS];    // Connections of the session
+int RUN = 0;                    // Index of the next run (transmission of the file)
+int RUNS = 0;                   // Measured runs to send without prompting, 0 to ask after every run
+int WARMUP = 0;                 // Runs sent before the measured ones and left out of the receiver's statistics
+int DELAY_MS = 0;               // Pause between runs
+int RECONNECT = 0;              // Send every run over fresh connections, a new session each
+char *ALGOS[MAX_ALGOS];         // Congestion control algorithm of each run, cycled through; ALGO throughout if empty
+int ALGO_COUNT = 0;             // Entries of ALGOS
+int WARMING = 0;                // Set while a warmup run is sent
+int CHUNK_SIZE = BUFFER_SIZE;   // File bytes per FILE_DATA frame, at most BUFFER_SIZE
+int SNDBUF = 0;                 // SO_SNDBUF of the data sockets, 0 leaves it to the kernel's autotuning
+int NODELAY = 0;                // TCP_NODELAY on the data sockets
+int CORK = 0;                   // TCP_CORK on the data sockets, lifted after every range
+int NOTSENT_LOWAT = 0;          // TCP_NOTSENT_LOWAT of the data sockets, 0 for the system default
+char *TUNE_PATH = NULL;         // Profile written by the tuning mode, no tuning if NULL
+off_t RUN_LIMIT = 0;            // Bytes of the file a run sends, 0 for all of it
+double PACE_RATE = 0;           // Target rate of all streams together in MB/s, 0 for no pacing
+enum PaceMode PACER = PACE_KERNEL; // How the target rate is kept
+enum TransportMode TRANSPORT = TRANSPORT_TCP; // Transport of the connections
+double LOSS_PERCENT = 0;        // Share of RUDP data datagrams dropped on purpose
+int RUDP_PORT = 0;              // Loopback port of the RUDP bridge, the streams connect to it
+
+// A socket setting the tuning mode sweeps and profiles store
+typedef struct {
+    const char *name; // Key in the profile file
+    int *setting;
+    int min, max;     // Valid values
+    int candidates[5]; // Values the tuning mode tries, 0-terminated after the first
+} TuneParameter;
+
+// Swept in this order, each with the ones before it fixed at their best value. SO_SNDBUF comes
+// last: once set, a socket never returns to autotuning, and the kernel's choice is tried first
+TuneParameter TUNE_PARAMETERS[] = {
+    {"chunk", &CHUNK_SIZE, 1, BUFFER_SIZE, {BUFFER_SIZE, 256 * 1024, 64 * 1024}},
+    {"nodelay", &NODELAY, 0, 1, {0, 1}},
+    {"cork", &CORK, 0, 1, {0, 1}},
+    {"notsent_lowat", &NOTSENT_LOWAT, 0, INT_MAX, {0, 128 * 1024, 1024 * 1024}},
+    {"sndbuf", &SNDBUF, 0, INT_MAX / 2, {0, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024}},
+};
+#define TUNE_PARAMETER_COUNT (int)(sizeof(TUNE_PARAMETERS) / sizeof(TUNE_PARAMETERS[0]))
+
+pthread_mutex_t POOL_LOCK = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t POOL_COND = PTHREAD_COND_INITIALIZER;
+int POOL_GENERATION = 0;        // Number of range jobs handed to the pool
+int POOL_DONE = 0;              // Pool threads that finished the current job
+int POOL_STOP = 0;              // Set when the pool threads must exit
+
+atomic_ulong SYSCALLS;          // System calls made on the data path
+atomic_ulong WIRE_BYTES;        // FILE_DATA payload bytes sent, after compression
+atomic_ulong CHUNKS_SENT;       // FILE_DATA frames sent by the copy path
+atomic_ulong CHUNKS_COMPRESSED; // Of which compressed
+atomic_ulong ZC_SENDS;          // Sends made with MSG_ZEROCOPY
+atomic_ulong ZC_COPIED;         // Of which the kernel completed by copying the data after all
+atomic_ulong ZC_FALLBACKS;      // Sends made without MSG_ZEROCOPY because the kernel refused to pin more pages
+atomic_ulong ZC_WAITS;          // Times a stream waited for the kernel to release a buffer
+double COPY_NS = 0;             // Time memcpy() takes per byte, measured when the zerocopy path is set up
+double CPU_TOTAL_MS = 0;        // CPU time spent in send_file() over all transfers
+double BYTES_TOTAL = 0;         // File bytes sent over all transfers
+
+/**
+ * Returns the command line name of a send mode.
+ *
+ * @param mode Send mode
+ * @return Name of the mode
+ */
+const char *send_mode_name(enum SendMode mode) {
+    switch (mode) {
+        case SEND_SENDFILE:
+            return "sendfile";
+        case SEND_SPLICE:
+            return "splice";
+        case SEND_URING:
+            return "uring";
+        case SEND_PIPELINE:
+            return "pipeline";
+        case SEND_ZEROCOPY:
+            return "zerocopy";
+        default:
+            return "copy";
+    }
+}
+
+/**
+ * Prints the command line usage of the sender.
+ *
+ * @param program Name of the executable
+ */
+void print_usage(const char *program) {
+    printf("Usage: %s -ip IP -p Port -algo Algo [-mode copy|sendfile|splice|uring|pipeline|zerocopy] [-streams N]\n"
+           "       [-source file|mem] [-size BYTES[K|M|G]] [-checksum on|off] [-compress off|on|auto]\n"
+           "       [-direct on|off] [-readahead CHUNKS] [-delta on|off] [-tcpinfo FILE] [-tcpinfo-interval MS]\n"
+           "       [-runs N] [-warmup K] [-delay MS] [-algos ALGO,ALGO,...] [-reconnect on|off]\n"
+           "       [-chunk BYTES] [-sndbuf BYTES] [-nodelay on|off] [-cork on|off] [-notsent-lowat BYTES]\n"
+           "       [-tune PROFILE] [-profile PROFILE] [-pace MB/S] [-pacer kernel|user]\n"
+           "       [-transport tcp|rudp] [-loss PERCENT] [-interval MS] [-interval-json FILE] [-dir PATH]\n"
+           "Without -runs the sender asks after every run whether to send the file again.\n"
+           "-tune sweeps the socket settings over probe runs, writes the best to PROFILE and exits;\n"
+           "-profile loads them, options after it override single settings.\n"
+           "-algo and -algos take any congestion control the kernel has loaded.\n"
+           "-transport rudp carries the streams over reliable UDP, -loss drops that share of its datagrams.\n"
+           "-interval reports bytes, goodput and retransmits every MS during a run, -interval-json also\n"
+           "writes the reports to FILE as JSON lines.\n"
+           "-dir sends the regular files and directories under PATH instead of random_file.txt.\n", program);
+}
+
+/**
+ * Checks that the kernel has a congestion control algorithm loaded, so a
+ * typo fails before the first connection rather than in the middle of a
+ * batch.
+ *
+ * @param algo Name of the algorithm
+ * @return 0 if it can be used, -1 if not
+ */
+int check_algorithm(const char *algo) {
+    char list[TCP_CONGESTION_LIST_SIZE];
+    if (strlen(algo) >= START_ALGO_MAX) {
+        printf("Congestion control algorithm name too long: %s\n", algo);
+        return -1;
+    }
+    if (tcp_congestion_available(algo, list, sizeof(list)) == 0) {
+        printf("Congestion control algorithm %s is not loaded (modprobe tcp_%s), available: %s\n", algo, algo, list);
+        return -1;
+    }
+    return 0; // Loaded, or no list to check against and setsockopt() will tell
+}
+
+/**
+ * Loads the socket settings of a profile written by the tuning mode: one
+ * name=value line per setting, # starts a comment.
+ *
+ * @param path Profile file
+ * @return 0 on success, -1 if the file cannot be read or is invalid
+ */
+int load_profile(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file) != NULL) {
+        char name[64];
+        long value;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        result = -1;
+        if (sscanf(line, "%63[^=]=%ld", name, &value) == 2) {
+            for (int p = 0; p < TUNE_PARAMETER_COUNT; p++) {
+                TuneParameter *parameter = &TUNE_PARAMETERS[p];
+                if (strcmp(name, parameter->name) == 0 && value >= parameter->min && value <= parameter->max) {
+                    *parameter->setting = value;
+                    result = 0;
+                }
+            }
+        }
+        if (result < 0) {
+            printf("Invalid profile setting in %s: %s", path, line);
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+/**
+ * Extracts IP address, port number, congestion control algorithm and
+ * optional settings from command line arguments.
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ * @return 0 if extraction is successful, 1 otherwise
+ */
+int extract_Variables(int argc, char *argv[]) {
+    IP = NULL;
+    ALGO = NULL;
+    PORT = 0;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-ip") == 0) {
+            IP = argv[i + 1];
+        } else if (strcmp(argv[i], "-p") == 0) {
+            PORT = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-algo") == 0) {
+            ALGO = argv[i + 1];
+        } else if (strcmp(argv[i], "-mode") == 0) {
+            if (strcmp(argv[i + 1], "copy") == 0) {
+                MODE = SEND_COPY;
+            } else if (strcmp(argv[i + 1], "sendfile") == 0) {
+                MODE = SEND_SENDFILE;
+            } else if (strcmp(argv[i + 1], "splice") == 0) {
+                MODE = SEND_SPLICE;
+            } else if (strcmp(argv[i + 1], "uring") == 0) {
+                MODE = SEND_URING;
+            } else if (strcmp(argv[i + 1], "pipeline") == 0) {
+                MODE = SEND_PIPELINE;
+            } else if (strcmp(argv[i + 1], "zerocopy") == 0) {
+                MODE = SEND_ZEROCOPY;
+            } else {
+                printf("Invalid send mode: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-source") == 0) {
+            if (strcmp(argv[i + 1], "file") == 0) {
+                SOURCE = SOURCE_FILE;
+            } else if (strcmp(argv[i + 1], "mem") == 0) {
+                SOURCE = SOURCE_MEM;
+            } else {
+                printf("Invalid source: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-dir") == 0) {
+            DIR_PATH = argv[i + 1];
+            SOURCE = SOURCE_DIR;
+        } else if (strcmp(argv[i], "-checksum") == 0) {
+            if (strcmp(argv[i + 1], "on") == 0) {
+                CHECKSUM = 1;
+            } else if (strcmp(argv[i + 1], "off") == 0) {
+                CHECKSUM = 0;
+            } else {
+                printf("Invalid checksum setting: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-compress") == 0) {
+            if (strcmp(argv[i + 1], "off") == 0) {
+                COMPRESS = COMPRESS_OFF;
+            } else if (strcmp(argv[i + 1], "on") == 0) {
+                COMPRESS = COMPRESS_ON;
+            } else if (strcmp(argv[i + 1], "auto") == 0) {
+                COMPRESS = COMPRESS_AUTO;
+            } else {
+                printf("Invalid compression setting: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-direct") == 0) {
+            if (strcmp(argv[i + 1], "on") == 0) {
+                DIRECT = 1;
+            } else if (strcmp(argv[i + 1], "off") == 0) {
+                DIRECT = 0;
+            } else {
+                printf("Invalid direct I/O setting: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-delta") == 0) {
+            if (strcmp(argv[i + 1], "on") == 0) {
+                DELTA = 1;
+            } else if (strcmp(argv[i + 1], "off") == 0) {
+                DELTA = 0;
+            } else {
+                printf("Invalid delta setting: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-readahead") == 0) {
+            READAHEAD = atoi(argv[i + 1]);
+            if (READAHEAD < 0) {
+                printf("Readahead must not be negative\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-size") == 0) {
+            if (parse_size(argv[i + 1], &FILE_SIZE) < 0) {
+                printf("Invalid size: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-tcpinfo") == 0) {
+            TCPINFO_PATH = argv[i + 1];
+        } else if (strcmp(argv[i], "-tcpinfo-interval") == 0) {
+            TCPINFO_INTERVAL_MS = atoi(argv[i + 1]);
+            if (TCPINFO_INTERVAL_MS < 1) {
+                printf("TCP_INFO interval must be at least 1 ms\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-interval") == 0) {
+            INTERVAL_MS = atoi(argv[i + 1]);
+            if (INTERVAL_MS < 1) {
+                printf("Report interval must be at least 1 ms\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-interval-json") == 0) {
+            INTERVAL_JSON = argv[i + 1];
+        } else if (strcmp(argv[i], "-runs") == 0) {
+            RUNS = atoi(argv[i + 1]);
+            if (RUNS < 1) {
+                printf("Number of runs must be at least 1\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-warmup") == 0) {
+            WARMUP = atoi(argv[i + 1]);
+            if (WARMUP < 0) {
+                printf("Number of warmup runs must not be negative\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-delay") == 0) {
+            DELAY_MS = atoi(argv[i + 1]);
+            if (DELAY_MS < 0) {
+                printf("Delay must not be negative\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-algos") == 0) {
+            for (char *algo = strtok(argv[i + 1], ","); algo != NULL; algo = strtok(NULL, ",")) {
+                if (check_algorithm(algo) < 0) {
+                    return 1;
+                }
+                if (ALGO_COUNT == MAX_ALGOS) {
+                    printf("At most %d algorithms can be listed\n", MAX_ALGOS);
+                    return 1;
+                }
+                ALGOS[ALGO_COUNT++] = algo;
+            }
+        } else if (strcmp(argv[i], "-reconnect") == 0) {
+            if (strcmp(argv[i + 1], "on") == 0) {
+                RECONNECT = 1;
+            } else if (strcmp(argv[i + 1], "off") == 0) {
+                RECONNECT = 0;
+            } else {
+                printf("Invalid reconnect setting: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-chunk") == 0 || strcmp(argv[i], "-sndbuf") == 0 ||
+                   strcmp(argv[i], "-notsent-lowat") == 0) {
+            uint64_t bytes;
+            int *setting = strcmp(argv[i], "-chunk") == 0    ? &CHUNK_SIZE
+                           : strcmp(argv[i], "-sndbuf") == 0 ? &SNDBUF
+                                                             : &NOTSENT_LOWAT;
+            if (parse_size(argv[i + 1], &bytes) < 0 || bytes > (setting == &CHUNK_SIZE ? BUFFER_SIZE : INT_MAX / 2) ||
+                (setting == &CHUNK_SIZE && bytes == 0)) {
+                printf("Invalid %s: %s\n", argv[i] + 1, argv[i + 1]);
+                return 1;
+            }
+            *setting = bytes;
+        } else if (strcmp(argv[i], "-nodelay") == 0 || strcmp(argv[i], "-cork") == 0) {
+            int *setting = strcmp(argv[i], "-nodelay") == 0 ? &NODELAY : &CORK;
+            if (strcmp(argv[i + 1], "on") == 0) {
+                *setting = 1;
+            } else if (strcmp(argv[i + 1], "off") == 0) {
+                *setting = 0;
+            } else {
+                printf("Invalid %s setting: %s\n", argv[i] + 1, argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-pace") == 0) {
+            PACE_RATE = atof(argv[i + 1]);
+            if (PACE_RATE <= 0) {
+                printf("Invalid pacing rate: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-pacer") == 0) {
+            if (strcmp(argv[i + 1], "kernel") == 0) {
+                PACER = PACE_KERNEL;
+            } else if (strcmp(argv[i + 1], "user") == 0) {
+                PACER = PACE_USER;
+            } else {
+                printf("Invalid pacer: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-transport") == 0) {
+            if (strcmp(argv[i + 1], "tcp") == 0) {
+                TRANSPORT = TRANSPORT_TCP;
+            } else if (strcmp(argv[i + 1], "rudp") == 0) {
+                TRANSPORT = TRANSPORT_RUDP;
+            } else {
+                printf("Invalid transport: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-loss") == 0) {
+            LOSS_PERCENT = atof(argv[i + 1]);
+            if (LOSS_PERCENT < 0 || LOSS_PERCENT >= 100) {
+                printf("Invalid loss: %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-tune") == 0) {
+            TUNE_PATH = argv[i + 1];
+        } else if (strcmp(argv[i], "-profile") == 0) {
+            if (load_profile(argv[i + 1]) < 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-streams") == 0) {
+            STREAM_COUNT = atoi(argv[i + 1]);
+            if (STREAM_COUNT < 1 || STREAM_COUNT > MAX_STREAMS) {
+                printf("Number of streams must be between 1 and %d\n", MAX_STREAMS);
+                return 1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (ALGO == NULL && ALGO_COUNT > 0) {
+        ALGO = ALGOS[0];
+    }
+    if (IP == NULL || PORT == 0 || ALGO == NULL) {
+        print_usage(argv[0]);
+        return 1; // Exit with error
+    }
+    if (check_algorithm(ALGO) < 0) {
+        return 1;
+    }
+    if (INTERVAL_JSON != NULL && INTERVAL_MS == 0) {
+        INTERVAL_MS = REPORTER_DEFAULT_INTERVAL_MS;
+    }
+    if (LOSS_PERCENT > 0 && TRANSPORT != TRANSPORT_RUDP) {
+        printf("-loss needs -transport rudp, use TCP_Proxy to drop TCP segments\n");
+        return 1;
+    }
+    if (TRANSPORT == TRANSPORT_RUDP && (TUNE_PATH != NULL || ALGO_COUNT > 0)) {
+        printf("-tune and -algos need -transport tcp, with rudp they would only reach the loopback bridge\n");
+        return 1;
+    }
+    if (WARMUP > 0 && RUNS == 0) {
+        printf("-warmup needs -runs\n");
+        return 1;
+    }
+    if (COMPRESS != COMPRESS_OFF && MODE != SEND_COPY && MODE != SEND_PIPELINE) {
+        printf("-compress needs -mode copy or pipeline, the other modes never see the data\n");
+        return 1;
+    }
+    if (DELTA && SOURCE == SOURCE_MEM && FILE_SIZE > SOURCE_BUFFER_SIZE) {
+        printf("-delta with -source mem needs a -size of at most %d bytes, the data must not wrap\n",
+               SOURCE_BUFFER_SIZE);
+        return 1;
+    }
+    if (DIR_PATH != NULL && (SOURCE != SOURCE_DIR || FILE_SIZE > 0 || TUNE_PATH != NULL)) {
+        printf("-dir excludes -source, -size and -tune, the tree decides what is sent\n");
+        return 1;
+    }
+    if (DIR_PATH != NULL && (DIRECT || READAHEAD > 0)) {
+        printf("-dir excludes -direct and -readahead, which work on a single file\n");
+        return 1;
+    }
+    if ((DIRECT || READAHEAD > 0) && MODE != SEND_PIPELINE) {
+        printf("-direct and -readahead need -mode pipeline\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Sets the congestion control algorithm for the socket.
+ *
+ * @param server_fd File descriptor of the socket
+ */
+void set_congestion_control(int server_fd) {
+    if (setsockopt(server_fd, IPPROTO_TCP, TCP_CONGESTION, ALGO, strlen(ALGO)) < 0) {
+        // EPERM: loaded, but not in net.ipv4.tcp_allowed_congestion_control for unprivileged users
+        fprintf(stderr, "setsockopt TCP_CONGESTION %s failed: %s\n", ALGO, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Switches every stream of the session to the algorithm of the next run.
+ * Linux lets an established connection change its congestion control.
+ *
+ * @param algo Congestion control algorithm
+ */
+void set_run_algorithm(char *algo) {
+    ALGO = algo;
+    for (int k = 0; k < STREAM_COUNT; k++) {
+        set_congestion_control(STREAMS[k].socket);
+    }
+}
+
+/**
+ * Applies the socket settings to a data socket. Every setting but SO_SNDBUF
+ * is set even at its default, so the tuning mode can switch it back.
+ *
+ * @param sock File descriptor of the socket
+ */
+void apply_socket_options(int sock) {
+    if ((SNDBUF > 0 && setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &SNDBUF, sizeof(SNDBUF)) < 0) ||
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &NODELAY, sizeof(NODELAY)) < 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_CORK, &CORK, sizeof(CORK)) < 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &NOTSENT_LOWAT, sizeof(NOTSENT_LOWAT)) < 0) {
+        perror("setsockopt");
+        exit(EXIT_FAILURE);
+    }
+    if (PACE_RATE > 0 && PACER == PACE_KERNEL) {
+        // The kernel takes a 64-bit rate since 5.0, older ones only 32 bits
+        uint64_t rate = PACE_RATE * 1024 * 1024 / STREAM_COUNT;
+        uint32_t rate32 = rate;
+        int result = rate <= UINT32_MAX ? setsockopt(sock, SOL_SOCKET, SO_MAX_PACING_RATE, &rate32, sizeof(rate32))
+                                        : setsockopt(sock, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+        if (result < 0) {
+            // Runtime fallback: pace in user space
+            fprintf(stderr, "SO_MAX_PACING_RATE unavailable (%s), pacing with a token bucket\n", strerror(errno));
+            PACER = PACE_USER;
+        }
+    }
+}
+
+/**
+ * Sends out what the socket holds back: the tail of a corked socket, or a
+ * small frame Nagle's algorithm keeps until the receiver's delayed ACK.
+ * Setting TCP_NODELAY pushes the pending data out at once.
+ *
+ * @param stream Stream to flush
+ */
+void flush_stream(Stream *stream) {
+    int off = 0, on = 1;
+    if (CORK) {
+        setsockopt(stream->socket, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+    setsockopt(stream->socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    setsockopt(stream->socket, IPPROTO_TCP, TCP_NODELAY, &NODELAY, sizeof(NODELAY));
+    if (CORK) {
+        setsockopt(stream->socket, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+    }
+}
+
+/**
+ * Sends a control message through the socket.
+ *
+ * @param stream Stream to send the message on
+ * @param type Type of the control message to be sent
+ */
+void send_control_message(Stream *stream, enum MessageType type) {
+    send_frame(stream->socket, &stream->seq, type, 0, NULL, 0);
+}
+
+/**
+ * Sends the END frame closing a stream's range, with the number of bytes
+ * sent and their CRC32C unless checksums are off.
+ *
+ * @param stream Stream whose range is complete
+ * @param bytes Number of bytes of the range that were sent
+ */
+void send_end(Stream *stream, uint64_t bytes) {
+    if (!CHECKSUM) {
+        send_control_message(stream, CONTROL_END);
+    } else {
+        unsigned char end[END_PAYLOAD_SIZE];
+        put_u64(end, bytes);
+        put_u32(end + 8, stream->crc);
+        send_frame(stream->socket, &stream->seq, CONTROL_END, 0, end, END_PAYLOAD_SIZE);
+    }
+    if (CORK) {
+        flush_stream(stream); // Instead of leaving the tail of the range to the 200 ms cork timer
+    }
+}
+
+/**
+ * Generates the in-memory source: one buffer of generated text, at most
+ * SOURCE_BUFFER_SIZE bytes, in a memfd so that the sendfile, splice and
+ * io_uring paths can read it like the file. Transfers longer than the buffer
+ * send it over and over.
+ */
+void open_memory_source() {
+    if (FILE_SIZE == 0) {
+        FILE_SIZE = DEFAULT_SIZE;
+    }
+    SOURCE_LENGTH = FILE_SIZE < SOURCE_BUFFER_SIZE ? FILE_SIZE : SOURCE_BUFFER_SIZE;
+    SOURCE_FD = memfd_create("tcp_sender_source", 0);
+    if (SOURCE_FD < 0 || ftruncate(SOURCE_FD, SOURCE_LENGTH) < 0) {
+        perror("Error creating the in-memory source");
+        exit(EXIT_FAILURE);
+    }
+    SOURCE_MAP = mmap(NULL, SOURCE_LENGTH, PROT_READ | PROT_WRITE, MAP_SHARED, SOURCE_FD, 0);
+    if (SOURCE_MAP == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    generate_text(SOURCE_MAP, SOURCE_LENGTH, 0, SOURCE_SEED);
+    printf("In-memory source: %.2f MB per run from a %.2f MB buffer\n", FILE_SIZE / (1024.0 * 1024.0),
+           SOURCE_LENGTH / (1024.0 * 1024.0));
+}
+
+/**
+ * nftw() callback collecting the entries of the -dir tree into TREE.
+ *
+ * @param path Path of the entry
+ * @param st Status of the entry, not following symbolic links
+ * @param type FTW_ type of the entry
+ * @param ftw Depth of the entry, 0 for the root
+ * @return 0 to continue the walk
+ */
+int collect_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    if (type == FTW_DNR || type == FTW_NS) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (ftw->level == 0) {
+        return 0;
+    }
+    if (!S_ISREG(st->st_mode) && !S_ISDIR(st->st_mode)) {
+        TREE_SKIPPED++;
+        return 0;
+    }
+    const char *relative = path + strlen(DIR_PATH);
+    relative += strspn(relative, "/");
+    if (strlen(relative) > MANIFEST_PATH_MAX) {
+        fprintf(stderr, "Path longer than %d bytes: %s\n", MANIFEST_PATH_MAX, relative);
+        exit(EXIT_FAILURE);
+    }
+    if (TREE_COUNT == TREE_CAPACITY) {
+        TREE_CAPACITY = TREE_CAPACITY ? TREE_CAPACITY * 2 : 256;
+        TREE = (TreeEntry *)realloc(TREE, TREE_CAPACITY * sizeof(TreeEntry));
+        if (TREE == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    TreeEntry *entry = &TREE[TREE_COUNT++];
+    entry->path = strdup(relative);
+    entry->size = S_ISREG(st->st_mode) ? st->st_size : 0;
+    entry->mode = st->st_mode;
+    if (entry->path == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
+
+/**
+ * Walks the -dir tree and lays its regular files out back to back, in the
+ * order of TREE, which the manifest announces. Nothing is read yet: every
+ * range is read from the files themselves as it is sent, so any number of
+ * small files go out in CHUNK_SIZE frames through every send mode, with no
+ * round trip per file and no copy of the tree in memory.
+ */
+void open_tree_source() {
+    if (nftw(DIR_PATH, collect_entry, 64, FTW_PHYS) < 0) {
+        perror("Error walking the directory");
+        exit(EXIT_FAILURE);
+    }
+    int files = 0;
+    FILE_SIZE = 0;
+    for (int k = 0; k < TREE_COUNT; k++) {
+        TREE[k].offset = FILE_SIZE;
+        FILE_SIZE += TREE[k].size;
+        files += S_ISREG(TREE[k].mode);
+    }
+    if (DELTA && FILE_SIZE > SOURCE_BUFFER_SIZE) {
+        fprintf(stderr, "-delta reads the whole tree into memory, which allows at most %d bytes\n",
+                SOURCE_BUFFER_SIZE);
+        exit(EXIT_FAILURE);
+    }
+    printf("Directory tree: %d files, %d directories, %.2f MB per run from %s", files, TREE_COUNT - files,
+           FILE_SIZE / (1024.0 * 1024.0), DIR_PATH);
+    if (TREE_SKIPPED > 0) {
+        printf(" (%d symbolic links or special files left out)", TREE_SKIPPED);
+    }
+    printf("\n");
+}
+
+/**
+ * Finds the file of the -dir tree holding an offset of the transferred data.
+ * The stream keeps the file open, ranges are read in order, so a file is
+ * opened once per stream however many chunks it spans.
+ *
+ * @param stream Stream that reads, owns the open file
+ * @param offset Offset in the transferred data, less than FILE_SIZE
+ * @param position Set to the offset in the file
+ * @param room Set to the bytes of the file from position on
+ * @return File descriptor of the file
+ */
+int tree_file(Stream *stream, off_t offset, off_t *position, size_t *room) {
+    // The last entry starting at or before offset; entries without data never hold it
+    int low = 0, high = TREE_COUNT - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (TREE[middle].offset <= (uint64_t)offset) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    if (stream->tree_file != low) {
+        if (stream->tree_fd >= 0) {
+            close(stream->tree_fd);
+        }
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", DIR_PATH, TREE[low].path);
+        stream->tree_fd = open(path, O_RDONLY);
+        if (stream->tree_fd < 0) {
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        stream->tree_file = low;
+        atomic_fetch_add(&SYSCALLS, 2);
+    }
+    *position = offset - TREE[low].offset;
+    *room = TREE[low].offset + TREE[low].size - offset;
+    return stream->tree_fd;
+}
+
+/**
+ * Reads bytes of the -dir tree, from as many of its files as they span, so
+ * that small files share a chunk.
+ *
+ * @param stream Stream that reads
+ * @param buffer Buffer to read into
+ * @param offset Offset in the transferred data
+ * @param length Number of bytes, offset + length at most FILE_SIZE
+ */
+void read_tree(Stream *stream, char *buffer, off_t offset, size_t length) {
+    while (length > 0) {
+        off_t position;
+        size_t room;
+        int fd = tree_file(stream, offset, &position, &room);
+        size_t want = length < room ? length : room;
+        ssize_t n = pread(fd, buffer, want, position);
+        atomic_fetch_add(&SYSCALLS, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // The manifest already announced the size, a shorter file would corrupt the rest of the tree
+            fprintf(stderr, "%s/%s changed while being sent\n", DIR_PATH, TREE[stream->tree_file].path);
+            exit(EXIT_FAILURE);
+        }
+        buffer += n;
+        offset += n;
+        length -= n;
+    }
+}
+
+/**
+ * Announces the entries of the -dir tree for the current run, in as many
+ * CONTROL_MANIFEST frames as they need.
+ *
+ * @param stream Stream to send the manifest on, the one that sent the START
+ */
+void send_manifest(Stream *stream) {
+    unsigned char payload[FRAME_MAX_CONTROL];
+    size_t length = MANIFEST_PAYLOAD_SIZE;
+    put_u32(payload, RUN);
+    for (int k = 0; k < TREE_COUNT; k++) {
+        size_t path_length = strlen(TREE[k].path);
+        if (length + MANIFEST_ENTRY_SIZE + path_length > sizeof(payload)) {
+            send_frame(stream->socket, &stream->seq, CONTROL_MANIFEST, 0, payload, length);
+            length = MANIFEST_PAYLOAD_SIZE;
+        }
+        put_u64(payload + length, TREE[k].size);
+        put_u32(payload + length + 8, TREE[k].mode);
+        put_u32(payload + length + 12, path_length);
+        memcpy(payload + length + MANIFEST_ENTRY_SIZE, TREE[k].path, path_length);
+        length += MANIFEST_ENTRY_SIZE + path_length;
+    }
+    if (length > MANIFEST_PAYLOAD_SIZE) {
+        send_frame(stream->socket, &stream->seq, CONTROL_MANIFEST, 0, payload, length);
+    }
+}
+
+/**
+ * Maps an offset of the transferred data to an offset in the source file.
+ * The in-memory source wraps around at SOURCE_LENGTH, so a chunk must not
+ * extend past the returned room.
+ *
+ * @param offset Offset in the transferred data
+ * @param room Set to the bytes that can be read at the returned offset
+ * @return Offset in the source file
+ */
+off_t source_offset(off_t offset, size_t *room) {
+    if (SOURCE != SOURCE_MEM) {
+        *room = SIZE_MAX;
+        return offset;
+    }
+    off_t position = offset % SOURCE_LENGTH;
+    *room = SOURCE_LENGTH - position;
+    return position;
+}
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ *
+ * @return Monotonic time in nanoseconds
+ */
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Folds a new measurement into an exponentially weighted average.
+ *
+ * @param average Average to update, 0 if nothing was measured yet
+ * @param value New measurement
+ */
+void ewma(double *average, double value) {
+    *average = (*average == 0) ? value : 0.75 * *average + 0.25 * value;
+}
+
+/**
+ * Holds a stream to its share of the -pace rate when pacing in user space:
+ * takes the bytes about to be sent from the stream's token bucket and, if
+ * that leaves it in debt, sleeps until the debt is paid off. The bucket
+ * fills at the stream's rate and holds at most one frame, the largest burst
+ * sent at line rate.
+ *
+ * @param stream Stream about to send
+ * @param bytes Bytes about to be sent
+ */
+void pace(Stream *stream, size_t bytes) {
+    if (PACE_RATE <= 0 || PACER != PACE_USER) {
+        return;
+    }
+    double rate = PACE_RATE * 1024 * 1024 / STREAM_COUNT / 1e9; // Bytes per nanosecond
+    uint64_t now = now_ns();
+    stream->pace_tokens += (now - stream->pace_ns) * rate;
+    if (stream->pace_tokens > FRAME_HEADER_SIZE + CHUNK_SIZE) {
+        stream->pace_tokens = FRAME_HEADER_SIZE + CHUNK_SIZE;
+    }
+    stream->pace_ns = now;
+    stream->pace_tokens -= bytes;
+    if (stream->pace_tokens < 0) {
+        uint64_t debt_ns = -stream->pace_tokens / rate;
+        struct timespec pause = {debt_ns / 1000000000, debt_ns % 1000000000};
+        nanosleep(&pause, NULL);
+    }
+}
+
+/**
+ * Compresses one chunk if -compress asks for it. In auto mode each chunk is
+ * compressed only if that is expected to pay off: compressing a byte must
+ * take less than the link time it saves, which is (1 - ratio) times the time
+ * the link takes per byte. While compression is off, every
+ * COMPRESS_PROBE_INTERVAL-th chunk is compressed anyway to keep the ratio and
+ * the codec speed current. Each stream compresses on its own thread, the
+ * pipeline mode on the stream's reader thread.
+ *
+ * @param stream Stream the chunk is sent on
+ * @param data Chunk
+ * @param length Length of the chunk
+ * @param out Buffer of BUFFER_SIZE bytes for the compressed chunk
+ * @return Length of the compressed chunk, 0 to send the chunk raw
+ */
+size_t pack_chunk(Stream *stream, const char *data, size_t length, char *out) {
+    int compress = (COMPRESS == COMPRESS_ON);
+    if (COMPRESS == COMPRESS_AUTO) {
+        compress = stream->codec_ns == 0 || ++stream->since_probe >= COMPRESS_PROBE_INTERVAL ||
+                   stream->codec_ns < (1 - stream->ratio) * stream->link_ns;
+    }
+    if (!compress) {
+        return 0;
+    }
+
+    uint64_t start = now_ns();
+    size_t packed = codec_compress(data, length, out, BUFFER_SIZE);
+    ewma(&stream->codec_ns, (double)(now_ns() - start) / length);
+    ewma(&stream->ratio, packed > 0 ? (double)packed / length : 1.0);
+    stream->since_probe = 0;
+    return packed;
+}
+
+/**
+ * Sends one chunk as a FILE_DATA frame, compressed if pack_chunk() produced
+ * a compressed copy, and updates the link time per byte that auto
+ * compression weighs against. The link time is the slower of two estimates:
+ * the time the send blocked per byte, which is the drain time of the link
+ * once the socket buffer is full, and the kernel's delivery rate of the
+ * connection.
+ *
+ * @param stream Stream to send the chunk on
+ * @param data Chunk
+ * @param length Length of the chunk
+ * @param packed Compressed chunk
+ * @param packed_length Length of the compressed chunk, 0 to send the chunk raw
+ */
+void send_packed(Stream *stream, const char *data, size_t length, const char *packed, size_t packed_length) {
+    pace(stream, FRAME_HEADER_SIZE + (packed_length > 0 ? packed_length : length));
+    uint64_t start = now_ns();
+    if (packed_length > 0) {
+        send_frame(stream->socket, &stream->seq, FILE_DATA, FRAME_FLAG_COMPRESSED, packed, packed_length);
+        atomic_fetch_add(&CHUNKS_COMPRESSED, 1);
+    } else {
+        send_frame(stream->socket, &stream->seq, FILE_DATA, 0, data, length);
+    }
+    size_t wire = packed_length > 0 ? packed_length : length;
+    if (COMPRESS == COMPRESS_AUTO) {
+        double link_ns = (double)(now_ns() - start) / (FRAME_HEADER_SIZE + wire);
+        uint64_t rate = tcp_delivery_rate(stream->socket);
+        if (rate > 0 && 1e9 / rate > link_ns) {
+            link_ns = 1e9 / rate;
+        }
+        double average = stream->link_ns;
+        ewma(&average, link_ns);
+        stream->link_ns = average;
+    }
+    atomic_fetch_add(&WIRE_BYTES, wire);
+    atomic_fetch_add(&CHUNKS_SENT, 1);
+    reporter_count(&REPORTER, length);
+}
+
+/**
+ * Sends one chunk of the copy path, compressed when -compress asks for it.
+ *
+ * @param stream Stream to send the chunk on
+ * @param data Chunk
+ * @param length Length of the chunk
+ */
+void send_chunk(Stream *stream, const char *data, size_t length) {
+    if (COMPRESS != COMPRESS_OFF && stream->packed == NULL && (stream->packed = malloc(BUFFER_SIZE)) == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t packed = COMPRESS != COMPRESS_OFF ? pack_chunk(stream, data, length, stream->packed) : 0;
+    send_packed(stream, data, length, stream->packed, packed);
+}
+
+/**
+ * Returns the start of a registered buffer of a stream's ring.
+ *
+ * @param stream Stream owning the buffers
+ * @param slot Buffer index
+ * @return Pointer to the buffer
+ */
+char *ring_slot(Stream *stream, int slot) {
+    return stream->ring_buffers + (size_t)slot * URING_SLOT_SIZE;
+}
+
+/**
+ * Sets up the io_uring backend of a stream: a ring and URING_DEPTH registered
+ * page-aligned buffers, each with room for a frame header before the chunk.
+ *
+ * @param stream Stream to set up
+ * @return 0 on success, -1 if io_uring is unavailable
+ */
+int init_stream_uring(Stream *stream) {
+    if (uring_init(&stream->ring, 2 * URING_DEPTH) < 0) {
+        return -1;
+    }
+    if (posix_memalign((void **)&stream->ring_buffers, 4096, URING_DEPTH * URING_SLOT_SIZE) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    struct iovec iov[URING_DEPTH];
+    for (int slot = 0; slot < URING_DEPTH; slot++) {
+        iov[slot].iov_base = stream->ring_buffers + slot * URING_SLOT_SIZE;
+        iov[slot].iov_len = URING_SLOT_SIZE;
+    }
+    if (uring_register_buffers(&stream->ring, iov, URING_DEPTH) < 0) {
+        uring_exit(&stream->ring);
+        free(stream->ring_buffers);
+        stream->ring_buffers = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sends a byte range of the file through io_uring, checksumming each chunk
+ * in its registered buffer just before it is sent. Up to URING_DEPTH chunks
+ * are read ahead with READ_FIXED into registered buffers while the previous
+ * chunk is written to the socket with WRITE_FIXED, so disk and network I/O
+ * overlap and each io_uring_enter() both submits and reaps a batch. The file
+ * and the socket are fixed files 0 and 1. Sends are issued one at a time to
+ * keep frames in order on the stream.
+ *
+ * @param stream Stream to send the range on
+ * @param fd File descriptor of the file to send
+ * @param offset Offset of the range in the file
+ * @param length Length of the range
+ * @return Number of file bytes sent
+ */
+size_t send_range_uring(Stream *stream, int fd, off_t offset, size_t length) {
+    enum { URING_READ = 1, URING_SEND = 2 };
+    Uring *ring = &stream->ring;
+    int files[2] = {fd, stream->socket};
+    if (uring_register_files(ring, files, 2) < 0) {
+        perror("io_uring register files");
+        exit(EXIT_FAILURE);
+    }
+    unsigned long enters = ring->enters;
+
+    size_t read_done = 0; // Bytes of the range whose reads have been issued
+    size_t next_read = 0, next_send = 0, total = 0;
+    size_t chunk_length[URING_DEPTH];
+    int ready[URING_DEPTH] = {0};
+    int send_busy = 0;
+    size_t send_done = 0, send_total = 0;
+
+    while (read_done < length || next_send < next_read) {
+        // Read ahead into every buffer whose previous chunk has been sent
+        while (read_done < length && next_read < next_send + URING_DEPTH) {
+            int slot = next_read % URING_DEPTH;
+            size_t room;
+            off_t position = source_offset(offset + read_done, &room);
+            size_t chunk = (length - read_done < (size_t)CHUNK_SIZE) ? length - read_done : (size_t)CHUNK_SIZE;
+            chunk = chunk < room ? chunk : room;
+            chunk_length[slot] = chunk;
+            ready[slot] = 0;
+            if (SOURCE == SOURCE_DIR) {
+                // A chunk of the tree spans files that would all have to stay open until their reads complete
+                read_tree(stream, ring_slot(stream, slot) + FRAME_HEADER_SIZE, position, chunk);
+                ready[slot] = 1;
+            } else {
+                struct io_uring_sqe *sqe = uring_get_sqe(ring);
+                uring_prep_rw(sqe, IORING_OP_READ_FIXED, 0, ring_slot(stream, slot) + FRAME_HEADER_SIZE, chunk,
+                              position, ((uint64_t)URING_READ << 32) | slot);
+                sqe->flags = IOSQE_FIXED_FILE;
+                sqe->buf_index = slot;
+            }
+            read_done += chunk;
+            next_read++;
+        }
+
+        // Send the next chunk in order as soon as its read has completed
+        int slot = next_send % URING_DEPTH;
+        if (!send_busy && ready[slot]) {
+            unsigned char *frame = (unsigned char *)ring_slot(stream, slot);
+            if (CHECKSUM) {
+                stream->crc = crc32c_update(stream->crc, frame + FRAME_HEADER_SIZE, chunk_length[slot]);
+            }
+            FrameHeader header = {PROTOCOL_VERSION, FILE_DATA, 0, chunk_length[slot], stream->seq++};
+            encode_frame_header(&header, frame);
+            send_total = FRAME_HEADER_SIZE + chunk_length[slot];
+            send_done = 0;
+            pace(stream, send_total);
+            struct io_uring_sqe *sqe = uring_get_sqe(ring);
+            uring_prep_rw(sqe, IORING_OP_WRITE_FIXED, 1, frame, send_total, 0, ((uint64_t)URING_SEND << 32) | slot);
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->buf_index = slot;
+            send_busy = 1;
+        }
+
+        if (uring_submit_and_wait(ring, 1) < 0) {
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(ring)) != NULL) {
+            int op = cqe->user_data >> 32;
+            int done_slot = cqe->user_data & 0xFFFFFFFF;
+            int res = cqe->res;
+            uring_cqe_seen(ring);
+
+            if (res < 0) {
+                errno = -res;
+                perror(op == URING_READ ? "io_uring read" : "io_uring send");
+                exit(EXIT_FAILURE);
+            }
+            if (op == URING_READ) {
+                chunk_length[done_slot] = res; // A short read means the file shrank while being sent
+                ready[done_slot] = 1;
+                continue;
+            }
+
+            send_done += res;
+            if (send_done < send_total) {
+                // Short write to the socket: resubmit the rest of the frame
+                struct io_uring_sqe *sqe = uring_get_sqe(ring);
+                uring_prep_rw(sqe, IORING_OP_WRITE_FIXED, 1, ring_slot(stream, done_slot) + send_done,
+                              send_total - send_done, 0, cqe->user_data);
+                sqe->flags = IOSQE_FIXED_FILE;
+                sqe->buf_index = done_slot;
+                continue;
+            }
+            total += chunk_length[done_slot];
+            reporter_count(&REPORTER, chunk_length[done_slot]);
+            send_busy = 0;
+            next_send++;
+        }
+    }
+
+    uring_unregister_files(ring);
+    atomic_fetch_add(&SYSCALLS, ring->enters - enters + 2); // Plus registering and unregistering the files
+    return total;
+}
+
+/**
+ * Sets up the pipeline mode of a stream: PIPELINE_DEPTH page-aligned chunk
+ * buffers, all in the ring of empty buffers.
+ *
+ * @param stream Stream to set up
+ */
+void init_stream_pipeline(Stream *stream) {
+    stream->pipe = calloc(PIPELINE_DEPTH, sizeof(PipeBuffer));
+    if (stream->pipe == NULL || ring_init(&stream->empty, PIPELINE_DEPTH) < 0 ||
+        ring_init(&stream->filled, PIPELINE_DEPTH) < 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int k = 0; k < PIPELINE_DEPTH; k++) {
+        PipeBuffer *buffer = &stream->pipe[k];
+        if (posix_memalign((void **)&buffer->base, DIRECT_ALIGN, PIPELINE_BUFFER_SIZE) != 0 ||
+            (COMPRESS != COMPRESS_OFF && (buffer->packed = malloc(BUFFER_SIZE)) == NULL)) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        ring_push(&stream->empty, buffer);
+    }
+}
+
+/**
+ * Releases the pipeline buffers of a stream.
+ *
+ * @param stream Stream to release
+ */
+void free_stream_pipeline(Stream *stream) {
+    for (int k = 0; k < PIPELINE_DEPTH; k++) {
+        free(stream->pipe[k].base);
+        free(stream->pipe[k].packed);
+    }
+    free(stream->pipe);
+    ring_free(&stream->empty);
+    ring_free(&stream->filled);
+}
+
+/**
+ * Reads one chunk into a pipeline buffer. With O_DIRECT the read has to start
+ * and end on a block boundary, so it covers the blocks around the chunk and
+ * the chunk starts a little into the buffer.
+ *
+ * @param stream Stream whose reader reads
+ * @param buffer Buffer to read into
+ * @param position Offset of the chunk in the file
+ * @param chunk Length of the chunk
+ * @return Bytes of the chunk read, 0 at the end of the file
+ */
+size_t read_chunk(Stream *stream, PipeBuffer *buffer, off_t position, size_t chunk) {
+    off_t start = DIRECT ? position & ~(off_t)(DIRECT_ALIGN - 1) : position;
+    size_t skew = position - start;
+    size_t want = DIRECT ? (skew + chunk + DIRECT_ALIGN - 1) & ~(size_t)(DIRECT_ALIGN - 1) : chunk;
+    ssize_t bytes_read;
+    do {
+        bytes_read = pread(stream->read_fd, buffer->base, want, start);
+    } while (bytes_read < 0 && errno == EINTR);
+    atomic_fetch_add(&SYSCALLS, 1);
+    if (bytes_read < 0) {
+        perror("pread");
+        exit(EXIT_FAILURE);
+    }
+    buffer->data = buffer->base + skew;
+    if ((size_t)bytes_read <= skew) {
+        return 0; // File shrank while being sent
+    }
+    return (size_t)bytes_read - skew < chunk ? (size_t)bytes_read - skew : chunk;
+}
+
+/**
+ * Body of a stream's reader thread in pipeline mode: reads the stream's range
+ * chunk by chunk into the empty buffers, checksums and compresses each chunk
+ * and hands it to the stream's thread through the ring of filled buffers.
+ * A buffer of length 0 ends the range. Chunks of the in-memory source are not
+ * copied, the buffer just points into its mapping. With -readahead the
+ * kernel is asked to prefetch the chunk that is READAHEAD chunks of
+ * CHUNK_SIZE bytes ahead, so a cold file is read from disk while earlier
+ * chunks are on the wire.
+ *
+ * @param arg Pointer to the Stream whose range is read
+ * @return NULL
+ */
+void *pipeline_reader(void *arg) {
+    Stream *stream = (Stream *)arg;
+    off_t offset = stream->offset, end = stream->offset + stream->length;
+    if (READAHEAD > 0 && !DIRECT && SOURCE == SOURCE_FILE) {
+        posix_fadvise(stream->read_fd, offset, (off_t)READAHEAD * CHUNK_SIZE, POSIX_FADV_WILLNEED);
+    }
+
+    while (1) {
+        PipeBuffer *buffer = ring_pop(&stream->empty);
+        buffer->length = 0;
+        buffer->packed_length = 0;
+        if (offset >= end) {
+            ring_push(&stream->filled, buffer);
+            break;
+        }
+
+        size_t room;
+        off_t position = source_offset(offset, &room);
+        size_t chunk = (end - offset < CHUNK_SIZE) ? (size_t)(end - offset) : (size_t)CHUNK_SIZE;
+        chunk = chunk < room ? chunk : room;
+        if (SOURCE_MAP != NULL) {
+            buffer->data = SOURCE_MAP + position;
+            buffer->length = chunk;
+        } else if (SOURCE == SOURCE_DIR) {
+            read_tree(stream, buffer->base, position, chunk);
+            buffer->data = buffer->base;
+            buffer->length = chunk;
+        } else {
+            if (READAHEAD > 0 && !DIRECT) {
+                off_t ahead = position + (off_t)READAHEAD * CHUNK_SIZE;
+                posix_fadvise(stream->read_fd, ahead, CHUNK_SIZE, POSIX_FADV_WILLNEED);
+            }
+            buffer->length = read_chunk(stream, buffer, position, chunk);
+        }
+        if (buffer->length == 0) {
+            ring_push(&stream->filled, buffer);
+            break;
+        }
+
+        if (CHECKSUM) {
+            stream->crc = crc32c_update(stream->crc, buffer->data, buffer->length);
+        }
+        if (COMPRESS != COMPRESS_OFF) {
+            buffer->packed_length = pack_chunk(stream, buffer->data, buffer->length, buffer->packed);
+        }
+        offset += buffer->length;
+        ring_push(&stream->filled, buffer);
+    }
+    return NULL;
+}
+
+/**
+ * Sends a byte range of the file in pipeline mode. A reader thread reads
+ * ahead into the stream's PIPELINE_DEPTH buffers while this thread sends
+ * the chunks already read, so a slow disk and a slow socket no longer wait on
+ * each other: reading only stops when every buffer is waiting to be sent,
+ * sending only when none is.
+ *
+ * @param stream Stream to send the range on
+ * @param fd File descriptor of the file to send, opened with O_DIRECT if -direct on
+ * @param offset Offset of the range in the file
+ * @param length Length of the range
+ * @return Number of file bytes sent
+ */
+size_t send_range_pipeline(Stream *stream, int fd, off_t offset, size_t length) {
+    stream->offset = offset;
+    stream->length = length;
+    stream->read_fd = fd;
+    if (pthread_create(&stream->reader, NULL, pipeline_reader, stream) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t total = 0;
+    while (1) {
+        PipeBuffer *buffer = ring_pop(&stream->filled);
+        size_t chunk = buffer->length;
+        if (chunk > 0) {
+            send_packed(stream, buffer->data, chunk, buffer->packed, buffer->packed_length);
+            atomic_fetch_add(&SYSCALLS, 1);
+        }
+        ring_push(&stream->empty, buffer);
+        if (chunk == 0) {
+            break;
+        }
+        total += chunk;
+    }
+
+    pthread_join(stream->reader, NULL);
+    return total;
+}
+
+/**
+ * Returns a frame buffer of the zerocopy path.
+ *
+ * @param stream Stream owning the buffers
+ * @param slot Buffer index
+ * @return Pointer to the buffer
+ */
+char *zerocopy_slot(Stream *stream, int slot) {
+    return stream->zc_pool + (size_t)slot * URING_SLOT_SIZE;
+}
+
+/**
+ * Sets up the zerocopy path of a stream: enables SO_ZEROCOPY on its socket
+ * and allocates ZEROCOPY_BUFFERS page-aligned frame buffers, locked in
+ * memory if the limit allows, which the kernel may pin while it sends them.
+ * The first stream also measures what a memcpy() of a chunk costs.
+ *
+ * @param stream Stream to set up
+ * @return 0 on success, -1 if the kernel has no MSG_ZEROCOPY
+ */
+int init_stream_zerocopy(Stream *stream) {
+    int on = 1;
+    if (setsockopt(stream->socket, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+        return -1;
+    }
+    if (posix_memalign((void **)&stream->zc_pool, 4096, ZEROCOPY_BUFFERS * URING_SLOT_SIZE) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(stream->zc_pool, 0, ZEROCOPY_BUFFERS * URING_SLOT_SIZE);
+    mlock(stream->zc_pool, ZEROCOPY_BUFFERS * URING_SLOT_SIZE); // Best effort, RLIMIT_MEMLOCK is often smaller
+
+    if (COPY_NS == 0) {
+        uint64_t start = now_ns();
+        for (int k = 1; k < ZEROCOPY_BUFFERS; k++) {
+            memcpy(zerocopy_slot(stream, k), zerocopy_slot(stream, k - 1), URING_SLOT_SIZE);
+        }
+        COPY_NS = (double)(now_ns() - start) / ((ZEROCOPY_BUFFERS - 1) * (double)URING_SLOT_SIZE);
+    }
+    return 0;
+}
+
+/**
+ * Reaps the completions of zerocopy sends from the socket's error queue and
+ * releases their buffers. Each notification covers a range of send ids;
+ * TCP completes them in order, as the data is acknowledged.
+ *
+ * @param stream Stream whose completions to reap
+ * @param wait Sleep until at least one completion arrives
+ */
+void zerocopy_reap(Stream *stream, int wait) {
+    while (stream->zc_inflight > 0) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+        struct msghdr msg = {0};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t result = recvmsg(stream->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        atomic_fetch_add(&SYSCALLS, 1);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0 && errno == EAGAIN) {
+            if (!wait) {
+                return;
+            }
+            // POLLERR is raised for a non-empty error queue whatever the events asked for
+            struct pollfd pfd = {stream->socket, 0, 0};
+            atomic_fetch_add(&SYSCALLS, 1);
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                perror("poll");
+                exit(EXIT_FAILURE);
+            }
+            if (pfd.revents & POLLHUP) {
+                fprintf(stderr, "Connection closed with zerocopy sends in flight\n");
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+        if (result < 0) {
+            perror("recvmsg errqueue");
+            exit(EXIT_FAILURE);
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                  (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            struct sock_extended_err *error = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            if (error->ee_origin != SO_EE_ORIGIN_ZEROCOPY || error->ee_errno != 0) {
+                continue;
+            }
+            // Sends ee_info to ee_data completed; COPIED means the kernel fell back to copying them
+            uint32_t count = error->ee_data - error->ee_info + 1;
+            if (error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                atomic_fetch_add(&ZC_COPIED, count);
+            }
+            for (uint32_t id = error->ee_info; id != error->ee_data + 1; id++) {
+                stream->zc_pending[stream->zc_owner[id % ZEROCOPY_MAX_SENDS]]--;
+            }
+            stream->zc_inflight -= count;
+        }
+        wait = 0; // Got one, take whatever else is queued without sleeping
+    }
+}
+
+/**
+ * Sends a frame from a zerocopy buffer, the payload possibly elsewhere (the
+ * mapping of the in-memory source). Every send() that moves data takes the
+ * next send id of the socket and holds the frame's buffer until the kernel
+ * completes that id. When the kernel refuses to pin more pages (ENOBUFS)
+ * the stream waits for completions, and with none in flight sends the rest
+ * of the frame with a plain copying send().
+ *
+ * @param stream Stream to send on
+ * @param slot Buffer holding the frame header, and the payload if it follows the header
+ * @param payload Payload of the frame
+ * @param length Length of the payload
+ */
+void send_frame_zerocopy(Stream *stream, int slot, const char *payload, size_t length) {
+    struct iovec iov[2] = {{zerocopy_slot(stream, slot), FRAME_HEADER_SIZE}, {(void *)payload, length}};
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (payload == zerocopy_slot(stream, slot) + FRAME_HEADER_SIZE) {
+        iov[0].iov_len += length; // Contiguous frame
+        msg.msg_iovlen = 1;
+    }
+
+    while (msg.msg_iovlen > 0) {
+        if (stream->zc_inflight >= ZEROCOPY_MAX_SENDS) {
+            zerocopy_reap(stream, 1);
+        }
+        int copy = 0;
+        ssize_t sent = sendmsg(stream->socket, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        atomic_fetch_add(&SYSCALLS, 1);
+        if (sent < 0 && errno == ENOBUFS && stream->zc_inflight > 0) {
+            zerocopy_reap(stream, 1);
+            continue;
+        }
+        if (sent < 0 && errno == ENOBUFS) {
+            copy = 1;
+            sent = sendmsg(stream->socket, &msg, MSG_NOSIGNAL);
+            atomic_fetch_add(&SYSCALLS, 1);
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            perror("sendmsg");
+            exit(EXIT_FAILURE);
+        }
+        if (copy) {
+            atomic_fetch_add(&ZC_FALLBACKS, 1);
+        } else {
+            stream->zc_owner[stream->zc_next_id++ % ZEROCOPY_MAX_SENDS] = slot;
+            stream->zc_pending[slot]++;
+            stream->zc_inflight++;
+            atomic_fetch_add(&ZC_SENDS, 1);
+        }
+
+        // Skip what went out, the kernel may have taken part of the frame
+        while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
+    }
+}
+
+/**
+ * Sends a byte range of the file with MSG_ZEROCOPY. Each chunk is read into
+ * the next of the stream's ZEROCOPY_BUFFERS frame buffers behind its header;
+ * the in-memory source is sent straight from its mapping and only the header
+ * takes a buffer. The kernel sends from the buffer in place, so a buffer is
+ * reused only after the completions of all of its sends have been reaped
+ * from the error queue. Completions are reaped without waiting after every
+ * frame, and all of them before the range counts as sent, so nothing is in
+ * flight between ranges.
+ *
+ * @param stream Stream to send the range on
+ * @param fd File descriptor of the file to send
+ * @param offset Offset of the range in the file
+ * @param length Length of the range
+ * @return Number of file bytes sent
+ */
+size_t send_range_zerocopy(Stream *stream, int fd, off_t offset, size_t length) {
+    size_t total = 0;
+    while (total < length) {
+        size_t room;
+        off_t position = source_offset(offset + total, &room);
+        size_t chunk = (length - total < (size_t)CHUNK_SIZE) ? length - total : (size_t)CHUNK_SIZE;
+        chunk = chunk < room ? chunk : room;
+
+        int slot = stream->zc_next;
+        if (stream->zc_pending[slot] > 0) {
+            atomic_fetch_add(&ZC_WAITS, 1);
+            while (stream->zc_pending[slot] > 0) {
+                zerocopy_reap(stream, 1);
+            }
+        }
+        char *frame = zerocopy_slot(stream, slot);
+        const char *payload = frame + FRAME_HEADER_SIZE;
+        if (SOURCE_MAP != NULL) {
+            payload = SOURCE_MAP + position;
+        } else if (SOURCE == SOURCE_DIR) {
+            read_tree(stream, frame + FRAME_HEADER_SIZE, position, chunk);
+        } else {
+            ssize_t bytes_read = pread(fd, frame + FRAME_HEADER_SIZE, chunk, position);
+            atomic_fetch_add(&SYSCALLS, 1);
+            if (bytes_read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes_read <= 0) {
+                break; // File shrank while being sent
+            }
+            chunk = bytes_read;
+        }
+        if (CHECKSUM) {
+            stream->crc = crc32c_update(stream->crc, payload, chunk);
+        }
+        FrameHeader header = {PROTOCOL_VERSION, FILE_DATA, 0, chunk, stream->seq++};
+        encode_frame_header(&header, (unsigned char *)frame);
+        pace(stream, FRAME_HEADER_SIZE + chunk);
+        send_frame_zerocopy(stream, slot, payload, chunk);
+        stream->zc_next = (slot + 1) % ZEROCOPY_BUFFERS;
+        total += chunk;
+        reporter_count(&REPORTER, chunk);
+        zerocopy_reap(stream, 0);
+    }
+    zerocopy_reap(stream, 1);
+    return total;
+}
+
+/**
+ * Sends a byte range of the file as FILE_DATA frames, one frame per chunk.
+ * The copy path pread()s each chunk into the stream's buffer, or sends it
+ * straight from the mapping of the in-memory source. The zero-copy paths
+ * write the frame header and let sendfile(), or splice() through a pipe,
+ * move the payload without it passing through user space; their checksum is
+ * computed from RUN_MAP, which only touches the page cache.
+ *
+ * @param stream Stream to send the range on
+ * @param fd File descriptor of the file to send
+ * @param offset Offset of the range in the file
+ * @param length Length of the range
+ * @return Number of file bytes sent
+ */
+size_t send_range(Stream *stream, int fd, off_t offset, size_t length) {
+    int socket = stream->socket;
+    off_t end = offset + length;
+    stream->crc = 0;
+
+    if (MODE == SEND_URING) {
+        return send_range_uring(stream, fd, offset, length);
+    }
+    if (MODE == SEND_PIPELINE) {
+        return send_range_pipeline(stream, fd, offset, length);
+    }
+    if (MODE == SEND_ZEROCOPY) {
+        return send_range_zerocopy(stream, fd, offset, length);
+    }
+
+    // The zero-copy paths checksum a tree from this buffer, the tree has no mapping of its own
+    if ((MODE == SEND_COPY || (SOURCE == SOURCE_DIR && CHECKSUM)) && stream->buffer == NULL && SOURCE_MAP == NULL) {
+        stream->buffer = malloc(BUFFER_SIZE);
+        if (stream->buffer == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (MODE == SEND_SPLICE && stream->pipe_fds[0] < 0) {
+        if (pipe(stream->pipe_fds) < 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        fcntl(stream->pipe_fds[1], F_SETPIPE_SZ, BUFFER_SIZE); // Best effort, bigger pipe means fewer splices
+    }
+
+    while (offset < end) {
+        size_t room;
+        off_t position = source_offset(offset, &room);
+        size_t chunk = (end - offset < CHUNK_SIZE) ? (size_t)(end - offset) : (size_t)CHUNK_SIZE;
+        chunk = chunk < room ? chunk : room;
+
+        if (MODE == SEND_COPY && SOURCE_MAP != NULL) {
+            if (CHECKSUM) {
+                stream->crc = crc32c_update(stream->crc, SOURCE_MAP + position, chunk);
+            }
+            send_chunk(stream, SOURCE_MAP + position, chunk);
+            atomic_fetch_add(&SYSCALLS, 1);
+            offset += chunk;
+            continue;
+        }
+        if (MODE == SEND_COPY && SOURCE == SOURCE_DIR) {
+            read_tree(stream, stream->buffer, position, chunk);
+            atomic_fetch_add(&SYSCALLS, 1);
+            if (CHECKSUM) {
+                stream->crc = crc32c_update(stream->crc, stream->buffer, chunk);
+            }
+            send_chunk(stream, stream->buffer, chunk);
+            offset += chunk;
+            continue;
+        }
+        if (MODE == SEND_COPY) {
+            // Each chunk goes out as a frame of exactly bytes_read payload bytes
+            ssize_t bytes_read = pread(fd, stream->buffer, chunk, position);
+            atomic_fetch_add(&SYSCALLS, 2); // pread() and the send of the frame
+            if (bytes_read <= 0) {
+                if (bytes_read < 0 && errno == EINTR) {
+                    continue;
+                }
+                break; // File shrank while being sent
+            }
+            if (CHECKSUM) {
+                stream->crc = crc32c_update(stream->crc, stream->buffer, bytes_read);
+            }
+            send_chunk(stream, stream->buffer, bytes_read);
+            offset += bytes_read;
+            continue;
+        }
+
+        pace(stream, FRAME_HEADER_SIZE + chunk);
+        send_frame_header(socket, &stream->seq, FILE_DATA, 0, chunk);
+        atomic_fetch_add(&SYSCALLS, 1);
+        if (CHECKSUM && SOURCE == SOURCE_DIR) {
+            read_tree(stream, stream->buffer, position, chunk);
+            stream->crc = crc32c_update(stream->crc, stream->buffer, chunk);
+        } else if (CHECKSUM) {
+            stream->crc = crc32c_update(stream->crc, RUN_MAP + position, chunk);
+        }
+        size_t left = chunk;
+        while (left > 0) {
+            // A frame of the tree is moved from each file it spans in turn
+            int from = fd;
+            off_t at = position;
+            size_t want = left;
+            if (SOURCE == SOURCE_DIR) {
+                size_t in_file;
+                from = tree_file(stream, position, &at, &in_file);
+                want = want < in_file ? want : in_file;
+            }
+            ssize_t moved;
+            atomic_fetch_add(&SYSCALLS, MODE == SEND_SENDFILE ? 1 : 2);
+            if (MODE == SEND_SENDFILE) {
+                moved = sendfile(socket, from, &at, want);
+            } else {
+                moved = splice(from, &at, stream->pipe_fds[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+                for (ssize_t drained = 0; moved > 0 && drained < moved;) {
+                    ssize_t n = splice(stream->pipe_fds[0], NULL, socket, NULL, moved - drained,
+                                       SPLICE_F_MOVE | SPLICE_F_MORE);
+                    if (n > 0 && n < moved - drained) {
+                        atomic_fetch_add(&SYSCALLS, 1);
+                    }
+                    if (n <= 0) {
+                        if (n < 0 && errno == EINTR) {
+                            continue;
+                        }
+                        perror("splice to socket");
+                        exit(EXIT_FAILURE);
+                    }
+                    drained += n;
+                }
+            }
+            if (moved < 0 && errno == EINTR) {
+                continue;
+            }
+            if (moved <= 0) {
+                perror(MODE == SEND_SENDFILE ? "sendfile" : "splice from file");
+                exit(EXIT_FAILURE);
+            }
+            position += moved;
+            left -= moved;
+            reporter_count(&REPORTER, moved);
+        }
+        offset += chunk;
+    }
+    return length - (end - offset);
+}
+
+/**
+ * Sends the literal bytes of a delta run as FILE_DATA chunks.
+ *
+ * @param stream Stream to send on
+ * @param data Literal bytes
+ * @param length Number of literal bytes
+ * @return Number of literal bytes, before any compression
+ */
+size_t send_literal(Stream *stream, const unsigned char *data, size_t length) {
+    size_t total = length;
+    while (length > 0) {
+        size_t chunk = length < (size_t)CHUNK_SIZE ? length : (size_t)CHUNK_SIZE;
+        if (CHECKSUM) {
+            stream->crc = crc32c_update(stream->crc, data, chunk);
+        }
+        send_chunk(stream, (const char *)data, chunk);
+        atomic_fetch_add(&SYSCALLS, 1);
+        data += chunk;
+        length -= chunk;
+    }
+    return total;
+}
+
+/**
+ * Sends a DELTA_COPY telling the receiver to take bytes from its previous
+ * file. The bytes still count towards the range's CRC32C, so END checks the
+ * rebuilt file as a whole.
+ *
+ * @param stream Stream to send on
+ * @param data The copied bytes, as the sender has them
+ * @param base_offset Offset of the bytes in the receiver's previous file
+ * @param length Number of bytes to copy
+ */
+void send_copy(Stream *stream, const unsigned char *data, uint64_t base_offset, uint64_t length) {
+    if (CHECKSUM) {
+        stream->crc = crc32c_update(stream->crc, data, length);
+    }
+    unsigned char copy[DELTA_COPY_PAYLOAD_SIZE];
+    put_u64(copy, base_offset);
+    put_u64(copy + 8, length);
+    send_frame(stream->socket, &stream->seq, DELTA_COPY, 0, copy, DELTA_COPY_PAYLOAD_SIZE);
+    atomic_fetch_add(&SYSCALLS, 1);
+    reporter_count(&REPORTER, length);
+}
+
+/**
+ * Sends a run as a delta against the receiver's previous file. The receiver
+ * answers the START with the signatures of its previous file's blocks. A
+ * window slides over the data one byte at a time, and its weak checksum is
+ * rolled along. Every window that matches a signed block becomes a
+ * DELTA_COPY, merged with the copies around it when they are adjacent in
+ * the previous file. The bytes between matches go out as FILE_DATA.
+ *
+ * @param stream Stream to send on, the one that sent START
+ * @param data Data of the run
+ * @param length Length of the data
+ * @return Number of file bytes sent, literally or as copies
+ */
+size_t send_delta(Stream *stream, const unsigned char *data, size_t length) {
+    uint64_t start = now_ns();
+    FrameHeader header;
+    int error = recv_frame_header(stream->socket, &stream->peer_seq, &header);
+    if (error == FRAME_OK && (header.type != DELTA_SIGNATURES || header.length < DELTA_HEADER_SIZE)) {
+        error = FRAME_BAD_TYPE;
+    }
+    unsigned char *signatures = NULL;
+    if (error == FRAME_OK && ((signatures = malloc(header.length)) == NULL ||
+                              recv_all(stream->socket, signatures, header.length) < 0)) {
+        error = FRAME_CLOSED;
+    }
+    if (error != FRAME_OK) {
+        fprintf(stderr, "No block signatures from the receiver: %s\n", frame_error_string(error));
+        exit(EXIT_FAILURE);
+    }
+    uint32_t block = get_u32(signatures);
+    uint32_t count = get_u32(signatures + 4);
+    if (block < DELTA_MIN_BLOCK || block > DELTA_MAX_BLOCK ||
+        DELTA_HEADER_SIZE + (uint64_t)count * DELTA_SIGNATURE_SIZE > header.length) {
+        fprintf(stderr, "Invalid block signatures from the receiver\n");
+        exit(EXIT_FAILURE);
+    }
+    DeltaIndex index;
+    if (delta_index_init(&index, signatures + DELTA_HEADER_SIZE, count, block) < 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    double signatures_ms = (now_ns() - start) / 1e6;
+
+    uint64_t match_start = now_ns();
+    uint64_t literal_bytes = 0;        // Literal bytes sent, counted before compression like the receiver does
+    size_t pos = 0, literal = 0;       // Window position, start of the pending literal bytes
+    size_t copy_pos = 0;               // Start of the pending copy in the data
+    uint64_t copy_base = 0, copy_length = 0;
+    uint32_t matched = 0;
+    stream->crc = 0;
+
+    uint32_t weak = (count > 0 && length >= block) ? delta_weak(data, block) : 0;
+    while (count > 0 && pos + block <= length) {
+        long k = delta_index_find(&index, weak, data + pos);
+        if (k >= 0) {
+            if (literal < pos) {
+                if (copy_length > 0) {
+                    send_copy(stream, data + copy_pos, copy_base, copy_length);
+                    copy_length = 0;
+                }
+                literal_bytes += send_literal(stream, data + literal, pos - literal);
+            }
+            if (copy_length > 0 && copy_base + copy_length == (uint64_t)k * block) {
+                copy_length += block;
+            } else {
+                if (copy_length > 0) {
+                    send_copy(stream, data + copy_pos, copy_base, copy_length);
+                }
+                copy_pos = pos;
+                copy_base = (uint64_t)k * block;
+                copy_length = block;
+            }
+            matched++;
+            pos += block;
+            literal = pos;
+            if (pos + block <= length) {
+                weak = delta_weak(data + pos, block);
+            }
+            continue;
+        }
+        if (pos + block < length) {
+            weak = delta_roll(weak, data[pos], data[pos + block], block);
+        }
+        pos++;
+        if (pos - literal >= BUFFER_SIZE) {
+            if (copy_length > 0) {
+                send_copy(stream, data + copy_pos, copy_base, copy_length);
+                copy_length = 0;
+            }
+            literal_bytes += send_literal(stream, data + literal, pos - literal);
+            literal = pos;
+        }
+    }
+    if (copy_length > 0) {
+        send_copy(stream, data + copy_pos, copy_base, copy_length);
+    }
+    literal_bytes += send_literal(stream, data + literal, length - literal);
+
+    printf("Delta: %u of %u blocks of %u KB matched, %.2f MB of %.2f MB sent as literals (%.1f%% saved)\n", matched,
+           count, block / 1024, literal_bytes / (1024.0 * 1024.0), length / (1024.0 * 1024.0),
+           length > 0 ? 100.0 * (1 - (double)literal_bytes / length) : 0.0);
+    printf("- Signatures: %.2f MB in %.2f ms, matching and sending: %.2f ms\n", header.length / (1024.0 * 1024.0),
+           signatures_ms, (now_ns() - match_start) / 1e6);
+    delta_index_free(&index);
+    free(signatures);
+    return length;
+}
+
+/**
+ * Body of a pool thread: waits for a range job, sends it on its own
+ * connection as RANGE, FILE_DATA frames and END, then reports completion.
+ *
+ * @param arg Pointer to the thread's Stream
+ * @return NULL
+ */
+void *stream_worker(void *arg) {
+    Stream *stream = (Stream *)arg;
+    int seen = 0;
+
+    while (1) {
+        pthread_mutex_lock(&POOL_LOCK);
+        while (POOL_GENERATION == seen && !POOL_STOP) {
+            pthread_cond_wait(&POOL_COND, &POOL_LOCK);
+        }
+        if (POOL_STOP) {
+            pthread_mutex_unlock(&POOL_LOCK);
+            break;
+        }
+        seen = POOL_GENERATION;
+        pthread_mutex_unlock(&POOL_LOCK);
+
+        unsigned char range[RANGE_PAYLOAD_SIZE];
+        put_u32(range, RUN);
+        put_u64(range + 4, TRANSFER_SIZE);
+        put_u64(range + 12, stream->offset);
+        put_u64(range + 20, stream->length);
+        send_frame(stream->socket, &stream->seq, CONTROL_RANGE, SOURCE == SOURCE_DIR ? FRAME_FLAG_TREE : 0, range,
+                   RANGE_PAYLOAD_SIZE);
+        size_t sent = send_range(stream, stream->fd, stream->offset, stream->length);
+        send_end(stream, sent);
+
+        pthread_mutex_lock(&POOL_LOCK);
+        POOL_DONE++;
+        pthread_cond_broadcast(&POOL_COND);
+        pthread_mutex_unlock(&POOL_LOCK);
+    }
+    return NULL;
+}
+
+/**
+ * Returns the CPU time (user + system) the process has used so far, in milliseconds.
+ *
+ * @return CPU time in milliseconds
+ */
+double cpu_time_ms() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+/**
+ * Sends the content of a file, FILE_SIZE bytes of the in-memory source, or
+ * the files of the -dir tree after its manifest, through the session's streams.
+ * With several streams the data is split into contiguous byte ranges, one per
+ * stream, sent concurrently by the pool threads while stream 0 sends the first.
+ * Reports the CPU time the transfer cost, normalized per GB.
+ */
+void send_file() {
+    Stream *primary = &STREAMS[0];
+    int fd = SOURCE_FD;
+    struct stat st;
+    st.st_size = FILE_SIZE;
+    if (SOURCE == SOURCE_FILE) {
+        fd = open(FILE_PATH, O_RDONLY);
+        if (fd < 0) {
+            perror("Error opening file");
+            return;
+        }
+        if (fstat(fd, &st) < 0) {
+            perror("Error reading file size");
+            close(fd);
+            return;
+        }
+        posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+        if (DIRECT) {
+            int direct_fd = open(FILE_PATH, O_RDONLY | O_DIRECT);
+            if (direct_fd < 0) {
+                // Runtime fallback: file systems without O_DIRECT (e.g. tmpfs) read through the page cache
+                fprintf(stderr, "O_DIRECT unavailable (%s), reading through the page cache\n", strerror(errno));
+                DIRECT = 0;
+            } else {
+                close(fd);
+                fd = direct_fd;
+            }
+        }
+    }
+    if (RUN_LIMIT > 0 && st.st_size > RUN_LIMIT) {
+        st.st_size = RUN_LIMIT; // A tuning probe, the receiver gets a prefix of the file
+    }
+    TRANSFER_SIZE = st.st_size;
+    RUN_MAP = SOURCE_MAP;
+    // A delta run needs all of the data at once: the previous run's file is all the receiver has to copy from
+    int delta = DELTA && RUN > 0;
+    const unsigned char *delta_data = (const unsigned char *)SOURCE_MAP;
+    if (delta && SOURCE == SOURCE_FILE && st.st_size > 0) {
+        delta_data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (delta_data == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (delta && SOURCE == SOURCE_DIR && st.st_size > 0) {
+        delta_data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (delta_data == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        read_tree(primary, (char *)delta_data, 0, st.st_size);
+    }
+    if (SOURCE == SOURCE_FILE && CHECKSUM && (MODE == SEND_SENDFILE || MODE == SEND_SPLICE) && st.st_size > 0) {
+        RUN_MAP = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (RUN_MAP == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double cpu_start = cpu_time_ms();
+    uint64_t wall_start = now_ns();
+    unsigned long syscalls_start = atomic_load(&SYSCALLS);
+    unsigned long wire_start = atomic_load(&WIRE_BYTES);
+    unsigned long chunks_start = atomic_load(&CHUNKS_SENT);
+    unsigned long compressed_start = atomic_load(&CHUNKS_COMPRESSED);
+    unsigned long zc_sends_start = atomic_load(&ZC_SENDS), zc_copied_start = atomic_load(&ZC_COPIED);
+    unsigned long zc_fallbacks_start = atomic_load(&ZC_FALLBACKS), zc_waits_start = atomic_load(&ZC_WAITS);
+    unsigned long reader_waits_start = 0, sender_waits_start = 0;
+    for (int k = 0; MODE == SEND_PIPELINE && k < STREAM_COUNT; k++) {
+        reader_waits_start += atomic_load(&STREAMS[k].empty.pop_waits);
+        sender_waits_start += atomic_load(&STREAMS[k].filled.pop_waits);
+    }
+    // Send "START" message before sending the file, announcing its size, the warmup runs and the run's algorithm
+    // Over RUDP the kernel's algorithm only runs the loopback hop to the bridge
+    const char *algo = TRANSPORT == TRANSPORT_RUDP ? "rudp" : ALGO;
+    unsigned char start_payload[START_PAYLOAD_SIZE + START_ALGO_MAX];
+    size_t algo_length = strnlen(algo, START_ALGO_MAX);
+    put_u32(start_payload, RUN);
+    put_u64(start_payload + 4, st.st_size);
+    put_u32(start_payload + 12, WARMUP);
+    memcpy(start_payload + START_PAYLOAD_SIZE, algo, algo_length);
+    send_frame(primary->socket, &primary->seq, CONTROL_START,
+               (delta ? FRAME_FLAG_DELTA : 0) | (WARMING ? FRAME_FLAG_WARMUP : 0) |
+                   (SOURCE == SOURCE_DIR ? FRAME_FLAG_TREE : 0),
+               start_payload, START_PAYLOAD_SIZE + algo_length);
+    if (SOURCE == SOURCE_DIR) {
+        send_manifest(primary);
+    }
+    if (delta) {
+        flush_stream(primary); // The receiver answers START before any data follows
+    }
+
+    size_t bytes_sent, primary_sent;
+    reporter_begin(&REPORTER);
+    if (delta) {
+        // Delta runs go over stream 0 alone, the receiver copies most of the data locally
+        bytes_sent = primary_sent = send_delta(primary, delta_data, st.st_size);
+    } else if (STREAM_COUNT == 1) {
+        bytes_sent = primary_sent = send_range(primary, fd, 0, st.st_size);
+    } else {
+        size_t share = (st.st_size + STREAM_COUNT - 1) / STREAM_COUNT;
+        for (int k = 0; k < STREAM_COUNT; k++) {
+            off_t offset = (off_t)share * k < st.st_size ? (off_t)share * k : st.st_size;
+            STREAMS[k].fd = fd;
+            STREAMS[k].offset = offset;
+            STREAMS[k].length = (st.st_size - offset < (off_t)share) ? (size_t)(st.st_size - offset) : share;
+        }
+
+        pthread_mutex_lock(&POOL_LOCK);
+        POOL_DONE = 0;
+        POOL_GENERATION++;
+        pthread_cond_broadcast(&POOL_COND);
+        pthread_mutex_unlock(&POOL_LOCK);
+
+        unsigned char range[RANGE_PAYLOAD_SIZE];
+        put_u32(range, RUN);
+        put_u64(range + 4, st.st_size);
+        put_u64(range + 12, primary->offset);
+        put_u64(range + 20, primary->length);
+        send_frame(primary->socket, &primary->seq, CONTROL_RANGE, SOURCE == SOURCE_DIR ? FRAME_FLAG_TREE : 0, range,
+                   RANGE_PAYLOAD_SIZE);
+        primary_sent = send_range(primary, fd, primary->offset, primary->length);
+
+        pthread_mutex_lock(&POOL_LOCK);
+        while (POOL_DONE < STREAM_COUNT - 1) {
+            pthread_cond_wait(&POOL_COND, &POOL_LOCK);
+        }
+        pthread_mutex_unlock(&POOL_LOCK);
+        bytes_sent = st.st_size;
+    }
+
+    // Send "END" message after finishing sending the file
+    send_end(primary, primary_sent);
+    reporter_end(&REPORTER);
+    double cpu_ms = cpu_time_ms() - cpu_start;
+    double wall_ms = (now_ns() - wall_start) / 1e6;
+    RUN++;
+
+    CPU_TOTAL_MS += cpu_ms;
+    BYTES_TOTAL += bytes_sent;
+    double syscalls = atomic_load(&SYSCALLS) - syscalls_start;
+    printf("CPU time (%s): %.2f ms for %.2f MB = %.2f ms/GB, %.0f data path syscalls/GB\n", send_mode_name(MODE),
+           cpu_ms, bytes_sent / (1024.0 * 1024.0), bytes_sent > 0 ? cpu_ms * (1 << 30) / bytes_sent : 0.0,
+           bytes_sent > 0 ? syscalls * (1 << 30) / bytes_sent : 0.0);
+    if (PACE_RATE > 0) {
+        // Sent into the socket buffers, the receiver's rate tells what the network delivered
+        printf("Pacing (%s): %.2f MB/s target, %.2f MB/s offered\n",
+               PACER == PACE_KERNEL ? "SO_MAX_PACING_RATE" : "token bucket", PACE_RATE,
+               wall_ms > 0 ? bytes_sent / (1024.0 * 1024.0) / (wall_ms / 1000) : 0.0);
+    }
+    if (MODE == SEND_PIPELINE) {
+        // Readers waiting for a free buffer means the network is the bottleneck, senders waiting for data the disk
+        unsigned long reader_waits = 0, sender_waits = 0;
+        for (int k = 0; k < STREAM_COUNT; k++) {
+            reader_waits += atomic_load(&STREAMS[k].empty.pop_waits);
+            sender_waits += atomic_load(&STREAMS[k].filled.pop_waits);
+        }
+        printf("Pipeline%s: readers waited %lu times for a free buffer, senders %lu times for data\n",
+               DIRECT ? " (O_DIRECT)" : "", reader_waits - reader_waits_start, sender_waits - sender_waits_start);
+    }
+    if (MODE == SEND_ZEROCOPY) {
+        // A completion the kernel copied for saved nothing; the others each skipped a copy of their bytes
+        unsigned long sends = atomic_load(&ZC_SENDS) - zc_sends_start;
+        unsigned long copied = atomic_load(&ZC_COPIED) - zc_copied_start;
+        unsigned long fallbacks = atomic_load(&ZC_FALLBACKS) - zc_fallbacks_start;
+        double zerocopy = sends + fallbacks > 0 ? (double)(sends - copied) / (sends + fallbacks) : 0.0;
+        printf("Zerocopy: %lu sends, %lu zero-copy, %lu copied by the kernel, %lu fell back to copying send() "
+               "(%.1f%% zero-copy), %lu waits for a buffer\n", sends + fallbacks, sends - copied, copied, fallbacks,
+               100.0 * zerocopy, atomic_load(&ZC_WAITS) - zc_waits_start);
+        printf("- About %.2f ms/GB of CPU time saved, at %.2f GB/s for a copy\n", zerocopy * COPY_NS * (1 << 30) / 1e6,
+               COPY_NS > 0 ? 1.0 / COPY_NS : 0.0);
+    }
+    if (COMPRESS != COMPRESS_OFF) {
+        double wire = atomic_load(&WIRE_BYTES) - wire_start;
+        printf("Compression (%s): %lu of %lu chunks compressed, %.2f MB of data in %.2f MB on the wire (%.1f%%)\n",
+               COMPRESS == COMPRESS_ON ? "on" : "auto", atomic_load(&CHUNKS_COMPRESSED) - compressed_start,
+               atomic_load(&CHUNKS_SENT) - chunks_start, bytes_sent / (1024.0 * 1024.0), wire / (1024.0 * 1024.0),
+               bytes_sent > 0 ? 100.0 * wire / bytes_sent : 100.0);
+    }
+
+    if (RUN_MAP != NULL && RUN_MAP != SOURCE_MAP) {
+        munmap(RUN_MAP, st.st_size);
+    }
+    if (delta_data != NULL && delta_data != (const unsigned char *)SOURCE_MAP) {
+        munmap((void *)delta_data, st.st_size);
+    }
+    if (SOURCE == SOURCE_FILE) {
+        close(fd);
+    }
+}
+
+/**
+ * Creates a socket.
+ *
+ * @return File descriptor of the created socket
+ */
+int create_socket() {
+    int sock;
+    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        printf("\n Socket creation error \n");
+        exit(EXIT_FAILURE);
+    }
+    return sock;
+}
+
+/**
+ * Connects to the server.
+ *
+ * @param sock File descriptor of the socket
+ */
+void connect_to_server(int sock) {
+    struct sockaddr_in serv_addr;
+    serv_addr.sin_family = AF_INET; // set the address family to AF_INET (IPv4)
+    serv_addr.sin_port = htons(TRANSPORT == TRANSPORT_RUDP ? RUDP_PORT : PORT); // set the port number
+    if (inet_pton(AF_INET, TRANSPORT == TRANSPORT_RUDP ? "127.0.0.1" : IP, &serv_addr.sin_addr) <= 0) {
+        printf("\nInvalid address/ Address not supported \n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Waiting for TCP connection...\n");
+
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        printf("\nConnection Failed \n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Closes the socket.
+ *
+ * @param sock File descriptor of the socket
+ */
+void close_socket(int sock) {
+    close(sock);
+}
+
+/**
+ * Opens the session's streams. Stream 0 is the already connected socket; for
+ * a multi-stream session every connection announces itself with CONTROL_JOIN
+ * and streams 1..N-1 get a pool thread each.
+ *
+ * @param sock File descriptor of the connected socket
+ */
+void open_streams(int sock) {
+    POOL_GENERATION = POOL_DONE = POOL_STOP = 0; // A reconnect starts a new pool
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t session_id = ((uint64_t)getpid() << 32) ^ ((uint64_t)ts.tv_sec << 20) ^ ts.tv_nsec;
+
+    for (int k = 0; k < STREAM_COUNT; k++) {
+        Stream *stream = &STREAMS[k];
+        memset(stream, 0, sizeof(*stream));
+        stream->pipe_fds[0] = stream->pipe_fds[1] = -1;
+        stream->tree_file = stream->tree_fd = -1;
+        if (k == 0) {
+            stream->socket = sock;
+        } else {
+            stream->socket = create_socket();
+            set_congestion_control(stream->socket);
+            connect_to_server(stream->socket);
+        }
+
+        apply_socket_options(stream->socket);
+        tcp_sampler_add(&SAMPLER, stream->socket, k);
+
+        if (MODE == SEND_URING && init_stream_uring(stream) < 0) {
+            // Runtime fallback: kernels without io_uring use the blocking copy path
+            fprintf(stderr, "io_uring unavailable (%s), falling back to -mode copy\n", strerror(errno));
+            MODE = SEND_COPY;
+        }
+        if (MODE == SEND_PIPELINE) {
+            init_stream_pipeline(stream);
+        }
+        if (MODE == SEND_ZEROCOPY && init_stream_zerocopy(stream) < 0) {
+            // Runtime fallback: kernels before 4.14 have no MSG_ZEROCOPY
+            fprintf(stderr, "MSG_ZEROCOPY unavailable (%s), falling back to -mode copy\n", strerror(errno));
+            MODE = SEND_COPY;
+        }
+        if (STREAM_COUNT > 1) {
+            unsigned char join[JOIN_PAYLOAD_SIZE];
+            put_u64(join, session_id);
+            put_u32(join + 8, k);
+            put_u32(join + 12, STREAM_COUNT);
+            send_frame(stream->socket, &stream->seq, CONTROL_JOIN, 0, join, JOIN_PAYLOAD_SIZE);
+        }
+        if (k > 0 && pthread_create(&stream->thread, NULL, stream_worker, stream) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Stops the pool threads and closes every stream.
+ */
+void close_streams() {
+    pthread_mutex_lock(&POOL_LOCK);
+    POOL_STOP = 1;
+    pthread_cond_broadcast(&POOL_COND);
+    pthread_mutex_unlock(&POOL_LOCK);
+
+    for (int k = 0; k < STREAM_COUNT; k++) {
+        Stream *stream = &STREAMS[k];
+        if (k > 0) {
+            pthread_join(stream->thread, NULL);
+        }
+        if (stream->pipe_fds[0] >= 0) {
+            close(stream->pipe_fds[0]);
+            close(stream->pipe_fds[1]);
+        }
+        if (stream->ring_buffers != NULL) {
+            uring_exit(&stream->ring);
+            free(stream->ring_buffers);
+        }
+        if (stream->pipe != NULL) {
+            free_stream_pipeline(stream);
+        }
+        if (stream->zc_pool != NULL) {
+            munlock(stream->zc_pool, ZEROCOPY_BUFFERS * URING_SLOT_SIZE);
+            free(stream->zc_pool);
+        }
+        if (stream->tree_fd >= 0) {
+            close(stream->tree_fd);
+        }
+        free(stream->buffer);
+        free(stream->packed);
+        tcp_sampler_remove(&SAMPLER, stream->socket);
+        close_socket(stream->socket);
+    }
+}
+
+/**
+ * Waits until the receiver has acknowledged everything sent on the streams,
+ * so a probe is timed to its delivery rather than to the socket buffers.
+ */
+void wait_acknowledged() {
+    for (int k = 0; k < STREAM_COUNT; k++) {
+        int queued;
+        while (ioctl(STREAMS[k].socket, SIOCOUTQ, &queued) == 0 && queued > 0) {
+            struct timespec pause = {0, 100000};
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+/**
+ * Applies the current settings to every stream and measures them with
+ * TUNE_REPEATS probe runs, and as many more as it takes to measure for
+ * TUNE_MIN_MS: a small file on a fast link is sent in milliseconds, where
+ * timer and scheduler noise alone would exceed TUNE_MARGIN.
+ *
+ * @param goodput Set to the delivered MB per second
+ * @param efficiency Set to the delivered MB per CPU-second of the sender
+ */
+void tune_probe(double *goodput, double *efficiency) {
+    for (int k = 0; k < STREAM_COUNT; k++) {
+        apply_socket_options(STREAMS[k].socket);
+    }
+    double seconds = 0, cpu_seconds = 0, mb = 0;
+    for (int r = 0; r < TUNE_REPEATS || seconds * 1000 < TUNE_MIN_MS; r++) {
+        uint64_t start = now_ns();
+        double cpu_start = cpu_time_ms();
+        send_file();
+        wait_acknowledged();
+        seconds += (now_ns() - start) / 1e9;
+        cpu_seconds += (cpu_time_ms() - cpu_start) / 1e3;
+        mb += TRANSFER_SIZE / (1024.0 * 1024.0);
+        send_control_message(&STREAMS[0], CONTROL_SEND_AGAIN);
+    }
+    *goodput = seconds > 0 ? mb / seconds : 0;
+    *efficiency = cpu_seconds > 0 ? mb / cpu_seconds : 0;
+}
+
+/**
+ * Tuning mode: sweeps the socket settings one at a time over probe runs on
+ * the live session and writes the best ones to the profile. A candidate wins
+ * on goodput; within TUNE_MARGIN of the best goodput, which is noise on a
+ * shared link, the one delivering more data per CPU-second wins. Probes are
+ * warmup runs of the first TUNE_PROBE_SIZE bytes, so the receiver leaves
+ * them out of its statistics.
+ */
+void tune() {
+    WARMING = 1;
+    DELTA = 0;
+    RUN_LIMIT = TUNE_PROBE_SIZE;
+    int probes = 0;
+    double best_goodput, best_efficiency;
+    tune_probe(&best_goodput, &best_efficiency);
+    printf("Tuning: start at %.2f MB/s, %.0f MB per CPU-second\n", best_goodput, best_efficiency);
+
+    for (int p = 0; p < TUNE_PARAMETER_COUNT; p++) {
+        TuneParameter *parameter = &TUNE_PARAMETERS[p];
+        int best = *parameter->setting;
+        for (int c = 0; c == 0 || (c < 5 && parameter->candidates[c] != 0); c++) {
+            if (parameter->candidates[c] == best) {
+                continue;
+            }
+            *parameter->setting = parameter->candidates[c];
+            double goodput, efficiency;
+            tune_probe(&goodput, &efficiency);
+            probes++;
+            printf("Tuning: %s = %d: %.2f MB/s, %.0f MB per CPU-second\n", parameter->name, *parameter->setting,
+                   goodput, efficiency);
+            if (goodput > best_goodput * (1 + TUNE_MARGIN) ||
+                (goodput >= best_goodput * (1 - TUNE_MARGIN) && efficiency > best_efficiency)) {
+                best = *parameter->setting;
+                best_goodput = goodput;
+                best_efficiency = efficiency;
+            }
+        }
+        *parameter->setting = best;
+    }
+
+    FILE *file = fopen(TUNE_PATH, "w");
+    if (file == NULL) {
+        perror(TUNE_PATH);
+        exit(EXIT_FAILURE);
+    }
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    getsockopt(STREAMS[0].socket, IPPROTO_TCP, TCP_INFO, &info, &length);
+    fprintf(file, "# Written by TCP_Sender -tune: %.2f MB/s, %.0f MB per CPU-second, %d stream(s), srtt %.2f ms\n",
+            best_goodput, best_efficiency, STREAM_COUNT, info.tcpi_rtt / 1e3);
+    printf("Tuning: %d probes, best %.2f MB/s, %.0f MB per CPU-second with", probes + 1, best_goodput,
+           best_efficiency);
+    for (int p = 0; p < TUNE_PARAMETER_COUNT; p++) {
+        fprintf(file, "%s=%d\n", TUNE_PARAMETERS[p].name, *TUNE_PARAMETERS[p].setting);
+        printf(" %s=%d", TUNE_PARAMETERS[p].name, *TUNE_PARAMETERS[p].setting);
+    }
+    printf(", written to %s\n", TUNE_PATH);
+    fclose(file);
+}
+
+/**
+ * Main function.
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ * @return 0 indicating successful execution of the program
+ */
+int main(int argc, char *argv[]) {
+    if (extract_Variables(argc, argv) == 1) {
+        return 1;
+    }
+    printf("Starting Sender...\n");
+    // A receiver that drops a connection shows up as EPIPE from the sending call, not as a silent exit
+    signal(SIGPIPE, SIG_IGN);
+    if (TRANSPORT == TRANSPORT_RUDP) {
+        RUDP_PORT = rudp_client_start(IP, PORT, LOSS_PERCENT);
+    }
+
+    int sock = create_socket();
+    set_congestion_control(sock);
+
+    if (SOURCE == SOURCE_MEM) {
+        open_memory_source();
+    } else if (SOURCE == SOURCE_DIR) {
+        open_tree_source();
+    } else {
+        // Assuming File_Generator is a separate program to generate random_file.txt
+        char command[64] = "./File_Generator";
+        if (FILE_SIZE > 0) {
+            snprintf(command, sizeof(command), "./File_Generator -size %llu", (unsigned long long)FILE_SIZE);
+        }
+        system(command);
+    }
+    connect_to_server(sock);
+    if (TCPINFO_PATH != NULL) {
+        tcp_sampler_start(&SAMPLER, TCPINFO_PATH, TCPINFO_INTERVAL_MS);
+    }
+    if (INTERVAL_MS > 0) {
+        // Over RUDP the data sockets only reach the bridge, the retransmissions happen in the flows
+        reporter_start(&REPORTER, &SAMPLER, "sender", INTERVAL_MS, INTERVAL_JSON,
+                       TRANSPORT == TRANSPORT_RUDP ? rudp_retransmits : NULL);
+    }
+    open_streams(sock);
+
+    printf("Connection established. Sending file...\n");
+
+    if (TUNE_PATH != NULL) {
+        tune();
+        send_control_message(&STREAMS[0], CONTROL_EXIT);
+    }
+
+    for (int i = 0; TUNE_PATH == NULL; i++) {
+        if (ALGO_COUNT > 0) {
+            set_run_algorithm(ALGOS[i % ALGO_COUNT]);
+        }
+        WARMING = i < WARMUP;
+        send_file();
+        printf("File sent successfully.\n");
+
+        if (RUNS > 0) {
+            // Batch mode: the warmup runs, then the measured ones, no questions asked
+            if (i + 1 == WARMUP + RUNS) {
+                send_control_message(&STREAMS[0], CONTROL_EXIT);
+                break;
+            }
+        } else {
+            // Prompt user to send the file again
+            char response[10];
+            printf("Do you want to send the file again? (yes/no): ");
+            if (scanf("%9s", response) != 1 || strcmp(response, "no") == 0 || strcmp(response, "n") == 0) {
+                send_control_message(&STREAMS[0], CONTROL_EXIT);
+                break;
+            }
+        }
+
+        if (DELAY_MS > 0) {
+            struct timespec delay = {DELAY_MS / 1000, (DELAY_MS % 1000) * 1000000L};
+            nanosleep(&delay, NULL);
+        }
+        if (RECONNECT) {
+            send_control_message(&STREAMS[0], CONTROL_EXIT);
+            close_streams();
+            sock = create_socket();
+            set_congestion_control(sock);
+            connect_to_server(sock);
+            open_streams(sock);
+            continue;
+        }
+        // Send "SEND_AGAIN" message
+        send_control_message(&STREAMS[0], CONTROL_SEND_AGAIN);
+    }
+    if (BYTES_TOTAL > 0) {
+        printf("Average CPU time (%s): %.2f ms/GB\n", send_mode_name(MODE), CPU_TOTAL_MS * (1 << 30) / BYTES_TOTAL);
+    }
+    close_streams();
+    if (TRANSPORT == TRANSPORT_RUDP) {
+        if (rudp_wait(RUDP_DRAIN_MS) < 0) {
+            fprintf(stderr, "RUDP flows still open after %d ms, exiting anyway\n", RUDP_DRAIN_MS);
+        }
+        rudp_report();
+    }
+    reporter_stop(&REPORTER);
+    tcp_sampler_stop(&SAMPLER);
+    if (SOURCE_MAP != NULL) {
+        munmap(SOURCE_MAP, SOURCE_LENGTH);
+        close(SOURCE_FD);
+    }
+    return 0;
+}
@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h> // The glibc struct tcp_info lacks the rate fields and tcpi_rcv_ooopack
+
+#include "TcpInfo.h"
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ */
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Returns the kernel's estimate of the rate a connection delivers data at,
+ * the link throughput as the congestion control sees it.
+ *
+ * @param socket Connected TCP socket
+ * @return Bytes per second, 0 if the kernel does not report it
+ */
+uint64_t tcp_delivery_rate(int socket) {
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &length) < 0) {
+        return 0;
+    }
+    return info.tcpi_delivery_rate;
+}
+
+/**
+ * Checks a congestion control algorithm against the ones the kernel has
+ * loaded, as listed in /proc/sys/net/ipv4/tcp_available_congestion_control.
+ *
+ * @param algo Name of the algorithm
+ * @param list Set to the space separated names of the loaded algorithms
+ * @param size Size of list
+ * @return 1 if the algorithm is loaded, 0 if not, -1 if the list cannot be read
+ */
+int tcp_congestion_available(const char *algo, char *list, size_t size) {
+    FILE *file = fopen(TCP_CONGESTION_LIST, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    if (fgets(list, size, file) == NULL) {
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    list[strcspn(list, "\n")] = '\0';
+
+    size_t length = strlen(algo);
+    for (const char *name = list; *name != '\0';) {
+        size_t name_length = strcspn(name, " ");
+        if (name_length == length && strncmp(name, algo, length) == 0) {
+            return 1;
+        }
+        name += name_length;
+        name += strspn(name, " ");
+    }
+    return 0;
+}
+
+/**
+ * Reads the TCP_INFO of a socket.
+ *
+ * @param socket Connected TCP socket
+ * @param info Filled with the connection's state
+ * @return Number of bytes of info the kernel filled, 0 on failure
+ */
+static socklen_t read_info(int socket, struct tcp_info *info) {
+    socklen_t length = sizeof(*info);
+    memset(info, 0, sizeof(*info));
+    if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, info, &length) < 0) {
+        return 0;
+    }
+    return length;
+}
+
+/**
+ * Adds the losses a socket counted since its previous poll to the totals
+ * of the listener.
+ *
+ * @param sampler Sampler holding the totals, locked
+ * @param sampled Socket, remembers the counters for the next poll
+ * @param info Fresh TCP_INFO of the socket
+ * @param length Bytes of info the kernel filled
+ */
+static void count_losses(TcpSampler *sampler, SampledSocket *sampled, const struct tcp_info *info,
+                         socklen_t length) {
+    sampler->retransmits += info->tcpi_total_retrans - sampled->retransmits;
+    sampled->retransmits = info->tcpi_total_retrans;
+    // Kernels before 5.5 do not count out-of-order segments
+    if (length >= offsetof(struct tcp_info, tcpi_rcv_ooopack) + sizeof(info->tcpi_rcv_ooopack)) {
+        sampler->out_of_order += info->tcpi_rcv_ooopack - sampled->out_of_order;
+        sampled->out_of_order = info->tcpi_rcv_ooopack;
+    }
+}
+
+/**
+ * Polls every watched socket once, counting its losses and writing a
+ * sample of it if the CSV is due.
+ *
+ * @param sampler Sampler to poll, locked
+ * @param now Current monotonic time in nanoseconds
+ * @param write Whether to write the samples to the CSV file
+ */
+static void sample_sockets(TcpSampler *sampler, uint64_t now, int write) {
+    double time_ms = (now - sampler->start_ns) / 1e6;
+    for (int i = 0; i < sampler->count; i++) {
+        struct tcp_info info;
+        socklen_t length = read_info(sampler->sockets[i].socket, &info);
+        if (length == 0) {
+            continue;
+        }
+        count_losses(sampler, &sampler->sockets[i], &info, length);
+        if (write) {
+            fprintf(sampler->file, "%.3f,%d,%u,%u,%u,%u,%u,%u,%llu,%llu\n", time_ms, sampler->sockets[i].id,
+                    info.tcpi_snd_cwnd, info.tcpi_snd_ssthresh, info.tcpi_rtt, info.tcpi_rttvar,
+                    info.tcpi_retransmits, info.tcpi_total_retrans, (unsigned long long)info.tcpi_delivery_rate,
+                    (unsigned long long)info.tcpi_pacing_rate);
+        }
+    }
+}
+
+/**
+ * Calls the listener with the losses counted since its previous call.
+ *
+ * @param sampler Sampler with a listener, locked
+ * @param now Current monotonic time in nanoseconds
+ * @param last Whether this is the listener's final call
+ */
+static void call_listener(TcpSampler *sampler, uint64_t now, int last) {
+    sampler->listener(sampler->listener_arg, (now - sampler->listen_start_ns) / 1e9, sampler->retransmits,
+                      sampler->out_of_order, last);
+    sampler->retransmits = 0;
+    sampler->out_of_order = 0;
+}
+
+/**
+ * Sampler thread: until stopped, sleeps until the next CSV sample or call
+ * of the listener is due, whichever comes first, then polls the sockets
+ * once for both.
+ *
+ * @param arg Pointer to the TcpSampler
+ * @return NULL
+ */
+static void *sampler_loop(void *arg) {
+    TcpSampler *sampler = (TcpSampler *)arg;
+    pthread_mutex_lock(&sampler->lock);
+    while (sampler->running) {
+        uint64_t due = UINT64_MAX;
+        if (sampler->file != NULL) {
+            due = sampler->sample_due_ns;
+        }
+        if (sampler->listener != NULL && sampler->listen_due_ns < due) {
+            due = sampler->listen_due_ns;
+        }
+        if (due == UINT64_MAX) {
+            pthread_cond_wait(&sampler->wake, &sampler->lock);
+            continue;
+        }
+        struct timespec deadline = {(time_t)(due / 1000000000ULL), (long)(due % 1000000000ULL)};
+        if (pthread_cond_timedwait(&sampler->wake, &sampler->lock, &deadline) != ETIMEDOUT) {
+            continue; // Stopped, the listener changed or a spurious wakeup: look at the deadlines again
+        }
+
+        uint64_t now = monotonic_ns();
+        int write = sampler->file != NULL && now >= sampler->sample_due_ns;
+        sample_sockets(sampler, now, write);
+        // Absolute deadlines keep the periods steady however long a tick takes
+        if (write) {
+            sampler->sample_due_ns += (uint64_t)sampler->interval_ms * 1000000ULL;
+        }
+        if (sampler->listener != NULL && now >= sampler->listen_due_ns) {
+            call_listener(sampler, now, 0);
+            sampler->listen_due_ns += (uint64_t)sampler->listener_ms * 1000000ULL;
+        }
+    }
+    pthread_mutex_unlock(&sampler->lock);
+    return NULL;
+}
+
+/**
+ * Opens the output file, if any, and starts the sampler thread.
+ *
+ * @param sampler Sampler to start
+ * @param path CSV file the samples are written to, NULL to only feed a listener
+ * @param interval_ms Polling period of the CSV samples in milliseconds
+ */
+void tcp_sampler_start(TcpSampler *sampler, const char *path, int interval_ms) {
+    memset(sampler, 0, sizeof(*sampler));
+    if (path != NULL) {
+        sampler->file = fopen(path, "w");
+        if (sampler->file == NULL) {
+            perror("Error opening TCP_INFO file");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(sampler->file, "time_ms,id,cwnd,ssthresh,srtt_us,rttvar_us,retransmits,total_retrans,"
+                               "delivery_rate,pacing_rate\n");
+    }
+    pthread_mutex_init(&sampler->lock, NULL);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sampler->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    sampler->interval_ms = interval_ms;
+    sampler->running = 1;
+    sampler->start_ns = monotonic_ns();
+    sampler->sample_due_ns = sampler->start_ns + (uint64_t)interval_ms * 1000000ULL;
+    if (pthread_create(&sampler->thread, NULL, sampler_loop, sampler) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Feeds a listener from the sampler's polls until it is removed. Starts
+ * the sampler without a CSV file if it is not running. One listener at a
+ * time.
+ *
+ * @param sampler Sampler
+ * @param interval_ms Period of the listener in milliseconds
+ * @param listener Function the sampler thread calls every period
+ * @param arg Passed to the listener
+ */
+void tcp_sampler_listen(TcpSampler *sampler, int interval_ms, TcpSamplerListener listener, void *arg) {
+    if (!sampler->running) {
+        tcp_sampler_start(sampler, NULL, interval_ms);
+    }
+    pthread_mutex_lock(&sampler->lock);
+    sampler->listener = listener;
+    sampler->listener_arg = arg;
+    sampler->listener_ms = interval_ms;
+    sampler->listen_start_ns = monotonic_ns();
+    sampler->listen_due_ns = sampler->listen_start_ns + (uint64_t)interval_ms * 1000000ULL;
+    sampler->retransmits = 0;
+    sampler->out_of_order = 0;
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+/**
+ * Removes the listener after a final call with the losses counted since
+ * its previous one.
+ *
+ * @param sampler Sampler, ignored if it has no listener
+ */
+void tcp_sampler_unlisten(TcpSampler *sampler) {
+    if (!sampler->running) {
+        return;
+    }
+    pthread_mutex_lock(&sampler->lock);
+    if (sampler->listener != NULL) {
+        uint64_t now = monotonic_ns();
+        sample_sockets(sampler, now, 0);
+        call_listener(sampler, now, 1);
+        sampler->listener = NULL;
+        pthread_cond_signal(&sampler->wake);
+    }
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+/**
+ * Starts sampling a socket.
+ *
+ * @param sampler Sampler, ignored if it was never started
+ * @param socket Socket to watch
+ * @param id Label of the socket's samples
+ */
+void tcp_sampler_add(TcpSampler *sampler, int socket, int id) {
+    if (!sampler->running) {
+        return;
+    }
+    struct tcp_info info;
+    read_info(socket, &info); // Left zeroed where the kernel does not fill it
+    pthread_mutex_lock(&sampler->lock);
+    if (sampler->count == sampler->capacity) {
+        int capacity = sampler->capacity ? sampler->capacity * 2 : 16;
+        SampledSocket *sockets = (SampledSocket *)realloc(sampler->sockets, capacity * sizeof(SampledSocket));
+        if (sockets == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        sampler->sockets = sockets;
+        sampler->capacity = capacity;
+    }
+    sampler->sockets[sampler->count].socket = socket;
+    sampler->sockets[sampler->count].id = id;
+    // Losses counted before the socket was added are not reported
+    sampler->sockets[sampler->count].retransmits = info.tcpi_total_retrans;
+    sampler->sockets[sampler->count].out_of_order = info.tcpi_rcv_ooopack;
+    sampler->count++;
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+/**
+ * Stops sampling a socket. The losses it counted since the last poll are
+ * kept for the listener. Must be called before the socket is closed, so the
+ * sampler never polls a reused descriptor.
+ *
+ * @param sampler Sampler, ignored if it was never started
+ * @param socket Socket to forget
+ */
+void tcp_sampler_remove(TcpSampler *sampler, int socket) {
+    if (!sampler->running) {
+        return;
+    }
+    pthread_mutex_lock(&sampler->lock);
+    for (int i = 0; i < sampler->count; i++) {
+        if (sampler->sockets[i].socket == socket) {
+            struct tcp_info info;
+            socklen_t length;
+            if (sampler->listener != NULL && (length = read_info(socket, &info)) > 0) {
+                count_losses(sampler, &sampler->sockets[i], &info, length);
+            }
+            sampler->sockets[i] = sampler->sockets[--sampler->count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+/**
+ * Stops the sampler thread and closes the output file.
+ *
+ * @param sampler Sampler to stop, ignored if it was never started
+ */
+void tcp_sampler_stop(TcpSampler *sampler) {
+    if (!sampler->running) {
+        return;
+    }
+    pthread_mutex_lock(&sampler->lock);
+    sampler->running = 0;
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+    pthread_join(sampler->thread, NULL);
+
+    if (sampler->file != NULL) {
+        fclose(sampler->file);
+    }
+    free(sampler->sockets);
+    pthread_cond_destroy(&sampler->wake);
+    pthread_mutex_destroy(&sampler->lock);
+}
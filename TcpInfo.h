@@ -0,0 +1,71 @@
+#ifndef TCPINFO_H
+#define TCPINFO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define TCP_SAMPLER_DEFAULT_INTERVAL_MS 10  // Default polling period of the sampler
+#define TCP_CONGESTION_LIST "/proc/sys/net/ipv4/tcp_available_congestion_control"
+#define TCP_CONGESTION_LIST_SIZE 512        // Room for the names of the loaded congestion control algorithms
+
+// A socket watched by the sampler
+typedef struct {
+    int socket;
+    int id;                // Label written with its samples (stream index or connection number)
+    uint32_t retransmits;  // tcpi_total_retrans at the previous poll
+    uint32_t out_of_order; // tcpi_rcv_ooopack at the previous poll
+} SampledSocket;
+
+/*
+ * Called by the sampler thread every period of the listener, with the time
+ * since it started listening and the segments the watched sockets
+ * retransmitted and received out of order since the previous call. last is
+ * set on the final call, made when the listener is removed.
+ */
+typedef void (*TcpSamplerListener)(void *arg, double elapsed_s, unsigned long retransmits,
+                                   unsigned long out_of_order, int last);
+
+/*
+ * Background thread that polls getsockopt(TCP_INFO) on a set of sockets.
+ * With a CSV file it appends one line per socket and tick: time, cwnd,
+ * ssthresh, srtt, rttvar, retransmits, delivery rate and pacing rate. A
+ * listener, such as the interval reporter, gets the losses counted on the
+ * sockets at its own period from the same polls, so every socket is read
+ * by one thread only. The data path only touches the sampler when a socket
+ * is added or removed.
+ */
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;     // Protects everything below running
+    pthread_cond_t wake;      // Signalled to stop the thread early or when the listener changes
+    FILE *file;               // CSV output, NULL when only the listener is fed
+    int interval_ms;
+    int running;
+    uint64_t start_ns;        // Time 0 of the samples
+    uint64_t sample_due_ns;   // Time of the next CSV sample
+    SampledSocket *sockets;
+    int count;
+    int capacity;
+    TcpSamplerListener listener; // NULL for none
+    void *listener_arg;
+    int listener_ms;          // Period of the listener
+    uint64_t listen_start_ns; // Time the listener was added
+    uint64_t listen_due_ns;   // Time of the next call of the listener
+    unsigned long retransmits;  // Counted since the last call of the listener
+    unsigned long out_of_order; // Counted since the last call of the listener
+} TcpSampler;
+
+void tcp_sampler_start(TcpSampler *sampler, const char *path, int interval_ms);
+void tcp_sampler_add(TcpSampler *sampler, int socket, int id);
+void tcp_sampler_remove(TcpSampler *sampler, int socket);
+void tcp_sampler_stop(TcpSampler *sampler);
+void tcp_sampler_listen(TcpSampler *sampler, int interval_ms, TcpSamplerListener listener, void *arg);
+void tcp_sampler_unlisten(TcpSampler *sampler);
+
+// Rate at which a connection currently delivers data, in bytes per second, 0 if unknown
+uint64_t tcp_delivery_rate(int socket);
+
+int tcp_congestion_available(const char *algo, char *list, size_t size);
+
+#endif // TCPINFO_H
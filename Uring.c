@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "Uring.h"
+
+/**
+ * Sets up a ring and maps its submission and completion queues.
+ *
+ * @param ring Ring to initialize
+ * @param entries Number of submission queue entries
+ * @return 0 on success, -1 if io_uring is unavailable (errno is set)
+ */
+int uring_init(Uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            return -1;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring != ring->sq_ring) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return -1;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->sq_local_tail = *ring->sq_tail;
+    return 0;
+}
+
+/**
+ * Unmaps the queues and closes the ring.
+ *
+ * @param ring Ring to release
+ */
+void uring_exit(Uring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+/**
+ * Returns the next free submission queue entry.
+ *
+ * @param ring Ring to take the entry from
+ * @return Zeroed entry, or NULL if the submission queue is full
+ */
+struct io_uring_sqe *uring_get_sqe(Uring *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head > *ring->sq_mask) {
+        return NULL;
+    }
+    unsigned index = ring->sq_local_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+/**
+ * Fills a read/write style submission queue entry.
+ *
+ * @param sqe Entry to fill
+ * @param op IORING_OP_* operation
+ * @param fd File descriptor, or fixed file index with IOSQE_FIXED_FILE
+ * @param addr Buffer address
+ * @param length Buffer length
+ * @param offset File offset (ignored for sockets)
+ * @param user_data Value returned in the completion
+ */
+void uring_prep_rw(struct io_uring_sqe *sqe, int op, int fd, const void *addr, unsigned length,
+                   uint64_t offset, uint64_t user_data) {
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+/**
+ * Publishes the prepared entries and enters the kernel once to submit them
+ * and wait for completions.
+ *
+ * @param ring Ring to submit on
+ * @param wait_nr Number of completions to wait for
+ * @return Number of entries consumed by the kernel, -1 on error (errno is set)
+ */
+int uring_submit_and_wait(Uring *ring, unsigned wait_nr) {
+    unsigned published = ring->sq_local_tail - *ring->sq_tail;
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    ring->to_submit += published;
+
+    int result;
+    do {
+        ring->enters++;
+        result = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait_nr,
+                         wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (result < 0 && errno == EINTR);
+
+    if (result > 0) {
+        ring->to_submit -= result;
+    }
+    return result;
+}
+
+/**
+ * Returns the oldest unconsumed completion, if any.
+ *
+ * @param ring Ring to look at
+ * @return Completion, or NULL if the completion queue is empty
+ */
+struct io_uring_cqe *uring_peek_cqe(Uring *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+/**
+ * Marks the completion returned by uring_peek_cqe() as consumed.
+ *
+ * @param ring Ring the completion belongs to
+ */
+void uring_cqe_seen(Uring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Registers buffers for IORING_OP_READ_FIXED / IORING_OP_WRITE_FIXED.
+ *
+ * @param ring Ring to register with
+ * @param iovecs Buffers to register
+ * @param count Number of buffers
+ * @return 0 on success, -1 on error
+ */
+int uring_register_buffers(Uring *ring, const struct iovec *iovecs, unsigned count) {
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iovecs, count) < 0 ? -1 : 0;
+}
+
+/**
+ * Registers a fixed file table; -1 entries leave a slot empty.
+ *
+ * @param ring Ring to register with
+ * @param fds File descriptors to register
+ * @param count Number of descriptors
+ * @return 0 on success, -1 on error
+ */
+int uring_register_files(Uring *ring, const int *fds, unsigned count) {
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, fds, count) < 0 ? -1 : 0;
+}
+
+/**
+ * Replaces one slot of the fixed file table.
+ *
+ * @param ring Ring the table belongs to
+ * @param index Slot to replace
+ * @param fd New file descriptor, -1 to empty the slot
+ * @return 0 on success, -1 on error
+ */
+int uring_update_file(Uring *ring, unsigned index, int fd) {
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = index;
+    update.fds = (uint64_t)(uintptr_t)&fd;
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) < 0 ? -1 : 0;
+}
+
+/**
+ * Drops the fixed file table.
+ *
+ * @param ring Ring the table belongs to
+ * @return 0 on success, -1 on error
+ */
+int uring_unregister_files(Uring *ring) {
+    return syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_FILES, NULL, 0) < 0 ? -1 : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring wrapper on top of the raw system calls, so the optional
+ * io_uring backend needs no external library. uring_init() fails cleanly on
+ * kernels without io_uring, letting callers fall back to blocking I/O.
+ */
+typedef struct {
+    int fd;                       // Ring file descriptor
+    unsigned *sq_head;            // Submission queue, shared with the kernel
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;            // Completion queue, shared with the kernel
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned sq_local_tail;       // SQEs handed out but not yet published
+    unsigned to_submit;           // Published SQEs the kernel has not consumed
+    void *sq_ring;                // Mappings released by uring_exit()
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned long enters;         // io_uring_enter() calls, for syscall accounting
+} Uring;
+
+int uring_init(Uring *ring, unsigned entries);
+void uring_exit(Uring *ring);
+
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+void uring_prep_rw(struct io_uring_sqe *sqe, int op, int fd, const void *addr, unsigned length,
+                   uint64_t offset, uint64_t user_data);
+int uring_submit_and_wait(Uring *ring, unsigned wait_nr);
+struct io_uring_cqe *uring_peek_cqe(Uring *ring);
+void uring_cqe_seen(Uring *ring);
+
+int uring_register_buffers(Uring *ring, const struct iovec *iovecs, unsigned count);
+int uring_register_files(Uring *ring, const int *fds, unsigned count);
+int uring_update_file(Uring *ring, unsigned index, int fd);
+int uring_unregister_files(Uring *ring);
+
+#endif // URING_H
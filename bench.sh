@@ -0,0 +1,85 @@
+#!/bin/bash
+# Reproducible reno vs cubic benchmark: every transfer goes through TCP_Proxy
+# on loopback, sweeping algorithm x loss x RTT x repetitions. One CSV line
+# per transfer is written to $OUT.
+#
+# "rudp" in ALGOS runs the reliable UDP transport instead (-transport rudp).
+# TCP_Proxy only relays TCP, so its loss is emulated by the sender's -loss
+# and it has no added RTT: it runs at RTT 0 only.
+#
+# Settings (environment): ALGOS, LOSSES (percent), RTTS (ms), REPS, RATE
+# (Mbit/s, 0 = unlimited), SENDER_ARGS (extra TCP_Sender options), OUT.
+set -u
+
+ALGOS=${ALGOS:-"reno cubic"}
+LOSSES=${LOSSES:-"0 2 5 10"}
+RTTS=${RTTS:-"0 10 20"}
+REPS=${REPS:-3}
+RATE=${RATE:-0}
+SENDER_ARGS=${SENDER_ARGS:-}
+ROOT=$(cd "$(dirname "$0")" && pwd)
+OUT=$(realpath -m "${OUT:-$ROOT/bench_results.csv}")
+WORK=$(mktemp -d)
+trap 'kill $(jobs -p) 2>/dev/null; rm -rf "$WORK"' EXIT
+
+cp "$ROOT/TCP_Receiver" "$ROOT/TCP_Sender" "$ROOT/TCP_Proxy" "$ROOT/File_Generator" "$WORK" || exit 1
+cd "$WORK" || exit 1
+
+echo "algo,loss_pct,rtt_ms,rate_mbit,rep,time_ms,bytes,mb_per_s" > "$OUT"
+# rudp skips the RTTs other than 0, they are not counted
+total=0
+for algo in $ALGOS; do
+    for rtt in $RTTS; do
+        if [ "$algo" != rudp ] || [ "$rtt" = 0 ]; then
+            total=$((total + $(wc -w <<< "$LOSSES") * REPS))
+        fi
+    done
+done
+done_count=0
+
+for algo in $ALGOS; do
+    for loss in $LOSSES; do
+        for rtt in $RTTS; do
+            for ((rep = 1; rep <= REPS; rep++)); do
+                if [ "$algo" = rudp ] && [ "$rtt" != 0 ]; then
+                    continue
+                fi
+                receiver_port=$((20000 + RANDOM % 20000))
+                proxy_port=$((receiver_port + 1))
+                rm -rf assets run.csv
+                if [ "$algo" = rudp ]; then
+                    ./TCP_Receiver -p "$receiver_port" -algo cubic -transport rudp -csv run.csv > receiver.log 2>&1 &
+                    receiver=$!
+                    sleep 0.3
+                    ./TCP_Sender -ip 127.0.0.1 -p "$receiver_port" -algo cubic -transport rudp -loss "$loss" -runs 1 \
+                        $SENDER_ARGS > sender.log 2>&1
+                    wait "$receiver"
+                else
+                    ./TCP_Receiver -p "$receiver_port" -algo "$algo" -csv run.csv > receiver.log 2>&1 &
+                    receiver=$!
+                    ./TCP_Proxy -p "$proxy_port" -to-port "$receiver_port" -delay "$(awk "BEGIN {print $rtt / 2}")" \
+                        -loss "$loss" -rate "$RATE" -seed "$rep" > proxy.log 2>&1 &
+                    proxy=$!
+                    sleep 0.3
+
+                    ./TCP_Sender -ip 127.0.0.1 -p "$proxy_port" -algo "$algo" -runs 1 $SENDER_ARGS > sender.log 2>&1
+                    wait "$receiver"
+                    kill "$proxy" 2>/dev/null
+                    wait "$proxy" 2>/dev/null
+                fi
+
+                if [ -s run.csv ] && [ "$(wc -l < run.csv)" -gt 1 ]; then
+                    tail -n +2 run.csv | awk -F, -v prefix="$algo,$loss,$rtt,$RATE,$rep" \
+                        '{print prefix "," $3 "," $4 "," $5}' >> "$OUT"
+                else
+                    echo "$algo,$loss,$rtt,$RATE,$rep,,," >> "$OUT"
+                    echo "Transfer failed: algo $algo, loss $loss%, rtt $rtt ms, rep $rep" >&2
+                fi
+                done_count=$((done_count + 1))
+                printf "\r%d/%d transfers" "$done_count" "$total"
+            done
+        done
+    done
+done
+echo
+echo "Results written to $OUT"
@@ -0,0 +1,58 @@
+#!/bin/bash
+# Compares two result files of Microbench: prints the change of every median
+# and exits with 1 if any benchmark of the baseline got slower by more than
+# THRESHOLD percent and by more than NOISE times the combined median absolute
+# deviation of both files, or is missing from the current results. A drop
+# within the spread of the repetitions is noise, not a regression.
+# Throughputs only, so higher is better for every unit.
+#
+# Usage: bench_compare.sh BASELINE CURRENT [THRESHOLD] [NOISE]  (percent, default 10; MADs, default 3)
+set -u
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 BASELINE CURRENT [THRESHOLD] [NOISE]" >&2
+    exit 2
+fi
+BASELINE=$1
+CURRENT=$2
+THRESHOLD=${3:-10}
+NOISE=${4:-3}
+for file in "$BASELINE" "$CURRENT"; do
+    if [ ! -r "$file" ]; then
+        echo "Cannot read $file (make microbench_baseline stores a baseline)" >&2
+        exit 2
+    fi
+done
+
+# One result per line: name size median mad. The frame loop was called socket_loop in older files
+extract() {
+    sed -e 's/"name":"socket_loop"/"name":"frame_loop"/' "$1" | sed -n 's/.*"name":"\([^"]*\)","size":\([0-9]*\),"unit":"[^"]*","median":\([0-9.]*\),"mad":\([0-9.]*\).*/\1 \2 \3 \4/p'
+}
+
+awk -v threshold="$THRESHOLD" -v noise="$NOISE" -v baseline="$BASELINE" -v current="$CURRENT" '
+    FNR == NR { base[$1 " " $2] = $3; base_mad[$1 " " $2] = $4; order[++count] = $1 " " $2; next }
+    { cur[$1 " " $2] = $3; cur_mad[$1 " " $2] = $4 }
+    END {
+        printf "%-16s %9s %12s %12s %8s\n", "benchmark", "size", baseline, current, "change"
+        failed = 0
+        for (i = 1; i <= count; i++) {
+            key = order[i]
+            split(key, part, " ")
+            if (!(key in cur)) {
+                printf "%-16s %9s %12.3f %12s %8s  MISSING\n", part[1], part[2], base[key], "-", "-"
+                failed = 1
+                continue
+            }
+            change = base[key] > 0 ? 100 * (cur[key] - base[key]) / base[key] : 0
+            spread = noise * sqrt(base_mad[key] ^ 2 + cur_mad[key] ^ 2)
+            flag = change < -threshold && base[key] - cur[key] > spread ? "  REGRESSION" : ""
+            printf "%-16s %9s %12.3f %12.3f %+7.1f%%%s\n", part[1], part[2], base[key], cur[key], change, flag
+            if (flag != "") {
+                failed = 1
+            }
+        }
+        if (failed) {
+            printf "Throughput regressed by more than %s%% and %s times the median absolute deviation\n", threshold, noise
+        }
+        exit failed
+    }' <(extract "$BASELINE") <(extract "$CURRENT")
@@ -0,0 +1,41 @@
+#!/bin/bash
+# Compares the blocking I/O paths with the io_uring and MSG_ZEROCOPY backends
+# on loopback: throughput and data path system calls per GB, for the sender and
+# the receiver, and the sender's CPU time per GB. On loopback the kernel copies
+# zerocopy sends after all, run it between two hosts to see the CPU saved.
+#
+# Usage: ./uring_bench.sh [RUNS] [STREAMS]
+set -u
+
+RUNS=${1:-20}
+STREAMS=${2:-1}
+ROOT=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+cp "$ROOT/TCP_Receiver" "$ROOT/TCP_Sender" "$ROOT/File_Generator" "$WORK" || exit 1
+cd "$WORK" || exit 1
+
+# bench NAME RECEIVER_SINK SENDER_MODE
+bench() {
+    local port=$((20000 + RANDOM % 20000))
+    rm -rf assets
+    ./TCP_Receiver -p "$port" -algo cubic -sink "$2" > receiver.log 2>&1 &
+    local receiver=$!
+    sleep 0.3
+    ./TCP_Sender -ip 127.0.0.1 -p "$port" -algo cubic -mode "$3" -streams "$STREAMS" -runs "$RUNS" > sender.log 2>&1
+    wait "$receiver"
+
+    local speed recv_calls send_calls cpu
+    speed=$(awk '/Average bandwidth/ {print $4}' receiver.log)
+    recv_calls=$(awk '/Data path syscalls/ {print $(NF - 2)}' receiver.log)
+    send_calls=$(awk '/data path syscalls\/GB/ {n++; s += $(NF - 3)} END {if (n) printf "%.0f", s / n}' sender.log)
+    cpu=$(awk '/Average CPU time/ {print $(NF - 1)}' sender.log)
+    printf "%-10s %14s %18s %18s %16s\n" "$1" "${speed:-?}" "${send_calls:-?}" "${recv_calls:-?}" "${cpu:-?}"
+}
+
+echo "$RUNS runs of the generated file, $STREAMS stream(s) on loopback"
+printf "%-10s %14s %18s %18s %16s\n" "backend" "MB/s" "sender calls/GB" "receiver calls/GB" "sender CPU ms/GB"
+bench blocking file copy
+bench uring uring uring
+bench zerocopy file zerocopy